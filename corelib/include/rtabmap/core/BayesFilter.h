@@ -32,7 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <opencv2/core/core.hpp>
 #include <list>
+#include <map>
 #include <set>
+#include <vector>
 #include "rtabmap/utilite/UEventsHandler.h"
 #include "rtabmap/core/Parameters.h"
 
@@ -41,6 +43,40 @@ namespace rtabmap {
 class Memory;
 class Signature;
 
+// Prediction matrix of the Bayes filter stored in compressed sparse
+// columns (CSC). Each column is the prior distribution of a place: only
+// the neighbors of the place (and the virtual place) are stored, all other
+// entries of the column are equal to the default value of the column.
+class RTABMAP_EXP SparsePrediction
+{
+public:
+	SparsePrediction() {}
+	// columns: for each column, the <row, value> entries
+	SparsePrediction(const std::vector<std::map<int, float> > & columns, const std::vector<float> & defaults);
+
+	bool empty() const {return _defaults.empty();}
+	int size() const {return (int)_defaults.size();}
+	size_t nonZeros() const {return _values.size();}
+	float at(int row, int col) const;
+
+	// Column accessors, entries are sorted by row
+	int columnBegin(int col) const {return _columns[col];}
+	int columnEnd(int col) const {return _columns[col+1];}
+	int row(int k) const {return _rows[k];}
+	float value(int k) const {return _values[k];}
+	float defaultValue(int col) const {return _defaults[col];}
+
+	// y = P * x, x and y have size() elements
+	void multiply(const float * x, float * y) const;
+	cv::Mat toDense() const;
+
+private:
+	std::vector<int> _columns; // size()+1, index of the first entry of each column
+	std::vector<int> _rows;
+	std::vector<float> _values;
+	std::vector<float> _defaults;
+};
+
 class RTABMAP_EXP BayesFilter
 {
 public:
@@ -59,19 +95,23 @@ public:
 	const std::vector<double> & getPredictionLC() const; // {Vp, Lc, l1, l2, l3, l4...}
 	std::string getPredictionLCStr() const; // for convenience {Vp, Lc, l1, l2, l3, l4...}
 
-	cv::Mat generatePrediction(const Memory * memory, const std::vector<int> & ids);
+	const SparsePrediction & getPrediction() const {return _prediction;}
+
+	SparsePrediction generateSparsePrediction(const Memory * memory, const std::vector<int> & ids);
+	cv::Mat generatePrediction(const Memory * memory, const std::vector<int> & ids); // dense, for debugging
 
 private:
-	cv::Mat updatePrediction(const cv::Mat & oldPrediction,
+	SparsePrediction updatePrediction(const SparsePrediction & oldPrediction,
 			const Memory * memory,
 			const std::vector<int> & oldIds,
 			const std::vector<int> & newIds);
 	void updatePosterior(const Memory * memory, const std::vector<int> & likelihoodIds);
-	void normalize(cv::Mat & prediction, unsigned int index, float addedProbabilitiesSum, bool virtualPlaceUsed) const;
+	void normalize(std::map<int, float> & column, float & defaultValue, unsigned int index, int cols, float addedProbabilitiesSum, bool virtualPlaceUsed) const;
+	void setVirtualPlaceColumn(std::map<int, float> & column, float & defaultValue, int cols) const;
 
 private:
 	std::map<int, float> _posterior;
-	cv::Mat _prediction;
+	SparsePrediction _prediction;
 	float _virtualPlacePrior;
 	std::vector<double> _predictionLC; // {Vp, Lc, l1, l2, l3, l4...}
 	bool _fullPredictionUpdate;
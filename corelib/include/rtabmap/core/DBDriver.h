@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <list>
 #include <map>
 #include <set>
+#include <cstdio>
 #include <opencv2/core/core.hpp>
 #include "rtabmap/utilite/UMutex.h"
 #include "rtabmap/utilite/UThreadNode.h"
@@ -78,6 +79,13 @@ public:
 	void asyncSave(VisualWord * vw); //ownership transferred
 	void emptyTrashes(bool async = false);
 	double getEmptyTrashesTime() const {return _emptyTrashesTime;}
+	// Apply Db/TrashPolicy if Db/TrashMaxMemory is reached, to be called once per batch of asyncSave()
+	void applyTrashPolicy();
+	int getTrashSize() const; // nodes and words waiting to be saved
+	long long getTrashMemoryUsed() const; // In bytes, including nodes and words being saved
+	long long getTrashSpilled() const; // In bytes, data of the nodes in the trash written to a temporary file
+	double getLastFlushLatency() const {return _lastFlushLatency;} // time between the oldest add to the trash and the end of its saving
+	int getTrashBlocked() const {return _trashBlocked;} // times applyTrashPolicy() has blocked because the trash was full
 	void setTimestampUpdateEnabled(bool enabled) {_timestampUpdate = enabled;} // used on Update Signature and Word queries
 
 	// Warning: the following functions don't look in the trash, direct database modifications
@@ -156,17 +164,23 @@ public:
 
 	// Load objects
 	void load(VWDictionary * dictionary) const;
-	void loadLastNodes(std::list<Signature *> & signatures) const;
-	void loadSignatures(const std::list<int> & ids, std::list<Signature *> & signatures, std::set<int> * loadedFromTrash = 0);
+	void loadLastNodes(std::list<Signature *> & signatures, bool features = true) const;
+	void loadSignatures(const std::list<int> & ids, std::list<Signature *> & signatures, std::set<int> * loadedFromTrash = 0, bool features = true);
+	void loadSavedSignatures(const std::list<int> & ids, std::list<Signature *> & signatures) const; // signatures in the trash are ignored
+	void loadFeatures(std::list<Signature *> & signatures) const; // for signatures loaded without features
 	void loadWords(const std::set<int> & wordIds, std::list<VisualWord *> & vws);
 
 	// Specific queries...
 	void loadNodeData(std::list<Signature *> & signatures, bool images = true, bool scan = true, bool userData = true, bool occupancyGrid = true) const;
 	void getNodeData(int signatureId, SensorData & data, bool images = true, bool scan = true, bool userData = true, bool occupancyGrid = true) const;
+	// data of all nodes loaded in one query, then uncompressed in parallel if uncompressedData is true (see Db/DecompressionThreads)
+	void getNodesData(const std::vector<int> & signatureIds, std::vector<SensorData> & data, bool images = true, bool scan = true, bool userData = true, bool occupancyGrid = true, bool uncompressedData = true) const;
+	void uncompressNodesData(std::vector<SensorData> & data, bool images = true, bool scan = true, bool userData = true, bool occupancyGrid = true) const; // only the selected buffers are uncompressed
 	bool getCalibration(int signatureId, std::vector<CameraModel> & models, StereoCameraModel & stereoModel) const;
 	bool getLaserScanInfo(int signatureId, LaserScan & info) const;
 	bool getNodeInfo(int signatureId, Transform & pose, int & mapId, int & weight, std::string & label, double & stamp, Transform & groundTruthPose, std::vector<float> & velocity, GPS & gps) const;
 	void loadLinks(int signatureId, std::map<int, Link> & links, Link::Type type = Link::kUndef) const;
+	void loadLinks(const std::set<int> & signatureIds, std::map<int, std::map<int, Link> > & links, Link::Type type = Link::kUndef) const; // links of all signatures in one query
 	void getWeight(int signatureId, int & weight) const;
 	void getAllNodeIds(std::set<int> & ids, bool ignoreChildren = false, bool ignoreBadSignatures = false) const;
 	void getAllLinks(std::multimap<int, Link> & links, bool ignoreNullLinks = true) const;
@@ -256,10 +270,12 @@ private:
 
 	// Load objects
 	virtual void loadQuery(VWDictionary * dictionary) const = 0;
-	virtual void loadLastNodesQuery(std::list<Signature *> & signatures) const = 0;
-	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures) const = 0;
+	virtual void loadLastNodesQuery(std::list<Signature *> & signatures, bool features = true) const = 0;
+	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures, bool features = true) const = 0;
+	virtual void loadFeaturesQuery(std::list<Signature *> & signatures) const = 0;
 	virtual void loadWordsQuery(const std::set<int> & wordIds, std::list<VisualWord *> & vws) const = 0;
 	virtual void loadLinksQuery(int signatureId, std::map<int, Link> & links, Link::Type type = Link::kUndef) const = 0;
+	virtual void loadLinksQuery(const std::set<int> & signatureIds, std::map<int, std::map<int, Link> > & links, Link::Type type = Link::kUndef) const = 0;
 
 	virtual void loadNodeDataQuery(std::list<Signature *> & signatures, bool images=true, bool scan=true, bool userData=true, bool occupancyGrid=true) const = 0;
 	virtual bool getCalibrationQuery(int signatureId, std::vector<CameraModel> & models, StereoCameraModel & stereoModel) const = 0;
@@ -277,6 +293,22 @@ private:
 	void saveOrUpdate(const std::vector<Signature *> & signatures);
 	void saveOrUpdate(const std::vector<VisualWord *> & words) const;
 
+	// trash memory limit
+	struct SpilledData
+	{
+		long long offset; // in the spill file
+		int sizes[7]; // image, depth/right, scan, user data, ground, obstacle and empty cells
+		int scanMaxPoints;
+		float scanMaxRange;
+		int scanFormat;
+		Transform scanLocalTransform;
+	};
+	void addToTrashMemoryUsed(long bytes);
+	void coalesceTrash();
+	void spillTrash();
+	void readSpilledData(const SpilledData & spilled, SensorData & data) const;
+	void closeSpillFile();
+
 	//thread stuff
 	virtual void mainLoop();
 
@@ -290,6 +322,18 @@ private:
 	double _emptyTrashesTime;
 	std::string _url;
 	bool _timestampUpdate;
+	long long _trashMemoryUsed; // bytes of the nodes and words in the trash
+	long long _trashMemoryFlushing; // bytes of the nodes and words being saved
+	std::map<int, SpilledData> _trashSpilled; // nodes of the trash with their data in the spill file
+	FILE * _spillFile;
+	long long _spillFileSize;
+	UMutex _spillMutex;
+	double _trashOldestStamp;
+	double _lastFlushLatency;
+	int _trashBlocked;
+	int _trashMaxMemory; // MB
+	int _trashPolicy;
+	int _decompressionThreads;
 };
 
 }
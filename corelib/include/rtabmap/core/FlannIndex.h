@@ -76,9 +76,14 @@ public:
 
 	unsigned int addPoints(const cv::Mat & features);
 
+	// Rebuild the index over all its points (e.g., after adding points
+	// with addPoints() to an index built with rebalancingFactor=0)
+	void rebuildIndex(float rebalancingFactor = 2.0f);
+
 	void removePoint(unsigned int index);
 
 	// return squared distances (indices should be casted in size_t)
+	// cores: number of threads used (only with OpenMP)
 	void knnSearch(
 			const cv::Mat & query,
 			cv::Mat & indices,
@@ -86,7 +91,8 @@ public:
 	        int knn,
 			int checks = 32,
 			float eps = 0.0,
-			bool sorted = true) const;
+			bool sorted = true,
+			int cores = 1) const;
 
 	// return squared distances
 	void radiusSearch(
@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_HNSWINDEX_H_
+#define CORELIB_SRC_HNSWINDEX_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <vector>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap {
+
+/**
+ * Hierarchical Navigable Small World graph (Malkov and Yashunin, 2016).
+ * Unlike FLANN indexes, points can be added and removed without ever
+ * rebuilding the index. Binary descriptors (CV_8UC1) are compared with
+ * the Hamming distance, float descriptors (CV_32FC1) with the squared L2 distance.
+ * Indexes of removed points are reused by the next added points: the links
+ * to a removed point are tracked (reverse links) and repaired on removal.
+ */
+class RTABMAP_EXP HnswIndex
+{
+public:
+	HnswIndex();
+	virtual ~HnswIndex();
+
+	void release();
+	unsigned int indexedFeatures() const;
+
+	// return KB
+	unsigned int memoryUsed() const;
+
+	void buildIndex(
+			const cv::Mat & features,
+			int M = 16,
+			int efConstruction = 100,
+			int efSearch = 64);
+
+	bool isBuilt() const {return featuresDim_ > 0;}
+
+	int featuresType() const {return featuresType_;}
+	int featuresDim() const {return featuresDim_;}
+
+	// return index of the added point
+	unsigned int addPoint(const cv::Mat & feature);
+
+	void removePoint(unsigned int index);
+
+	// return squared distances for float descriptors (indices should be casted in size_t)
+	// threads: number of threads used (only with OpenMP)
+	void knnSearch(
+			const cv::Mat & query,
+			cv::Mat & indices,
+			cv::Mat & dists,
+			int knn,
+			int threads = 1) const;
+
+private:
+	typedef std::pair<float, int> Candidate; // <distance, index>
+
+	// Points visited by a search, cleared in constant time by changing the tag
+	class VisitedList
+	{
+	public:
+		VisitedList() : tag_(0) {}
+		void reset(size_t size)
+		{
+			if(tags_.size() < size)
+			{
+				tags_.resize(size, 0);
+			}
+			if(++tag_ == 0)
+			{
+				std::fill(tags_.begin(), tags_.end(), 0);
+				tag_ = 1;
+			}
+		}
+		// Returns false if the point was already visited
+		bool visit(int index)
+		{
+			if(tags_[index] == tag_)
+			{
+				return false;
+			}
+			tags_[index] = tag_;
+			return true;
+		}
+	private:
+		std::vector<unsigned int> tags_;
+		unsigned int tag_;
+	};
+
+	const unsigned char * feature(int index) const {return &data_[index*rowSize_];}
+	float distance(const unsigned char * a, const unsigned char * b) const;
+	int maxNeighbors(int level) const {return level==0?maxM0_:M_;}
+	int randomLevel();
+	int greedySearch(const unsigned char * query, int entryPoint, int fromLevel, int toLevel) const;
+	void searchLayer(
+			const unsigned char * query,
+			int entryPoint,
+			int ef,
+			int level,
+			VisitedList & visited,
+			std::vector<Candidate> & results) const;
+	void selectNeighbors(
+			std::vector<Candidate> & candidates,
+			int maxSize,
+			std::vector<int> & neighbors) const;
+	void shrinkNeighbors(int index, int level);
+	void setNeighbors(int index, int level, const std::vector<int> & neighbors);
+	void addLink(int from, int to, int level);
+
+private:
+	int featuresType_;
+	int featuresDim_;
+	int rowSize_; // bytes
+	int M_;
+	int maxM0_;
+	int efConstruction_;
+	int efSearch_;
+	double levelMult_;
+	int entryPoint_;
+	int maxLevel_;
+	cv::RNG rng_;
+
+	std::vector<unsigned char> data_;
+	std::vector<int> levels_; // -1 if the slot is free
+	std::vector<std::vector<std::vector<int> > > links_; // index -> level -> neighbors
+	std::vector<std::vector<std::vector<int> > > reverseLinks_; // index -> level -> points linked to it
+	std::vector<int> freeSlots_;
+	VisitedList visited_; // used when adding points
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_HNSWINDEX_H_ */
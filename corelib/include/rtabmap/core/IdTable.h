@@ -0,0 +1,231 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef IDTABLE_H_
+#define IDTABLE_H_
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace rtabmap {
+
+/**
+ * Table of values indexed by id, for ids generated incrementally. Positive
+ * ids are stored in fixed size pages (so lookups are just two array accesses),
+ * other ids are stored in a map. A page is released when all its values are
+ * removed, so the memory used follows the ids actually in the table.
+ * A value equal to T() is considered as not set.
+ */
+template<typename T>
+class IdTable
+{
+public:
+	IdTable() : size_(0) {}
+
+	T get(int id) const
+	{
+		if(id > 0)
+		{
+			size_t p = size_t(id) >> kPageBits;
+			if(p < pages_.size() && !pages_[p].values.empty())
+			{
+				return pages_[p].values[id & kPageMask];
+			}
+			return T();
+		}
+		typename std::map<int, T>::const_iterator iter = others_.find(id);
+		return iter!=others_.end()?iter->second:T();
+	}
+
+	bool contains(int id) const {return !(get(id) == T());}
+
+	void set(int id, const T & value)
+	{
+		if(value == T())
+		{
+			erase(id);
+		}
+		else if(id > 0)
+		{
+			size_t p = size_t(id) >> kPageBits;
+			if(p >= pages_.size())
+			{
+				pages_.resize(p+1);
+			}
+			Page & page = pages_[p];
+			if(page.values.empty())
+			{
+				page.values.resize(kPageSize, T());
+			}
+			typename std::vector<T>::reference v = page.values[id & kPageMask];
+			if(v == T())
+			{
+				++page.count;
+				++size_;
+			}
+			v = value;
+		}
+		else
+		{
+			std::pair<typename std::map<int, T>::iterator, bool> inserted = others_.insert(std::make_pair(id, value));
+			if(inserted.second)
+			{
+				++size_;
+			}
+			else
+			{
+				inserted.first->second = value;
+			}
+		}
+	}
+
+	void erase(int id)
+	{
+		if(id > 0)
+		{
+			size_t p = size_t(id) >> kPageBits;
+			if(p < pages_.size() && !pages_[p].values.empty())
+			{
+				Page & page = pages_[p];
+				typename std::vector<T>::reference v = page.values[id & kPageMask];
+				if(!(v == T()))
+				{
+					v = T();
+					--size_;
+					if(--page.count == 0)
+					{
+						std::vector<T>().swap(page.values);
+					}
+				}
+			}
+		}
+		else
+		{
+			size_ -= others_.erase(id);
+		}
+	}
+
+	void clear()
+	{
+		pages_.clear();
+		others_.clear();
+		size_ = 0;
+	}
+
+	size_t size() const {return size_;}
+	bool empty() const {return size_ == 0;}
+
+private:
+	static const int kPageBits = 10;
+	static const int kPageSize = 1 << kPageBits;
+	static const int kPageMask = kPageSize - 1;
+
+	struct Page
+	{
+		Page() : count(0) {}
+		std::vector<T> values;
+		int count;
+	};
+
+	std::vector<Page> pages_;
+	std::map<int, T> others_; // ids <= 0
+	size_t size_;
+};
+
+/**
+ * Set of ids stored as a bitset, used to mark the nodes visited by graph
+ * traversals. Positive ids are bits of an array of words, other ids are
+ * stored in a set. clear() only resets the words that were set, so a bitset
+ * can be reused by many small traversals without reallocating or scanning
+ * the whole array.
+ */
+class IdBitset
+{
+public:
+	IdBitset() {}
+
+	bool contains(int id) const
+	{
+		if(id > 0)
+		{
+			size_t w = size_t(id) >> kWordBits;
+			return w < words_.size() && (words_[w] & (1u << (id & kWordMask))) != 0;
+		}
+		return others_.find(id) != others_.end();
+	}
+
+	// Returns false if the id was already in the set
+	bool insert(int id)
+	{
+		if(id > 0)
+		{
+			size_t w = size_t(id) >> kWordBits;
+			if(w >= words_.size())
+			{
+				words_.resize(w + 1 + (w >> 1), 0);
+			}
+			unsigned int mask = 1u << (id & kWordMask);
+			if(words_[w] & mask)
+			{
+				return false;
+			}
+			if(words_[w] == 0)
+			{
+				touched_.push_back(w);
+			}
+			words_[w] |= mask;
+			return true;
+		}
+		return others_.insert(id).second;
+	}
+
+	void clear()
+	{
+		for(size_t i=0; i<touched_.size(); ++i)
+		{
+			words_[touched_[i]] = 0;
+		}
+		touched_.clear();
+		others_.clear();
+	}
+
+	bool empty() const {return touched_.empty() && others_.empty();}
+
+private:
+	static const int kWordBits = 5;
+	static const int kWordMask = (1 << kWordBits) - 1;
+
+	std::vector<unsigned int> words_;
+	std::vector<size_t> touched_; // indexes of the non-null words
+	std::set<int> others_; // ids <= 0
+};
+
+} /* namespace rtabmap */
+
+#endif /* IDTABLE_H_ */
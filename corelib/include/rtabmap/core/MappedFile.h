@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <string>
+#include <cstddef>
+
+namespace rtabmap {
+
+/**
+ * Read-only file mapped in memory in copy-on-write mode: the data can be
+ * modified in memory (modified pages are copied), but the changes are
+ * never written back to the file. The pages are loaded by the system
+ * when they are accessed, so opening a large file is almost free.
+ */
+class RTABMAP_EXP MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+
+	bool open(const std::string & path);
+	void close();
+
+	bool isOpen() const {return data_ != 0;}
+	const std::string & path() const {return path_;}
+	size_t size() const {return size_;}
+	const unsigned char * data() const {return data_;}
+	unsigned char * data() {return data_;}
+
+private:
+	// not copyable
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+private:
+	std::string path_;
+	unsigned char * data_;
+	size_t size_;
+#ifdef _WIN32
+	void * file_;
+	void * mapping_;
+#endif
+};
+
+} /* namespace rtabmap */
+
+#endif /* MAPPEDFILE_H_ */
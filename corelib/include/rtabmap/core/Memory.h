@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/SensorData.h"
 #include "rtabmap/core/Link.h"
 #include "rtabmap/core/Features2d.h"
+#include "rtabmap/core/IdTable.h"
 #include <typeinfo>
 #include <list>
 #include <map>
@@ -57,6 +58,8 @@ class RegistrationInfo;
 class RegistrationIcp;
 class Stereo;
 class OccupancyGrid;
+class SignaturePrefetchThread;
+class SignatureWarmUpThread;
 
 class RTABMAP_EXP Memory
 {
@@ -90,6 +93,9 @@ public:
 
 	std::list<int> forget(const std::set<int> & ignoredIds = std::set<int>());
 	std::set<int> reactivateSignatures(const std::list<int> & ids, unsigned int maxLoaded, double & timeDbAccess);
+	// Load in background the signatures of LTM, they will be taken by the next reactivateSignatures()
+	void prefetchSignatures(const std::list<int> & ids);
+	int getLastSignaturesPrefetched() const {return _lastSignaturesPrefetched;}
 
 	int cleanup();
 	void saveStatistics(const Statistics & statistics);
@@ -132,6 +138,9 @@ public:
 			bool ignoreLocalSpaceLoopIds = false,
 			const std::set<int> & nodesSet = std::set<int>(),
 			double * dbAccessTime = 0) const;
+	// Same as getNeighborsId(signatureId, maxGraphDepth, 0, false, false, true, true),
+	// the results are cached until the links of one of the visited nodes change.
+	std::map<int, int> getNeighborsIdCached(int signatureId, int maxGraphDepth) const;
 	std::map<int, float> getNeighborsIdRadius(
 			int signatureId,
 			float radius,
@@ -172,6 +181,11 @@ public:
 	int getDatabaseMemoryUsed() const; // in bytes
 	std::string getDatabaseVersion() const;
 	double getDbSavingTime() const;
+	int getDbTrashSize() const;
+	long long getDbTrashMemoryUsed() const; // in bytes
+	long long getDbTrashSpilled() const; // in bytes
+	double getDbFlushLatency() const;
+	int getDbTrashBlocked() const;
 	Transform getOdomPose(int signatureId, bool lookInDatabase = false) const;
 	Transform getGroundTruthPose(int signatureId, bool lookInDatabase = false) const;
 	bool getNodeInfo(int signatureId,
@@ -186,6 +200,7 @@ public:
 			bool lookInDatabase = false) const;
 	cv::Mat getImageCompressed(int signatureId) const;
 	SensorData getNodeData(int nodeId, bool uncompressedData = false) const;
+	std::vector<SensorData> getNodesData(const std::vector<int> & nodeIds, bool uncompressedData = false) const; // nodes not in RAM are loaded in one query
 	void getNodeWords(int nodeId,
 			std::multimap<int, cv::KeyPoint> & words,
 			std::multimap<int, cv::Point3f> & words3,
@@ -197,9 +212,13 @@ public:
 	std::set<int> getAllSignatureIds() const;
 	bool memoryChanged() const {return _memoryChanged;}
 	bool isIncremental() const {return _incrementalMemory;}
-	const Signature * getSignature(int id) const;
+	const Signature * getSignature(int id) const; // without words if not loaded yet (Mem/InitWMLazy), see loadLazySignatures()
+	// With Mem/InitWMLazy, load the features and the words of the WM nodes not loaded yet. With
+	// maxNodes>0, only the maxNodes most recent ones are loaded. Nodes already loaded by the
+	// warm-up thread are added at the same time.
+	void loadLazySignatures(const std::list<int> & ids, int maxNodes = 0);
 	bool isInSTM(int signatureId) const {return _stMem.find(signatureId) != _stMem.end();}
-	bool isInWM(int signatureId) const {return _workingMem.find(signatureId) != _workingMem.end();}
+	bool isInWM(int signatureId) const {return _workingMemTable.contains(signatureId);}
 	bool isInLTM(int signatureId) const {return !this->isInSTM(signatureId) && !this->isInWM(signatureId);}
 	bool isIDsGenerated() const {return _generateIds;}
 	int getLastGlobalLoopClosureId() const {return _lastGlobalLoopClosureId;}
@@ -231,6 +250,40 @@ public:
 			const std::map<int, Transform> & poses,
 			RegistrationInfo * info = 0);
 
+private:
+	// Transfer priority of a WM node: less weighted, then oldest, then lowest id
+	class WeightAgeIdKey
+	{
+	public:
+		WeightAgeIdKey(int w, double a, int i) :
+			weight(w),
+			age(a),
+			id(i){}
+		bool operator<(const WeightAgeIdKey & k) const
+		{
+			if(weight < k.weight)
+			{
+				return true;
+			}
+			else if(weight == k.weight)
+			{
+				if(age < k.age)
+				{
+					return true;
+				}
+				else if(age == k.age)
+				{
+					if(id < k.id)
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+		int weight, age, id;
+	};
+
 private:
 	void preUpdate();
 	void addSignatureToStm(Signature * signature, const cv::Mat & covariance);
@@ -243,10 +296,23 @@ private:
 	Signature * _getSignature(int id) const;
 	std::list<Signature *> getRemovableSignatures(int count,
 			const std::set<int> & ignoredIds = std::set<int>());
+	// Weights and ages of WM nodes must be changed with these
+	// to keep the transfer index sorted.
+	void setWeight(Signature * s, int weight);
+	void addToTransferIndex(const Signature * s, double age);
+	void removeFromTransferIndex(const Signature * s, double age);
+	void rebuildTransferIndex();
 	int getNextId();
 	void initCountId();
 	void rehearsal(Signature * signature, Statistics * stats = 0);
 	bool rehearsalMerge(int oldId, int newId);
+	void invalidateNeighborsCache(int signatureId, bool linkedNodes = false);
+	void clearNeighborsCache();
+	void joinPrefetchThread();
+	void discardPrefetchedSignature(int signatureId);
+	void clearPrefetchedSignatures();
+	void loadLazySignatures(const std::set<int> & ids);
+	void stopWarmUpThread();
 
 	const std::map<int, Signature*> & getSignatures() const {return _signatures;}
 
@@ -287,6 +353,7 @@ private:
 	int _imagePreDecimation;
 	int _imagePostDecimation;
 	bool _compressionParallelized;
+	bool _signatureStagesParallelized;
 	float _laserScanDownsampleStepSize;
 	float _laserScanVoxelSize;
 	int _laserScanNormalK;
@@ -295,6 +362,7 @@ private:
 	float _rehearsalMaxDistance;
 	float _rehearsalMaxAngle;
 	bool _rehearsalWeightIgnoredWhileMoving;
+	int _rehearsalMaxCompared;
 	bool _useOdometryFeatures;
 	bool _createOccupancyGrid;
 	int _visMaxFeatures;
@@ -313,12 +381,53 @@ private:
 	std::map<int, Signature *> _signatures; // TODO : check if a signature is already added? although it is not supposed to occur...
 	std::set<int> _stMem; // id
 	std::map<int, double> _workingMem; // id,age
+	// O(1) lookups by id, kept synchronized with _signatures and _workingMem
+	IdTable<Signature *> _signaturesTable;
+	IdTable<bool> _workingMemTable;
+	std::set<WeightAgeIdKey> _transferIndex; // WM nodes sorted by transfer priority
+
+	// cache of getNeighborsIdCached()
+	mutable int _neighborsCacheDepth;
+	mutable std::map<int, std::map<int, int> > _neighborsCache; // id, <neighbor id, margin>
+	mutable std::map<int, std::set<int> > _neighborsCacheRefs; // visited id, cached ids
+
+	// buffers reused by getNeighborsId() and getNeighborsIdRadius()
+	struct TraversalBuffers
+	{
+		IdBitset visited;
+		IdBitset ignored;
+		IdBitset sameLevel;
+		std::vector<int> current;
+		std::vector<int> next;
+		void clear()
+		{
+			visited.clear();
+			ignored.clear();
+			sameLevel.clear();
+			current.clear();
+			next.clear();
+		}
+	};
+	mutable TraversalBuffers _traversalBuffers;
+	mutable bool _traversalBuffersUsed;
+
+	// signatures and their words loaded in background from LTM, not yet in WM
+	SignaturePrefetchThread * _prefetchThread;
+	std::map<int, Signature *> _prefetchedSignatures;
+	std::map<int, VisualWord *> _prefetchedWords;
+	int _lastSignaturesPrefetched;
+
+	// nodes added to WM on initialization without their features and words (Mem/InitWMLazy)
+	std::set<int> _lazySignatures;
+	SignatureWarmUpThread * _warmUpThread;
+	int _initWMLazyBatch;
 
 	//Keypoint stuff
 	VWDictionary * _vwd;
 	Feature2D * _feature2D;
 	float _badSignRatio;;
 	bool _tfIdfLikelihoodUsed;
+	int _likelihoodThreads;
 	bool _parallelized;
 
 	Registration * _registrationPipeline;
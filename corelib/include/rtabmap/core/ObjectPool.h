@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OBJECTPOOL_H_
+#define OBJECTPOOL_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include "rtabmap/utilite/UMutex.h"
+#include <set>
+#include <cstddef>
+
+namespace rtabmap {
+
+/**
+ * Thread-safe pool of fixed-size memory blocks, one pool per class (see the
+ * class-specific new/delete operators of Signature and VisualWord). Blocks
+ * are carved from large chunks, so objects continuously created and deleted
+ * from different threads (e.g., the main thread and the database trash
+ * thread) don't fragment the heap. Each thread keeps a small cache of free
+ * blocks: the pool mutex is locked only to move a batch of blocks between
+ * the cache and the chunks. A chunk is given back to the system when all
+ * its blocks are free, except one spare empty chunk to avoid allocating it
+ * again on the next batch. The pool must outlive the threads using it.
+ */
+class RTABMAP_EXP ObjectPool
+{
+public:
+	ObjectPool(size_t blockSize, size_t blocksPerChunk = 256);
+	virtual ~ObjectPool();
+
+	// Return a block of blockSize() bytes
+	void * allocate();
+	// p must have been returned by allocate() of this pool, from any thread
+	void deallocate(void * p);
+
+	size_t blockSize() const {return blockSize_;}
+	size_t capacity() const; // blocks allocated from the system
+	size_t used() const;     // blocks currently allocated or in a thread cache
+	size_t peak() const;     // maximum blocks used at the same time
+
+private:
+	// not copyable
+	ObjectPool(const ObjectPool &);
+	ObjectPool & operator=(const ObjectPool &);
+
+	struct FreeBlock
+	{
+		FreeBlock * next;
+	};
+	struct Chunk;
+	struct ThreadCache;
+
+	ThreadCache * threadCache();
+#ifdef _WIN32
+	static void WINAPI releaseThreadCache(void * cache);
+#else
+	static void releaseThreadCache(void * cache);
+#endif
+	// following methods must be called with mutex_ locked
+	void refill(ThreadCache * cache);
+	void flush(ThreadCache * cache, size_t blocks);
+	void releaseChunk(Chunk * chunk);
+
+private:
+	size_t blockSize_;
+	size_t blocksPerChunk_;
+	size_t headerSize_; // Chunk header before the blocks
+	size_t batchSize_;  // blocks moved at once between a thread cache and the chunks
+	std::set<Chunk*> chunks_; // sorted by address to find the chunk of a block
+	Chunk * available_; // chunks with free blocks
+	size_t emptyChunks_;
+	ThreadCache * caches_;
+	size_t used_;
+	size_t peak_;
+#ifdef _WIN32
+	DWORD cacheKey_;
+#else
+	pthread_key_t cacheKey_;
+#endif
+	mutable UMutex mutex_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* OBJECTPOOL_H_ */
@@ -182,6 +182,7 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Rtabmap, CreateIntermediateNodes,      bool, false, uFormat("Create intermediate nodes between loop closure detection. Only used when %s>0.", kRtabmapDetectionRate().c_str()));
     RTABMAP_PARAM_STR(Rtabmap, WorkingDirectory,         "",          "Working directory.");
     RTABMAP_PARAM(Rtabmap, MaxRetrieved,             unsigned int, 2, "Maximum locations retrieved at the same time from LTM.");
+    RTABMAP_PARAM(Rtabmap, PrefetchHypotheses,       unsigned int, 0, uFormat("Number of highest loop closure hypotheses for which the neighbors in LTM are loaded in background at the end of an update, ready to be retrieved on the next update (0=disabled). At most %s locations are prefetched.", kRtabmapMaxRetrieved().c_str()));
     RTABMAP_PARAM(Rtabmap, StatisticLogsBufferedInRAM,   bool, true,  "Statistic logs buffered in RAM instead of written to hard drive after each iteration.");
     RTABMAP_PARAM(Rtabmap, StatisticLogged,              bool, false, "Logging enabled.");
     RTABMAP_PARAM(Rtabmap, StatisticLoggedHeaders,       bool, true,  "Add column header description to log files.");
@@ -208,13 +209,18 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Mem, TransferSortingByWeightId,   bool, false,    "On transfer, signatures are sorted by weight->ID only (i.e. the oldest of the lowest weighted signatures are transferred first). If false, the signatures are sorted by weight->Age->ID (i.e. the oldest inserted in WM of the lowest weighted signatures are transferred first). Note that retrieval updates the age, not the ID.");
     RTABMAP_PARAM(Mem, RehearsalIdUpdatedToNewOne,  bool, false,    "On merge, update to new id. When false, no copy.");
     RTABMAP_PARAM(Mem, RehearsalWeightIgnoredWhileMoving, bool, false, "When the robot is moving, weights are not updated on rehearsal.");
+    RTABMAP_PARAM(Mem, RehearsalMaxCompared,        int, 1,         "Maximum number of most recent nodes in STM compared to a new node on rehearsal. The most similar one is merged with the new node.");
     RTABMAP_PARAM(Mem, GenerateIds,                 bool, true,     "True=Generate location IDs, False=use input image IDs.");
     RTABMAP_PARAM(Mem, BadSignaturesIgnored,        bool, false,    "Bad signatures are ignored.");
     RTABMAP_PARAM(Mem, InitWMWithAllNodes,          bool, false,    "Initialize the Working Memory with all nodes in Long-Term Memory. When false, it is initialized with nodes of the previous session.");
+    RTABMAP_PARAM(Mem, InitWMLazy,                  bool, false,    uFormat("On initialization, only the node info and the links are loaded in the Working Memory. Features and words of a node are loaded when they are first needed (e.g., when the node is registered with another one). Bad signatures are not ignored. A fixed dictionary is still loaded on initialization. For loop closure detection, nodes are loaded progressively (see \"%s\" and \"%s\"): until then, a node of the previous session cannot be detected as a loop closure (neutral likelihood).", kMemInitWMWarmUp().c_str(), kMemInitWMLazyBatch().c_str()).c_str());
+    RTABMAP_PARAM(Mem, InitWMWarmUp,                bool, false,    uFormat("With \"%s\", the features and words of the nodes are loaded by a background thread and added to the Working Memory at each update.", kMemInitWMLazy().c_str()).c_str());
+    RTABMAP_PARAM(Mem, InitWMLazyBatch,             int, 100,       uFormat("With \"%s\" and without \"%s\", maximum number of nodes (most recent first) loaded at each update to compute the likelihood. 0 means all nodes are loaded on the first update.", kMemInitWMLazy().c_str(), kMemInitWMWarmUp().c_str()).c_str());
     RTABMAP_PARAM(Mem, DepthAsMask,                 bool, true,     "Use depth image as mask when extracting features for vocabulary.");
     RTABMAP_PARAM(Mem, ImagePreDecimation,          int, 1,         "Image decimation (>=1) before features extraction. Negative decimation is done from RGB size instead of depth size (if depth is smaller than RGB, it may be interpolated depending of the decimation value).");
     RTABMAP_PARAM(Mem, ImagePostDecimation,         int, 1,         "Image decimation (>=1) of saved data in created signatures (after features extraction). Decimation is done from the original image. Negative decimation is done from RGB size instead of depth size (if depth is smaller than RGB, it may be interpolated depending of the decimation value).");
     RTABMAP_PARAM(Mem, CompressionParallelized,     bool, true,     "Compression of sensor data is multi-threaded.");
+    RTABMAP_PARAM(Mem, SignatureStagesParallelized, bool, true,     "When creating a signature, image post-decimation, laser scan filtering and data compression are done in parallel with visual features extraction.");
     RTABMAP_PARAM(Mem, LaserScanDownsampleStepSize, int, 1,         "If > 1, downsample the laser scans when creating a signature.");
     RTABMAP_PARAM(Mem, LaserScanVoxelSize,          float, 0.0,     uFormat("If > 0 m, voxel filtering is done on laser scans when creating a signature. If the laser scan had normals, they will be removed. To recompute the normals, make sure to use \"%s\" or \"%s\" parameters.", kMemLaserScanNormalK().c_str(), kMemLaserScanNormalRadius().c_str()).c_str());
     RTABMAP_PARAM(Mem, LaserScanNormalK,            int, 0,         "If > 0 and laser scans don't have normals, normals will be computed with K search neighbors when creating a signature.");
@@ -222,10 +228,16 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Mem, UseOdomFeatures,             bool, true,     "Use odometry features.");
 
     // KeypointMemory (Keypoint-based)
-    RTABMAP_PARAM(Kp, NNStrategy,               int, 1,       "kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4");
+    RTABMAP_PARAM(Kp, NNStrategy,               int, 1,       "kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4, kNNHnsw=5, kNNVocabularyTree=6");
     RTABMAP_PARAM(Kp, IncrementalDictionary,    bool, true,   "");
     RTABMAP_PARAM(Kp, IncrementalFlann,         bool, true,   uFormat("When using FLANN based strategy, add/remove points to its index without always rebuilding the index (the index is built only when the dictionary increases of the factor \"%s\" in size).", kKpFlannRebalancingFactor().c_str()));
-    RTABMAP_PARAM(Kp, FlannRebalancingFactor,   float, 2.0,   uFormat("Factor used when rebuilding the incremental FLANN index (see \"%s\"). Set <=1 to disable.", kKpIncrementalFlann().c_str()));
+    RTABMAP_PARAM(Kp, FlannRebalancingFactor,   float, 2.0,   uFormat("Factor used when rebuilding the incremental FLANN index (see \"%s\") or the vocabulary tree of an incremental dictionary. Set <=1 to disable.", kKpIncrementalFlann().c_str()));
+    RTABMAP_PARAM(Kp, FlannBackgroundRebuild,   bool, false,  "With an incremental dictionary, rebuild the FLANN index in a background thread from a copy of the words. While the index is rebuilding, the previous index is still used and the words not yet indexed are searched by brute force. The new index is swapped on the next dictionary update after the rebuild is done.");
+    RTABMAP_PARAM(Kp, HnswM,                    int, 16,      uFormat("[%s=5] Maximum number of links per word in the HNSW graph (twice this value on the bottom layer). Higher values give better recall at the cost of memory and insertion time.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, HnswEfConstruction,       int, 100,     uFormat("[%s=5] Size of the dynamic candidate list when inserting words in the HNSW graph.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, HnswEfSearch,             int, 64,      uFormat("[%s=5] Size of the dynamic candidate list when searching the HNSW graph.", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, VocTreeBranching,         int, 10,      uFormat("[%s=6] Number of children of each node of the vocabulary tree (hierarchical k-means).", kKpNNStrategy().c_str()));
+    RTABMAP_PARAM(Kp, VocTreeDepth,             int, 6,       uFormat("[%s=6] Maximum depth of the vocabulary tree. Words are bucketed in the leaves, about branching^depth leaves are created.", kKpNNStrategy().c_str()));
     RTABMAP_PARAM(Kp, MaxDepth,                 float, 0,     "Filter extracted keypoints by depth (0=inf).");
     RTABMAP_PARAM(Kp, MinDepth,                 float, 0,     "Filter extracted keypoints by depth.");
     RTABMAP_PARAM(Kp, MaxFeatures,              int, 500,     "Maximum features extracted from the images (0 means not bounded, <0 means no extraction).");
@@ -242,10 +254,12 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Kp, DetectorStrategy,         int, 6,       "0=SURF 1=SIFT 2=ORB 3=FAST/FREAK 4=FAST/BRIEF 5=GFTT/FREAK 6=GFTT/BRIEF 7=BRISK 8=GFTT/ORB 9=KAZE.");
 #endif
     RTABMAP_PARAM(Kp, TfIdfLikelihoodUsed,      bool, true,   "Use of the td-idf strategy to compute the likelihood.");
+    RTABMAP_PARAM(Kp, LikelihoodThreads,        int, 1,       "Number of threads used to compute the likelihood (0 means all cores, requires OpenMP). With more than one thread, partial tf-idf scores are summed in a fixed order, so the likelihood doesn't depend on the number of threads.");
     RTABMAP_PARAM(Kp, Parallelized,             bool, true,   "If the dictionary update and signature creation were parallelized.");
     RTABMAP_PARAM_STR(Kp, RoiRatios,       "0.0 0.0 0.0 0.0", "Region of interest ratios [left, right, top, bottom].");
-    RTABMAP_PARAM_STR(Kp, DictionaryPath,       "",           "Path of the pre-computed dictionary");
+    RTABMAP_PARAM_STR(Kp, DictionaryPath,       "",           "Path of the pre-computed dictionary (text, or binary vocabulary exported by rtabmap-vocabulary_tree which is memory-mapped for fast loading).");
     RTABMAP_PARAM(Kp, NewWordsComparedTogether, bool, true,   "When adding new words to dictionary, they are compared also with each other (to detect same words in the same signature).");
+    RTABMAP_PARAM(Kp, NNThreads,                int, 1,       "Number of threads used to search the nearest words of new features in the dictionary (0 means all cores, requires OpenMP). The resulting words don't depend on the number of threads.");
     RTABMAP_PARAM(Kp, SubPixWinSize,            int, 3,       "See cv::cornerSubPix().");
     RTABMAP_PARAM(Kp, SubPixIterations,         int, 0,       "See cv::cornerSubPix(). 0 disables sub pixel refining.");
     RTABMAP_PARAM(Kp, SubPixEps,                double, 0.02, "See cv::cornerSubPix().");
@@ -253,11 +267,17 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Kp, GridCols,                 int, 1,       uFormat("Number of columns of the grid used to extract uniformly \"%s / grid cells\" features from each cell.", kKpMaxFeatures().c_str()));
 
     //Database
+    RTABMAP_PARAM(Db, TrashMaxMemory,      int, 0,           "Maximum memory (MB) used by the nodes and words waiting to be saved in the database (0 means no limit). When reached, the policy set by \"Db/TrashPolicy\" is applied.");
+    RTABMAP_PARAM(Db, TrashPolicy,         int, 0,           "Policy applied at the end of an update when \"Db/TrashMaxMemory\" is reached: 0=Block (wait until the pending nodes and words are saved), 1=Coalesce (first release the sensor data of the pending nodes already in the database, as their update doesn't save it, then block if the limit is still reached), 2=Spill (Coalesce, then write the compressed sensor data of the pending nodes not yet in the database to a temporary file, read back when they are saved, then block if the limit is still reached).");
+    RTABMAP_PARAM(Db, DecompressionThreads, int, 0,        "Number of threads used to uncompress the data of nodes loaded by batch from the database (0 means all cores, requires OpenMP).");
     RTABMAP_PARAM(DbSqlite3, InMemory,     bool, false,      "Using database in the memory instead of a file on the hard disk.");
     RTABMAP_PARAM(DbSqlite3, CacheSize, unsigned int, 10000, "Sqlite cache size (default is 2000).");
     RTABMAP_PARAM(DbSqlite3, JournalMode,  int, 3,           "0=DELETE, 1=TRUNCATE, 2=PERSIST, 3=MEMORY, 4=OFF (see sqlite3 doc : \"PRAGMA journal_mode\")");
     RTABMAP_PARAM(DbSqlite3, Synchronous,  int, 0,           "0=OFF, 1=NORMAL, 2=FULL (see sqlite3 doc : \"PRAGMA synchronous\")");
     RTABMAP_PARAM(DbSqlite3, TempStore,    int, 2,           "0=DEFAULT, 1=FILE, 2=MEMORY (see sqlite3 doc : \"PRAGMA temp_store\")");
+    RTABMAP_PARAM(DbSqlite3, WordsQuantized, bool, false,    "Reduce the database size: float descriptors (SURF, SIFT) of the visual words are saved quantized on 8 bits in Word table (~4x smaller, small precision loss). The memory used by the dictionary is not reduced: quantized words are decoded to float when loaded, so words are always matched on float descriptors. Both formats can be read.");
+    RTABMAP_PARAM(DbSqlite3, FeaturesBlob, bool, false,      "Features (keypoints, 3D points and descriptors) of a node are saved in a single compressed blob (Feature_blob table) instead of one row per keypoint in Feature table. Both layouts can be read. Requires database version >= 0.13.0.");
+    RTABMAP_PARAM(DbSqlite3, FeaturesBlobMigration, bool, false, uFormat("When the database is opened with %s enabled, features saved in rows of Feature table are moved to Feature_blob table.", kDbSqlite3FeaturesBlob().c_str()));
 
     // Keypoints descriptors/detectors
     RTABMAP_PARAM(SURF, Extended,          bool, false,  "Extended descriptor flag (true - use extended 128-element descriptors; false - use 64-element descriptors).");
@@ -532,7 +552,7 @@ class RTABMAP_EXP Parameters
     RTABMAP_PARAM(Vis, GridRows,                 int, 1,      uFormat("Number of rows of the grid used to extract uniformly \"%s / grid cells\" features from each cell.", kVisMaxFeatures().c_str()));
     RTABMAP_PARAM(Vis, GridCols,                 int, 1,      uFormat("Number of columns of the grid used to extract uniformly \"%s / grid cells\" features from each cell.", kVisMaxFeatures().c_str()));
     RTABMAP_PARAM(Vis, CorType,                  int, 0,      "Correspondences computation approach: 0=Features Matching, 1=Optical Flow");
-    RTABMAP_PARAM(Vis, CorNNType,                int, 1,    uFormat("[%s=0] kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4. Used for features matching approach.", kVisCorType().c_str()));
+    RTABMAP_PARAM(Vis, CorNNType,                int, 1,    uFormat("[%s=0] kNNFlannNaive=0, kNNFlannKdTree=1, kNNFlannLSH=2, kNNBruteForce=3, kNNBruteForceGPU=4, kNNHnsw=5. Used for features matching approach.", kVisCorType().c_str()));
     RTABMAP_PARAM(Vis, CorNNDR,                  float, 0.6,  uFormat("[%s=0] NNDR: nearest neighbor distance ratio. Used for features matching approach.", kVisCorType().c_str()));
     RTABMAP_PARAM(Vis, CorGuessWinSize,          int, 20,     uFormat("[%s=0] Matching window size (pixels) around projected points when a guess transform is provided to find correspondences. 0 means disabled.", kVisCorType().c_str()));
     RTABMAP_PARAM(Vis, CorGuessMatchToProjection, bool, false, uFormat("[%s=0] Match frame's corners to source's projected points (when guess transform is provided) instead of projected points to frame's corners.", kVisCorType().c_str()));
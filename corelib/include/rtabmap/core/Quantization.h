@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_QUANTIZATION_H_
+#define CORELIB_SRC_QUANTIZATION_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap {
+
+/**
+ * Scalar quantization of float descriptors (SURF, SIFT) on 8 bits. Each
+ * descriptor is stored as its minimum and its step (two floats) followed by
+ * one byte per element, so a descriptor of "dim" floats takes dim+8 bytes
+ * instead of 4*dim (~4x smaller). The reconstruction error of each element
+ * is at most step/2. This is only the database format of the words (see
+ * DbSqlite3/WordsQuantized), used to reduce the size of the Word table:
+ * descriptors are decoded with dequantize() when they are loaded, so the
+ * dictionary in memory always keeps and searches float descriptors.
+ */
+namespace quantization {
+
+/**
+ * Size in bytes of a quantized descriptor of "dim" floats.
+ */
+RTABMAP_EXP int quantizedSize(int dim);
+
+/**
+ * Return true if a buffer of "bytes" is a quantized descriptor of "dim" floats.
+ */
+RTABMAP_EXP bool isQuantized(int bytes, int dim);
+
+/**
+ * @param descriptors CV_32FC1 descriptors
+ * @return CV_8UC1 quantized descriptors (one row per descriptor, quantizedSize(cols) columns)
+ */
+RTABMAP_EXP cv::Mat quantize(const cv::Mat & descriptors);
+
+/**
+ * @param quantized CV_8UC1 descriptors returned by quantize()
+ * @return CV_32FC1 descriptors
+ */
+RTABMAP_EXP cv::Mat dequantize(const cv::Mat & quantized);
+
+} /* namespace quantization */
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_QUANTIZATION_H_ */
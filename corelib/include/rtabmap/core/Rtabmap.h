@@ -158,7 +158,8 @@ public:
 			std::map<int, Transform> & poses,
 			std::multimap<int, Link> & constraints,
 			bool optimized,
-			bool global) const;
+			bool global,
+			bool uncompressedData = false) const; // if true, data of all nodes is uncompressed in parallel (see Db/DecompressionThreads)
 	void getGraph(std::map<int, Transform> & poses,
 			std::multimap<int, Link> & constraints,
 			bool optimized,
@@ -221,6 +222,7 @@ private:
 	float _loopRatio;
 	bool _verifyLoopClosureHypothesis;
 	unsigned int _maxRetrieved;
+	unsigned int _prefetchHypotheses;
 	unsigned int _maxLocalRetrieved;
 	bool _rawDataKept;
 	bool _statisticLogsBufferedInRAM;
@@ -45,9 +45,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap
 {
 
+class ObjectPool;
+
 class RTABMAP_EXP Signature
 {
 
+public:
+	// Signatures created with new are allocated from a pool
+	static void * operator new(size_t size);
+	static void operator delete(void * p, size_t size);
+	static const ObjectPool & pool();
+
 public:
 	Signature();
 	Signature(int id,
@@ -62,9 +70,13 @@ public:
 	virtual ~Signature();
 
 	/**
-	 * Must return a value between >=0 and <=1 (1 means 100% similarity).
+	 * Must return a value between >=0 and <=1 (1 means 100% similarity).
 	 */
 	float compareTo(const Signature & signature) const;
+	/**
+	 * Same as compareTo() for each signature, in a single pass over the words of this signature.
+	 */
+	std::vector<float> compareTo(const std::vector<const Signature *> & signatures) const;
 	bool isBadSignature() const;
 
 	int id() const {return _id;}
@@ -102,17 +114,46 @@ public:
 	void removeAllWords();
 	void removeWord(int wordId);
 	void changeWordsRef(int oldWordId, int activeWordId);
+	void changeWordsRef(const std::map<int, int> & refsToChange); // <oldId, activeId>, words sorted once
 	void setWords(const std::multimap<int, cv::KeyPoint> & words);
+	/**
+	 * Set words from parallel arrays (ids don't need to be sorted, words
+	 * with the same id keep their relative order). points and descriptors
+	 * can be empty, otherwise they must have the same size than ids.
+	 */
+	void setWords(const std::vector<int> & ids,
+			const std::vector<cv::KeyPoint> & keypoints,
+			const std::vector<cv::Point3f> & points = std::vector<cv::Point3f>(),
+			const cv::Mat & descriptors = cv::Mat());
 	bool isEnabled() const {return _enabled;}
 	void setEnabled(bool enabled) {_enabled = enabled;}
-	const std::multimap<int, cv::KeyPoint> & getWords() const {return _words;}
 	int getInvalidWordsCount() const {return _invalidWordsCount;}
 	const std::map<int, int> & getWordsChanged() const {return _wordsChanged;}
-	const std::multimap<int, cv::Mat> & getWordsDescriptors() const {return _wordsDescriptors;}
-	void setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors) {_wordsDescriptors = descriptors;}
+	void setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors);
+
+	// Flat words storage: ids are sorted, keypoints, 3D points and
+	// descriptor rows are in the same order than ids. 3D points and
+	// descriptors are either empty or have the same size than ids.
+	const std::vector<int> & getWordIds() const {return _wordIds;}
+	const std::vector<cv::KeyPoint> & getWordsKpts() const {return _wordsKpts;}
+	const std::vector<cv::Point3f> & getWords3Pts() const {return _words3;}
+	const cv::Mat & getWordsDescriptorsMat() const {return _wordsDescriptors;}
+	std::vector<int> getUniqueWordIds() const;
+	// Words with an id appearing only once (like uMultimapToMapUnique() on the views)
+	std::map<int, cv::KeyPoint> getUniqueWordsKpts() const;
+	std::map<int, cv::Point3f> getUniqueWords3() const;
+	// [first, last) indexes of the words with this id
+	std::pair<int, int> getWordRange(int wordId) const;
+
+	// Compatibility views of the flat storage, created on first
+	// access and kept until the words are modified. The first
+	// access is not thread-safe: use the flat accessors above
+	// when the same signature is read from multiple threads.
+	const std::multimap<int, cv::KeyPoint> & getWords() const;
+	const std::multimap<int, cv::Mat> & getWordsDescriptors() const;
 
 	//metric stuff
-	void setWords3(const std::multimap<int, cv::Point3f> & words3) {_words3 = words3;}
+	void setWords3(const std::multimap<int, cv::Point3f> & words3);
 	void setPose(const Transform & pose) {_pose = pose;}
 	void setGroundTruthPose(const Transform & pose) {_groundTruthPose = pose;}
 	void setVelocity(float vx, float vy, float vz, float vroll, float vpitch, float vyaw) {
@@ -125,7 +166,7 @@ public:
 		_velocity[5]=vyaw;
 	}
 
-	const std::multimap<int, cv::Point3f> & getWords3() const {return _words3;}
+	const std::multimap<int, cv::Point3f> & getWords3() const;
 	const Transform & getPose() const {return _pose;}
 	cv::Mat getPoseCovariance() const;
 	const Transform & getGroundTruthPose() const {return _groundTruthPose;}
@@ -136,6 +177,9 @@ public:
 
 	long getMemoryUsed(bool withSensorData=true) const; // Return memory usage in Bytes
 
+private:
+	void invalidateWordsViews();
+
 private:
 	int _id;
 	int _mapId;
@@ -150,9 +194,10 @@ private:
 	// Contains all words (Some can be duplicates -> if a word appears 2
 	// times in the signature, it will be 2 times in this list)
 	// Words match with the CvSeq keypoints and descriptors
-	std::multimap<int, cv::KeyPoint> _words; // word <id, keypoint>
-	std::multimap<int, cv::Point3f> _words3; // word <id, point> // in base_link frame (localTransform applied))
-	std::multimap<int, cv::Mat> _wordsDescriptors;
+	std::vector<int> _wordIds; // sorted word ids
+	std::vector<cv::KeyPoint> _wordsKpts;
+	std::vector<cv::Point3f> _words3; // in base_link frame (localTransform applied))
+	cv::Mat _wordsDescriptors; // one row per word
 	std::map<int, int> _wordsChanged; // <oldId, newId>
 	bool _enabled;
 	int _invalidWordsCount;
@@ -162,6 +207,14 @@ private:
 	std::vector<float> _velocity;
 
 	SensorData _sensorData;
+
+	// lazy compatibility views
+	mutable std::multimap<int, cv::KeyPoint> _wordsView;
+	mutable std::multimap<int, cv::Point3f> _words3View;
+	mutable std::multimap<int, cv::Mat> _wordsDescriptorsView;
+	mutable bool _wordsViewValid;
+	mutable bool _words3ViewValid;
+	mutable bool _wordsDescriptorsViewValid;
 };
 
 } // namespace rtabmap
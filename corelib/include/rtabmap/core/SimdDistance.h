@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_SIMDDISTANCE_H_
+#define CORELIB_SRC_SIMDDISTANCE_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace rtabmap {
+
+/**
+ * Descriptor distance kernels shared by the visual dictionary,
+ * the FLANN indexes and the brute force matching. The
+ * implementation is selected at runtime depending on the
+ * instructions supported by the compiler and the CPU.
+ */
+namespace simd {
+
+enum Instructions {
+	kScalar=0,
+	kSSE42=1, // POPCNT + SSE
+	kAVX2=2   // POPCNT + AVX2 + FMA
+};
+
+/**
+ * Best instructions supported by both the build and the CPU.
+ */
+RTABMAP_EXP Instructions supportedInstructions();
+
+/**
+ * Instructions currently used by the kernels.
+ */
+RTABMAP_EXP Instructions instructions();
+
+/**
+ * Force the instructions used by the kernels (e.g., kScalar
+ * for comparison). If not supported, the best supported
+ * ones are used. This is not thread-safe, it should
+ * be called before any matching is done.
+ * @return the instructions actually used
+ */
+RTABMAP_EXP Instructions setInstructions(Instructions instructions);
+
+RTABMAP_EXP const char * instructionsName(Instructions instructions);
+
+/**
+ * Hamming distance between two binary descriptors of "size" bytes.
+ */
+RTABMAP_EXP unsigned int hamming(const unsigned char * a, const unsigned char * b, int size);
+
+/**
+ * Squared euclidean distance between two float descriptors of "size" elements.
+ */
+RTABMAP_EXP float l2Sqr(const float * a, const float * b, int size);
+
+/**
+ * Brute force search of the k nearest neighbors of each query row in
+ * the train descriptors (Hamming distance for CV_8U, squared
+ * euclidean distance for CV_32F). This is the same as cv::BFMatcher
+ * with NORM_HAMMING/NORM_L2SQR: train can be splitted in many matrices
+ * (DMatch::imgIdx is the index of the matrix) and matches are
+ * sorted by distance. Query rows can be matched in parallel
+ * with OpenMP, results don't depend on the number of threads.
+ */
+RTABMAP_EXP void knnMatch(
+		const cv::Mat & query,
+		const std::vector<cv::Mat> & train,
+		std::vector<std::vector<cv::DMatch> > & matches,
+		int k,
+		int threads = 1);
+
+} /* namespace simd */
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_SIMDDISTANCE_H_ */
@@ -93,6 +93,7 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Memory, Immunized_locally,);
 	RTABMAP_STATS(Memory, Immunized_locally_max,);
 	RTABMAP_STATS(Memory, Signatures_retrieved,);
+	RTABMAP_STATS(Memory, Signatures_prefetched,);
 	RTABMAP_STATS(Memory, Images_buffered,);
 	RTABMAP_STATS(Memory, Rehearsal_sim,);
 	RTABMAP_STATS(Memory, Rehearsal_id,);
@@ -104,6 +105,14 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Memory, Odometry_variance_lin,);
 	RTABMAP_STATS(Memory, Distance_travelled, m);
 	RTABMAP_STATS(Memory, RAM_usage, MB);
+	RTABMAP_STATS(Memory, Signatures_pool_used,);
+	RTABMAP_STATS(Memory, Signatures_pool_capacity,);
+	RTABMAP_STATS(Memory, Words_pool_used,);
+	RTABMAP_STATS(Memory, Words_pool_capacity,);
+	RTABMAP_STATS(Memory, Db_trash_size,);
+	RTABMAP_STATS(Memory, Db_trash_memory, MB);
+	RTABMAP_STATS(Memory, Db_trash_blocked,);
+	RTABMAP_STATS(Memory, Db_trash_spilled, MB);
 
 	RTABMAP_STATS(Timing, Memory_update, ms);
 	RTABMAP_STATS(Timing, Neighbor_link_refining, ms);
@@ -124,6 +133,7 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(Timing, Forgetting, ms);
 	RTABMAP_STATS(Timing, Joining_trash, ms);
 	RTABMAP_STATS(Timing, Emptying_trash, ms);
+	RTABMAP_STATS(Timing, Db_flush_latency, ms);
 
 	RTABMAP_STATS(TimingMem, Pre_update, ms);
 	RTABMAP_STATS(TimingMem, Signature_creation, ms);
@@ -140,6 +150,7 @@ class RTABMAP_EXP Statistics
 	RTABMAP_STATS(TimingMem, Post_decimation, ms);
 	RTABMAP_STATS(TimingMem, Scan_filtering, ms);
 	RTABMAP_STATS(TimingMem, Occupancy_grid, ms);
+	RTABMAP_STATS(TimingMem, Joining_stages, ms);
 
 	RTABMAP_STATS(Keypoint, Dictionary_size, words);
 	RTABMAP_STATS(Keypoint, Indexed_words, words);
@@ -42,6 +42,10 @@ namespace rtabmap
 class DBDriver;
 class VisualWord;
 class FlannIndex;
+class FlannRebuildThread;
+class HnswIndex;
+class VocabularyTree;
+class MappedFile;
 
 class RTABMAP_EXP VWDictionary
 {
@@ -52,6 +56,8 @@ public:
 		kNNFlannLSH,
 		kNNBruteForce,
 		kNNBruteForceGPU,
+		kNNHnsw,
+		kNNVocabularyTree,
 		kNNUndef};
 	static const int ID_START;
 	static const int ID_INVALID;
@@ -74,6 +80,14 @@ public:
 
 	void addWordRef(int wordId, int signatureId);
 	void removeAllWordRef(int wordId, int signatureId);
+
+	// Inverted index of the references: for each word, <node, count> of the
+	// signatures referencing it. Nodes are dense indexes (reused when a
+	// signature doesn't reference words anymore) to accumulate scores in arrays.
+	const std::vector<std::pair<int, int> > & getWordPostings(int wordId) const;
+	int getNodeIndex(int signatureId) const; // -1 if the signature doesn't reference any word
+	unsigned int getNodesCount() const {return (unsigned int)_nodeSignatureIds.size();}
+
 	const VisualWord * getWord(int id) const;
 	VisualWord * getUnusedWord(int id) const;
 	void setLastWordId(int id) {_lastWordId = id;}
@@ -87,10 +101,16 @@ public:
 	void setNNStrategy(NNStrategy strategy);
 	bool isIncremental() const {return _incrementalDictionary;}
 	bool isIncrementalFlann() const {return _incrementalFlann;}
+	bool isFlannRebuilding() const {return _flannRebuildThread != 0;}
 	void setIncrementalDictionary();
 	void setFixedDictionary(const std::string & dictionaryPath);
+	const std::string & getDictionaryPath() const {return _dictionaryPath;}
+	static bool isVocabularyFile(const std::string & path); // binary vocabulary (see exportVocabulary())
 
 	void exportDictionary(const char * fileNameReferences, const char * fileNameDescriptors) const;
+	// Versioned binary vocabulary, mapped in memory when loaded with Kp/DictionaryPath. With
+	// Kp/NNStrategy=6, the vocabulary tree is saved too so that it is not rebuilt on loading.
+	bool exportVocabulary(const std::string & path) const;
 
 	void clear(bool printWarningsIfNotEmpty = true);
 	std::vector<VisualWord *> getUnusedWords() const;
@@ -102,6 +122,27 @@ public:
 protected:
 	int getNextId();
 
+private:
+	void addDescriptorToArena(VisualWord * vw);
+	void addDescriptorsToArena(const cv::Mat & descriptors, const std::vector<VisualWord *> & words);
+	void removeDescriptorFromArena(VisualWord * vw, bool indexed);
+	void compactArena();
+	std::vector<cv::Mat> getArenaBlocks() const;
+	int getArenaWordId(int block, int row) const;
+	bool isArenaIndexable() const;
+	std::vector<cv::Mat> createArenaData(std::map<int, int> & mapIndexId, std::map<int, int> & mapIdIndex);
+	void addPosting(int wordId, int signatureId, int count, bool exists);
+	void removePosting(int wordId, int signatureId);
+	cv::Mat createFlannData(std::map<int, int> & mapIndexId, std::map<int, int> & mapIdIndex);
+	void startFlannRebuild();
+	void swapFlannRebuild();
+	void cancelFlannRebuild();
+	bool loadVocabulary(const std::string & path);
+	void searchNotIndexedWords(
+			const cv::Mat & query,
+			std::vector<std::vector<cv::DMatch> > & matches,
+			std::vector<int> & wordIds) const;
+
 protected:
 	std::map<int, VisualWord *> _visualWords; //<id,VisualWord*>
 	int _totalActiveReferences; // keep track of all references for updating the common signature
@@ -110,12 +151,22 @@ private:
 	bool _incrementalDictionary;
 	bool _incrementalFlann;
 	float _rebalancingFactor;
+	bool _flannBackgroundRebuild;
+	int _hnswM;
+	int _hnswEfConstruction;
+	int _hnswEfSearch;
+	int _vocTreeBranching;
+	int _vocTreeDepth;
 	float _nndrRatio;
 	std::string _dictionaryPath; // a pre-computed dictionary (.txt)
 	bool _newWordsComparedTogether;
+	int _nnThreads;
 	int _lastWordId;
 	bool useDistanceL1_;
 	FlannIndex * _flannIndex;
+	HnswIndex * _hnswIndex;
+	VocabularyTree * _vocTree;
+	MappedFile * _vocabularyFile; // binary vocabulary, the descriptors of its words are in the file
 	cv::Mat _dataTree;
 	NNStrategy _strategy;
 	std::map<int ,int> _mapIndexId;
@@ -123,6 +174,33 @@ private:
 	std::map<int, VisualWord*> _unusedWords; //<id,VisualWord*>, note that these words stay in _visualWords
 	std::set<int> _notIndexedWords; // Words that are not indexed in the dictionary
 	std::set<int> _removedIndexedWords; // Words not anymore in the dictionary but still indexed in the dictionary
+	unsigned int _flannSizeAtBuild;
+	unsigned int _flannAddedSinceBuild;
+
+	// FLANN index rebuilt in background over the words (see Kp/FlannBackgroundRebuild),
+	// the current index is used until the new one is swapped.
+	FlannRebuildThread * _flannRebuildThread;
+	std::map<int ,int> _rebuildMapIndexId;
+	std::map<int ,int> _rebuildMapIdIndex;
+	std::set<int> _rebuildRemovedWords; // Words of the rebuilt index removed during the rebuild
+	std::vector<int> _rebuildFreeSlots; // Free rows of the arena when the rebuild started
+
+	// Descriptors of all words in the dictionary are stored in fixed size blocks. FLANN
+	// and vocabulary tree indexes are built directly on the blocks, so rows never move
+	// while an index uses them (the arena is compacted only before an index is rebuilt),
+	// and the rows of removed words are reused only when they are not indexed anymore.
+	// Brute force matching is done directly on the blocks.
+	std::vector<cv::Mat> _arenaBlocks;
+	std::vector<int> _arenaSlotIds; // <slot, word id>, 0 if the slot is free
+	std::vector<int> _arenaFreeSlots;
+	std::vector<int> _arenaPendingFreeSlots; // rows of removed words still indexed
+	std::map<int, int> _mapIdArenaSlot; // <word id, slot>
+
+	std::map<int, std::vector<std::pair<int, int> > > _wordPostings; // <word id, <node, count> >
+	std::map<int, int> _signatureNodes; // <signature id, node>
+	std::vector<int> _nodeSignatureIds; // <node, signature id>, 0 if the node is free
+	std::vector<int> _nodeReferences; // <node, references>
+	std::vector<int> _freeNodes;
 };
 
 } // namespace rtabmap
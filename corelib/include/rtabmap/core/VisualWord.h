@@ -35,8 +35,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace rtabmap
 {
 
+class ObjectPool;
+
 class RTABMAP_EXP VisualWord
 {
+public:
+	// Words created with new are allocated from a pool
+	static void * operator new(size_t size);
+	static void operator delete(void * p, size_t size);
+	static const ObjectPool & pool();
+
 public:
 	VisualWord(int id, const cv::Mat & descriptor, int signatureId = 0);
 	~VisualWord();
@@ -47,11 +55,14 @@ public:
 	int getTotalReferences() const {return _totalReferences;}
 	int id() const {return _id;}
 	const cv::Mat & getDescriptor() const {return _descriptor;}
+	void setDescriptor(const cv::Mat & descriptor) {_descriptor = descriptor;} // VWDictionary may store it in its descriptors arena
 	const std::map<int, int> & getReferences() const {return _references;} // (signature id , occurrence in the signature)
 
 	bool isSaved() const {return _saved;}
 	void setSaved(bool saved) {_saved = saved;}
 
+	long getMemoryUsed() const; // Return memory usage in Bytes
+
 private:
 	int _id;
 	cv::Mat _descriptor;
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORELIB_SRC_VOCABULARYTREE_H_
+#define CORELIB_SRC_VOCABULARYTREE_H_
+
+#include "rtabmap/core/RtabmapExp.h" // DLL export/import defines
+#include <vector>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+
+namespace rtabmap {
+
+/**
+ * Hierarchical k-means vocabulary tree (Nister and Stewenius, 2006) over a
+ * fixed set of points (the words of a dictionary). Each node has up to
+ * "branching" children, leaves keep the indexes of their points. A query
+ * descends to the nearest child at each level, then it is compared only to
+ * the points of the reached leaf, so quantization is O(branching*depth).
+ * Binary descriptors (CV_8UC1) are clustered with k-majority and compared with
+ * the Hamming distance, float descriptors (CV_32FC1) are clustered with k-means
+ * and compared with the squared L2 distance.
+ *
+ * The points are not copied, they should stay valid while the tree is used.
+ * They can be split in blocks of the same number of rows (except the last
+ * one), the index of a point is then its row over all blocks.
+ */
+class RTABMAP_EXP VocabularyTree
+{
+public:
+	VocabularyTree();
+	virtual ~VocabularyTree();
+
+	void release();
+	unsigned int indexedFeatures() const {return featuresCount_;}
+
+	// return KB
+	unsigned int memoryUsed() const;
+
+	void buildIndex(
+			const cv::Mat & features,
+			int branching = 10,
+			int maxDepth = 6,
+			int iterations = 10);
+	void buildIndex(
+			const std::vector<cv::Mat> & blocks,
+			int branching = 10,
+			int maxDepth = 6,
+			int iterations = 10);
+
+	bool isBuilt() const {return !nodes_.empty();}
+
+	int featuresType() const {return featuresType_;}
+	int featuresDim() const {return featuresDim_;}
+	int branching() const {return branching_;}
+	int depth() const {return depth_;}
+	unsigned int nodesCount() const {return (unsigned int)nodes_.size();}
+
+	// return squared distances for float descriptors (indices should be casted in size_t)
+	// threads: number of threads used (only with OpenMP)
+	void knnSearch(
+			const cv::Mat & query,
+			cv::Mat & indices,
+			cv::Mat & dists,
+			int knn,
+			int threads = 1) const;
+
+	// Binary serialization of the tree structure, the points are not saved.
+	void save(std::ostream & stream) const;
+	// Load a tree saved with save() from memory (e.g., a mapped file).
+	// features: the same points used to build the tree
+	bool load(const unsigned char * data, size_t size, const cv::Mat & features);
+
+private:
+	struct Node
+	{
+		int firstChild;  // children are contiguous
+		int children;    // 0 for leaves
+		int firstPoint;  // points of the subtree are contiguous in points_
+		int points;
+	};
+
+	const unsigned char * feature(int index) const {return blocks_[index/blockRows_].ptr(index%blockRows_);}
+	const unsigned char * centroid(int node) const {return &centroids_[node*rowSize_];}
+	float distance(const unsigned char * a, const unsigned char * b) const;
+	void buildNode(int node, std::vector<int> & indexes, int level, int maxDepth, int iterations, cv::RNG & rng);
+	void kmeans(
+			const std::vector<int> & indexes,
+			int k,
+			int iterations,
+			cv::RNG & rng,
+			std::vector<unsigned char> & centers,
+			std::vector<int> & labels) const;
+	void updateCenters(
+			const std::vector<int> & indexes,
+			const std::vector<int> & labels,
+			int k,
+			std::vector<unsigned char> & centers) const;
+
+private:
+	std::vector<cv::Mat> blocks_;
+	int featuresType_;
+	int featuresDim_;
+	unsigned int featuresCount_;
+	int blockRows_;
+	int rowSize_; // bytes
+	int branching_;
+	int depth_;
+	std::vector<Node> nodes_;
+	std::vector<unsigned char> centroids_;
+	std::vector<int> points_;
+};
+
+} /* namespace rtabmap */
+
+#endif /* CORELIB_SRC_VOCABULARYTREE_H_ */
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Signature.h"
 #include "rtabmap/core/Parameters.h"
 #include <iostream>
+#include <algorithm>
 #include <set>
 #if __cplusplus >= 201103L
 #include <unordered_map>
@@ -40,6 +41,90 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace rtabmap {
 
+SparsePrediction::SparsePrediction(const std::vector<std::map<int, float> > & columns, const std::vector<float> & defaults) :
+	_defaults(defaults)
+{
+	UASSERT(columns.size() == defaults.size());
+	size_t nonZeros = 0;
+	for(unsigned int i=0; i<columns.size(); ++i)
+	{
+		nonZeros += columns[i].size();
+	}
+	_columns.resize(columns.size()+1);
+	_rows.resize(nonZeros);
+	_values.resize(nonZeros);
+	int k = 0;
+	for(unsigned int i=0; i<columns.size(); ++i)
+	{
+		_columns[i] = k;
+		for(std::map<int, float>::const_iterator iter=columns[i].begin(); iter!=columns[i].end(); ++iter)
+		{
+			UASSERT(iter->first >= 0 && iter->first < (int)columns.size());
+			_rows[k] = iter->first;
+			_values[k] = iter->second;
+			++k;
+		}
+	}
+	_columns[columns.size()] = k;
+}
+
+float SparsePrediction::at(int row, int col) const
+{
+	UASSERT(row >= 0 && row < size() && col >= 0 && col < size());
+	std::vector<int>::const_iterator begin = _rows.begin() + _columns[col];
+	std::vector<int>::const_iterator end = _rows.begin() + _columns[col+1];
+	std::vector<int>::const_iterator iter = std::lower_bound(begin, end, row);
+	if(iter != end && *iter == row)
+	{
+		return _values[iter - _rows.begin()];
+	}
+	return _defaults[col];
+}
+
+void SparsePrediction::multiply(const float * x, float * y) const
+{
+	// Each column contributes its default value to all rows, the
+	// stored entries only add their difference with the default value.
+	int n = size();
+	float common = 0.0f;
+	for(int i=0; i<n; ++i)
+	{
+		common += _defaults[i] * x[i];
+	}
+	for(int j=0; j<n; ++j)
+	{
+		y[j] = common;
+	}
+	for(int i=0; i<n; ++i)
+	{
+		if(x[i] != 0.0f)
+		{
+			for(int k=_columns[i]; k<_columns[i+1]; ++k)
+			{
+				y[_rows[k]] += (_values[k] - _defaults[i]) * x[i];
+			}
+		}
+	}
+}
+
+cv::Mat SparsePrediction::toDense() const
+{
+	int n = size();
+	cv::Mat dense(n, n, CV_32FC1);
+	for(int i=0; i<n; ++i)
+	{
+		for(int j=0; j<n; ++j)
+		{
+			dense.at<float>(j, i) = _defaults[i];
+		}
+		for(int k=_columns[i]; k<_columns[i+1]; ++k)
+		{
+			dense.at<float>(_rows[k], i) = _values[k];
+		}
+	}
+	return dense;
+}
+
 BayesFilter::BayesFilter(const ParametersMap & parameters) :
 	_virtualPlacePrior(Parameters::defaultBayesVirtualPlacePriorThr()),
 	_fullPredictionUpdate(Parameters::defaultBayesFullPredictionUpdate()),
@@ -129,7 +214,7 @@ std::string BayesFilter::getPredictionLCStr() const
 void BayesFilter::reset()
 {
 	_posterior.clear();
-	_prediction = cv::Mat();
+	_prediction = SparsePrediction();
 	_neighborsIndex.clear();
 }
 
@@ -158,37 +243,38 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	UTimer timer;
 	timer.start();
 
-	cv::Mat prior;
-	cv::Mat posterior;
+	std::vector<float> prior;
+	std::vector<float> posterior;
 
 	float sum = 0;
 	int j=0;
 	// Recursive Bayes estimation...
 	// STEP 1 - Prediction : Prior*lastPosterior
-	_prediction = this->generatePrediction(memory, uKeys(likelihood));
+	_prediction = this->generateSparsePrediction(memory, uKeys(likelihood));
 
-	UDEBUG("STEP1-generate prior=%fs, rows=%d, cols=%d", timer.ticks(), _prediction.rows, _prediction.cols);
-	//std::cout << "Prediction=" << _prediction << std::endl;
+	UDEBUG("STEP1-generate prior=%fs, size=%d, non zeros=%d", timer.ticks(), _prediction.size(), (int)_prediction.nonZeros());
+	//std::cout << "Prediction=" << _prediction.toDense() << std::endl;
 
 	// Adjust the last posterior if some images were
 	// reactivated or removed from the working memory
-	posterior = cv::Mat(likelihood.size(), 1, CV_32FC1);
+	posterior.resize(likelihood.size());
 	this->updatePosterior(memory, uKeys(likelihood));
 	j=0;
 	for(std::map<int, float>::const_iterator i=_posterior.begin(); i!= _posterior.end(); ++i)
 	{
-		((float*)posterior.data)[j++] = (*i).second;
+		posterior[j++] = (*i).second;
 	}
-	ULOGGER_DEBUG("STEP1-update posterior=%fs, posterior=%d, _posterior size=%d", posterior.rows, _posterior.size());
-	//std::cout << "LastPosterior=" << posterior << std::endl;
+	ULOGGER_DEBUG("STEP1-update posterior=%fs, posterior=%d, _posterior size=%d", timer.ticks(), (int)posterior.size(), (int)_posterior.size());
+	//std::cout << "LastPosterior=" << cv::Mat(posterior) << std::endl;
 
 	// Multiply prediction matrix with the last posterior
 	// (m,m) X (m,1) = (m,1)
-	prior = _prediction * posterior;
+	UASSERT(_prediction.size() == (int)posterior.size());
+	prior.resize(posterior.size());
+	_prediction.multiply(posterior.data(), prior.data());
 	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
-	//std::cout << "ResultingPrior=" << prior << std::endl;
+	//std::cout << "ResultingPrior=" << cv::Mat(prior) << std::endl;
 
-	ULOGGER_DEBUG("STEP1-matrix mult time=%fs", timer.ticks());
 	std::vector<float> likelihoodValues = uValues(likelihood);
 	//std::cout << "Likelihood=" << cv::Mat(likelihoodValues) << std::endl;
 
@@ -199,7 +285,7 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 		std::map<int, float>::iterator p =_posterior.find((*i).first);
 		if(p!= _posterior.end())
 		{
-			(*p).second = (*i).second * ((float*)prior.data)[j++];
+			(*p).second = (*i).second * prior[j++];
 			sum+=(*p).second;
 		}
 		else
@@ -225,8 +311,7 @@ const std::map<int, float> & BayesFilter::computePosterior(const Memory * memory
 	return _posterior;
 }
 
-float addNeighborProb(cv::Mat & prediction,
-			unsigned int col,
+float addNeighborProb(std::map<int, float> & column,
 			const std::map<int, int> & neighbors,
 			const std::vector<double> & predictionLC,
 #if __cplusplus >= 201103L
@@ -236,11 +321,7 @@ float addNeighborProb(cv::Mat & prediction,
 #endif
 			)
 {
-	UASSERT(col < (unsigned int)prediction.cols &&
-			col < (unsigned int)prediction.rows);
-
 	float sum=0.0f;
-	float * dataPtr = (float*)prediction.data;
 	for(std::map<int, int>::const_iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
 	{
 		if(iter->first>=0)
@@ -253,15 +334,19 @@ float addNeighborProb(cv::Mat & prediction,
 			if(jter != idToIndex.end())
 			{
 				UASSERT((iter->second+1) < (int)predictionLC.size());
-				sum += dataPtr[col + jter->second*prediction.cols] = predictionLC[iter->second+1];
+				sum += column[jter->second] = predictionLC[iter->second+1];
 			}
 		}
 	}
 	return sum;
 }
 
-
 cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector<int> & ids)
+{
+	return generateSparsePrediction(memory, ids).toDense();
+}
+
+SparsePrediction BayesFilter::generateSparsePrediction(const Memory * memory, const std::vector<int> & ids)
 {
 	if(!_fullPredictionUpdate && !_prediction.empty())
 	{
@@ -292,10 +377,9 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 		}
 	}
 
-
-	//int rows = prediction.rows;
-	cv::Mat prediction = cv::Mat::zeros(ids.size(), ids.size(), CV_32FC1);
-	int cols = prediction.cols;
+	int cols = (int)ids.size();
+	std::vector<std::map<int, float> > columns(cols);
+	std::vector<float> defaults(cols, 0.0f);
 
 	// Each prior is a column vector
 	UDEBUG("_predictionLC.size()=%d",_predictionLC.size());
@@ -310,7 +394,7 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 				// Set high values (gaussians curves) to loop closure neighbors
 
 				// ADD prob for each neighbors
-				std::map<int, int> neighbors = memory->getNeighborsId(ids[i], _predictionLC.size()-1, 0, false, false, true, true);
+				std::map<int, int> neighbors = memory->getNeighborsIdCached(ids[i], _predictionLC.size()-1);
 
 				if(!_fullPredictionUpdate)
 				{
@@ -349,68 +433,70 @@ cv::Mat BayesFilter::generatePrediction(const Memory * memory, const std::vector
 						uInsert(_neighborsIndex, std::make_pair(*iter, neighbors));
 					}
 
-					float sum = 0.0f; // sum values added
 					int index = idToIndexMap.at(*iter);
-					sum += addNeighborProb(prediction, index, neighbors, _predictionLC, idToIndexMap);
+					columns[index].clear();
+					float sum = addNeighborProb(columns[index], neighbors, _predictionLC, idToIndexMap); // sum values added
 					idsDone.insert(*iter);
-					this->normalize(prediction, index, sum, ids[0]<0);
+					this->normalize(columns[index], defaults[index], index, cols, sum, ids[0]<0);
 				}
 			}
 			else
 			{
-				// Set the virtual place prior
-				if(_virtualPlacePrior > 0)
-				{
-					if(cols>1) // The first must be the virtual place
-					{
-						((float*)prediction.data)[i] = _virtualPlacePrior;
-						float val = (1.0-_virtualPlacePrior)/(cols-1);
-						for(int j=1; j<cols; j++)
-						{
-							((float*)prediction.data)[i + j*cols] = val;
-						}
-					}
-					else if(cols>0)
-					{
-						((float*)prediction.data)[i] = 1;
-					}
-				}
-				else
-				{
-					// Only for some tests...
-					// when _virtualPlacePrior=0, set all priors to the same value
-					if(cols>1)
-					{
-						float val = 1.0/cols;
-						for(int j=0; j<cols; j++)
-						{
-							((float*)prediction.data)[i + j*cols] = val;
-						}
-					}
-					else if(cols>0)
-					{
-						((float*)prediction.data)[i] = 1;
-					}
-				}
+				this->setVirtualPlaceColumn(columns[i], defaults[i], cols);
 			}
 		}
 	}
 
+	SparsePrediction prediction(columns, defaults);
+
 	ULOGGER_DEBUG("time = %fs", timerGlobal.ticks());
 
 	return prediction;
 }
 
-void BayesFilter::normalize(cv::Mat & prediction, unsigned int index, float addedProbabilitiesSum, bool virtualPlaceUsed) const
+void BayesFilter::setVirtualPlaceColumn(std::map<int, float> & column, float & defaultValue, int cols) const
 {
-	UASSERT(index < (unsigned int)prediction.rows && index < (unsigned int)prediction.cols);
+	column.clear();
+	defaultValue = 0.0f;
+	if(_virtualPlacePrior > 0)
+	{
+		if(cols>1) // The first must be the virtual place
+		{
+			column[0] = _virtualPlacePrior;
+			defaultValue = (1.0-_virtualPlacePrior)/(cols-1);
+		}
+		else if(cols>0)
+		{
+			column[0] = 1;
+		}
+	}
+	else
+	{
+		// Only for some tests...
+		// when _virtualPlacePrior=0, set all priors to the same value
+		if(cols>1)
+		{
+			defaultValue = 1.0/cols;
+		}
+		else if(cols>0)
+		{
+			column[0] = 1;
+		}
+	}
+}
+
+void BayesFilter::normalize(std::map<int, float> & column, float & defaultValue, unsigned int index, int cols, float addedProbabilitiesSum, bool virtualPlaceUsed) const
+{
+	UASSERT(index < (unsigned int)cols);
+
+	int start = virtualPlaceUsed?1:0;
+	defaultValue = 0.0f;
 
-	int cols = prediction.cols;
 	// ADD values of not found neighbors to loop closure
 	if(addedProbabilitiesSum < _totalPredictionLCValues-_predictionLC[0])
 	{
 		float delta = _totalPredictionLCValues-_predictionLC[0]-addedProbabilitiesSum;
-		((float*)prediction.data)[index + index*cols] += delta;
+		column[index] += delta;
 		addedProbabilitiesSum+=delta;
 	}
 
@@ -420,51 +506,53 @@ void BayesFilter::normalize(cv::Mat & prediction, unsigned int index, float adde
 		allOtherPlacesValue = 1.0f - _totalPredictionLCValues;
 	}
 
-	// Set all loop events to small values according to the model
+	// Set all loop events to small values according to the model,
+	// the entries not stored in the column take the default value
 	if(allOtherPlacesValue > 0 && cols>1)
 	{
 		float value = allOtherPlacesValue / float(cols - 1);
-		for(int j=virtualPlaceUsed?1:0; j<cols; ++j)
+		int zeros = cols - start;
+		for(std::map<int, float>::iterator iter=column.lower_bound(start); iter!=column.end(); ++iter)
 		{
-			if(((float*)prediction.data)[index + j*cols] == 0)
+			if(iter->second == 0)
 			{
-				((float*)prediction.data)[index + j*cols] = value;
-				addedProbabilitiesSum += ((float*)prediction.data)[index + j*cols];
+				iter->second = value;
+			}
+			else
+			{
+				--zeros;
 			}
 		}
+		defaultValue = value;
+		addedProbabilitiesSum += value * float(zeros);
 	}
 
-	//normalize this row
+	//normalize this column
 	float maxNorm = 1 - (virtualPlaceUsed?_predictionLC[0]:0); // 1 - virtual place probability
 	if(addedProbabilitiesSum<maxNorm-0.0001 || addedProbabilitiesSum>maxNorm+0.0001)
 	{
-		for(int j=virtualPlaceUsed?1:0; j<cols; ++j)
+		float factor = maxNorm / addedProbabilitiesSum;
+		for(std::map<int, float>::iterator iter=column.lower_bound(start); iter!=column.end(); ++iter)
 		{
-			((float*)prediction.data)[index + j*cols] *= maxNorm / addedProbabilitiesSum;
+			iter->second *= factor;
 		}
+		defaultValue *= factor;
 		addedProbabilitiesSum = maxNorm;
 	}
 
 	// ADD virtual place prob
 	if(virtualPlaceUsed)
 	{
-		((float*)prediction.data)[index] = _predictionLC[0];
-		addedProbabilitiesSum += ((float*)prediction.data)[index];
+		addedProbabilitiesSum += column[0] = _predictionLC[0];
 	}
 
-	//debug
-	//for(int j=0; j<cols; ++j)
-	//{
-	//	ULOGGER_DEBUG("test col=%d = %f", i, prediction.data.fl[i + j*cols]);
-	//}
-
 	if(addedProbabilitiesSum<0.99 || addedProbabilitiesSum > 1.01)
 	{
 		UWARN("Prediction is not normalized sum=%f", addedProbabilitiesSum);
 	}
 }
 
-cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
+SparsePrediction BayesFilter::updatePrediction(const SparsePrediction & oldPrediction,
 		const Memory * memory,
 		const std::vector<int> & oldIds,
 		const std::vector<int> & newIds)
@@ -475,10 +563,11 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	UASSERT(memory &&
 		oldIds.size() &&
 		newIds.size() &&
-		oldIds.size() == (unsigned int)oldPrediction.cols &&
-		oldIds.size() == (unsigned int)oldPrediction.rows);
+		oldIds.size() == (unsigned int)oldPrediction.size());
 
-	cv::Mat prediction = cv::Mat::zeros(newIds.size(), newIds.size(), CV_32FC1);
+	int cols = (int)newIds.size();
+	std::vector<std::map<int, float> > columns(cols);
+	std::vector<float> defaults(cols, 0.0f);
 	UDEBUG("time creating prediction = %fs", timer.restart());
 
 	// Create id to index maps
@@ -528,17 +617,31 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 		{
 			if(removedIds.find(oldIds[i]) != removedIds.end())
 			{
-				unsigned int cols = oldPrediction.cols;
 				int count = 0;
-				for(unsigned int j=0; j<cols; ++j)
+				if(oldPrediction.defaultValue(i) > epsilon)
 				{
-					if(((const float *)oldPrediction.data)[i + j*cols] > epsilon &&
-					   j!=i &&
-					   removedIds.find(oldIds[j]) == removedIds.end())
+					// all places are in the prior of the removed place
+					for(unsigned int j=0; j<oldIds.size(); ++j)
 					{
-						//UDEBUG("to update id=%d from id=%d removed (value=%f)", oldIds[j], oldIds[i], ((const float *)oldPrediction.data)[i + j*cols]);
-						idsToUpdate.insert(oldIds[j]);
-						++count;
+						if(j!=i && removedIds.find(oldIds[j]) == removedIds.end())
+						{
+							idsToUpdate.insert(oldIds[j]);
+							++count;
+						}
+					}
+				}
+				else
+				{
+					for(int k=oldPrediction.columnBegin(i); k<oldPrediction.columnEnd(i); ++k)
+					{
+						unsigned int j = oldPrediction.row(k);
+						if(oldPrediction.value(k) > epsilon &&
+						   j!=i &&
+						   removedIds.find(oldIds[j]) == removedIds.end())
+						{
+							idsToUpdate.insert(oldIds[j]);
+							++count;
+						}
 					}
 				}
 				UDEBUG("From removed id %d, %d neighbors to update.", oldIds[i], count);
@@ -548,7 +651,7 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 		{
 			if(_neighborsIndex.find(newIds[i]) == _neighborsIndex.end())
 			{
-				std::map<int, int> neighbors = memory->getNeighborsId(newIds[i], _predictionLC.size()-1, 0, false, false, true, true);
+				std::map<int, int> neighbors = memory->getNeighborsIdCached(newIds[i], _predictionLC.size()-1);
 
 				for(std::map<int, int>::iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
 				{
@@ -561,10 +664,9 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 				_neighborsIndex.insert(std::make_pair(newIds[i], neighbors));
 			}
 			const std::map<int, int> & neighbors = _neighborsIndex.at(newIds[i]);
-			//std::map<int, int> neighbors = memory->getNeighborsId(newIds[i], _predictionLC.size()-1, 0, false, false, true, true);
 
-			float sum = addNeighborProb(prediction, i, neighbors, _predictionLC, newIdToIndexMap);
-			this->normalize(prediction, i, sum, newIds[0]<0);
+			float sum = addNeighborProb(columns[i], neighbors, _predictionLC, newIdToIndexMap);
+			this->normalize(columns[i], defaults[i], i, cols, sum, newIds[0]<0);
 			++added;
 			int count = 0;
 			for(std::map<int,int>::const_iterator iter=neighbors.begin(); iter!=neighbors.end(); ++iter)
@@ -581,8 +683,6 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	}
 	UDEBUG("time getting %d ids to update = %fs", idsToUpdate.size(), timer.restart());
 
-	UTimer t1;
-	double e0=0,e1=0, e2=0, e3=0, e4=0;
 	// update modified/added ids
 	int modified = 0;
 	for(std::set<int>::iterator iter = idsToUpdate.begin(); iter!=idsToUpdate.end(); ++iter)
@@ -592,49 +692,36 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 		{
 			int index = newIdToIndexMap.at(id);
 
-			e0 = t1.ticks();
 			std::map<int, std::map<int, int> >::iterator kter = _neighborsIndex.find(id);
 			UASSERT_MSG(kter != _neighborsIndex.end(), uFormat("Did not find %d (current index size=%d)", id, (int)_neighborsIndex.size()).c_str());
 			const std::map<int, int> & neighbors = kter->second;
-			//std::map<int, int> neighbors = memory->getNeighborsId(id, _predictionLC.size()-1, 0, false, false, true, true);
-			e1+=t1.ticks();
-
-			float sum = addNeighborProb(prediction, index, neighbors, _predictionLC, newIdToIndexMap);
-			e3+=t1.ticks();
 
-			this->normalize(prediction, index, sum, newIds[0]<0);
+			columns[index].clear();
+			float sum = addNeighborProb(columns[index], neighbors, _predictionLC, newIdToIndexMap);
+			this->normalize(columns[index], defaults[index], index, cols, sum, newIds[0]<0);
 			++modified;
-			e4+=t1.ticks();
 		}
 	}
-	UDEBUG("time updating modified/added %d ids = %fs (e0=%f e1=%f e2=%f e3=%f e4=%f)", idsToUpdate.size(), timer.restart(), e0, e1, e2, e3, e4);
+	UDEBUG("time updating modified/added %d ids = %fs", idsToUpdate.size(), timer.restart());
 
-	//UDEBUG("oldIds.size()=%d, oldPrediction.cols=%d, oldPrediction.rows=%d", oldIds.size(), oldPrediction.cols, oldPrediction.rows);
-	//UDEBUG("newIdToIndexMap.size()=%d, prediction.cols=%d, prediction.rows=%d", newIdToIndexMap.size(), prediction.cols, prediction.rows);
-	// copy not changed probabilities
+	// copy not changed columns, only the rows of the removed ids are dropped
 	int copied = 0;
 	for(unsigned int i=0; i<oldIds.size(); ++i)
 	{
 		if(oldIds[i]>0 && removedIds.find(oldIds[i]) == removedIds.end() && idsToUpdate.find(oldIds[i]) == idsToUpdate.end())
 		{
-			for(int j=i; j<oldPrediction.cols; ++j)
+			int ii = newIdToIndexMap.at(oldIds[i]);
+			std::map<int, float> & column = columns[ii];
+			for(int k=oldPrediction.columnBegin(i); k<oldPrediction.columnEnd(i); ++k)
 			{
-				if(removedIds.find(oldIds[j]) == removedIds.end() && ((const float *)oldPrediction.data)[i + j*oldPrediction.cols] > epsilon)
+				int id = oldIds[oldPrediction.row(k)];
+				// the virtual place row is set below
+				if(id > 0 && removedIds.find(id) == removedIds.end())
 				{
-					//UDEBUG("i=%d, j=%d", i, j);
-					//UDEBUG("oldIds[i]=%d, oldIds[j]=%d", oldIds[i], oldIds[j]);
-					//UDEBUG("newIdToIndexMap.at(oldIds[i])=%d", newIdToIndexMap.at(oldIds[i]));
-					//UDEBUG("newIdToIndexMap.at(oldIds[j])=%d", newIdToIndexMap.at(oldIds[j]));
-					float v = ((const float *)oldPrediction.data)[i + j*oldPrediction.cols];
-					int ii = newIdToIndexMap.at(oldIds[i]);
-					int jj = newIdToIndexMap.at(oldIds[j]);
-					((float *)prediction.data)[ii + jj*prediction.cols] = v;
-					if(ii != jj)
-					{
-						((float *)prediction.data)[jj + ii*prediction.cols] = v;
-					}
+					column.insert(column.end(), std::make_pair(newIdToIndexMap.at(id), oldPrediction.value(k)));
 				}
 			}
+			defaults[ii] = oldPrediction.defaultValue(i);
 			++copied;
 		}
 	}
@@ -643,23 +730,27 @@ cv::Mat BayesFilter::updatePrediction(const cv::Mat & oldPrediction,
 	//update virtual place
 	if(newIds[0] < 0)
 	{
-		if(prediction.cols>1) // The first must be the virtual place
+		columns[0].clear();
+		if(cols>1) // The first must be the virtual place
 		{
-			((float*)prediction.data)[0] = _virtualPlacePrior;
-			float val = (1.0-_virtualPlacePrior)/(prediction.cols-1);
-			for(int j=1; j<prediction.cols; j++)
+			columns[0][0] = _virtualPlacePrior;
+			defaults[0] = (1.0-_virtualPlacePrior)/(cols-1);
+			for(int j=1; j<cols; j++)
 			{
-				((float*)prediction.data)[j*prediction.cols] = val;
-				((float*)prediction.data)[j] = _predictionLC[0];
+				columns[j][0] = _predictionLC[0];
 			}
 		}
-		else if(prediction.cols>0)
+		else if(cols>0)
 		{
-			((float*)prediction.data)[0] = 1;
+			columns[0][0] = 1;
+			defaults[0] = 0.0f;
 		}
 	}
 	UDEBUG("time updating virtual place = %fs", timer.restart());
 
+	SparsePrediction prediction(columns, defaults);
+	UDEBUG("time packing prediction (non zeros=%d) = %fs", (int)prediction.nonZeros(), timer.restart());
+
 	UDEBUG("Modified=%d, Added=%d, Copied=%d", modified, added, copied);
 	return prediction;
 }
@@ -36,6 +36,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/UStl.h"
 #include "DBDriverSqlite3.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace rtabmap {
 
 DBDriver * DBDriver::create(const ParametersMap & parameters)
@@ -46,7 +50,17 @@ DBDriver * DBDriver::create(const ParametersMap & parameters)
 
 DBDriver::DBDriver(const ParametersMap & parameters) :
 	_emptyTrashesTime(0),
-	_timestampUpdate(true)
+	_timestampUpdate(true),
+	_trashMemoryUsed(0),
+	_trashMemoryFlushing(0),
+	_spillFile(0),
+	_spillFileSize(0),
+	_trashOldestStamp(0.0),
+	_lastFlushLatency(0.0),
+	_trashBlocked(0),
+	_trashMaxMemory(Parameters::defaultDbTrashMaxMemory()),
+	_trashPolicy(Parameters::defaultDbTrashPolicy()),
+	_decompressionThreads(Parameters::defaultDbDecompressionThreads())
 {
 	this->parseParameters(parameters);
 }
@@ -55,10 +69,17 @@ DBDriver::~DBDriver()
 {
 	join(true);
 	this->emptyTrashes();
+	closeSpillFile();
 }
 
 void DBDriver::parseParameters(const ParametersMap & parameters)
 {
+	Parameters::parse(parameters, Parameters::kDbTrashMaxMemory(), _trashMaxMemory);
+	Parameters::parse(parameters, Parameters::kDbTrashPolicy(), _trashPolicy);
+	Parameters::parse(parameters, Parameters::kDbDecompressionThreads(), _decompressionThreads);
+	UASSERT(_trashMaxMemory >= 0);
+	UASSERT(_trashPolicy >= 0 && _trashPolicy <= 2);
+	UASSERT(_decompressionThreads >= 0);
 }
 
 void DBDriver::closeConnection(bool save, const std::string & outputUrl)
@@ -75,6 +96,10 @@ void DBDriver::closeConnection(bool save, const std::string & outputUrl)
 		_trashesMutex.lock();
 		_trashSignatures.clear();
 		_trashVisualWords.clear();
+		_trashMemoryUsed = 0;
+		_trashOldestStamp = 0.0;
+		_trashSpilled.clear();
+		closeSpillFile();
 		_trashesMutex.unlock();
 	}
 	_dbSafeAccessMutex.lock();
@@ -322,13 +347,23 @@ void DBDriver::emptyTrashes(bool async)
 
 	std::map<int, Signature*> signatures;
 	std::map<int, VisualWord*> visualWords;
+	std::map<int, SpilledData> spilled;
+	double oldestStamp = 0.0;
+	long long flushingBytes = 0;
 	_trashesMutex.lock();
 	{
-		ULOGGER_DEBUG("signatures=%d, visualWords=%d", _trashSignatures.size(), _trashVisualWords.size());
+		ULOGGER_DEBUG("signatures=%d, visualWords=%d, spilled=%d", _trashSignatures.size(), _trashVisualWords.size(), _trashSpilled.size());
 		signatures = _trashSignatures;
 		visualWords = _trashVisualWords;
+		spilled.swap(_trashSpilled);
 		_trashSignatures.clear();
 		_trashVisualWords.clear();
+		// still in memory until they are saved
+		flushingBytes = _trashMemoryUsed;
+		_trashMemoryFlushing += flushingBytes;
+		_trashMemoryUsed = 0;
+		oldestStamp = _trashOldestStamp;
+		_trashOldestStamp = 0.0;
 
 		_dbSafeAccessMutex.lock();
 	}
@@ -341,11 +376,42 @@ void DBDriver::emptyTrashes(bool async)
 		timer.start();
 		if(signatures.size())
 		{
-			if(this->isConnected())
+			if(this->isConnected() && spilled.empty())
 			{
 				//Only one query to the database
 				this->saveOrUpdate(uValues(signatures));
 			}
+			else if(this->isConnected())
+			{
+				// Read back the data spilled to the temporary file by batches
+				// of half the trash limit, each batch is saved and released
+				// before reading the next one.
+				long long maxBatchBytes = (long long)_trashMaxMemory*1024*1024/2;
+				long long batchBytes = 0;
+				std::vector<Signature *> batch;
+				for(std::map<int, Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+				{
+					std::map<int, SpilledData>::iterator jter = spilled.find(iter->first);
+					if(jter != spilled.end())
+					{
+						readSpilledData(jter->second, iter->second->sensorData());
+						batchBytes += iter->second->getMemoryUsed();
+					}
+					batch.push_back(iter->second);
+					std::map<int, Signature *>::iterator next = iter;
+					if(batchBytes > maxBatchBytes || ++next == signatures.end())
+					{
+						this->saveOrUpdate(batch);
+						for(unsigned int i=0; i<batch.size(); ++i)
+						{
+							signatures.at(batch[i]->id()) = 0;
+							delete batch[i];
+						}
+						batch.clear();
+						batchBytes = 0;
+					}
+				}
+			}
 
 			for(std::map<int, Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
 			{
@@ -377,6 +443,270 @@ void DBDriver::emptyTrashes(bool async)
 	ULOGGER_DEBUG("Total time emptying trashes = %fs...", _emptyTrashesTime);
 
 	_dbSafeAccessMutex.unlock();
+
+	_trashesMutex.lock();
+	_trashMemoryFlushing -= flushingBytes;
+	if(oldestStamp > 0.0)
+	{
+		_lastFlushLatency = UTimer::now() - oldestStamp;
+	}
+	if(_trashSpilled.empty())
+	{
+		// all spilled data has been read back
+		closeSpillFile();
+	}
+	_trashesMutex.unlock();
+}
+
+int DBDriver::getTrashSize() const
+{
+	int size;
+	_trashesMutex.lock();
+	size = (int)(_trashSignatures.size() + _trashVisualWords.size());
+	_trashesMutex.unlock();
+	return size;
+}
+
+long long DBDriver::getTrashMemoryUsed() const
+{
+	long long bytes;
+	_trashesMutex.lock();
+	bytes = _trashMemoryUsed + _trashMemoryFlushing;
+	_trashesMutex.unlock();
+	return bytes;
+}
+
+long long DBDriver::getTrashSpilled() const
+{
+	long long bytes;
+	_spillMutex.lock();
+	bytes = _spillFileSize;
+	_spillMutex.unlock();
+	return bytes;
+}
+
+void DBDriver::addToTrashMemoryUsed(long bytes)
+{
+	if(_trashOldestStamp == 0.0)
+	{
+		_trashOldestStamp = UTimer::now();
+	}
+	_trashMemoryUsed += bytes;
+}
+
+// Release the sensor data of the nodes already saved in the database. Their
+// update doesn't write the sensor data, and they can be reloaded from
+// the database if the nodes are retrieved from the trash.
+void DBDriver::coalesceTrash()
+{
+	_trashesMutex.lock();
+	int coalesced = 0;
+	for(std::map<int, Signature*>::iterator iter=_trashSignatures.begin(); iter!=_trashSignatures.end(); ++iter)
+	{
+		Signature * s = iter->second;
+		if(s->isSaved())
+		{
+			long before = s->getMemoryUsed();
+			s->sensorData().clearCompressedData();
+			s->sensorData().setImageRaw(cv::Mat());
+			s->sensorData().setDepthOrRightRaw(cv::Mat());
+			s->sensorData().setLaserScanRaw(LaserScan());
+			s->sensorData().setUserDataRaw(cv::Mat());
+			s->sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), 0.0f, cv::Point3f(0,0,0));
+			long released = before - s->getMemoryUsed();
+			if(released > 0)
+			{
+				_trashMemoryUsed -= released;
+				++coalesced;
+			}
+		}
+	}
+	_trashesMutex.unlock();
+	UDEBUG("Released sensor data of %d nodes already saved", coalesced);
+}
+
+static int seekFile(FILE * file, long long offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, SEEK_SET);
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// Write the compressed sensor data of the nodes not saved yet in the
+// database to a temporary file and release it from RAM. The data is
+// read back when the nodes are saved or retrieved from the trash.
+void DBDriver::spillTrash()
+{
+	UTimer timer;
+	int count = 0;
+	_trashesMutex.lock();
+	_spillMutex.lock();
+	if(_spillFile == 0)
+	{
+		_spillFile = tmpfile();
+		_spillFileSize = 0;
+	}
+	if(_spillFile == 0 || seekFile(_spillFile, _spillFileSize) != 0)
+	{
+		UERROR("Cannot write the trash to a temporary file, waiting for the database instead.");
+	}
+	else
+	{
+		for(std::map<int, Signature*>::iterator iter=_trashSignatures.begin(); iter!=_trashSignatures.end(); ++iter)
+		{
+			Signature * s = iter->second;
+			if(s->isSaved() || _trashSpilled.find(iter->first) != _trashSpilled.end())
+			{
+				continue;
+			}
+			const SensorData & data = s->sensorData();
+			const cv::Mat buffers[7] = {
+					data.imageCompressed(),
+					data.depthOrRightCompressed(),
+					data.laserScanCompressed().data(),
+					data.userDataCompressed(),
+					data.gridGroundCellsCompressed(),
+					data.gridObstacleCellsCompressed(),
+					data.gridEmptyCellsCompressed()};
+			SpilledData spilled;
+			spilled.offset = _spillFileSize;
+			bool written = true;
+			long long size = 0;
+			for(int i=0; i<7 && written; ++i)
+			{
+				spilled.sizes[i] = buffers[i].empty()?0:buffers[i].cols;
+				if(spilled.sizes[i])
+				{
+					UASSERT(buffers[i].type() == CV_8UC1 && buffers[i].rows == 1);
+					written = fwrite(buffers[i].data, 1, spilled.sizes[i], _spillFile) == (size_t)spilled.sizes[i];
+					size += spilled.sizes[i];
+				}
+			}
+			if(!written)
+			{
+				UERROR("Cannot write the trash to the temporary file (%lld bytes written), waiting for the database instead.", _spillFileSize);
+				seekFile(_spillFile, _spillFileSize);
+				break;
+			}
+			if(size == 0)
+			{
+				continue;
+			}
+			_spillFileSize += size;
+			spilled.scanMaxPoints = data.laserScanCompressed().maxPoints();
+			spilled.scanMaxRange = data.laserScanCompressed().maxRange();
+			spilled.scanFormat = data.laserScanCompressed().format();
+			spilled.scanLocalTransform = data.laserScanCompressed().localTransform();
+			_trashSpilled.insert(std::make_pair(iter->first, spilled));
+
+			long before = s->getMemoryUsed();
+			s->sensorData().clearCompressedData();
+			s->sensorData().setImageRaw(cv::Mat());
+			s->sensorData().setDepthOrRightRaw(cv::Mat());
+			s->sensorData().setLaserScanRaw(LaserScan());
+			s->sensorData().setUserDataRaw(cv::Mat());
+			// keep cell size and view point of the grid
+			s->sensorData().setOccupancyGrid(cv::Mat(), cv::Mat(), cv::Mat(), data.gridCellSize(), data.gridViewPoint());
+			_trashMemoryUsed -= before - s->getMemoryUsed();
+			++count;
+		}
+		fflush(_spillFile);
+	}
+	_spillMutex.unlock();
+	_trashesMutex.unlock();
+	UDEBUG("Spilled sensor data of %d nodes to a temporary file (%lld MB) = %fs", count, _spillFileSize/(1024*1024), timer.ticks());
+}
+
+// Rebuild the sensor data of a node with its compressed data read back
+// from the spill file, like when it is loaded from the database.
+void DBDriver::readSpilledData(const SpilledData & spilled, SensorData & data) const
+{
+	cv::Mat buffers[7];
+	_spillMutex.lock();
+	bool read = _spillFile != 0 && seekFile(_spillFile, spilled.offset) == 0;
+	for(int i=0; i<7 && read; ++i)
+	{
+		if(spilled.sizes[i])
+		{
+			buffers[i] = cv::Mat(1, spilled.sizes[i], CV_8UC1);
+			read = fread(buffers[i].data, 1, spilled.sizes[i], _spillFile) == (size_t)spilled.sizes[i];
+		}
+	}
+	_spillMutex.unlock();
+	if(!read)
+	{
+		UERROR("Cannot read the data of node %d from the trash temporary file!", data.id());
+		return;
+	}
+
+	LaserScan scan(buffers[2], spilled.scanMaxPoints, spilled.scanMaxRange, (LaserScan::Format)spilled.scanFormat, spilled.scanLocalTransform);
+	SensorData restored;
+	if(data.cameraModels().size())
+	{
+		restored = SensorData(scan, buffers[0], buffers[1], data.cameraModels(), data.id(), data.stamp(), buffers[3]);
+	}
+	else
+	{
+		restored = SensorData(scan, buffers[0], buffers[1], data.stereoCameraModel(), data.id(), data.stamp(), buffers[3]);
+	}
+	restored.setOccupancyGrid(buffers[4], buffers[5], buffers[6], data.gridCellSize(), data.gridViewPoint());
+	restored.setFeatures(data.keypoints(), data.keypoints3D(), data.descriptors());
+	restored.setGroundTruth(data.groundTruth());
+	restored.setGlobalPose(data.globalPose(), data.globalPoseCovariance());
+	restored.setGPS(data.gps());
+	restored.setIMU(data.imu());
+	data = restored;
+}
+
+void DBDriver::closeSpillFile()
+{
+	_spillMutex.lock();
+	if(_spillFile)
+	{
+		fclose(_spillFile); // the temporary file is deleted
+		_spillFile = 0;
+		_spillFileSize = 0;
+	}
+	_spillMutex.unlock();
+}
+
+void DBDriver::applyTrashPolicy()
+{
+	long long maxBytes = (long long)_trashMaxMemory*1024*1024;
+	if(_trashMaxMemory == 0 || getTrashMemoryUsed() <= maxBytes)
+	{
+		return;
+	}
+
+	if(_trashPolicy == 1 || _trashPolicy == 2)
+	{
+		coalesceTrash();
+		if(getTrashMemoryUsed() <= maxBytes)
+		{
+			return;
+		}
+	}
+
+	if(_trashPolicy == 2)
+	{
+		spillTrash();
+		if(getTrashMemoryUsed() <= maxBytes)
+		{
+			return;
+		}
+	}
+
+	// block: wait until the pending data is saved
+	UTimer timer;
+	++_trashBlocked;
+	this->join();
+	if(getTrashMemoryUsed() > maxBytes)
+	{
+		this->emptyTrashes();
+	}
+	UDEBUG("Trash was full (%s=%d MB), blocked %fs", Parameters::kDbTrashMaxMemory().c_str(), _trashMaxMemory, timer.ticks());
 }
 
 void DBDriver::asyncSave(Signature * s)
@@ -386,7 +716,10 @@ void DBDriver::asyncSave(Signature * s)
 		UDEBUG("s=%d", s->id());
 		_trashesMutex.lock();
 		{
-			_trashSignatures.insert(std::pair<int, Signature*>(s->id(), s));
+			if(_trashSignatures.insert(std::pair<int, Signature*>(s->id(), s)).second)
+			{
+				addToTrashMemoryUsed(s->getMemoryUsed());
+			}
 		}
 		_trashesMutex.unlock();
 	}
@@ -398,7 +731,10 @@ void DBDriver::asyncSave(VisualWord * vw)
 	{
 		_trashesMutex.lock();
 		{
-			_trashVisualWords.insert(std::pair<int, VisualWord*>(vw->id(), vw));
+			if(_trashVisualWords.insert(std::pair<int, VisualWord*>(vw->id(), vw)).second)
+			{
+				addToTrashMemoryUsed(vw->getMemoryUsed());
+			}
 		}
 		_trashesMutex.unlock();
 	}
@@ -518,16 +854,25 @@ void DBDriver::load(VWDictionary * dictionary) const
 	_dbSafeAccessMutex.unlock();
 }
 
-void DBDriver::loadLastNodes(std::list<Signature *> & signatures) const
+void DBDriver::loadLastNodes(std::list<Signature *> & signatures, bool features) const
 {
 	_dbSafeAccessMutex.lock();
-	this->loadLastNodesQuery(signatures);
+	this->loadLastNodesQuery(signatures, features);
 	_dbSafeAccessMutex.unlock();
 }
 
+void DBDriver::loadFeatures(std::list<Signature *> & signatures) const
+{
+	_dbSafeAccessMutex.lock();
+	this->loadFeaturesQuery(signatures);
+	_dbSafeAccessMutex.unlock();
+}
+
+// Signatures found in the trash are always returned with their features
 void DBDriver::loadSignatures(const std::list<int> & signIds,
 		std::list<Signature *> & signatures,
-		std::set<int> * loadedFromTrash)
+		std::set<int> * loadedFromTrash,
+		bool features)
 {
 	UDEBUG("");
 	// look up in the trash before the database
@@ -543,6 +888,13 @@ void DBDriver::loadSignatures(const std::list<int> & signIds,
 				if(sIter->first == *iter)
 				{
 					signatures.push_back(sIter->second);
+					_trashMemoryUsed -= sIter->second->getMemoryUsed();
+					std::map<int, SpilledData>::iterator jter = _trashSpilled.find(sIter->first);
+					if(jter != _trashSpilled.end())
+					{
+						readSpilledData(jter->second, sIter->second->sensorData());
+						_trashSpilled.erase(jter);
+					}
 					_trashSignatures.erase(sIter++);
 
 					valueFound = true;
@@ -570,6 +922,29 @@ void DBDriver::loadSignatures(const std::list<int> & signIds,
 	_trashesMutex.unlock();
 	UDEBUG("");
 	if(ids.size())
+	{
+		_dbSafeAccessMutex.lock();
+		this->loadSignaturesQuery(ids, signatures, features);
+		_dbSafeAccessMutex.unlock();
+	}
+}
+
+// Load only from the database, the signatures waiting in the trash
+// are left there (their database version may be outdated).
+void DBDriver::loadSavedSignatures(const std::list<int> & signIds, std::list<Signature *> & signatures) const
+{
+	UDEBUG("");
+	std::list<int> ids;
+	_trashesMutex.lock();
+	for(std::list<int>::const_iterator iter = signIds.begin(); iter != signIds.end(); ++iter)
+	{
+		if(_trashSignatures.find(*iter) == _trashSignatures.end())
+		{
+			ids.push_back(*iter);
+		}
+	}
+	_trashesMutex.unlock();
+	if(ids.size())
 	{
 		_dbSafeAccessMutex.lock();
 		this->loadSignaturesQuery(ids, signatures);
@@ -595,6 +970,7 @@ void DBDriver::loadWords(const std::set<int> & wordIds, std::list<VisualWord *>
 				{
 					UDEBUG("put back word %d from trash", *iter);
 					puttedBack.push_back(wIter->second);
+					_trashMemoryUsed -= wIter->second->getMemoryUsed();
 					_trashVisualWords.erase(wIter);
 					ids.erase(iter++);
 				}
@@ -657,6 +1033,11 @@ void DBDriver::getNodeData(
 			!s->isSaved())
 		{
 			data = (SensorData)s->sensorData();
+			std::map<int, SpilledData>::const_iterator jter = _trashSpilled.find(signatureId);
+			if(jter != _trashSpilled.end())
+			{
+				readSpilledData(jter->second, data);
+			}
 			found = true;
 		}
 	}
@@ -674,6 +1055,96 @@ void DBDriver::getNodeData(
 	}
 }
 
+void DBDriver::getNodesData(
+		const std::vector<int> & signatureIds,
+		std::vector<SensorData> & data,
+		bool images, bool scan, bool userData, bool occupancyGrid,
+		bool uncompressedData) const
+{
+	UTimer timer;
+	data.resize(signatureIds.size());
+
+	// look in the trash
+	std::vector<int> indexesToLoad;
+	_trashesMutex.lock();
+	for(unsigned int i=0; i<signatureIds.size(); ++i)
+	{
+		std::map<int, Signature *>::const_iterator iter = _trashSignatures.find(signatureIds[i]);
+		if(iter != _trashSignatures.end() &&
+			(!iter->second->sensorData().imageCompressed().empty() ||
+			 !iter->second->sensorData().laserScanCompressed().isEmpty() ||
+			 !iter->second->sensorData().userDataCompressed().empty() ||
+			 iter->second->sensorData().gridCellSize() != 0.0f ||
+			 !iter->second->isSaved()))
+		{
+			data[i] = (SensorData)iter->second->sensorData();
+			std::map<int, SpilledData>::const_iterator jter = _trashSpilled.find(signatureIds[i]);
+			if(jter != _trashSpilled.end())
+			{
+				readSpilledData(jter->second, data[i]);
+			}
+		}
+		else
+		{
+			indexesToLoad.push_back(i);
+		}
+	}
+	_trashesMutex.unlock();
+
+	if(indexesToLoad.size())
+	{
+		std::list<Signature> tmp;
+		std::list<Signature *> signatures;
+		for(unsigned int i=0; i<indexesToLoad.size(); ++i)
+		{
+			tmp.push_back(Signature(signatureIds[indexesToLoad[i]]));
+			signatures.push_back(&tmp.back());
+		}
+
+		_dbSafeAccessMutex.lock();
+		loadNodeDataQuery(signatures, images, scan, userData, occupancyGrid);
+		_dbSafeAccessMutex.unlock();
+
+		int i=0;
+		for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+		{
+			data[indexesToLoad[i++]] = (*iter)->sensorData();
+		}
+	}
+	UDEBUG("Loaded data of %d nodes (%d from database): %fs", (int)data.size(), (int)indexesToLoad.size(), timer.ticks());
+
+	if(uncompressedData)
+	{
+		uncompressNodesData(data, images, scan, userData, occupancyGrid);
+	}
+}
+
+void DBDriver::uncompressNodesData(
+		std::vector<SensorData> & data,
+		bool images, bool scan, bool userData, bool occupancyGrid) const
+{
+	UTimer timer;
+#ifdef _OPENMP
+	int threads = _decompressionThreads>0?_decompressionThreads:omp_get_max_threads();
+	#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+#endif
+	for(int i=0; i<(int)data.size(); ++i)
+	{
+		SensorData & d = data[i];
+		cv::Mat imageRaw, depthRaw, userDataRaw, groundCellsRaw, obstacleCellsRaw, emptyCellsRaw;
+		LaserScan laserScanRaw;
+		d.uncompressData(
+				images && !d.imageCompressed().empty()?&imageRaw:0,
+				images && !d.depthOrRightCompressed().empty()?&depthRaw:0,
+				scan && !d.laserScanCompressed().isEmpty()?&laserScanRaw:0,
+				userData && !d.userDataCompressed().empty()?&userDataRaw:0,
+				occupancyGrid && !d.gridGroundCellsCompressed().empty()?&groundCellsRaw:0,
+				occupancyGrid && !d.gridObstacleCellsCompressed().empty()?&obstacleCellsRaw:0,
+				occupancyGrid && !d.gridEmptyCellsCompressed().empty()?&emptyCellsRaw:0);
+	}
+	UDEBUG("Uncompressed data of %d nodes: %fs", (int)data.size(), timer.ticks());
+}
+
 bool DBDriver::getCalibration(
 		int signatureId,
 		std::vector<CameraModel> & models,
@@ -710,8 +1181,20 @@ bool DBDriver::getLaserScanInfo(
 	_trashesMutex.lock();
 	if(uContains(_trashSignatures, signatureId))
 	{
-		info = _trashSignatures.at(signatureId)->sensorData().laserScanCompressed();
-		found = true;
+		const Signature * s = _trashSignatures.at(signatureId);
+		// the scan of saved nodes may have been released from the trash (see coalesceTrash())
+		std::map<int, SpilledData>::const_iterator jter = _trashSpilled.find(signatureId);
+		if(jter != _trashSpilled.end())
+		{
+			// the scan of nodes not saved may have been spilled (see spillTrash())
+			info = LaserScan(cv::Mat(), jter->second.scanMaxPoints, jter->second.scanMaxRange, (LaserScan::Format)jter->second.scanFormat, jter->second.scanLocalTransform);
+			found = true;
+		}
+		else if(!s->isSaved() || !s->sensorData().laserScanCompressed().isEmpty())
+		{
+			info = s->sensorData().laserScanCompressed();
+			found = true;
+		}
 	}
 	_trashesMutex.unlock();
 
@@ -790,6 +1273,43 @@ void DBDriver::loadLinks(int signatureId, std::map<int, Link> & links, Link::Typ
 	}
 }
 
+void DBDriver::loadLinks(const std::set<int> & signatureIds, std::map<int, std::map<int, Link> > & links, Link::Type type) const
+{
+	std::set<int> ids;
+	// look in the trash
+	_trashesMutex.lock();
+	for(std::set<int>::const_iterator iter=signatureIds.begin(); iter!=signatureIds.end(); ++iter)
+	{
+		std::map<int, Signature*>::const_iterator sIter = _trashSignatures.find(*iter);
+		if(sIter != _trashSignatures.end())
+		{
+			UASSERT(sIter->second != 0);
+			std::map<int, Link> & signatureLinks = links[*iter];
+			for(std::map<int, Link>::const_iterator nIter = sIter->second->getLinks().begin();
+					nIter!=sIter->second->getLinks().end();
+					++nIter)
+			{
+				if(type == Link::kUndef || nIter->second.type() == type)
+				{
+					signatureLinks.insert(*nIter);
+				}
+			}
+		}
+		else
+		{
+			ids.insert(ids.end(), *iter);
+		}
+	}
+	_trashesMutex.unlock();
+
+	if(ids.size())
+	{
+		_dbSafeAccessMutex.lock();
+		this->loadLinksQuery(ids, links, type);
+		_dbSafeAccessMutex.unlock();
+	}
+}
+
 void DBDriver::getWeight(int signatureId, int & weight) const
 {
 	bool found = false;
@@ -32,11 +32,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/VWDictionary.h"
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/Compression.h"
+#include "rtabmap/core/Quantization.h"
 #include "DatabaseSchema_sql.h"
 #include <set>
+#include <algorithm>
 
 #include "rtabmap/utilite/UtiLite.h"
 
+// Maximum rows inserted by a single multi-row INSERT
+#define DB_MAX_ROWS_PER_INSERT 64
+
 namespace rtabmap {
 
 DBDriverSqlite3::DBDriverSqlite3(const ParametersMap & parameters) :
@@ -48,7 +53,11 @@ DBDriverSqlite3::DBDriverSqlite3(const ParametersMap & parameters) :
 	_cacheSize(Parameters::defaultDbSqlite3CacheSize()),
 	_journalMode(Parameters::defaultDbSqlite3JournalMode()),
 	_synchronous(Parameters::defaultDbSqlite3Synchronous()),
-	_tempStore(Parameters::defaultDbSqlite3TempStore())
+	_tempStore(Parameters::defaultDbSqlite3TempStore()),
+	_wordsQuantized(Parameters::defaultDbSqlite3WordsQuantized()),
+	_featuresBlob(Parameters::defaultDbSqlite3FeaturesBlob()),
+	_featuresBlobMigration(Parameters::defaultDbSqlite3FeaturesBlobMigration()),
+	_featuresBlobTable(false)
 {
 	ULOGGER_DEBUG("treadSafe=%d", sqlite3_threadsafe());
 	this->parseParameters(parameters);
@@ -82,6 +91,9 @@ void DBDriverSqlite3::parseParameters(const ParametersMap & parameters)
 	{
 		this->setDbInMemory(uStr2Bool((*iter).second.c_str()));
 	}
+	Parameters::parse(parameters, Parameters::kDbSqlite3WordsQuantized(), _wordsQuantized);
+	Parameters::parse(parameters, Parameters::kDbSqlite3FeaturesBlob(), _featuresBlob);
+	Parameters::parse(parameters, Parameters::kDbSqlite3FeaturesBlobMigration(), _featuresBlobMigration);
 	DBDriver::parseParameters(parameters);
 }
 
@@ -405,6 +417,17 @@ bool DBDriverSqlite3::connectDatabaseQuery(const std::string & url, bool overwri
 	this->setSynchronous(_synchronous); // this will call the SQL
 	this->setTempStore(_tempStore); // this will call the SQL
 
+	_featuresBlobTable = uStrNumCmp(_version, "0.13.0") >= 0 && this->hasTable("Feature_blob");
+	if(_featuresBlob && uStrNumCmp(_version, "0.13.0") < 0)
+	{
+		UWARN("Parameter %s is ignored for database version %s (minimum 0.13.0), features are saved in rows.",
+				Parameters::kDbSqlite3FeaturesBlob().c_str(), _version.c_str());
+	}
+	else if(_featuresBlob && _featuresBlobMigration)
+	{
+		this->migrateFeaturesToBlob();
+	}
+
 	return true;
 }
 void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & outputUrl)
@@ -414,6 +437,7 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 	{
 		int rc = SQLITE_OK;
 		// make sure that all statements are finalized
+		finalizeCachedStatements();
 		sqlite3_stmt * pStmt;
 		while( (pStmt = sqlite3_next_stmt(_ppDb, 0))!=0 )
 		{
@@ -452,6 +476,7 @@ void DBDriverSqlite3::disconnectDatabaseQuery(bool save, const std::string & out
 		UINFO("Disconnecting database %s...", this->getUrl().c_str());
 		sqlite3_close(_ppDb);
 		_ppDb = 0;
+		_featuresBlobTable = false;
 
 		if(save && !_dbInMemory && !outputUrl.empty() && !this->getUrl().empty() && outputUrl.compare(this->getUrl()) != 0)
 		{
@@ -835,6 +860,10 @@ long DBDriverSqlite3::getFeaturesMemoryUsedQuery() const
 		{
 			query = "SELECT sum(length(word_id) + length(pos_x) + length(pos_y) + length(size) + length(dir) + length(response) + length(octave) + length(depth_x) + length(depth_y) + length(depth_z) + length(descriptor_size) + length(descriptor)) "
 					 "FROM Feature";
+			if(_featuresBlobTable)
+			{
+				query = "SELECT coalesce((" + query + "), 0) + coalesce((SELECT sum(length(node_id) + length(count) + length(data)) FROM Feature_blob), 0)";
+			}
 		}
 		else if(uStrNumCmp(_version, "0.12.0") >= 0)
 		{
@@ -2183,6 +2212,10 @@ void DBDriverSqlite3::getAllNodeIdsQuery(std::set<int> & ids, bool ignoreChildre
 			if(uStrNumCmp(_version, "0.13.0") >= 0)
 			{
 				query << "WHERE id in (select node_id from Feature) ";
+				if(_featuresBlobTable)
+				{
+					query << "OR id in (select node_id from Feature_blob) ";
+				}
 			}
 			else
 			{
@@ -2397,7 +2430,12 @@ void DBDriverSqlite3::getInvertedIndexNiQuery(int nodeId, int & ni) const
 		{
 			query << "SELECT count(word_id) "
 				  << "FROM Feature "
-				  << "WHERE node_id=" << nodeId << ";";
+				  << "WHERE node_id=" << nodeId;
+			if(_featuresBlobTable)
+			{
+				query << " UNION ALL SELECT count FROM Feature_blob WHERE node_id=" << nodeId;
+			}
+			query << ";";
 		}
 		else
 		{
@@ -2416,6 +2454,12 @@ void DBDriverSqlite3::getInvertedIndexNiQuery(int nodeId, int & ni) const
 		{
 			ni = sqlite3_column_int(ppStmt, 0);
 			rc = sqlite3_step(ppStmt);
+			if(rc == SQLITE_ROW)
+			{
+				// features saved in the Feature_blob table
+				ni += sqlite3_column_int(ppStmt, 0);
+				rc = sqlite3_step(ppStmt);
+			}
 			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 		}
 		else
@@ -2536,7 +2580,7 @@ void DBDriverSqlite3::getWeightQuery(int nodeId, int & weight) const
 }
 
 //may be slower than the previous version but don't have a limit of words that can be loaded at the same time
-void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & nodes) const
+void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & nodes, bool features) const
 {
 	ULOGGER_DEBUG("count=%d", (int)ids.size());
 	if(_ppDb && ids.size())
@@ -2713,164 +2757,12 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 
 		ULOGGER_DEBUG("Time=%fs", timer.ticks());
 
-		// Prepare the query... Get the map from signature and visual words
-		std::stringstream query2;
-		if(uStrNumCmp(_version, "0.13.0") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Feature "
-					 "WHERE node_id = ? ";
-		}
-		else if(uStrNumCmp(_version, "0.12.0") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-		else if(uStrNumCmp(_version, "0.11.2") >= 0)
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-		else
-		{
-			query2 << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z "
-					 "FROM Map_Node_Word "
-					 "WHERE node_id = ? ";
-		}
-
-		query2 << " ORDER BY word_id"; // Needed for fast insertion below
-		query2 << ";";
-
-		rc = sqlite3_prepare_v2(_ppDb, query2.str().c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-		float nanFloat = std::numeric_limits<float>::quiet_NaN ();
-
-		for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+		if(features)
 		{
-			//ULOGGER_DEBUG("Loading words of %d...", (*iter)->id());
-			// bind id
-			rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-			int visualWordId = 0;
-			int descriptorSize = 0;
-			const void * descriptor = 0;
-			int dRealSize = 0;
-			cv::KeyPoint kpt;
-			std::multimap<int, cv::KeyPoint> visualWords;
-			std::multimap<int, cv::Point3f> visualWords3;
-			std::multimap<int, cv::Mat> descriptors;
-			cv::Point3f depth(0,0,0);
-
-			// Process the result if one
-			rc = sqlite3_step(ppStmt);
-			while(rc == SQLITE_ROW)
-			{
-				int index = 0;
-				visualWordId = sqlite3_column_int(ppStmt, index++);
-				kpt.pt.x = sqlite3_column_double(ppStmt, index++);
-				kpt.pt.y = sqlite3_column_double(ppStmt, index++);
-				kpt.size = sqlite3_column_int(ppStmt, index++);
-				kpt.angle = sqlite3_column_double(ppStmt, index++);
-				kpt.response = sqlite3_column_double(ppStmt, index++);
-				if(uStrNumCmp(_version, "0.12.0") >= 0)
-				{
-					kpt.octave = sqlite3_column_int(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.x = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.x = sqlite3_column_double(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.y = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.y = sqlite3_column_double(ppStmt, index++);
-				}
-
-				if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
-				{
-					depth.z = nanFloat;
-					++index;
-				}
-				else
-				{
-					depth.z = sqlite3_column_double(ppStmt, index++);
-				}
-
-				visualWords.insert(visualWords.end(), std::make_pair(visualWordId, kpt));
-				visualWords3.insert(visualWords3.end(), std::make_pair(visualWordId, depth));
-
-				if(uStrNumCmp(_version, "0.11.2") >= 0)
-				{
-					descriptorSize = sqlite3_column_int(ppStmt, index++); // VisualWord descriptor size
-					descriptor = sqlite3_column_blob(ppStmt, index); 	// VisualWord descriptor array
-					dRealSize = sqlite3_column_bytes(ppStmt, index++);
-
-					if(descriptor && descriptorSize>0 && dRealSize>0)
-					{
-						cv::Mat d;
-						if(dRealSize == descriptorSize)
-						{
-							// CV_8U binary descriptors
-							d = cv::Mat(1, descriptorSize, CV_8U);
-						}
-						else if(dRealSize/int(sizeof(float)) == descriptorSize)
-						{
-							// CV_32F
-							d = cv::Mat(1, descriptorSize, CV_32F);
-						}
-						else
-						{
-							UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
-						}
-
-						memcpy(d.data, descriptor, dRealSize);
-
-						descriptors.insert(descriptors.end(), std::make_pair(visualWordId, d));
-					}
-				}
-
-				rc = sqlite3_step(ppStmt);
-			}
-			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-			if(visualWords.size()==0)
-			{
-				UDEBUG("Empty signature detected! (id=%d)", (*iter)->id());
-			}
-			else
-			{
-				(*iter)->setWords(visualWords);
-				(*iter)->setWords3(visualWords3);
-				(*iter)->setWordsDescriptors(descriptors);
-				ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), (int)visualWords3.size(), (int)descriptors.size(), (*iter)->id());
-			}
-
-			//reset
-			rc = sqlite3_reset(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			this->loadFeaturesQuery(nodes);
+			ULOGGER_DEBUG("Time load features=%fs", timer.ticks());
 		}
 
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-		ULOGGER_DEBUG("Time=%fs", timer.ticks());
-
 		this->loadLinksQuery(nodes);
 		for(std::list<Signature*>::iterator iter = nodes.begin(); iter!=nodes.end(); ++iter)
 		{
@@ -3026,7 +2918,80 @@ void DBDriverSqlite3::loadSignaturesQuery(const std::list<int> & ids, std::list<
 	}
 }
 
-void DBDriverSqlite3::loadLastNodesQuery(std::list<Signature *> & nodes) const
+void DBDriverSqlite3::loadFeaturesQuery(std::list<Signature *> & nodes) const
+{
+	ULOGGER_DEBUG("count=%d", (int)nodes.size());
+	if(_ppDb && nodes.size())
+	{
+		UTimer timer;
+		int rc = SQLITE_OK;
+		sqlite3_stmt * ppStmt = 0;
+
+		// Get the map from signature and visual words
+		std::string query2 = queryFeaturesRows();
+		rc = sqlite3_prepare_v2(_ppDb, query2.c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		// Features saved in a single blob per node
+		sqlite3_stmt * ppStmtBlob = 0;
+		if(_featuresBlobTable)
+		{
+			rc = sqlite3_prepare_v2(_ppDb, "SELECT data FROM Feature_blob WHERE node_id = ?;", -1, &ppStmtBlob, 0);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+
+		for(std::list<Signature*>::const_iterator iter=nodes.begin(); iter!=nodes.end(); ++iter)
+		{
+			//ULOGGER_DEBUG("Loading words of %d...", (*iter)->id());
+			std::vector<int> visualWords;
+			std::vector<cv::KeyPoint> visualWordsKpts;
+			std::vector<cv::Point3f> visualWords3;
+			cv::Mat descriptors;
+
+			if(ppStmtBlob == 0 || !loadFeaturesBlob(ppStmtBlob, (*iter)->id(), visualWords, visualWordsKpts, visualWords3, descriptors))
+			{
+				// bind id
+				rc = sqlite3_bind_int(ppStmt, 1, (*iter)->id());
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+				loadFeaturesRows(ppStmt, visualWords, visualWordsKpts, visualWords3, descriptors);
+
+				//reset
+				rc = sqlite3_reset(ppStmt);
+				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			}
+
+			if(visualWords.size()==0)
+			{
+				UDEBUG("Empty signature detected! (id=%d)", (*iter)->id());
+			}
+			else
+			{
+				if(descriptors.rows && descriptors.rows != (int)visualWords.size())
+				{
+					UWARN("Node %d: only %d/%d words have a descriptor, descriptors are ignored.",
+							(*iter)->id(), descriptors.rows, (int)visualWords.size());
+					descriptors = cv::Mat();
+				}
+				(*iter)->setWords(visualWords, visualWordsKpts, visualWords3, descriptors);
+				ULOGGER_DEBUG("Add %d keypoints, %d 3d points and %d descriptors to node %d", (int)visualWords.size(), (int)visualWords3.size(), descriptors.rows, (*iter)->id());
+			}
+		}
+
+		// Finalize (delete) the statements
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		if(ppStmtBlob)
+		{
+			rc = sqlite3_finalize(ppStmtBlob);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+
+		ULOGGER_DEBUG("Time=%fs", timer.ticks());
+	}
+}
+
+void DBDriverSqlite3::loadLastNodesQuery(std::list<Signature *> & nodes, bool features) const
 {
 	ULOGGER_DEBUG("");
 	if(_ppDb)
@@ -3072,7 +3037,7 @@ void DBDriverSqlite3::loadLastNodesQuery(std::list<Signature *> & nodes) const
 		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		ULOGGER_DEBUG("Loading %d signatures...", ids.size());
-		this->loadSignaturesQuery(ids, nodes);
+		this->loadSignaturesQuery(ids, nodes, features);
 		ULOGGER_DEBUG("loaded=%d, Time=%fs", nodes.size(), timer.ticks());
 	}
 }
@@ -3130,18 +3095,23 @@ void DBDriverSqlite3::loadQuery(VWDictionary * dictionary) const
 			{
 				// CV_8U binary descriptors
 				d = cv::Mat(1, descriptorSize, CV_8U);
+				memcpy(d.data, descriptor, dRealSize);
+			}
+			else if(quantization::isQuantized(dRealSize, descriptorSize))
+			{
+				// CV_32F quantized on 8 bits
+				d = quantization::dequantize(cv::Mat(1, dRealSize, CV_8U, (void*)descriptor));
 			}
 			else if(dRealSize/int(sizeof(float)) == descriptorSize)
 			{
 				// CV_32F
 				d = cv::Mat(1, descriptorSize, CV_32F);
+				memcpy(d.data, descriptor, dRealSize);
 			}
 			else
 			{
 				UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
 			}
-
-			memcpy(d.data, descriptor, dRealSize);
 			VisualWord * vw = new VisualWord(id, d);
 			vw->setSaved(true);
 			dictionary->addWord(vw);
@@ -3210,18 +3180,23 @@ void DBDriverSqlite3::loadWordsQuery(const std::set<int> & wordIds, std::list<Vi
 				{
 					// CV_8U binary descriptors
 					d = cv::Mat(1, descriptorSize, CV_8U);
+					memcpy(d.data, descriptor, dRealSize);
+				}
+				else if(quantization::isQuantized(dRealSize, descriptorSize))
+				{
+					// CV_32F quantized on 8 bits
+					d = quantization::dequantize(cv::Mat(1, dRealSize, CV_8U, (void*)descriptor));
 				}
 				else if(dRealSize/int(sizeof(float)) == descriptorSize)
 				{
 					// CV_32F
 					d = cv::Mat(1, descriptorSize, CV_32F);
+					memcpy(d.data, descriptor, dRealSize);
 				}
 				else
 				{
 					UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
 				}
-
-				memcpy(d.data, descriptor, dRealSize);
 				VisualWord * vw = new VisualWord(*iter, d);
 				if(vw)
 				{
@@ -3259,142 +3234,207 @@ void DBDriverSqlite3::loadWordsQuery(const std::set<int> & wordIds, std::list<Vi
 	}
 }
 
-void DBDriverSqlite3::loadLinksQuery(
-		int signatureId,
-		std::map<int, Link> & neighbors,
-		Link::Type typeIn) const
+std::string DBDriverSqlite3::queryLinksColumns() const
 {
-	neighbors.clear();
-	if(_ppDb)
+	if(uStrNumCmp(_version, "0.13.0") >= 0)
 	{
-		UTimer timer;
-		timer.start();
-		int rc = SQLITE_OK;
-		sqlite3_stmt * ppStmt = 0;
-		std::stringstream query;
+		return "to_id, type, transform, information_matrix, user_data";
+	}
+	else if(uStrNumCmp(_version, "0.10.10") >= 0)
+	{
+		return "to_id, type, transform, rot_variance, trans_variance, user_data";
+	}
+	else if(uStrNumCmp(_version, "0.8.4") >= 0)
+	{
+		return "to_id, type, transform, rot_variance, trans_variance";
+	}
+	else if(uStrNumCmp(_version, "0.7.4") >= 0)
+	{
+		return "to_id, type, transform, variance";
+	}
+	return "to_id, type, transform";
+}
 
-		if(uStrNumCmp(_version, "0.13.0") >= 0)
+std::string DBDriverSqlite3::queryLinksTypeCondition(Link::Type typeIn) const
+{
+	std::stringstream query;
+	if(typeIn != Link::kUndef)
+	{
+		if(uStrNumCmp(_version, "0.7.4") >= 0)
 		{
-			query << "SELECT to_id, type, transform, information_matrix, user_data FROM Link ";
+			query << " AND type = " << typeIn;
 		}
-		else if(uStrNumCmp(_version, "0.10.10") >= 0)
+		else if(typeIn == Link::kNeighbor)
 		{
-			query << "SELECT to_id, type, transform, rot_variance, trans_variance, user_data FROM Link ";
+			query << " AND type = 0";
 		}
-		else if(uStrNumCmp(_version, "0.8.4") >= 0)
+		else if(typeIn > Link::kNeighbor)
 		{
-			query << "SELECT to_id, type, transform, rot_variance, trans_variance FROM Link ";
+			query << " AND type > 0";
 		}
-		else if(uStrNumCmp(_version, "0.7.4") >= 0)
+	}
+	return query.str();
+}
+
+// Columns from "index" are queryLinksColumns()
+Link DBDriverSqlite3::linkFromRow(sqlite3_stmt * ppStmt, int fromId, int index) const
+{
+	int toId = sqlite3_column_int(ppStmt, index++);
+	int type = sqlite3_column_int(ppStmt, index++);
+
+	const void * data = sqlite3_column_blob(ppStmt, index);
+	int dataSize = sqlite3_column_bytes(ppStmt, index++);
+
+	Transform transform;
+	if((unsigned int)dataSize == transform.size()*sizeof(float) && data)
+	{
+		memcpy(transform.data(), data, dataSize);
+		if(uStrNumCmp(_version, "0.15.2") < 0)
+		{
+			transform.normalizeRotation();
+		}
+	}
+	else if(dataSize)
+	{
+		UERROR("Error while loading link transform from %d to %d! Setting to null...", fromId, toId);
+	}
+
+	cv::Mat informationMatrix = cv::Mat::eye(6,6,CV_64FC1);
+	if(uStrNumCmp(_version, "0.8.4") >= 0)
+	{
+		if(uStrNumCmp(_version, "0.13.0") >= 0)
 		{
-			query << "SELECT to_id, type, transform, variance FROM Link ";
+			data = sqlite3_column_blob(ppStmt, index);
+			dataSize = sqlite3_column_bytes(ppStmt, index++);
+			UASSERT(dataSize==36*sizeof(double) && data);
+			informationMatrix = cv::Mat(6, 6, CV_64FC1, (void *)data).clone(); // information_matrix
 		}
 		else
 		{
-			query << "SELECT to_id, type, transform FROM Link ";
+			double rotVariance = sqlite3_column_double(ppStmt, index++);
+			double transVariance = sqlite3_column_double(ppStmt, index++);
+			UASSERT(rotVariance > 0.0 && transVariance>0.0);
+			informationMatrix.at<double>(0,0) = 1.0/transVariance;
+			informationMatrix.at<double>(1,1) = 1.0/transVariance;
+			informationMatrix.at<double>(2,2) = 1.0/transVariance;
+			informationMatrix.at<double>(3,3) = 1.0/rotVariance;
+			informationMatrix.at<double>(4,4) = 1.0/rotVariance;
+			informationMatrix.at<double>(5,5) = 1.0/rotVariance;
 		}
-		query << "WHERE from_id = " << signatureId;
-		if(typeIn != Link::kUndef)
+
+		cv::Mat userDataCompressed;
+		if(uStrNumCmp(_version, "0.10.10") >= 0)
 		{
-			if(uStrNumCmp(_version, "0.7.4") >= 0)
-			{
-				query << " AND type = " << typeIn;
-			}
-			else if(typeIn == Link::kNeighbor)
-			{
-				query << " AND type = 0";
-			}
-			else if(typeIn > Link::kNeighbor)
+			const void * data = sqlite3_column_blob(ppStmt, index);
+			dataSize = sqlite3_column_bytes(ppStmt, index++);
+			//Create the userData
+			if(dataSize>4 && data)
 			{
-				query << " AND type > 0";
+				userDataCompressed = cv::Mat(1, dataSize, CV_8UC1, (void *)data).clone(); // userData
 			}
 		}
+
+		return Link(fromId, toId, (Link::Type)type, transform, informationMatrix, userDataCompressed);
+	}
+	else if(uStrNumCmp(_version, "0.7.4") >= 0)
+	{
+		double variance = sqlite3_column_double(ppStmt, index++);
+		UASSERT(variance>0.0);
+		informationMatrix *= 1.0/variance;
+		return Link(fromId, toId, (Link::Type)type, transform, informationMatrix);
+	}
+	// neighbor is 0, loop closures are 1 and 2 (child)
+	return Link(fromId, toId, type==0?Link::kNeighbor:Link::kGlobalClosure, transform, informationMatrix);
+}
+
+void DBDriverSqlite3::loadLinksQuery(
+		int signatureId,
+		std::map<int, Link> & neighbors,
+		Link::Type typeIn) const
+{
+	neighbors.clear();
+	if(_ppDb)
+	{
+		UTimer timer;
+		timer.start();
+		int rc = SQLITE_OK;
+		sqlite3_stmt * ppStmt = 0;
+		std::stringstream query;
+
+		query << "SELECT " << queryLinksColumns() << " FROM Link ";
+		query << "WHERE from_id = " << signatureId;
+		query << queryLinksTypeCondition(typeIn);
 		query << " ORDER BY to_id";
 
 		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
 		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
-		int toId = -1;
-		int type = Link::kUndef;
-		const void * data = 0;
-		int dataSize = 0;
-
 		// Process the result if one
 		rc = sqlite3_step(ppStmt);
 		while(rc == SQLITE_ROW)
 		{
-			int index = 0;
+			Link link = linkFromRow(ppStmt, signatureId, 0);
+			neighbors.insert(neighbors.end(), std::make_pair(link.to(), link));
+			rc = sqlite3_step(ppStmt);
+		}
 
-			toId = sqlite3_column_int(ppStmt, index++);
-			type = sqlite3_column_int(ppStmt, index++);
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
-			data = sqlite3_column_blob(ppStmt, index);
-			dataSize = sqlite3_column_bytes(ppStmt, index++);
+		// Finalize (delete) the statement
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
-			Transform transform;
-			if((unsigned int)dataSize == transform.size()*sizeof(float) && data)
-			{
-				memcpy(transform.data(), data, dataSize);
-				if(uStrNumCmp(_version, "0.15.2") < 0)
-				{
-					transform.normalizeRotation();
-				}
-			}
-			else if(dataSize)
-			{
-				UERROR("Error while loading link transform from %d to %d! Setting to null...", signatureId, toId);
-			}
-
-			cv::Mat informationMatrix = cv::Mat::eye(6,6,CV_64FC1);
-			if(uStrNumCmp(_version, "0.8.4") >= 0)
-			{
-				if(uStrNumCmp(_version, "0.13.0") >= 0)
-				{
-					data = sqlite3_column_blob(ppStmt, index);
-					dataSize = sqlite3_column_bytes(ppStmt, index++);
-					UASSERT(dataSize==36*sizeof(double) && data);
-					informationMatrix = cv::Mat(6, 6, CV_64FC1, (void *)data).clone(); // information_matrix
-				}
-				else
-				{
-					double rotVariance = sqlite3_column_double(ppStmt, index++);
-					double transVariance = sqlite3_column_double(ppStmt, index++);
-					UASSERT(rotVariance > 0.0 && transVariance>0.0);
-					informationMatrix.at<double>(0,0) = 1.0/transVariance;
-					informationMatrix.at<double>(1,1) = 1.0/transVariance;
-					informationMatrix.at<double>(2,2) = 1.0/transVariance;
-					informationMatrix.at<double>(3,3) = 1.0/rotVariance;
-					informationMatrix.at<double>(4,4) = 1.0/rotVariance;
-					informationMatrix.at<double>(5,5) = 1.0/rotVariance;
-				}
+		if(neighbors.size() == 0)
+		{
+			//UERROR("No neighbors loaded from signature %d", signatureId);
+		}
+	}
+}
 
-				cv::Mat userDataCompressed;
-				if(uStrNumCmp(_version, "0.10.10") >= 0)
-				{
-					const void * data = sqlite3_column_blob(ppStmt, index);
-					dataSize = sqlite3_column_bytes(ppStmt, index++);
-					//Create the userData
-					if(dataSize>4 && data)
-					{
-						userDataCompressed = cv::Mat(1, dataSize, CV_8UC1, (void *)data).clone(); // userData
-					}
-				}
+void DBDriverSqlite3::loadLinksQuery(
+		const std::set<int> & signatureIds,
+		std::map<int, std::map<int, Link> > & links,
+		Link::Type typeIn) const
+{
+	if(_ppDb && signatureIds.size())
+	{
+		UTimer timer;
+		timer.start();
+		int rc = SQLITE_OK;
+		sqlite3_stmt * ppStmt = 0;
+		std::stringstream query;
 
-				neighbors.insert(neighbors.end(), std::make_pair(toId, Link(signatureId, toId, (Link::Type)type, transform, informationMatrix, userDataCompressed)));
-			}
-			else if(uStrNumCmp(_version, "0.7.4") >= 0)
-			{
-				double variance = sqlite3_column_double(ppStmt, index++);
-				UASSERT(variance>0.0);
-				informationMatrix *= 1.0/variance;
-				neighbors.insert(neighbors.end(), std::make_pair(toId, Link(signatureId, toId, (Link::Type)type, transform, informationMatrix)));
-			}
-			else
+		query << "SELECT from_id, " << queryLinksColumns() << " FROM Link ";
+		query << "WHERE from_id IN (";
+		for(std::set<int>::const_iterator iter=signatureIds.begin(); iter!=signatureIds.end(); ++iter)
+		{
+			if(iter != signatureIds.begin())
 			{
-				// neighbor is 0, loop closures are 1 and 2 (child)
-				neighbors.insert(neighbors.end(), std::make_pair(toId, Link(signatureId, toId, type==0?Link::kNeighbor:Link::kGlobalClosure, transform, informationMatrix)));
+				query << ",";
 			}
+			query << *iter;
+		}
+		query << ")";
+		query << queryLinksTypeCondition(typeIn);
+		query << " ORDER BY from_id, to_id";
+
+		rc = sqlite3_prepare_v2(_ppDb, query.str().c_str(), -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
+		// signatures without links are also returned
+		for(std::set<int>::const_iterator iter=signatureIds.begin(); iter!=signatureIds.end(); ++iter)
+		{
+			links[*iter].clear();
+		}
+
+		int totalLinksLoaded = 0;
+		rc = sqlite3_step(ppStmt);
+		while(rc == SQLITE_ROW)
+		{
+			int fromId = sqlite3_column_int(ppStmt, 0);
+			Link link = linkFromRow(ppStmt, fromId, 1);
+			links[fromId].insert(std::make_pair(link.to(), link));
+			++totalLinksLoaded;
 			rc = sqlite3_step(ppStmt);
 		}
 
@@ -3404,10 +3444,7 @@ void DBDriverSqlite3::loadLinksQuery(
 		rc = sqlite3_finalize(ppStmt);
 		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
-		if(neighbors.size() == 0)
-		{
-			//UERROR("No neighbors loaded from signature %d", signatureId);
-		}
+		UDEBUG("Time=%fs, nodes=%d, links=%d", timer.ticks(), (int)signatureIds.size(), totalLinksLoaded);
 	}
 }
 
@@ -3607,8 +3644,7 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				query = "UPDATE Node SET weight=? WHERE id=?;";
 			}
 		}
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		for(std::list<Signature *>::const_iterator i=nodes.begin(); i!=nodes.end(); ++i)
 		{
@@ -3644,16 +3680,12 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		ULOGGER_DEBUG("Update Node table, Time=%fs", timer.ticks());
 
 		// Update links part1
 		query = "DELETE FROM Link WHERE from_id=?;";
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->isLinksModified())
@@ -3668,35 +3700,26 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		// Update links part2
-		query = queryStepLink();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		std::vector<const Link *> links;
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->isLinksModified())
 			{
-				// Save links
-				const std::map<int, Link> & links = (*j)->getLinks();
-				for(std::map<int, Link>::const_iterator i=links.begin(); i!=links.end(); ++i)
+				const std::map<int, Link> & nodeLinks = (*j)->getLinks();
+				for(std::map<int, Link>::const_iterator i=nodeLinks.begin(); i!=nodeLinks.end(); ++i)
 				{
-					stepLink(ppStmt, i->second);
+					links.push_back(&i->second);
 				}
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		stepLinks(links);
 		ULOGGER_DEBUG("Update Neighbors Time=%fs", timer.ticks());
 
 		// Update word references
 		query = queryStepWordsChanged();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 		for(std::list<Signature *>::const_iterator j=nodes.begin(); j!=nodes.end(); ++j)
 		{
 			if((*j)->getWordsChanged().size())
@@ -3708,9 +3731,7 @@ void DBDriverSqlite3::updateQuery(const std::list<Signature *> & nodes, bool upd
 				}
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		updateFeaturesBlobsWords(nodes);
 
 		ULOGGER_DEBUG("signatures update=%fs", timer.ticks());
 	}
@@ -3728,8 +3749,7 @@ void DBDriverSqlite3::updateQuery(const std::list<VisualWord *> & words, bool up
 		VisualWord * w = 0;
 
 		std::string query = "UPDATE Word SET time_enter = DATETIME('NOW') WHERE id=?;";
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		for(std::list<VisualWord *>::const_iterator i=words.begin(); i!=words.end(); ++i)
 		{
@@ -3748,9 +3768,6 @@ void DBDriverSqlite3::updateQuery(const std::list<VisualWord *> & words, bool up
 			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		ULOGGER_DEBUG("Update Word table, Time=%fs", timer.ticks());
 	}
@@ -3764,13 +3781,11 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Signature table
 		std::string query = queryStepNode();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 		{
@@ -3782,75 +3797,40 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 
 			stepNode(ppStmt, *i);
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		UDEBUG("Time=%fs", timer.ticks());
 
 		// Create new entries in table Link
-		query = queryStepLink();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		std::vector<const Link *> links;
 		for(std::list<Signature *>::const_iterator jter=signatures.begin(); jter!=signatures.end(); ++jter)
 		{
-			// Save links
-			const std::map<int, Link> & links = (*jter)->getLinks();
-			for(std::map<int, Link>::const_iterator i=links.begin(); i!=links.end(); ++i)
+			const std::map<int, Link> & nodeLinks = (*jter)->getLinks();
+			for(std::map<int, Link>::const_iterator i=nodeLinks.begin(); i!=nodeLinks.end(); ++i)
 			{
-				stepLink(ppStmt, i->second);
+				links.push_back(&i->second);
 			}
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		stepLinks(links);
 
 		UDEBUG("Time=%fs", timer.ticks());
 
 
-		// Create new entries in table Feature
-		query = queryStepKeypoint();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-		for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
+		// Create new entries in table Feature (or Feature_blob)
+		if(_featuresBlob && uStrNumCmp(_version, "0.13.0") >= 0)
 		{
-			UASSERT((*i)->getWords3().empty() || (*i)->getWords().size() == (*i)->getWords3().size());
-			UASSERT((*i)->getWordsDescriptors().empty() || (*i)->getWords().size() == (*i)->getWordsDescriptors().size());
-
-			std::multimap<int, cv::Point3f>::const_iterator p=(*i)->getWords3().begin();
-			std::multimap<int, cv::Mat>::const_iterator d=(*i)->getWordsDescriptors().begin();
-			for(std::multimap<int, cv::KeyPoint>::const_iterator w=(*i)->getWords().begin(); w!=(*i)->getWords().end(); ++w)
-			{
-				cv::Point3f pt(0,0,0);
-				if(p!=(*i)->getWords3().end())
-				{
-					UASSERT(w->first == p->first); // must be same id!
-					pt = p->second;
-					++p;
-				}
-
-				cv::Mat descriptor;
-				if(d!=(*i)->getWordsDescriptors().end())
-				{
-					UASSERT(w->first == d->first); // must be same id!
-					descriptor = d->second;
-					++d;
-				}
-
-				stepKeypoint(ppStmt, (*i)->id(), w->first, w->second, pt, descriptor);
-			}
+			stepFeaturesBlobs(signatures);
+		}
+		else
+		{
+			stepKeypoints(signatures);
 		}
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 		UDEBUG("Time=%fs", timer.ticks());
 
 		if(uStrNumCmp(_version, "0.10.0") >= 0)
 		{
 			// Add SensorData
 			query = queryStepSensorData();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareCachedStatement(query);
 			UDEBUG("Saving %d images", signatures.size());
 
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
@@ -3867,17 +3847,13 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 				}
 			}
 
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			UDEBUG("Time=%fs", timer.ticks());
 		}
 		else
 		{
 			// Add images
 			query = queryStepImage();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareCachedStatement(query);
 			UDEBUG("Saving %d images", signatures.size());
 
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
@@ -3888,15 +3864,11 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 				}
 			}
 
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 			UDEBUG("Time=%fs", timer.ticks());
 
 			// Add depths
 			query = queryStepDepth();
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareCachedStatement(query);
 			for(std::list<Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 			{
 				//metric
@@ -3906,9 +3878,6 @@ void DBDriverSqlite3::saveQuery(const std::list<Signature *> & signatures)
 					stepDepth(ppStmt, (*i)->sensorData());
 				}
 			}
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 		}
 
 		UDEBUG("Time=%fs", timer.ticks());
@@ -3931,8 +3900,7 @@ void DBDriverSqlite3::saveQuery(const std::list<VisualWord *> & words) const
 		if(words.size()>0)
 		{
 			query = std::string("INSERT INTO Word(id, descriptor_size, descriptor) VALUES(?,?,?);");
-			rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+			ppStmt = prepareCachedStatement(query);
 			for(std::list<VisualWord *>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
 			{
 				const VisualWord * w = *iter;
@@ -3944,7 +3912,14 @@ void DBDriverSqlite3::saveQuery(const std::list<VisualWord *> & words) const
 					rc = sqlite3_bind_int(ppStmt, 2, w->getDescriptor().cols);
 					UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 					UASSERT(w->getDescriptor().type() == CV_32F || w->getDescriptor().type() == CV_8U);
-					if(w->getDescriptor().type() == CV_32F)
+					cv::Mat quantized; // should stay valid until the query is executed
+					if(w->getDescriptor().type() == CV_32F && _wordsQuantized)
+					{
+						// CV_32F quantized on 8 bits
+						quantized = quantization::quantize(w->getDescriptor());
+						rc = sqlite3_bind_blob(ppStmt, 3, quantized.data, quantized.cols, SQLITE_STATIC);
+					}
+					else if(w->getDescriptor().type() == CV_32F)
 					{
 						// CV_32F
 						rc = sqlite3_bind_blob(ppStmt, 3, w->getDescriptor().data, w->getDescriptor().cols*sizeof(float), SQLITE_STATIC);
@@ -3964,9 +3939,6 @@ void DBDriverSqlite3::saveQuery(const std::list<VisualWord *> & words) const
 					UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 				}
 			}
-			// Finalize (delete) the statement
-			rc = sqlite3_finalize(ppStmt);
-			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 		}
 
 		UDEBUG("Time=%fs", timer.ticks());
@@ -3981,20 +3953,15 @@ void DBDriverSqlite3::addLinkQuery(const Link & link) const
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Create new entries in table Link
 		std::string query = queryStepLink();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		// Save link
 		stepLink(ppStmt, link);
 
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		UDEBUG("Time=%fs", timer.ticks());
 	}
@@ -4009,20 +3976,15 @@ void DBDriverSqlite3::updateLinkQuery(const Link & link) const
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Create new entries in table Link
 		std::string query = queryStepLinkUpdate();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		// Save link
 		stepLink(ppStmt, link);
 
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		UDEBUG("Time=%fs", timer.ticks());
 	}
@@ -4042,13 +4004,11 @@ void DBDriverSqlite3::updateOccupancyGridQuery(
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Create query
 		std::string query = queryStepOccupancyGridUpdate();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		// Save occupancy grid
 		stepOccupancyGridUpdate(ppStmt,
@@ -4059,9 +4019,6 @@ void DBDriverSqlite3::updateOccupancyGridQuery(
 				cellSize,
 				viewpoint);
 
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		UDEBUG("Time=%fs", timer.ticks());
 	}
@@ -4077,22 +4034,17 @@ void DBDriverSqlite3::updateDepthImageQuery(
 		std::string type;
 		UTimer timer;
 		timer.start();
-		int rc = SQLITE_OK;
 		sqlite3_stmt * ppStmt = 0;
 
 		// Create query
 		std::string query = queryStepDepthUpdate();
-		rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		ppStmt = prepareCachedStatement(query);
 
 		// Save depth
 		stepDepthUpdate(ppStmt,
 				nodeId,
 				image);
 
-		// Finalize (delete) the statement
-		rc = sqlite3_finalize(ppStmt);
-		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 		UDEBUG("Time=%fs", timer.ticks());
 	}
@@ -5543,9 +5495,22 @@ void DBDriverSqlite3::stepLink(
 		return;
 	}
 
-	int rc = SQLITE_OK;
 	int index = 1;
-	rc = sqlite3_bind_int(ppStmt, index++, link.type());
+	bindLink(ppStmt, index, link);
+
+	int rc=sqlite3_step(ppStmt);
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc=sqlite3_reset(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+
+void DBDriverSqlite3::bindLink(
+		sqlite3_stmt * ppStmt,
+		int & index,
+		const Link & link) const
+{
+	int rc = sqlite3_bind_int(ppStmt, index++, link.type());
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 
 	if(uStrNumCmp(_version, "0.13.0") >= 0)
@@ -5588,12 +5553,6 @@ void DBDriverSqlite3::stepLink(
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	rc = sqlite3_bind_int(ppStmt, index++, link.to());
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-	rc=sqlite3_step(ppStmt);
-	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-	rc=sqlite3_reset(ppStmt);
-	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 }
 
 std::string DBDriverSqlite3::queryStepWordsChanged() const
@@ -5629,6 +5588,489 @@ void DBDriverSqlite3::stepWordsChanged(sqlite3_stmt * ppStmt, int nodeId, int ol
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 }
 
+std::string DBDriverSqlite3::queryFeaturesRows() const
+{
+	std::stringstream query;
+	if(uStrNumCmp(_version, "0.13.0") >= 0)
+	{
+		query << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Feature "
+				 "WHERE node_id = ? ";
+	}
+	else if(uStrNumCmp(_version, "0.12.0") >= 0)
+	{
+		query << "SELECT word_id, pos_x, pos_y, size, dir, response, octave, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+	else if(uStrNumCmp(_version, "0.11.2") >= 0)
+	{
+		query << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z, descriptor_size, descriptor "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+	else
+	{
+		query << "SELECT word_id, pos_x, pos_y, size, dir, response, depth_x, depth_y, depth_z "
+				 "FROM Map_Node_Word "
+				 "WHERE node_id = ? ";
+	}
+
+	query << " ORDER BY word_id"; // Needed for fast insertion below
+	query << ";";
+	return query.str();
+}
+
+void DBDriverSqlite3::loadFeaturesRows(
+		sqlite3_stmt * ppStmt,
+		std::vector<int> & visualWords,
+		std::vector<cv::KeyPoint> & visualWordsKpts,
+		std::vector<cv::Point3f> & visualWords3,
+		cv::Mat & descriptors) const
+{
+	float nanFloat = std::numeric_limits<float>::quiet_NaN ();
+	int visualWordId = 0;
+	int descriptorSize = 0;
+	const void * descriptor = 0;
+	int dRealSize = 0;
+	cv::KeyPoint kpt;
+	cv::Point3f depth(0,0,0);
+
+	// Process the result if one
+	int rc = sqlite3_step(ppStmt);
+	while(rc == SQLITE_ROW)
+	{
+		int index = 0;
+		visualWordId = sqlite3_column_int(ppStmt, index++);
+		kpt.pt.x = sqlite3_column_double(ppStmt, index++);
+		kpt.pt.y = sqlite3_column_double(ppStmt, index++);
+		kpt.size = sqlite3_column_int(ppStmt, index++);
+		kpt.angle = sqlite3_column_double(ppStmt, index++);
+		kpt.response = sqlite3_column_double(ppStmt, index++);
+		if(uStrNumCmp(_version, "0.12.0") >= 0)
+		{
+			kpt.octave = sqlite3_column_int(ppStmt, index++);
+		}
+
+		if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+		{
+			depth.x = nanFloat;
+			++index;
+		}
+		else
+		{
+			depth.x = sqlite3_column_double(ppStmt, index++);
+		}
+
+		if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+		{
+			depth.y = nanFloat;
+			++index;
+		}
+		else
+		{
+			depth.y = sqlite3_column_double(ppStmt, index++);
+		}
+
+		if(sqlite3_column_type(ppStmt, index) == SQLITE_NULL)
+		{
+			depth.z = nanFloat;
+			++index;
+		}
+		else
+		{
+			depth.z = sqlite3_column_double(ppStmt, index++);
+		}
+
+		visualWords.push_back(visualWordId);
+		visualWordsKpts.push_back(kpt);
+		visualWords3.push_back(depth);
+
+		if(uStrNumCmp(_version, "0.11.2") >= 0)
+		{
+			descriptorSize = sqlite3_column_int(ppStmt, index++); // VisualWord descriptor size
+			descriptor = sqlite3_column_blob(ppStmt, index); 	// VisualWord descriptor array
+			dRealSize = sqlite3_column_bytes(ppStmt, index++);
+
+			if(descriptor && descriptorSize>0 && dRealSize>0)
+			{
+				// header on the blob, copied in the flat descriptors
+				cv::Mat d;
+				if(dRealSize == descriptorSize)
+				{
+					// CV_8U binary descriptors
+					d = cv::Mat(1, descriptorSize, CV_8U, (void *)descriptor);
+				}
+				else if(dRealSize/int(sizeof(float)) == descriptorSize)
+				{
+					// CV_32F
+					d = cv::Mat(1, descriptorSize, CV_32F, (void *)descriptor);
+				}
+				else
+				{
+					UFATAL("Saved buffer size (%d bytes) is not the same as descriptor size (%d)", dRealSize, descriptorSize);
+				}
+
+				descriptors.push_back(d);
+			}
+		}
+
+		rc = sqlite3_step(ppStmt);
+	}
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+
+// Features of a node saved in a single blob (Feature_blob table). The
+// columns are stored one after the other, sorted by word id like the
+// rows of the Feature table, then compressed with compressData2():
+//   int32 version, count, descriptor cols, descriptor type
+//   int32 word_id[count]
+//   float32 pos_x[count], pos_y[count], size[count], dir[count], response[count]
+//   int32 octave[count]
+//   float32 depth_x[count], depth_y[count], depth_z[count]
+//   descriptors[count][descriptor cols] (CV_8U or CV_32F)
+#define FEATURES_BLOB_VERSION 1
+#define FEATURES_BLOB_HEADER_SIZE 4
+
+static size_t featuresBlobSize(int count, int descriptorCols, int descriptorType)
+{
+	size_t descriptorBytes = descriptorCols * (descriptorType == CV_32F?sizeof(float):sizeof(unsigned char));
+	return FEATURES_BLOB_HEADER_SIZE*sizeof(int) + count * (2*sizeof(int) + 8*sizeof(float) + descriptorBytes);
+}
+
+static cv::Mat serializeFeaturesBlob(
+		const std::vector<int> & wordIds,
+		const std::vector<cv::KeyPoint> & kpts,
+		const std::vector<cv::Point3f> & pts,
+		const cv::Mat & descriptors)
+{
+	int count = (int)wordIds.size();
+	UASSERT((int)kpts.size() == count);
+	UASSERT(pts.empty() || (int)pts.size() == count);
+	UASSERT(descriptors.empty() || descriptors.rows == count);
+	UASSERT(descriptors.empty() || descriptors.type() == CV_32F || descriptors.type() == CV_8U);
+
+	// <word id, index>, sorted by word id then by index
+	std::vector<std::pair<int, int> > order(count);
+	for(int i=0; i<count; ++i)
+	{
+		order[i] = std::make_pair(wordIds[i], i);
+	}
+	std::sort(order.begin(), order.end());
+
+	int descriptorCols = descriptors.empty()?0:descriptors.cols;
+	int descriptorType = descriptors.empty()?CV_8U:descriptors.type();
+	size_t descriptorBytes = descriptorCols * descriptors.elemSize();
+	cv::Mat data(1, (int)featuresBlobSize(count, descriptorCols, descriptorType), CV_8UC1);
+
+	int * header = (int*)data.data;
+	header[0] = FEATURES_BLOB_VERSION;
+	header[1] = count;
+	header[2] = descriptorCols;
+	header[3] = descriptorType;
+	int * ids = header + FEATURES_BLOB_HEADER_SIZE;
+	float * posX = (float*)(ids + count);
+	float * posY = posX + count;
+	float * size = posY + count;
+	float * dir = size + count;
+	float * response = dir + count;
+	int * octave = (int*)(response + count);
+	float * depthX = (float*)(octave + count);
+	float * depthY = depthX + count;
+	float * depthZ = depthY + count;
+	unsigned char * descriptorsData = (unsigned char *)(depthZ + count);
+	for(int i=0; i<count; ++i)
+	{
+		int j = order[i].second;
+		ids[i] = wordIds[j];
+		posX[i] = kpts[j].pt.x;
+		posY[i] = kpts[j].pt.y;
+		size[i] = kpts[j].size;
+		dir[i] = kpts[j].angle;
+		response[i] = kpts[j].response;
+		octave[i] = kpts[j].octave;
+		cv::Point3f pt(0,0,0);
+		if(!pts.empty())
+		{
+			pt = pts[j];
+		}
+		depthX[i] = pt.x;
+		depthY[i] = pt.y;
+		depthZ[i] = pt.z;
+		if(descriptorCols)
+		{
+			memcpy(descriptorsData + i*descriptorBytes, descriptors.ptr(j), descriptorBytes);
+		}
+	}
+	return compressData2(data);
+}
+
+static void deserializeFeaturesBlob(
+		const cv::Mat & data,
+		std::vector<int> & wordIds,
+		std::vector<cv::KeyPoint> & kpts,
+		std::vector<cv::Point3f> & pts,
+		cv::Mat & descriptors)
+{
+	size_t bytes = data.total()*data.elemSize();
+	UASSERT(bytes >= FEATURES_BLOB_HEADER_SIZE*sizeof(int));
+	const int * header = (const int*)data.data;
+	UASSERT_MSG(header[0] == FEATURES_BLOB_VERSION, uFormat("Features blob version %d is not supported", header[0]).c_str());
+	int count = header[1];
+	int descriptorCols = header[2];
+	int descriptorType = header[3];
+	UASSERT(count >= 0 && descriptorCols >= 0 && (descriptorType == CV_32F || descriptorType == CV_8U));
+	UASSERT_MSG(bytes == featuresBlobSize(count, descriptorCols, descriptorType),
+			uFormat("Features blob size (%d bytes) doesn't match %d features with %d descriptor columns", (int)bytes, count, descriptorCols).c_str());
+
+	const int * ids = header + FEATURES_BLOB_HEADER_SIZE;
+	const float * posX = (const float*)(ids + count);
+	const float * posY = posX + count;
+	const float * size = posY + count;
+	const float * dir = size + count;
+	const float * response = dir + count;
+	const int * octave = (const int*)(response + count);
+	const float * depthX = (const float*)(octave + count);
+	const float * depthY = depthX + count;
+	const float * depthZ = depthY + count;
+	const unsigned char * descriptorsData = (const unsigned char *)(depthZ + count);
+
+	wordIds.assign(ids, ids+count);
+	kpts.resize(count);
+	pts.resize(count);
+	for(int i=0; i<count; ++i)
+	{
+		kpts[i] = cv::KeyPoint(posX[i], posY[i], size[i], dir[i], response[i], octave[i]);
+		pts[i] = cv::Point3f(depthX[i], depthY[i], depthZ[i]);
+	}
+	if(descriptorCols && count)
+	{
+		descriptors = cv::Mat(count, descriptorCols, descriptorType);
+		memcpy(descriptors.data, descriptorsData, descriptors.total()*descriptors.elemSize());
+	}
+	else
+	{
+		descriptors = cv::Mat();
+	}
+}
+
+bool DBDriverSqlite3::hasTable(const std::string & table) const
+{
+	bool found = false;
+	if(_ppDb)
+	{
+		sqlite3_stmt * ppStmt = 0;
+		int rc = sqlite3_prepare_v2(_ppDb, "SELECT count(*) FROM sqlite_master WHERE type='table' AND name=?;", -1, &ppStmt, 0);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_bind_text(ppStmt, 1, table.c_str(), -1, SQLITE_STATIC);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_step(ppStmt);
+		if(rc == SQLITE_ROW)
+		{
+			found = sqlite3_column_int(ppStmt, 0) > 0;
+			rc = sqlite3_step(ppStmt);
+		}
+		UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		rc = sqlite3_finalize(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	}
+	return found;
+}
+
+void DBDriverSqlite3::createFeaturesBlobTable() const
+{
+	if(!_featuresBlobTable)
+	{
+		UASSERT(uStrNumCmp(_version, "0.13.0") >= 0);
+		UINFO("Creating Feature_blob table");
+		this->executeNoResultQuery(
+				"CREATE TABLE IF NOT EXISTS Feature_blob ("
+				"node_id INTEGER NOT NULL, "
+				"count INTEGER NOT NULL, "
+				"data BLOB NOT NULL, " // compressed features, see serializeFeaturesBlob()
+				"PRIMARY KEY (node_id));");
+		_featuresBlobTable = true;
+	}
+}
+
+bool DBDriverSqlite3::loadFeaturesBlob(
+		sqlite3_stmt * ppStmt,
+		int nodeId,
+		std::vector<int> & visualWords,
+		std::vector<cv::KeyPoint> & visualWordsKpts,
+		std::vector<cv::Point3f> & visualWords3,
+		cv::Mat & descriptors) const
+{
+	int rc = sqlite3_bind_int(ppStmt, 1, nodeId);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	bool found = false;
+	rc = sqlite3_step(ppStmt);
+	if(rc == SQLITE_ROW)
+	{
+		const void * data = sqlite3_column_blob(ppStmt, 0);
+		int dataSize = sqlite3_column_bytes(ppStmt, 0);
+		if(data && dataSize)
+		{
+			deserializeFeaturesBlob(uncompressData((const unsigned char *)data, dataSize), visualWords, visualWordsKpts, visualWords3, descriptors);
+		}
+		found = true;
+		rc = sqlite3_step(ppStmt);
+	}
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc = sqlite3_reset(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	return found;
+}
+
+void DBDriverSqlite3::stepFeaturesBlob(
+		sqlite3_stmt * ppStmt,
+		int nodeId,
+		const std::vector<int> & wordIds,
+		const std::vector<cv::KeyPoint> & kpts,
+		const std::vector<cv::Point3f> & pts,
+		const cv::Mat & descriptors) const
+{
+	cv::Mat blob = serializeFeaturesBlob(wordIds, kpts, pts, descriptors);
+
+	int index = 1;
+	int rc = sqlite3_bind_int(ppStmt, index++, (int)wordIds.size());
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_bind_blob(ppStmt, index++, blob.data, (int)blob.total(), SQLITE_STATIC);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_bind_int(ppStmt, index++, nodeId);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc=sqlite3_step(ppStmt);
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc = sqlite3_reset(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+
+void DBDriverSqlite3::stepFeaturesBlobs(const std::list<Signature *> & signatures) const
+{
+	createFeaturesBlobTable();
+	// node_id is at the end to match the update query
+	sqlite3_stmt * ppStmt = prepareCachedStatement("INSERT INTO Feature_blob(count, data, node_id) VALUES(?,?,?);");
+	for(std::list<Signature *>::const_iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const Signature * s = *iter;
+		if(s->getWordIds().size())
+		{
+			stepFeaturesBlob(ppStmt, s->id(), s->getWordIds(), s->getWordsKpts(), s->getWords3Pts(), s->getWordsDescriptorsMat());
+		}
+	}
+}
+
+void DBDriverSqlite3::updateFeaturesBlobsWords(const std::list<Signature *> & signatures) const
+{
+	if(!_featuresBlobTable)
+	{
+		return;
+	}
+	sqlite3_stmt * ppStmtSelect = 0;
+	sqlite3_stmt * ppStmtUpdate = 0;
+	for(std::list<Signature *>::const_iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const std::map<int, int> & wordsChanged = (*iter)->getWordsChanged();
+		if(wordsChanged.size())
+		{
+			if(ppStmtSelect == 0)
+			{
+				ppStmtSelect = prepareCachedStatement("SELECT data FROM Feature_blob WHERE node_id = ?;");
+				ppStmtUpdate = prepareCachedStatement("UPDATE Feature_blob SET count=?, data=? WHERE node_id = ?;");
+			}
+
+			std::vector<int> wordIds;
+			std::vector<cv::KeyPoint> kpts;
+			std::vector<cv::Point3f> pts;
+			cv::Mat descriptors;
+			if(loadFeaturesBlob(ppStmtSelect, (*iter)->id(), wordIds, kpts, pts, descriptors))
+			{
+				for(unsigned int i=0; i<wordIds.size(); ++i)
+				{
+					std::map<int, int>::const_iterator jter = wordsChanged.find(wordIds[i]);
+					if(jter != wordsChanged.end())
+					{
+						wordIds[i] = jter->second;
+					}
+				}
+				stepFeaturesBlob(ppStmtUpdate, (*iter)->id(), wordIds, kpts, pts, descriptors);
+			}
+		}
+	}
+}
+
+void DBDriverSqlite3::migrateFeaturesToBlob() const
+{
+	if(uStrNumCmp(_version, "0.13.0") < 0)
+	{
+		UWARN("Features cannot be migrated to Feature_blob table for database version %s (minimum 0.13.0).", _version.c_str());
+		return;
+	}
+
+	UTimer timer;
+	int rc = SQLITE_OK;
+	sqlite3_stmt * ppStmt = 0;
+
+	// Nodes with features in the Feature table
+	std::list<int> ids;
+	rc = sqlite3_prepare_v2(_ppDb, "SELECT DISTINCT node_id FROM Feature;", -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_step(ppStmt);
+	while(rc == SQLITE_ROW)
+	{
+		ids.push_back(sqlite3_column_int(ppStmt, 0));
+		rc = sqlite3_step(ppStmt);
+	}
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	rc = sqlite3_finalize(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	if(ids.empty())
+	{
+		return;
+	}
+
+	UINFO("Migrating features of %d nodes to Feature_blob table...", (int)ids.size());
+	this->executeNoResultQuery("BEGIN TRANSACTION;");
+	createFeaturesBlobTable();
+
+	rc = sqlite3_prepare_v2(_ppDb, queryFeaturesRows().c_str(), -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	sqlite3_stmt * ppStmtInsert = prepareCachedStatement("INSERT INTO Feature_blob(count, data, node_id) VALUES(?,?,?);");
+	for(std::list<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		rc = sqlite3_bind_int(ppStmt, 1, *iter);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		std::vector<int> wordIds;
+		std::vector<cv::KeyPoint> kpts;
+		std::vector<cv::Point3f> pts;
+		cv::Mat descriptors;
+		loadFeaturesRows(ppStmt, wordIds, kpts, pts, descriptors);
+
+		rc = sqlite3_reset(ppStmt);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+		if(descriptors.rows && descriptors.rows != (int)wordIds.size())
+		{
+			UWARN("Node %d: only %d/%d words have a descriptor, descriptors are ignored.",
+					*iter, descriptors.rows, (int)wordIds.size());
+			descriptors = cv::Mat();
+		}
+		stepFeaturesBlob(ppStmtInsert, *iter, wordIds, kpts, pts, descriptors);
+	}
+	rc = sqlite3_finalize(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	this->executeNoResultQuery("DELETE FROM Feature;");
+	this->executeNoResultQuery("COMMIT;");
+	UINFO("Migrated features of %d nodes to Feature_blob table (%fs)", (int)ids.size(), timer.ticks());
+}
+
 std::string DBDriverSqlite3::queryStepKeypoint() const
 {
 	if(uStrNumCmp(_version, "0.13.0") >= 0)
@@ -5656,9 +6098,25 @@ void DBDriverSqlite3::stepKeypoint(sqlite3_stmt * ppStmt,
 	{
 		UFATAL("");
 	}
-	int rc = SQLITE_OK;
 	int index = 1;
-	rc = sqlite3_bind_int(ppStmt, index++, nodeId);
+	bindKeypoint(ppStmt, index, nodeId, wordId, kp, pt, descriptor);
+
+	int rc=sqlite3_step(ppStmt);
+	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+	rc = sqlite3_reset(ppStmt);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+}
+
+void DBDriverSqlite3::bindKeypoint(sqlite3_stmt * ppStmt,
+		int & index,
+		int nodeId,
+		int wordId,
+		const cv::KeyPoint & kp,
+		const cv::Point3f & pt,
+		const cv::Mat & descriptor) const
+{
+	int rc = sqlite3_bind_int(ppStmt, index++, nodeId);
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	rc = sqlite3_bind_int(ppStmt, index++, wordId);
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
@@ -5736,12 +6194,6 @@ void DBDriverSqlite3::stepKeypoint(sqlite3_stmt * ppStmt,
 		}
 		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 	}
-
-	rc=sqlite3_step(ppStmt);
-	UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
-
-	rc = sqlite3_reset(ppStmt);
-	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 }
 
 std::string DBDriverSqlite3::queryStepOccupancyGridUpdate() const
@@ -5847,4 +6299,199 @@ void DBDriverSqlite3::stepOccupancyGridUpdate(sqlite3_stmt * ppStmt,
 	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
 }
 
+sqlite3_stmt * DBDriverSqlite3::prepareCachedStatement(const std::string & query) const
+{
+	UASSERT(_ppDb);
+	std::map<std::string, sqlite3_stmt *>::iterator iter = _cachedStatements.find(query);
+	if(iter != _cachedStatements.end())
+	{
+		// already reset after its last step, remove the bindings of the previous query
+		int rc = sqlite3_clear_bindings(iter->second);
+		UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		return iter->second;
+	}
+
+	sqlite3_stmt * ppStmt = 0;
+	int rc = sqlite3_prepare_v2(_ppDb, query.c_str(), -1, &ppStmt, 0);
+	UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+	_cachedStatements.insert(std::make_pair(query, ppStmt));
+	return ppStmt;
+}
+
+void DBDriverSqlite3::finalizeCachedStatements() const
+{
+	for(std::map<std::string, sqlite3_stmt *>::iterator iter=_cachedStatements.begin(); iter!=_cachedStatements.end(); ++iter)
+	{
+		int rc = sqlite3_finalize(iter->second);
+		if(rc != SQLITE_OK)
+		{
+			UERROR("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb));
+		}
+	}
+	_cachedStatements.clear();
+}
+
+int DBDriverSqlite3::maxRowsPerInsert(const std::string & query) const
+{
+	// multi-row VALUES are supported since SQLite 3.7.11
+	if(sqlite3_libversion_number() < 3007011)
+	{
+		return 1;
+	}
+	int columns = (int)std::count(query.begin(), query.end(), '?');
+	UASSERT(columns > 0);
+	int maxVariables = sqlite3_limit(_ppDb, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+	int rows = maxVariables / columns;
+	if(rows > DB_MAX_ROWS_PER_INSERT)
+	{
+		rows = DB_MAX_ROWS_PER_INSERT;
+	}
+	return rows>1?rows:1;
+}
+
+std::string DBDriverSqlite3::queryMultiRows(const std::string & query, int rows) const
+{
+	// "INSERT INTO Table(a, b) VALUES(?,?);" -> "INSERT INTO Table(a, b) VALUES(?,?),(?,?),...;"
+	size_t start = query.find("VALUES(");
+	size_t end = query.rfind(')');
+	UASSERT_MSG(start != std::string::npos && end != std::string::npos && end > start, query.c_str());
+	start += 6;
+	std::string values = query.substr(start, end+1-start);
+	std::string multi = query.substr(0, end+1);
+	multi.reserve(query.size() + (rows-1)*(values.size()+1));
+	for(int i=1; i<rows; ++i)
+	{
+		multi += ",";
+		multi += values;
+	}
+	multi += query.substr(end+1);
+	return multi;
+}
+
+void DBDriverSqlite3::stepLinks(const std::vector<const Link *> & links) const
+{
+	// Don't save virtual links
+	std::vector<const Link *> toSave;
+	toSave.reserve(links.size());
+	for(unsigned int i=0; i<links.size(); ++i)
+	{
+		if(links[i]->type() != Link::kVirtualClosure)
+		{
+			toSave.push_back(links[i]);
+		}
+	}
+	if(toSave.empty())
+	{
+		return;
+	}
+
+	std::string query = queryStepLink();
+	int rows = maxRowsPerInsert(query);
+	unsigned int i=0;
+	if(rows > 1 && (int)toSave.size() >= rows)
+	{
+		sqlite3_stmt * ppStmt = prepareCachedStatement(queryMultiRows(query, rows));
+		for(; i+rows <= toSave.size(); i+=rows)
+		{
+			int index = 1;
+			for(int j=0; j<rows; ++j)
+			{
+				bindLink(ppStmt, index, *toSave[i+j]);
+			}
+
+			int rc=sqlite3_step(ppStmt);
+			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+			rc=sqlite3_reset(ppStmt);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+	}
+
+	// remaining links
+	if(i < toSave.size())
+	{
+		sqlite3_stmt * ppStmt = prepareCachedStatement(query);
+		for(; i<toSave.size(); ++i)
+		{
+			stepLink(ppStmt, *toSave[i]);
+		}
+	}
+}
+
+// 3D point and descriptor of the word at index w of a signature
+static void wordPointAndDescriptor(const Signature * s, int w, cv::Point3f & pt, cv::Mat & descriptor)
+{
+	pt = cv::Point3f(0,0,0);
+	if(!s->getWords3Pts().empty())
+	{
+		pt = s->getWords3Pts()[w];
+	}
+	// the descriptor data stay valid in the signature until the query is executed
+	descriptor = cv::Mat();
+	if(!s->getWordsDescriptorsMat().empty())
+	{
+		descriptor = s->getWordsDescriptorsMat().row(w);
+	}
+}
+
+void DBDriverSqlite3::stepKeypoints(const std::list<Signature *> & signatures) const
+{
+	// <node, word index>
+	std::vector<std::pair<const Signature *, int> > toSave;
+	for(std::list<Signature *>::const_iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const Signature * s = *iter;
+		UASSERT(s->getWords3Pts().empty() || s->getWordIds().size() == s->getWords3Pts().size());
+		UASSERT(s->getWordsDescriptorsMat().empty() || (int)s->getWordIds().size() == s->getWordsDescriptorsMat().rows);
+		for(unsigned int w=0; w<s->getWordIds().size(); ++w)
+		{
+			toSave.push_back(std::make_pair(s, (int)w));
+		}
+	}
+	if(toSave.empty())
+	{
+		return;
+	}
+
+	std::string query = queryStepKeypoint();
+	int rows = maxRowsPerInsert(query);
+	cv::Point3f pt;
+	cv::Mat descriptor;
+	unsigned int i=0;
+	if(rows > 1 && (int)toSave.size() >= rows)
+	{
+		sqlite3_stmt * ppStmt = prepareCachedStatement(queryMultiRows(query, rows));
+		for(; i+rows <= toSave.size(); i+=rows)
+		{
+			int index = 1;
+			for(int j=0; j<rows; ++j)
+			{
+				const Signature * s = toSave[i+j].first;
+				int w = toSave[i+j].second;
+				wordPointAndDescriptor(s, w, pt, descriptor);
+				bindKeypoint(ppStmt, index, s->id(), s->getWordIds()[w], s->getWordsKpts()[w], pt, descriptor);
+			}
+
+			int rc=sqlite3_step(ppStmt);
+			UASSERT_MSG(rc == SQLITE_DONE, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+
+			rc=sqlite3_reset(ppStmt);
+			UASSERT_MSG(rc == SQLITE_OK, uFormat("DB error (%s): %s", _version.c_str(), sqlite3_errmsg(_ppDb)).c_str());
+		}
+	}
+
+	// remaining keypoints
+	if(i < toSave.size())
+	{
+		sqlite3_stmt * ppStmt = prepareCachedStatement(query);
+		for(; i<toSave.size(); ++i)
+		{
+			const Signature * s = toSave[i].first;
+			int w = toSave[i].second;
+			wordPointAndDescriptor(s, w, pt, descriptor);
+			stepKeypoint(ppStmt, s->id(), s->getWordIds()[w], s->getWordsKpts()[w], pt, descriptor);
+		}
+	}
+}
+
 } // namespace rtabmap
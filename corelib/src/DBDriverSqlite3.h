@@ -125,10 +125,12 @@ private:
 
 	// Load objects
 	virtual void loadQuery(VWDictionary * dictionary) const;
-	virtual void loadLastNodesQuery(std::list<Signature *> & signatures) const;
-	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures) const;
+	virtual void loadLastNodesQuery(std::list<Signature *> & signatures, bool features = true) const;
+	virtual void loadSignaturesQuery(const std::list<int> & ids, std::list<Signature *> & signatures, bool features = true) const;
+	virtual void loadFeaturesQuery(std::list<Signature *> & signatures) const;
 	virtual void loadWordsQuery(const std::set<int> & wordIds, std::list<VisualWord *> & vws) const;
 	virtual void loadLinksQuery(int signatureId, std::map<int, Link> & links, Link::Type type = Link::kUndef) const;
+	virtual void loadLinksQuery(const std::set<int> & signatureIds, std::map<int, std::map<int, Link> > & links, Link::Type type = Link::kUndef) const;
 
 	virtual void loadNodeDataQuery(std::list<Signature *> & signatures, bool images=true, bool scan=true, bool userData=true, bool occupancyGrid=true) const;
 	virtual bool getCalibrationQuery(int signatureId, std::vector<CameraModel> & models, StereoCameraModel & stereoModel) const;
@@ -152,6 +154,9 @@ private:
 	std::string queryStepWordsChanged() const;
 	std::string queryStepKeypoint() const;
 	std::string queryStepOccupancyGridUpdate() const;
+	std::string queryLinksColumns() const;
+	std::string queryLinksTypeCondition(Link::Type type) const;
+	Link linkFromRow(sqlite3_stmt * ppStmt, int fromId, int index) const;
 	void stepNode(sqlite3_stmt * ppStmt, const Signature * s) const;
 	void stepImage(
 			sqlite3_stmt * ppStmt,
@@ -161,8 +166,18 @@ private:
 	void stepDepthUpdate(sqlite3_stmt * ppStmt, int nodeId, const cv::Mat & imageCompressed) const;
 	void stepSensorData(sqlite3_stmt * ppStmt, const SensorData & sensorData) const;
 	void stepLink(sqlite3_stmt * ppStmt, const Link & link) const;
+	void bindLink(sqlite3_stmt * ppStmt, int & index, const Link & link) const;
+	void stepLinks(const std::vector<const Link *> & links) const;
 	void stepWordsChanged(sqlite3_stmt * ppStmt, int signatureId, int oldWordId, int newWordId) const;
 	void stepKeypoint(sqlite3_stmt * ppStmt, int signatureId, int wordId, const cv::KeyPoint & kp, const cv::Point3f & pt, const cv::Mat & descriptor) const;
+	void bindKeypoint(sqlite3_stmt * ppStmt, int & index, int signatureId, int wordId, const cv::KeyPoint & kp, const cv::Point3f & pt, const cv::Mat & descriptor) const;
+	void stepKeypoints(const std::list<Signature *> & signatures) const;
+	std::string queryFeaturesRows() const;
+	void loadFeaturesRows(sqlite3_stmt * ppStmt, std::vector<int> & visualWords, std::vector<cv::KeyPoint> & visualWordsKpts, std::vector<cv::Point3f> & visualWords3, cv::Mat & descriptors) const;
+	bool loadFeaturesBlob(sqlite3_stmt * ppStmt, int nodeId, std::vector<int> & visualWords, std::vector<cv::KeyPoint> & visualWordsKpts, std::vector<cv::Point3f> & visualWords3, cv::Mat & descriptors) const;
+	void stepFeaturesBlob(sqlite3_stmt * ppStmt, int nodeId, const std::vector<int> & wordIds, const std::vector<cv::KeyPoint> & kpts, const std::vector<cv::Point3f> & pts, const cv::Mat & descriptors) const;
+	void stepFeaturesBlobs(const std::list<Signature *> & signatures) const;
+	void updateFeaturesBlobsWords(const std::list<Signature *> & signatures) const;
 	void stepOccupancyGridUpdate(sqlite3_stmt * ppStmt,
 			int nodeId,
 			const cv::Mat & ground,
@@ -175,6 +190,16 @@ private:
 	void loadLinksQuery(std::list<Signature *> & signatures) const;
 	int loadOrSaveDb(sqlite3 *pInMemory, const std::string & fileName, int isSave) const;
 
+	// Statements prepared once per connection, reset after each step
+	sqlite3_stmt * prepareCachedStatement(const std::string & query) const;
+	void finalizeCachedStatements() const;
+	int maxRowsPerInsert(const std::string & query) const;
+	std::string queryMultiRows(const std::string & query, int rows) const;
+
+	bool hasTable(const std::string & table) const;
+	void createFeaturesBlobTable() const;
+	void migrateFeaturesToBlob() const;
+
 private:
 	sqlite3 * _ppDb;
 	long _memoryUsedEstimate;
@@ -184,6 +209,11 @@ private:
 	int _journalMode;
 	int _synchronous;
 	int _tempStore;
+	bool _wordsQuantized;
+	bool _featuresBlob;
+	bool _featuresBlobMigration;
+	mutable bool _featuresBlobTable; // Feature_blob table exists
+	mutable std::map<std::string, sqlite3_stmt *> _cachedStatements; // query, statement
 };
 
 }
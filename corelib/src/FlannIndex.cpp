@@ -398,6 +398,40 @@ unsigned int FlannIndex::addPoints(const cv::Mat & features)
 	return r;
 }
 
+void FlannIndex::rebuildIndex(float rebalancingFactor)
+{
+	if(!index_)
+	{
+		UERROR("Flann index not yet created!");
+		return;
+	}
+
+	if(featuresType_ == CV_8UC1)
+	{
+		((rtflann::Index<rtflann::Hamming<unsigned char> >*)index_)->buildIndex();
+	}
+	else if(useDistanceL1_)
+	{
+		((rtflann::Index<rtflann::L1<float> >*)index_)->buildIndex();
+	}
+	else if(featuresDim_ <= 3)
+	{
+		((rtflann::Index<rtflann::L2_Simple<float> >*)index_)->buildIndex();
+	}
+	else
+	{
+		((rtflann::Index<rtflann::L2<float> >*)index_)->buildIndex();
+	}
+	rebalancingFactor_ = rebalancingFactor;
+
+	// clean not used features
+	for(std::list<int>::iterator iter=removedIndexes_.begin(); iter!=removedIndexes_.end(); ++iter)
+	{
+		addedDescriptors_.erase(*iter);
+	}
+	removedIndexes_.clear();
+}
+
 void FlannIndex::removePoint(unsigned int index)
 {
 	if(!index_)
@@ -438,7 +472,8 @@ void FlannIndex::knnSearch(
 		int knn,
 		int checks,
 		float eps,
-		bool sorted) const
+		bool sorted,
+		int cores) const
 {
 	if(!index_)
 	{
@@ -451,6 +486,7 @@ void FlannIndex::knnSearch(
 	rtflann::Matrix<size_t> indicesF((size_t*)indices.data, indices.rows, indices.cols);
 
 	rtflann::SearchParams params = rtflann::SearchParams(checks, eps, sorted);
+	params.cores = cores>0?cores:1;
 
 	if(featuresType_ == CV_8UC1)
 	{
@@ -0,0 +1,507 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/HnswIndex.h>
+#include <rtabmap/core/SimdDistance.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <algorithm>
+#include <queue>
+#include <cmath>
+#include <cstring>
+
+namespace rtabmap {
+
+HnswIndex::HnswIndex():
+		featuresType_(0),
+		featuresDim_(0),
+		rowSize_(0),
+		M_(16),
+		maxM0_(32),
+		efConstruction_(100),
+		efSearch_(64),
+		levelMult_(1.0/std::log(16.0)),
+		entryPoint_(-1),
+		maxLevel_(-1),
+		rng_(0xffffffff)
+{
+}
+HnswIndex::~HnswIndex()
+{
+	this->release();
+}
+
+void HnswIndex::release()
+{
+	featuresType_ = 0;
+	featuresDim_ = 0;
+	rowSize_ = 0;
+	entryPoint_ = -1;
+	maxLevel_ = -1;
+	rng_ = cv::RNG(0xffffffff);
+	data_.clear();
+	levels_.clear();
+	links_.clear();
+	reverseLinks_.clear();
+	freeSlots_.clear();
+}
+
+unsigned int HnswIndex::indexedFeatures() const
+{
+	return (unsigned int)(levels_.size() - freeSlots_.size());
+}
+
+// return KB
+unsigned int HnswIndex::memoryUsed() const
+{
+	size_t bytes = data_.capacity() + levels_.capacity()*sizeof(int) + freeSlots_.capacity()*sizeof(int);
+	for(unsigned int i=0; i<links_.size(); ++i)
+	{
+		for(unsigned int j=0; j<links_[i].size(); ++j)
+		{
+			bytes += links_[i][j].capacity()*sizeof(int);
+		}
+		for(unsigned int j=0; j<reverseLinks_[i].size(); ++j)
+		{
+			bytes += reverseLinks_[i][j].capacity()*sizeof(int);
+		}
+	}
+	return bytes/1000;
+}
+
+void HnswIndex::buildIndex(
+		const cv::Mat & features,
+		int M,
+		int efConstruction,
+		int efSearch)
+{
+	this->release();
+	UASSERT(features.type() == CV_32FC1 || features.type() == CV_8UC1);
+	UASSERT(features.cols > 0);
+	UASSERT_MSG(M > 1, uFormat("M=%d", M).c_str());
+	featuresType_ = features.type();
+	featuresDim_ = features.cols;
+	rowSize_ = features.cols * features.elemSize();
+	M_ = M;
+	maxM0_ = M*2;
+	efConstruction_ = efConstruction>M?efConstruction:M;
+	efSearch_ = efSearch>1?efSearch:1;
+	levelMult_ = 1.0/std::log(double(M));
+
+	data_.reserve(features.rows*rowSize_);
+	levels_.reserve(features.rows);
+	links_.reserve(features.rows);
+	reverseLinks_.reserve(features.rows);
+	for(int i=0; i<features.rows; ++i)
+	{
+		this->addPoint(features.row(i));
+	}
+}
+
+unsigned int HnswIndex::addPoint(const cv::Mat & feature)
+{
+	UASSERT_MSG(this->isBuilt(), "HNSW index not yet created!");
+	UASSERT(feature.rows == 1);
+	UASSERT(feature.type() == featuresType_);
+	UASSERT(feature.cols == featuresDim_);
+
+	int index;
+	if(freeSlots_.size())
+	{
+		index = freeSlots_.back();
+		freeSlots_.pop_back();
+	}
+	else
+	{
+		index = (int)levels_.size();
+		levels_.push_back(-1);
+		links_.push_back(std::vector<std::vector<int> >());
+		reverseLinks_.push_back(std::vector<std::vector<int> >());
+		data_.resize(data_.size() + rowSize_);
+	}
+	memcpy(&data_[index*rowSize_], feature.data, rowSize_);
+
+	int level = this->randomLevel();
+	// no links refer to a free slot (they are removed with the point)
+	links_[index].assign(level+1, std::vector<int>());
+	reverseLinks_[index].assign(level+1, std::vector<int>());
+
+	if(entryPoint_ < 0)
+	{
+		levels_[index] = level;
+		entryPoint_ = index;
+		maxLevel_ = level;
+		return index;
+	}
+
+	// The level of the new point is set only after it is linked, so that
+	// it is ignored while searching its own neighbors.
+	const unsigned char * query = this->feature(index);
+	int current = this->greedySearch(query, entryPoint_, maxLevel_, level);
+	std::vector<Candidate> candidates;
+	std::vector<int> neighbors;
+	for(int l=std::min(level, maxLevel_); l>=0; --l)
+	{
+		this->searchLayer(query, current, efConstruction_, l, visited_, candidates);
+		UASSERT(candidates.size());
+		current = candidates.front().second;
+
+		this->selectNeighbors(candidates, M_, neighbors);
+		this->setNeighbors(index, l, neighbors);
+		for(unsigned int i=0; i<neighbors.size(); ++i)
+		{
+			this->addLink(neighbors[i], index, l);
+			this->shrinkNeighbors(neighbors[i], l);
+		}
+	}
+	levels_[index] = level;
+
+	if(level > maxLevel_)
+	{
+		entryPoint_ = index;
+		maxLevel_ = level;
+	}
+	return index;
+}
+
+void HnswIndex::removePoint(unsigned int index)
+{
+	if(!this->isBuilt())
+	{
+		UERROR("HNSW index not yet created!");
+		return;
+	}
+	UASSERT(index < levels_.size() && levels_[index] >= 0);
+
+	int level = levels_[index];
+	levels_[index] = -1;
+
+	// Reconnect all points linked to the removed point (including one-way
+	// links) to the neighbors of the removed point
+	std::vector<int> neighbors;
+	for(int l=0; l<=level; ++l)
+	{
+		const std::vector<int> & removedNeighbors = links_[index][l];
+		std::vector<int> incoming = reverseLinks_[index][l]; // modified by setNeighbors()
+		for(unsigned int i=0; i<incoming.size(); ++i)
+		{
+			int n = incoming[i];
+			const std::vector<int> & oldNeighbors = links_[n][l];
+			std::vector<Candidate> candidates;
+			candidates.reserve(oldNeighbors.size() + removedNeighbors.size());
+			for(unsigned int j=0; j<oldNeighbors.size(); ++j)
+			{
+				if(oldNeighbors[j] != (int)index)
+				{
+					candidates.push_back(Candidate(this->distance(this->feature(n), this->feature(oldNeighbors[j])), oldNeighbors[j]));
+				}
+			}
+			for(unsigned int j=0; j<removedNeighbors.size(); ++j)
+			{
+				int m = removedNeighbors[j];
+				if(m != n &&
+				   levels_[m] >= l &&
+				   std::find(oldNeighbors.begin(), oldNeighbors.end(), m) == oldNeighbors.end())
+				{
+					candidates.push_back(Candidate(this->distance(this->feature(n), this->feature(m)), m));
+				}
+			}
+			this->selectNeighbors(candidates, this->maxNeighbors(l), neighbors);
+			this->setNeighbors(n, l, neighbors);
+		}
+		UASSERT(reverseLinks_[index][l].empty());
+	}
+
+	if(entryPoint_ == (int)index)
+	{
+		// choose the highest remaining point as the new entry point
+		entryPoint_ = -1;
+		maxLevel_ = -1;
+		for(int l=level; l>=0 && entryPoint_<0; --l)
+		{
+			for(unsigned int i=0; i<links_[index][l].size(); ++i)
+			{
+				int n = links_[index][l][i];
+				if(levels_[n] > maxLevel_)
+				{
+					entryPoint_ = n;
+					maxLevel_ = levels_[n];
+				}
+			}
+		}
+		if(maxLevel_ < level)
+		{
+			for(unsigned int i=0; i<levels_.size(); ++i)
+			{
+				if(levels_[i] > maxLevel_)
+				{
+					entryPoint_ = i;
+					maxLevel_ = levels_[i];
+				}
+			}
+		}
+	}
+
+	// remove the reverse links of the outgoing links
+	for(int l=0; l<=level; ++l)
+	{
+		this->setNeighbors(index, l, std::vector<int>());
+	}
+	links_[index].clear();
+	reverseLinks_[index].clear();
+	freeSlots_.push_back(index);
+}
+
+void HnswIndex::knnSearch(
+		const cv::Mat & query,
+		cv::Mat & indices,
+		cv::Mat & dists,
+		int knn,
+		int threads) const
+{
+	if(!this->isBuilt())
+	{
+		UERROR("HNSW index not yet created!");
+		return;
+	}
+	UASSERT(query.type() == featuresType_);
+	UASSERT(query.cols == featuresDim_);
+	UASSERT(knn > 0);
+
+	indices.create(query.rows, knn, sizeof(size_t)==8?CV_64F:CV_32S);
+	dists.create(query.rows, knn, CV_32F);
+
+	// queries are independent, the graph is only read
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(threads>0?threads:1)
+#endif
+	{
+		VisitedList visited; // one per thread, reused by its queries
+		std::vector<Candidate> results;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, 16)
+#endif
+		for(int i=0; i<query.rows; ++i)
+		{
+			results.clear();
+			if(entryPoint_ >= 0)
+			{
+				const unsigned char * q = query.ptr<unsigned char>(i);
+				int current = this->greedySearch(q, entryPoint_, maxLevel_, 0);
+				this->searchLayer(q, current, std::max(efSearch_, knn), 0, visited, results);
+			}
+			size_t * indicesRow = indices.ptr<size_t>(i);
+			float * distsRow = dists.ptr<float>(i);
+			for(int j=0; j<knn; ++j)
+			{
+				if(j < (int)results.size())
+				{
+					indicesRow[j] = results[j].second;
+					distsRow[j] = results[j].first;
+				}
+				else
+				{
+					indicesRow[j] = 0;
+					distsRow[j] = -1.0f;
+				}
+			}
+		}
+	}
+}
+
+float HnswIndex::distance(const unsigned char * a, const unsigned char * b) const
+{
+	if(featuresType_ == CV_8UC1)
+	{
+		return (float)simd::hamming(a, b, featuresDim_);
+	}
+	return simd::l2Sqr((const float*)a, (const float*)b, featuresDim_);
+}
+
+int HnswIndex::randomLevel()
+{
+	double r = rng_.uniform(0.0, 1.0);
+	return (int)(-std::log(1.0-r) * levelMult_);
+}
+
+int HnswIndex::greedySearch(const unsigned char * query, int entryPoint, int fromLevel, int toLevel) const
+{
+	int current = entryPoint;
+	float currentDist = this->distance(query, this->feature(current));
+	for(int l=fromLevel; l>toLevel; --l)
+	{
+		bool changed = true;
+		while(changed)
+		{
+			changed = false;
+			const std::vector<int> & neighbors = links_[current][l];
+			for(unsigned int i=0; i<neighbors.size(); ++i)
+			{
+				int n = neighbors[i];
+				if(levels_[n] < l)
+				{
+					continue;
+				}
+				float d = this->distance(query, this->feature(n));
+				if(d < currentDist)
+				{
+					currentDist = d;
+					current = n;
+					changed = true;
+				}
+			}
+		}
+	}
+	return current;
+}
+
+void HnswIndex::searchLayer(
+		const unsigned char * query,
+		int entryPoint,
+		int ef,
+		int level,
+		VisitedList & visited,
+		std::vector<Candidate> & results) const
+{
+	visited.reset(levels_.size());
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > candidates; // closest first
+	std::priority_queue<Candidate> nearest; // farthest first
+
+	float d = this->distance(query, this->feature(entryPoint));
+	candidates.push(Candidate(d, entryPoint));
+	nearest.push(Candidate(d, entryPoint));
+	visited.visit(entryPoint);
+
+	while(!candidates.empty())
+	{
+		Candidate c = candidates.top();
+		if(c.first > nearest.top().first && (int)nearest.size() >= ef)
+		{
+			break;
+		}
+		candidates.pop();
+
+		const std::vector<int> & neighbors = links_[c.second][level];
+		for(unsigned int i=0; i<neighbors.size(); ++i)
+		{
+			int n = neighbors[i];
+			if(levels_[n] < level || !visited.visit(n))
+			{
+				continue;
+			}
+			d = this->distance(query, this->feature(n));
+			if((int)nearest.size() < ef || d < nearest.top().first)
+			{
+				candidates.push(Candidate(d, n));
+				nearest.push(Candidate(d, n));
+				if((int)nearest.size() > ef)
+				{
+					nearest.pop();
+				}
+			}
+		}
+	}
+
+	results.resize(nearest.size());
+	for(int i=(int)results.size()-1; i>=0; --i)
+	{
+		results[i] = nearest.top();
+		nearest.pop();
+	}
+}
+
+void HnswIndex::selectNeighbors(
+		std::vector<Candidate> & candidates,
+		int maxSize,
+		std::vector<int> & neighbors) const
+{
+	// Heuristic of the paper: keep a candidate only if it is closer to the
+	// base point than to any already selected neighbor.
+	std::sort(candidates.begin(), candidates.end());
+	neighbors.clear();
+	for(unsigned int i=0; i<candidates.size() && (int)neighbors.size() < maxSize; ++i)
+	{
+		bool keep = true;
+		for(unsigned int j=0; j<neighbors.size() && keep; ++j)
+		{
+			keep = this->distance(this->feature(candidates[i].second), this->feature(neighbors[j])) >= candidates[i].first;
+		}
+		if(keep)
+		{
+			neighbors.push_back(candidates[i].second);
+		}
+	}
+}
+
+void HnswIndex::shrinkNeighbors(int index, int level)
+{
+	const std::vector<int> & neighbors = links_[index][level];
+	if((int)neighbors.size() > this->maxNeighbors(level))
+	{
+		std::vector<Candidate> candidates(neighbors.size());
+		for(unsigned int i=0; i<neighbors.size(); ++i)
+		{
+			candidates[i] = Candidate(this->distance(this->feature(index), this->feature(neighbors[i])), neighbors[i]);
+		}
+		std::vector<int> selected;
+		this->selectNeighbors(candidates, this->maxNeighbors(level), selected);
+		this->setNeighbors(index, level, selected);
+	}
+}
+
+// Replace the neighbors of a point, the reverse links are updated accordingly
+void HnswIndex::setNeighbors(int index, int level, const std::vector<int> & neighbors)
+{
+	std::vector<int> & current = links_[index][level];
+	for(unsigned int i=0; i<current.size(); ++i)
+	{
+		std::vector<int> & reverse = reverseLinks_[current[i]][level];
+		std::vector<int>::iterator iter = std::find(reverse.begin(), reverse.end(), index);
+		UASSERT(iter != reverse.end());
+		*iter = reverse.back();
+		reverse.pop_back();
+	}
+	current = neighbors;
+	for(unsigned int i=0; i<current.size(); ++i)
+	{
+		reverseLinks_[current[i]][level].push_back(index);
+	}
+}
+
+// Add a link if it doesn't already exist
+void HnswIndex::addLink(int from, int to, int level)
+{
+	std::vector<int> & neighbors = links_[from][level];
+	if(std::find(neighbors.begin(), neighbors.end(), to) == neighbors.end())
+	{
+		neighbors.push_back(to);
+		reverseLinks_[to][level].push_back(from);
+	}
+}
+
+} /* namespace rtabmap */
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/MappedFile.h"
+#include "rtabmap/utilite/ULogger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace rtabmap {
+
+MappedFile::MappedFile() :
+		data_(0),
+		size_(0)
+#ifdef _WIN32
+		,file_(0),
+		mapping_(0)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	this->close();
+}
+
+bool MappedFile::open(const std::string & path)
+{
+	this->close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		UERROR("Cannot open \"%s\"", path.c_str());
+		return false;
+	}
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		UERROR("Cannot map \"%s\", the file is empty", path.c_str());
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+	void * data = mapping?MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0):0;
+	if(data == 0)
+	{
+		UERROR("Cannot map \"%s\" (error=%d)", path.c_str(), (int)GetLastError());
+		if(mapping)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+	file_ = file;
+	mapping_ = mapping;
+	size_ = (size_t)size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		UERROR("Cannot open \"%s\"", path.c_str());
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		UERROR("Cannot map \"%s\", the file is empty", path.c_str());
+		::close(fd);
+		return false;
+	}
+	void * data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps a reference on the file
+	if(data == MAP_FAILED)
+	{
+		UERROR("Cannot map \"%s\"", path.c_str());
+		return false;
+	}
+	// start reading the pages in background
+	madvise(data, st.st_size, MADV_WILLNEED);
+	size_ = (size_t)st.st_size;
+#endif
+	data_ = (unsigned char *)data;
+	path_ = path;
+	UDEBUG("Mapped \"%s\" (%ld bytes)", path.c_str(), (long)size_);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(data_)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+		CloseHandle((HANDLE)mapping_);
+		CloseHandle((HANDLE)file_);
+		mapping_ = 0;
+		file_ = 0;
+#else
+		munmap(data_, size_);
+#endif
+		data_ = 0;
+		size_ = 0;
+		path_.clear();
+	}
+}
+
+} /* namespace rtabmap */
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UProcessInfo.h>
 #include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UThread.h>
 
 #include "rtabmap/core/Memory.h"
 #include "rtabmap/core/Signature.h"
@@ -60,6 +61,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl/io/pcd_io.h>
 #include <pcl/common/common.h>
 #include <rtabmap/core/OccupancyGrid.h>
+#include <algorithm>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Maximum number of partial tf-idf accumulators when the likelihood is multi-threaded
+#define LIKELIHOOD_PARTIALS 16
 
 namespace rtabmap {
 
@@ -67,6 +77,167 @@ const int Memory::kIdStart = 0;
 const int Memory::kIdVirtual = -1;
 const int Memory::kIdInvalid = 0;
 
+class SignaturePrefetchThread : public UThread
+{
+public:
+	SignaturePrefetchThread(DBDriver * dbDriver, const std::list<int> & ids) :
+		_dbDriver(dbDriver),
+		_ids(ids)
+	{}
+	virtual ~SignaturePrefetchThread()
+	{
+		this->join(true);
+		UASSERT_MSG(_signatures.empty() && _words.empty(), "Prefetched signatures and words should have been taken!");
+	}
+	// Caller takes ownership of the signatures and the words
+	void take(std::list<Signature *> & signatures, std::list<VisualWord *> & words)
+	{
+		signatures.splice(signatures.end(), _signatures);
+		words.splice(words.end(), _words);
+	}
+
+private:
+	virtual void mainLoop()
+	{
+		UTimer timer;
+		// DBDriver accesses are mutex-protected. Only signatures saved in the
+		// database are loaded: until they are reactivated, the prefetched
+		// signatures are not visible to the other database queries.
+		_dbDriver->loadSavedSignatures(_ids, _signatures);
+
+		// The dictionary cannot be accessed from this thread, so all words
+		// of the signatures are loaded. Those already in the dictionary are
+		// ignored on reactivation.
+		std::set<int> wordIds;
+		for(std::list<Signature *>::iterator iter=_signatures.begin(); iter!=_signatures.end(); ++iter)
+		{
+			const std::vector<int> & ids = (*iter)->getWordIds();
+			for(std::vector<int>::const_iterator jter=ids.begin(); jter!=ids.end(); ++jter)
+			{
+				if(*jter > 0)
+				{
+					wordIds.insert(*jter);
+				}
+			}
+		}
+		if(wordIds.size())
+		{
+			_dbDriver->loadWords(wordIds, _words);
+		}
+		UDEBUG("Prefetched %d/%d signatures and %d words = %fs",
+				(int)_signatures.size(), (int)_ids.size(), (int)_words.size(), timer.ticks());
+		this->kill();
+	}
+
+private:
+	DBDriver * _dbDriver;
+	std::list<int> _ids;
+	std::list<Signature *> _signatures;
+	std::list<VisualWord *> _words;
+};
+
+// Load in background, by batches, the features and the words of
+// the nodes added to WM without them (Mem/InitWMLazy).
+class SignatureWarmUpThread : public UThread
+{
+public:
+	SignatureWarmUpThread(DBDriver * dbDriver, const std::list<int> & ids, bool wordsLoaded, int batchSize = 100) :
+		_dbDriver(dbDriver),
+		_ids(ids),
+		_wordsLoaded(wordsLoaded),
+		_batchSize(batchSize)
+	{
+		UASSERT(_dbDriver != 0);
+		UASSERT(_batchSize > 0);
+	}
+	virtual ~SignatureWarmUpThread()
+	{
+		this->join(true);
+		for(std::list<Signature *>::iterator iter=_signatures.begin(); iter!=_signatures.end(); ++iter)
+		{
+			delete *iter;
+		}
+		for(std::list<VisualWord *>::iterator iter=_words.begin(); iter!=_words.end(); ++iter)
+		{
+			if((*iter)->isSaved())
+			{
+				delete *iter;
+			}
+			else
+			{
+				_dbDriver->asyncSave(*iter); // move it again to trash
+			}
+		}
+	}
+	// Caller takes ownership of the signatures and the words. Signatures
+	// are temporary copies holding only the features of the nodes.
+	void take(std::list<Signature *> & signatures, std::list<VisualWord *> & words)
+	{
+		_mutex.lock();
+		signatures.splice(signatures.end(), _signatures);
+		words.splice(words.end(), _words);
+		_mutex.unlock();
+	}
+
+private:
+	virtual void mainLoop()
+	{
+		if(_ids.empty())
+		{
+			this->kill();
+			return;
+		}
+
+		UTimer timer;
+		std::list<Signature *> signatures;
+		for(int i=0; i<_batchSize && !_ids.empty(); ++i)
+		{
+			signatures.push_back(new Signature(_ids.front()));
+			_ids.pop_front();
+		}
+		// DBDriver accesses are mutex-protected
+		_dbDriver->loadFeatures(signatures);
+
+		std::list<VisualWord *> words;
+		if(_wordsLoaded)
+		{
+			std::set<int> wordIds;
+			for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+			{
+				const std::vector<int> & ids = (*iter)->getWordIds();
+				for(std::vector<int>::const_iterator jter=ids.begin(); jter!=ids.end(); ++jter)
+				{
+					if(*jter > 0 && _loadedWordIds.insert(*jter).second)
+					{
+						wordIds.insert(*jter);
+					}
+				}
+			}
+			if(wordIds.size())
+			{
+				_dbDriver->loadWords(wordIds, words);
+			}
+		}
+		UDEBUG("Warm-up: %d signatures and %d words loaded (%d remaining) = %fs",
+				(int)signatures.size(), (int)words.size(), (int)_ids.size(), timer.ticks());
+
+		_mutex.lock();
+		_signatures.splice(_signatures.end(), signatures);
+		_words.splice(_words.end(), words);
+		_mutex.unlock();
+	}
+
+private:
+	DBDriver * _dbDriver;
+	std::list<int> _ids;
+	bool _wordsLoaded;
+	int _batchSize;
+	std::set<int> _loadedWordIds;
+	UMutex _mutex;
+	std::list<Signature *> _signatures;
+	std::list<VisualWord *> _words;
+};
+
 Memory::Memory(const ParametersMap & parameters) :
 	_dbDriver(0),
 	_similarityThreshold(Parameters::defaultMemRehearsalSimilarity()),
@@ -88,6 +259,7 @@ Memory::Memory(const ParametersMap & parameters) :
 	_imagePreDecimation(Parameters::defaultMemImagePreDecimation()),
 	_imagePostDecimation(Parameters::defaultMemImagePostDecimation()),
 	_compressionParallelized(Parameters::defaultMemCompressionParallelized()),
+	_signatureStagesParallelized(Parameters::defaultMemSignatureStagesParallelized()),
 	_laserScanDownsampleStepSize(Parameters::defaultMemLaserScanDownsampleStepSize()),
 	_laserScanVoxelSize(Parameters::defaultMemLaserScanVoxelSize()),
 	_laserScanNormalK(Parameters::defaultMemLaserScanNormalK()),
@@ -96,6 +268,7 @@ Memory::Memory(const ParametersMap & parameters) :
 	_rehearsalMaxDistance(Parameters::defaultRGBDLinearUpdate()),
 	_rehearsalMaxAngle(Parameters::defaultRGBDAngularUpdate()),
 	_rehearsalWeightIgnoredWhileMoving(Parameters::defaultMemRehearsalWeightIgnoredWhileMoving()),
+	_rehearsalMaxCompared(Parameters::defaultMemRehearsalMaxCompared()),
 	_useOdometryFeatures(Parameters::defaultMemUseOdomFeatures()),
 	_createOccupancyGrid(Parameters::defaultRGBDCreateOccupancyGrid()),
 	_visMaxFeatures(Parameters::defaultVisMaxFeatures()),
@@ -108,9 +281,15 @@ Memory::Memory(const ParametersMap & parameters) :
 	_memoryChanged(false),
 	_linksChanged(false),
 	_signaturesAdded(0),
+	_neighborsCacheDepth(0),
+	_prefetchThread(0),
+	_lastSignaturesPrefetched(0),
+	_warmUpThread(0),
+	_initWMLazyBatch(Parameters::defaultMemInitWMLazyBatch()),
 
 	_badSignRatio(Parameters::defaultKpBadSignRatio()),
 	_tfIdfLikelihoodUsed(Parameters::defaultKpTfIdfLikelihoodUsed()),
+	_likelihoodThreads(Parameters::defaultKpLikelihoodThreads()),
 	_parallelized(Parameters::defaultKpParallelized())
 {
 	_feature2D = Feature2D::create(parameters);
@@ -204,7 +383,11 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 	if(_dbDriver && _dbDriver->isConnected())
 	{
 		bool loadAllNodesInWM = Parameters::defaultMemInitWMWithAllNodes();
+		bool lazy = Parameters::defaultMemInitWMLazy();
+		bool warmUp = Parameters::defaultMemInitWMWarmUp();
 		Parameters::parse(parameters_, Parameters::kMemInitWMWithAllNodes(), loadAllNodesInWM);
+		Parameters::parse(parameters_, Parameters::kMemInitWMLazy(), lazy);
+		Parameters::parse(parameters_, Parameters::kMemInitWMWarmUp(), warmUp);
 
 		// Load the last working memory...
 		std::list<Signature*> dbSignatures;
@@ -214,26 +397,33 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 			if(postInitClosingEvents) UEventsManager::post(new RtabmapEventInit(std::string("Loading all nodes to WM...")));
 			std::set<int> ids;
 			_dbDriver->getAllNodeIds(ids, true);
-			_dbDriver->loadSignatures(std::list<int>(ids.begin(), ids.end()), dbSignatures);
+			_dbDriver->loadSignatures(std::list<int>(ids.begin(), ids.end()), dbSignatures, 0, !lazy);
 		}
 		else
 		{
 			// load previous session working memory
 			if(postInitClosingEvents) UEventsManager::post(new RtabmapEventInit(std::string("Loading last nodes to WM...")));
-			_dbDriver->loadLastNodes(dbSignatures);
+			_dbDriver->loadLastNodes(dbSignatures, !lazy);
 		}
 		for(std::list<Signature*>::reverse_iterator iter=dbSignatures.rbegin(); iter!=dbSignatures.rend(); ++iter)
 		{
-			// ignore bad signatures
-			if(!((*iter)->isBadSignature() && _badSignaturesIgnored))
+			// ignore bad signatures (features of lazy signatures are not loaded yet)
+			if(lazy || !((*iter)->isBadSignature() && _badSignaturesIgnored))
 			{
+				if(lazy)
+				{
+					_lazySignatures.insert((*iter)->id());
+				}
 				// insert all in WM
 				// Note: it doesn't make sense to keep last STM images
 				//       of the last session in the new STM because they can be
 				//       only linked with the ones of the current session by
 				//       global loop closures.
 				_signatures.insert(std::pair<int, Signature *>((*iter)->id(), *iter));
-				_workingMem.insert(std::make_pair((*iter)->id(), UTimer::now()));
+				_signaturesTable.set((*iter)->id(), *iter);
+				std::pair<std::map<int, double>::iterator, bool> inserted = _workingMem.insert(std::make_pair((*iter)->id(), UTimer::now()));
+				_workingMemTable.set((*iter)->id(), true);
+				addToTransferIndex(*iter, inserted.first->second);
 			}
 			else
 			{
@@ -245,11 +435,11 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 		// Assign the last signature
 		if(_stMem.size()>0)
 		{
-			_lastSignature = uValue(_signatures, *_stMem.rbegin(), (Signature*)0);
+			_lastSignature = _signaturesTable.get(*_stMem.rbegin());
 		}
 		else if(_workingMem.size()>0)
 		{
-			_lastSignature = uValue(_signatures, _workingMem.rbegin()->first, (Signature*)0);
+			_lastSignature = _signaturesTable.get(_workingMem.rbegin()->first);
 		}
 
 		// Last id
@@ -259,7 +449,21 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 		// Now load the dictionary if we have a connection
 		if(postInitClosingEvents) UEventsManager::post(new RtabmapEventInit("Loading dictionary..."));
 		UDEBUG("Loading dictionary...");
-		if(loadAllNodesInWM)
+		if(!_vwd->isIncremental() && VWDictionary::isVocabularyFile(_vwd->getDictionaryPath()))
+		{
+			// All words of a fixed dictionary are in the binary vocabulary,
+			// mapping it is faster than loading the words from the database.
+			UDEBUG("map the fixed dictionary");
+			_vwd->setFixedDictionary(_vwd->getDictionaryPath());
+		}
+		else if(lazy && _vwd->isIncremental())
+		{
+			// words are loaded with their nodes
+			int id = 0;
+			_dbDriver->getLastWordId(id);
+			_vwd->setLastWordId(id);
+		}
+		else if(loadAllNodesInWM)
 		{
 			UDEBUG("load all referenced words in working memory");
 			// load all referenced words in working memory
@@ -267,9 +471,8 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 			const std::map<int, Signature *> & signatures = this->getSignatures();
 			for(std::map<int, Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 			{
-				const std::multimap<int, cv::KeyPoint> & words = i->second->getWords();
-				std::list<int> keys = uUniqueKeys(words);
-				for(std::list<int>::iterator iter=keys.begin(); iter!=keys.end(); ++iter)
+				std::vector<int> keys = i->second->getUniqueWordIds();
+				for(std::vector<int>::iterator iter=keys.begin(); iter!=keys.end(); ++iter)
 				{
 					if(*iter > 0)
 					{
@@ -308,18 +511,18 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 		const std::map<int, Signature *> & signatures = this->getSignatures();
 		for(std::map<int, Signature *>::const_iterator i=signatures.begin(); i!=signatures.end(); ++i)
 		{
-			Signature * s = this->_getSignature(i->first);
+			Signature * s = i->second;
 			UASSERT(s != 0);
 
-			const std::multimap<int, cv::KeyPoint> & words = s->getWords();
+			const std::vector<int> & words = s->getWordIds();
 			if(words.size())
 			{
 				UDEBUG("node=%d, word references=%d", s->id(), words.size());
-				for(std::multimap<int, cv::KeyPoint>::const_iterator iter = words.begin(); iter!=words.end(); ++iter)
+				for(std::vector<int>::const_iterator iter = words.begin(); iter!=words.end(); ++iter)
 				{
-					if(iter->first > 0)
+					if(*iter > 0)
 					{
-						_vwd->addWordRef(iter->first, i->first);
+						_vwd->addWordRef(*iter, i->first);
 					}
 				}
 				s->setEnabled(true);
@@ -333,6 +536,23 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 		}
 		UDEBUG("Total word references added = %d", _vwd->getTotalActiveReferences());
 
+		if(_lazySignatures.size())
+		{
+			if(_lastSignature)
+			{
+				std::set<int> ids;
+				ids.insert(_lastSignature->id());
+				loadLazySignatures(ids);
+			}
+			if(warmUp && _lazySignatures.size())
+			{
+				// most recent nodes first
+				UDEBUG("Warm-up of %d nodes...", (int)_lazySignatures.size());
+				_warmUpThread = new SignatureWarmUpThread(_dbDriver, std::list<int>(_lazySignatures.rbegin(), _lazySignatures.rend()), _vwd->isIncremental());
+				_warmUpThread->start();
+			}
+		}
+
 		if(_lastSignature == 0)
 		{
 			// Memory is empty, save parameters
@@ -350,6 +570,7 @@ void Memory::loadDataFromDb(bool postInitClosingEvents)
 	}
 
 	_workingMem.insert(std::make_pair(kIdVirtual, 0));
+	_workingMemTable.set(kIdVirtual, true);
 
 	UDEBUG("ids start with %d", _idCount+1);
 	UDEBUG("map ids start with %d", _idMapCount);
@@ -360,6 +581,10 @@ void Memory::close(bool databaseSaved, bool postInitClosingEvents, const std::st
 	UINFO("databaseSaved=%d, postInitClosingEvents=%d", databaseSaved?1:0, postInitClosingEvents?1:0);
 	if(postInitClosingEvents) UEventsManager::post(new RtabmapEventInit(RtabmapEventInit::kClosing));
 
+	// give back the signatures not reactivated before the database is closed
+	clearPrefetchedSignatures();
+	stopWarmUpThread();
+
 	bool databaseNameChanged = false;
 	if(databaseSaved && _dbDriver)
 	{
@@ -451,6 +676,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	ParametersMap::const_iterator iter;
 
 	Parameters::parse(params, Parameters::kMemBinDataKept(), _binDataKept);
+	Parameters::parse(params, Parameters::kMemInitWMLazyBatch(), _initWMLazyBatch);
 	Parameters::parse(params, Parameters::kMemRawDescriptorsKept(), _rawDescriptorsKept);
 	Parameters::parse(params, Parameters::kMemSaveDepth16Format(), _saveDepth16Format);
 	Parameters::parse(params, Parameters::kMemReduceGraph(), _reduceGraph);
@@ -462,12 +688,18 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kMemMapLabelsAdded(), _mapLabelsAdded);
 	Parameters::parse(params, Parameters::kMemRehearsalSimilarity(), _similarityThreshold);
 	Parameters::parse(params, Parameters::kMemRecentWmRatio(), _recentWmRatio);
+	bool transferSortingByWeightId = _transferSortingByWeightId;
 	Parameters::parse(params, Parameters::kMemTransferSortingByWeightId(), _transferSortingByWeightId);
+	if(transferSortingByWeightId != _transferSortingByWeightId)
+	{
+		rebuildTransferIndex();
+	}
 	Parameters::parse(params, Parameters::kMemSTMSize(), _maxStMemSize);
 	Parameters::parse(params, Parameters::kMemDepthAsMask(), _depthAsMask);
 	Parameters::parse(params, Parameters::kMemImagePreDecimation(), _imagePreDecimation);
 	Parameters::parse(params, Parameters::kMemImagePostDecimation(), _imagePostDecimation);
 	Parameters::parse(params, Parameters::kMemCompressionParallelized(), _compressionParallelized);
+	Parameters::parse(params, Parameters::kMemSignatureStagesParallelized(), _signatureStagesParallelized);
 	Parameters::parse(params, Parameters::kMemLaserScanDownsampleStepSize(), _laserScanDownsampleStepSize);
 	Parameters::parse(params, Parameters::kMemLaserScanVoxelSize(), _laserScanVoxelSize);
 	Parameters::parse(params, Parameters::kMemLaserScanNormalK(), _laserScanNormalK);
@@ -476,6 +708,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(params, Parameters::kRGBDLinearUpdate(), _rehearsalMaxDistance);
 	Parameters::parse(params, Parameters::kRGBDAngularUpdate(), _rehearsalMaxAngle);
 	Parameters::parse(params, Parameters::kMemRehearsalWeightIgnoredWhileMoving(), _rehearsalWeightIgnoredWhileMoving);
+	Parameters::parse(params, Parameters::kMemRehearsalMaxCompared(), _rehearsalMaxCompared);
 	Parameters::parse(params, Parameters::kMemUseOdomFeatures(), _useOdometryFeatures);
 	Parameters::parse(params, Parameters::kRGBDCreateOccupancyGrid(), _createOccupancyGrid);
 	Parameters::parse(params, Parameters::kVisMaxFeatures(), _visMaxFeatures);
@@ -493,6 +726,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 
 	UASSERT_MSG(_maxStMemSize >= 0, uFormat("value=%d", _maxStMemSize).c_str());
 	UASSERT_MSG(_similarityThreshold >= 0.0f && _similarityThreshold <= 1.0f, uFormat("value=%f", _similarityThreshold).c_str());
+	UASSERT_MSG(_rehearsalMaxCompared >= 1, uFormat("value=%d", _rehearsalMaxCompared).c_str());
 	UASSERT_MSG(_recentWmRatio >= 0.0f && _recentWmRatio <= 1.0f, uFormat("value=%f", _recentWmRatio).c_str());
 	if(_imagePreDecimation == 0)
 	{
@@ -517,6 +751,7 @@ void Memory::parseParameters(const ParametersMap & parameters)
 	}
 
 	Parameters::parse(params, Parameters::kKpTfIdfLikelihoodUsed(), _tfIdfLikelihoodUsed);
+	Parameters::parse(params, Parameters::kKpLikelihoodThreads(), _likelihoodThreads);
 	Parameters::parse(params, Parameters::kKpParallelized(), _parallelized);
 	Parameters::parse(params, Parameters::kKpBadSignRatio(), _badSignRatio);
 
@@ -649,6 +884,15 @@ void Memory::parseParameters(const ParametersMap & parameters)
 void Memory::preUpdate()
 {
 	_signaturesAdded = 0;
+	if(_warmUpThread)
+	{
+		bool done = !_warmUpThread->isRunning();
+		loadLazySignatures(std::set<int>());
+		if(done)
+		{
+			stopWarmUpThread();
+		}
+	}
 	this->cleanUnusedWords();
 	if(_vwd && !_parallelized)
 	{
@@ -815,6 +1059,7 @@ void Memory::addSignatureToStm(Signature * signature, const cv::Mat & covariance
 					_signatures.at(*_stMem.rbegin())->addLink(Link(*_stMem.rbegin(), signature->id(), Link::kNeighbor, Transform()));
 					signature->addLink(Link(signature->id(), *_stMem.rbegin(), Link::kNeighbor, Transform()));
 				}
+				invalidateNeighborsCache(*_stMem.rbegin());
 				UDEBUG("Min STM id = %d", *_stMem.begin());
 			}
 			else
@@ -844,14 +1089,15 @@ void Memory::addSignatureToStm(Signature * signature, const cv::Mat & covariance
 		}
 
 		_signatures.insert(_signatures.end(), std::pair<int, Signature *>(signature->id(), signature));
+		_signaturesTable.set(signature->id(), signature);
 		_stMem.insert(_stMem.end(), signature->id());
 		++_signaturesAdded;
 
 		if(_vwd)
 		{
-			UDEBUG("%d words ref for the signature %d", signature->getWords().size(), signature->id());
+			UDEBUG("%d words ref for the signature %d", signature->getWordIds().size(), signature->id());
 		}
-		if(signature->getWords().size())
+		if(signature->getWordIds().size())
 		{
 			signature->setEnabled(true);
 		}
@@ -865,8 +1111,13 @@ void Memory::addSignatureToWmFromLTM(Signature * signature)
 	if(signature)
 	{
 		UDEBUG("Inserting node %d in WM...", signature->id());
-		_workingMem.insert(std::make_pair(signature->id(), UTimer::now()));
+		std::pair<std::map<int, double>::iterator, bool> inserted = _workingMem.insert(std::make_pair(signature->id(), UTimer::now()));
+		_workingMemTable.set(signature->id(), true);
 		_signatures.insert(std::pair<int, Signature*>(signature->id(), signature));
+		_signaturesTable.set(signature->id(), signature);
+		addToTransferIndex(signature, inserted.first->second);
+		// neighbors in WM can now reach the reactivated node
+		invalidateNeighborsCache(signature->id(), true);
 		++_signaturesAdded;
 	}
 	else
@@ -917,10 +1168,11 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 		{
 			if(s->getLabel().empty())
 			{
+				invalidateNeighborsCache(s->id(), true);
 				for(std::map<int, Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
 				{
 					merge = true;
-					Signature * sTo = this->_getSignature(iter->first);
+					Signature * sTo = _signaturesTable.get(iter->first);
 					UASSERT(sTo!=0);
 					sTo->removeLink(s->id());
 					if(iter->second.type() != Link::kNeighbor &&
@@ -936,7 +1188,7 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 										jter->second,
 										iter->second.userDataCompressed().empty() && iter->second.type() != Link::kVirtualClosure?Link::kNeighborMerged:iter->second.type());
 								sTo->addLink(l);
-								Signature * sB = this->_getSignature(l.to());
+								Signature * sB = _signaturesTable.get(l.to());
 								UASSERT(sB!=0);
 								UASSERT(!sB->hasLink(l.to()));
 								sB->addLink(l.inverse());
@@ -970,7 +1222,9 @@ void Memory::moveSignatureToWMFromSTM(int id, int * reducedTo)
 	}
 	if(s != 0)
 	{
-		_workingMem.insert(_workingMem.end(), std::make_pair(*_stMem.begin(), UTimer::now()));
+		std::map<int, double>::iterator inserted = _workingMem.insert(_workingMem.end(), std::make_pair(*_stMem.begin(), UTimer::now()));
+		_workingMemTable.set(*_stMem.begin(), true);
+		addToTransferIndex(s, inserted->second);
 		_stMem.erase(*_stMem.begin());
 	}
 	// else already removed from STM/WM in moveToTrash()
@@ -983,7 +1237,7 @@ const Signature * Memory::getSignature(int id) const
 
 Signature * Memory::_getSignature(int id) const
 {
-	return uValue(_signatures, id, (Signature*)0);
+	return _signaturesTable.get(id);
 }
 
 const VWDictionary * Memory::getVWDictionary() const
@@ -996,7 +1250,7 @@ std::map<int, Link> Memory::getNeighborLinks(
 		bool lookInDatabase) const
 {
 	std::map<int, Link> links;
-	Signature * s = uValue(_signatures, signatureId, (Signature*)0);
+	Signature * s = _signaturesTable.get(signatureId);
 	if(s)
 	{
 		const std::map<int, Link> & allLinks = s->getLinks();
@@ -1037,7 +1291,7 @@ std::map<int, Link> Memory::getLoopClosureLinks(
 		int signatureId,
 		bool lookInDatabase) const
 {
-	const Signature * s = this->getSignature(signatureId);
+	const Signature * s = _signaturesTable.get(signatureId);
 	std::map<int, Link> loopClosures;
 	if(s)
 	{
@@ -1078,7 +1332,7 @@ std::map<int, Link> Memory::getLinks(
 		bool lookInDatabase) const
 {
 	std::map<int, Link> links;
-	Signature * s = uValue(_signatures, signatureId, (Signature*)0);
+	Signature * s = _signaturesTable.get(signatureId);
 	if(s)
 	{
 		links = s->getLinks();
@@ -1147,37 +1401,82 @@ std::map<int, int> Memory::getNeighborsId(
 	{
 		return ids;
 	}
+
+	// Reuse the member buffers, unless they are already used by a traversal
+	TraversalBuffers localBuffers;
+	bool ownBuffers = !_traversalBuffersUsed;
+	TraversalBuffers & buffers = ownBuffers?_traversalBuffers:localBuffers;
+	_traversalBuffersUsed = true;
+
 	int nbLoadedFromDb = 0;
-	std::list<int> curentMarginList;
-	std::set<int> currentMargin;
-	std::set<int> nextMargin;
-	nextMargin.insert(signatureId);
+	std::vector<int> & currentMargin = buffers.current;
+	std::vector<int> & nextMargin = buffers.next;
+	nextMargin.push_back(signatureId);
+	std::map<int, std::map<int, Link> > dbLinks; // links of the current margin loaded from the database
+	const std::map<int, Link> emptyLinks;
 	int m = 0;
-	std::set<int> ignoredIds;
 	while((maxGraphDepth == 0 || m < maxGraphDepth) && nextMargin.size())
 	{
 		// insert more recent first (priority to be loaded first from the database below if set)
-		curentMarginList = std::list<int>(nextMargin.rbegin(), nextMargin.rend());
+		currentMargin.swap(nextMargin);
 		nextMargin.clear();
+		std::sort(currentMargin.begin(), currentMargin.end(), std::greater<int>());
+		currentMargin.erase(std::unique(currentMargin.begin(), currentMargin.end()), currentMargin.end());
 
-		for(std::list<int>::iterator jter = curentMarginList.begin(); jter!=curentMarginList.end(); ++jter)
+		// Load in a single query the links of the nodes of this margin not in STM/WM
+		dbLinks.clear();
+		if(_dbDriver && maxCheckedInDatabase != 0)
 		{
-			if(ids.find(*jter) == ids.end() && (nodesSet.empty() || nodesSet.find(*jter) != nodesSet.end()))
+			std::set<int> idsToLoad;
+			for(unsigned int i=0;
+				i<currentMargin.size() && (maxCheckedInDatabase == -1 || nbLoadedFromDb + (int)idsToLoad.size() < maxCheckedInDatabase);
+				++i)
 			{
-				//UDEBUG("Added %d with margin %d", *jter, m);
+				int id = currentMargin[i];
+				if(!buffers.visited.contains(id) &&
+					!buffers.ignored.contains(id) &&
+					(nodesSet.empty() || nodesSet.find(id) != nodesSet.end()) &&
+					_signaturesTable.get(id) == 0)
+				{
+					idsToLoad.insert(id);
+				}
+			}
+			if(idsToLoad.size())
+			{
+				UTimer timer;
+				_dbDriver->loadLinks(idsToLoad, dbLinks);
+				if(dbAccessTime)
+				{
+					*dbAccessTime += timer.getElapsedTime();
+				}
+			}
+		}
+
+		// nodes can be appended to the current margin while iterating
+		for(unsigned int i=0; i<currentMargin.size(); ++i)
+		{
+			int id = currentMargin[i];
+			if(!buffers.visited.contains(id) &&
+				!buffers.ignored.contains(id) &&
+				(nodesSet.empty() || nodesSet.find(id) != nodesSet.end()))
+			{
+				//UDEBUG("Added %d with margin %d", id, m);
 				// Look up in STM/WM if all ids are here, if not... load them from the database
-				const Signature * s = this->getSignature(*jter);
+				const Signature * s = _signaturesTable.get(id);
 				std::map<int, Link> tmpLinks;
-				const std::map<int, Link> * links = &tmpLinks;
+				const std::map<int, Link> * links = &emptyLinks;
+				bool intermediate = false;
 				if(s)
 				{
 					if(!ignoreIntermediateNodes || s->getWeight() != -1)
 					{
-						ids.insert(std::pair<int, int>(*jter, m));
+						ids.insert(std::pair<int, int>(id, m));
+						buffers.visited.insert(id);
 					}
 					else
 					{
-						ignoredIds.insert(*jter);
+						buffers.ignored.insert(id);
+						intermediate = true;
 					}
 
 					links = &s->getLinks();
@@ -1185,49 +1484,60 @@ std::map<int, int> Memory::getNeighborsId(
 				else if(maxCheckedInDatabase == -1 || (maxCheckedInDatabase > 0 && _dbDriver && nbLoadedFromDb < maxCheckedInDatabase))
 				{
 					++nbLoadedFromDb;
-					ids.insert(std::pair<int, int>(*jter, m));
+					ids.insert(std::pair<int, int>(id, m));
+					buffers.visited.insert(id);
 
-					UTimer timer;
-					_dbDriver->loadLinks(*jter, tmpLinks);
-					if(dbAccessTime)
+					std::map<int, std::map<int, Link> >::const_iterator kter = dbLinks.find(id);
+					if(kter != dbLinks.end())
 					{
-						*dbAccessTime += timer.getElapsedTime();
+						links = &kter->second;
+					}
+					else if(_dbDriver)
+					{
+						// appended to this margin after the batch was loaded
+						UTimer timer;
+						_dbDriver->loadLinks(id, tmpLinks);
+						links = &tmpLinks;
+						if(dbAccessTime)
+						{
+							*dbAccessTime += timer.getElapsedTime();
+						}
 					}
 				}
 
 				// links
 				for(std::map<int, Link>::const_iterator iter=links->begin(); iter!=links->end(); ++iter)
 				{
-					if( !uContains(ids, iter->first) && ignoredIds.find(iter->first) == ignoredIds.end())
+					if(!buffers.visited.contains(iter->first) && !buffers.ignored.contains(iter->first))
 					{
 						UASSERT(iter->second.type() != Link::kUndef);
 						if(iter->second.type() == Link::kNeighbor ||
 					       iter->second.type() == Link::kNeighborMerged)
 						{
-							if(ignoreIntermediateNodes && s->getWeight()==-1)
+							if(intermediate)
 							{
 								// stay on the same margin
-								if(currentMargin.insert(iter->first).second)
+								if(buffers.sameLevel.insert(iter->first))
 								{
-									curentMarginList.push_back(iter->first);
+									currentMargin.push_back(iter->first);
 								}
 							}
 							else
 							{
-								nextMargin.insert(iter->first);
+								nextMargin.push_back(iter->first);
 							}
 						}
 						else if(!ignoreLoopIds && (!ignoreLocalSpaceLoopIds || iter->second.type()!=Link::kLocalSpaceClosure))
 						{
 							if(incrementMarginOnLoop)
 							{
-								nextMargin.insert(iter->first);
+								nextMargin.push_back(iter->first);
 							}
 							else
 							{
-								if(currentMargin.insert(iter->first).second)
+								if(buffers.sameLevel.insert(iter->first))
 								{
-									curentMarginList.push_back(iter->first);
+									currentMargin.push_back(iter->first);
 								}
 							}
 						}
@@ -1237,9 +1547,313 @@ std::map<int, int> Memory::getNeighborsId(
 		}
 		++m;
 	}
+
+	buffers.clear();
+	if(ownBuffers)
+	{
+		_traversalBuffersUsed = false;
+	}
 	return ids;
 }
 
+std::map<int, int> Memory::getNeighborsIdCached(int signatureId, int maxGraphDepth) const
+{
+	if(maxGraphDepth != _neighborsCacheDepth)
+	{
+		_neighborsCache.clear();
+		_neighborsCacheRefs.clear();
+		_neighborsCacheDepth = maxGraphDepth;
+	}
+
+	std::map<int, std::map<int, int> >::const_iterator iter = _neighborsCache.find(signatureId);
+	if(iter != _neighborsCache.end())
+	{
+		return iter->second;
+	}
+
+	std::map<int, int> ids = this->getNeighborsId(signatureId, maxGraphDepth, 0, false, false, true, true);
+	if(_signaturesTable.get(signatureId) == 0)
+	{
+		// not in WM/STM, don't cache
+		return ids;
+	}
+
+	// Reference all nodes visited: the neighbors returned and the
+	// intermediate nodes (ignored in the results) traversed to reach them.
+	std::set<int> visited;
+	std::list<int> toVisit = uKeysList(ids);
+	toVisit.push_back(signatureId);
+	while(toVisit.size())
+	{
+		int id = toVisit.front();
+		toVisit.pop_front();
+		if(visited.insert(id).second)
+		{
+			_neighborsCacheRefs[id].insert(signatureId);
+			const Signature * s = _signaturesTable.get(id);
+			if(s)
+			{
+				for(std::map<int, Link>::const_iterator jter=s->getLinks().begin(); jter!=s->getLinks().end(); ++jter)
+				{
+					const Signature * sTo = _signaturesTable.get(jter->first);
+					if(sTo && sTo->getWeight() == -1 && ids.find(jter->first) == ids.end())
+					{
+						toVisit.push_back(jter->first);
+					}
+				}
+			}
+		}
+	}
+	_neighborsCache.insert(std::make_pair(signatureId, ids));
+	return ids;
+}
+
+void Memory::invalidateNeighborsCache(int signatureId, bool linkedNodes)
+{
+	if(_neighborsCache.empty())
+	{
+		_neighborsCacheRefs.clear();
+		return;
+	}
+	std::list<int> ids;
+	ids.push_back(signatureId);
+	if(linkedNodes)
+	{
+		const Signature * s = _signaturesTable.get(signatureId);
+		if(s)
+		{
+			for(std::map<int, Link>::const_iterator iter=s->getLinks().begin(); iter!=s->getLinks().end(); ++iter)
+			{
+				if(iter->first != signatureId)
+				{
+					ids.push_back(iter->first);
+				}
+			}
+		}
+	}
+	for(std::list<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		std::map<int, std::set<int> >::iterator jter = _neighborsCacheRefs.find(*iter);
+		if(jter != _neighborsCacheRefs.end())
+		{
+			for(std::set<int>::iterator kter=jter->second.begin(); kter!=jter->second.end(); ++kter)
+			{
+				_neighborsCache.erase(*kter);
+			}
+			_neighborsCacheRefs.erase(jter);
+		}
+	}
+}
+
+void Memory::clearNeighborsCache()
+{
+	_neighborsCache.clear();
+	_neighborsCacheRefs.clear();
+}
+
+void Memory::joinPrefetchThread()
+{
+	if(_prefetchThread)
+	{
+		_prefetchThread->join();
+		std::list<Signature *> signatures;
+		std::list<VisualWord *> words;
+		_prefetchThread->take(signatures, words);
+		delete _prefetchThread;
+		_prefetchThread = 0;
+		for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+		{
+			UASSERT(_prefetchedSignatures.find((*iter)->id()) == _prefetchedSignatures.end());
+			_prefetchedSignatures.insert(std::make_pair((*iter)->id(), *iter));
+		}
+		for(std::list<VisualWord *>::iterator iter=words.begin(); iter!=words.end(); ++iter)
+		{
+			UASSERT(_prefetchedWords.find((*iter)->id()) == _prefetchedWords.end());
+			_prefetchedWords.insert(std::make_pair((*iter)->id(), *iter));
+		}
+	}
+}
+
+// A prefetched signature loaded from the database is not valid anymore
+// if the node is modified directly in the database.
+void Memory::discardPrefetchedSignature(int signatureId)
+{
+	joinPrefetchThread();
+	std::map<int, Signature *>::iterator iter = _prefetchedSignatures.find(signatureId);
+	if(iter != _prefetchedSignatures.end())
+	{
+		UDEBUG("Discarding prefetched signature %d", signatureId);
+		delete iter->second; // still in the database
+		_prefetchedSignatures.erase(iter);
+	}
+}
+
+void Memory::clearPrefetchedSignatures()
+{
+	joinPrefetchThread();
+	if(_prefetchedSignatures.size())
+	{
+		UDEBUG("Discarding %d prefetched signatures", (int)_prefetchedSignatures.size());
+	}
+	for(std::map<int, Signature *>::iterator iter=_prefetchedSignatures.begin(); iter!=_prefetchedSignatures.end(); ++iter)
+	{
+		delete iter->second; // still in the database
+	}
+	_prefetchedSignatures.clear();
+	for(std::map<int, VisualWord *>::iterator iter=_prefetchedWords.begin(); iter!=_prefetchedWords.end(); ++iter)
+	{
+		if(iter->second->isSaved())
+		{
+			delete iter->second;
+		}
+		else
+		{
+			UASSERT(_dbDriver);
+			_dbDriver->asyncSave(iter->second); // move it again to trash
+		}
+	}
+	_prefetchedWords.clear();
+}
+
+// Load the features and the words of the nodes added to WM without them
+// (Mem/InitWMLazy). Nodes already loaded by the warm-up thread are added
+// at the same time. Must be called before accessing the words of nodes
+// that may not be loaded yet.
+void Memory::loadLazySignatures(const std::list<int> & ids, int maxNodes)
+{
+	std::set<int> lazyIds;
+	if(!_lazySignatures.empty())
+	{
+		for(std::list<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+		{
+			if(_lazySignatures.find(*iter) != _lazySignatures.end())
+			{
+				lazyIds.insert(*iter);
+			}
+		}
+		// keep the most recent nodes
+		while(maxNodes > 0 && (int)lazyIds.size() > maxNodes)
+		{
+			lazyIds.erase(lazyIds.begin());
+		}
+	}
+	if(lazyIds.size() || _warmUpThread)
+	{
+		loadLazySignatures(lazyIds);
+	}
+}
+
+void Memory::loadLazySignatures(const std::set<int> & ids)
+{
+	UTimer timer;
+	std::list<Signature *> signatures;
+	std::list<VisualWord *> words;
+	if(_warmUpThread)
+	{
+		std::list<Signature *> loaded;
+		_warmUpThread->take(loaded, words);
+		for(std::list<Signature *>::iterator iter=loaded.begin(); iter!=loaded.end(); ++iter)
+		{
+			Signature * s = _signaturesTable.get((*iter)->id());
+			if(s && _lazySignatures.erase(s->id()))
+			{
+				s->setWords((*iter)->getWordIds(), (*iter)->getWordsKpts(), (*iter)->getWords3Pts(), (*iter)->getWordsDescriptorsMat());
+				signatures.push_back(s);
+			}
+			delete *iter;
+		}
+	}
+
+	std::list<Signature *> toLoad;
+	for(std::set<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		if(_lazySignatures.erase(*iter))
+		{
+			Signature * s = _signaturesTable.get(*iter);
+			UASSERT(s != 0);
+			toLoad.push_back(s);
+		}
+	}
+	if(toLoad.size() && _dbDriver)
+	{
+		_dbDriver->loadFeatures(toLoad);
+	}
+	signatures.splice(signatures.end(), toLoad);
+
+	for(std::list<VisualWord *>::iterator iter=words.begin(); iter!=words.end(); ++iter)
+	{
+		if(_vwd->getWord((*iter)->id()) == 0 && _vwd->getUnusedWord((*iter)->id()) == 0)
+		{
+			_vwd->addWord(*iter);
+		}
+		else if((*iter)->isSaved())
+		{
+			delete *iter;
+		}
+		else
+		{
+			UASSERT(_dbDriver);
+			_dbDriver->asyncSave(*iter); // move it again to trash
+		}
+	}
+
+	if(signatures.empty())
+	{
+		return;
+	}
+
+	// Load the words not already in the dictionary
+	std::set<int> wordIds;
+	for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const std::vector<int> & ids = (*iter)->getWordIds();
+		for(std::vector<int>::const_iterator jter=ids.begin(); jter!=ids.end(); ++jter)
+		{
+			if(*jter > 0 && _vwd->getWord(*jter) == 0 && _vwd->getUnusedWord(*jter) == 0)
+			{
+				wordIds.insert(*jter);
+			}
+		}
+	}
+	if(wordIds.size() && _dbDriver)
+	{
+		std::list<VisualWord *> vws;
+		_dbDriver->loadWords(wordIds, vws);
+		for(std::list<VisualWord *>::iterator iter=vws.begin(); iter!=vws.end(); ++iter)
+		{
+			_vwd->addWord(*iter);
+		}
+	}
+
+	for(std::list<Signature *>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		const std::vector<int> & ids = (*iter)->getWordIds();
+		if(ids.size())
+		{
+			for(std::vector<int>::const_iterator jter=ids.begin(); jter!=ids.end(); ++jter)
+			{
+				if(*jter > 0)
+				{
+					_vwd->addWordRef(*jter, (*iter)->id());
+				}
+			}
+			(*iter)->setEnabled(true);
+		}
+	}
+	UDEBUG("Loaded %d signatures (%d words), %d remaining = %fs",
+			(int)signatures.size(), (int)wordIds.size(), (int)_lazySignatures.size(), timer.ticks());
+}
+
+void Memory::stopWarmUpThread()
+{
+	if(_warmUpThread)
+	{
+		// results not taken are discarded
+		delete _warmUpThread;
+		_warmUpThread = 0;
+	}
+}
+
 // return map<Id,sqrdDistance>, including signatureId
 std::map<int, float> Memory::getNeighborsIdRadius(
 		int signatureId,
@@ -1252,56 +1866,66 @@ std::map<int, float> Memory::getNeighborsIdRadius(
 	UASSERT(uContains(optimizedPoses, signatureId));
 	UASSERT(signatureId > 0);
 	std::map<int, float> ids;
-	std::map<int, float> checkedIds;
-	std::list<int> curentMarginList;
-	std::set<int> currentMargin;
-	std::set<int> nextMargin;
-	nextMargin.insert(signatureId);
+
+	// Reuse the member buffers, unless they are already used by a traversal
+	TraversalBuffers localBuffers;
+	bool ownBuffers = !_traversalBuffersUsed;
+	TraversalBuffers & buffers = ownBuffers?_traversalBuffers:localBuffers;
+	_traversalBuffersUsed = true;
+
+	std::vector<int> & currentMargin = buffers.current;
+	std::vector<int> & nextMargin = buffers.next;
+	nextMargin.push_back(signatureId);
 	int m = 0;
 	Transform referential = optimizedPoses.at(signatureId);
 	UASSERT(!referential.isNull());
 	float radiusSqrd = radius*radius;
 	while((maxGraphDepth == 0 || m < maxGraphDepth) && nextMargin.size())
 	{
-		curentMarginList = std::list<int>(nextMargin.begin(), nextMargin.end());
+		currentMargin.swap(nextMargin);
 		nextMargin.clear();
 
-		for(std::list<int>::iterator jter = curentMarginList.begin(); jter!=curentMarginList.end(); ++jter)
+		for(unsigned int i=0; i<currentMargin.size(); ++i)
 		{
-			if(checkedIds.find(*jter) == checkedIds.end())
+			int id = currentMargin[i];
+			// nodes outside the radius are expanded only once
+			if(buffers.visited.insert(id))
 			{
-				//UDEBUG("Added %d with margin %d", *jter, m);
-				// Look up in STM/WM if all ids are here, if not... load them from the database
-				const Signature * s = this->getSignature(*jter);
-				std::map<int, Link> tmpLinks;
-				const std::map<int, Link> * links = &tmpLinks;
+				//UDEBUG("Added %d with margin %d", id, m);
+				// Look up in STM/WM if all ids are here
+				const Signature * s = _signaturesTable.get(id);
 				if(s)
 				{
-					const Transform & t = optimizedPoses.at(*jter);
+					const Transform & t = optimizedPoses.at(id);
 					UASSERT(!t.isNull());
 					float distanceSqrd = referential.getDistanceSquared(t);
 					if(radiusSqrd == 0 || distanceSqrd<radiusSqrd)
 					{
-						ids.insert(std::pair<int, float>(*jter,distanceSqrd));
+						ids.insert(std::pair<int, float>(id,distanceSqrd));
 					}
 
-					links = &s->getLinks();
-				}
-
-				// links
-				for(std::map<int, Link>::const_iterator iter=links->begin(); iter!=links->end(); ++iter)
-				{
-					if(!uContains(ids, iter->first) &&
-						uContains(optimizedPoses, iter->first) &&
-						iter->second.type()!=Link::kVirtualClosure)
+					// links
+					const std::map<int, Link> & links = s->getLinks();
+					for(std::map<int, Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
 					{
-						nextMargin.insert(iter->first);
+						if(!buffers.visited.contains(iter->first) &&
+							iter->second.type()!=Link::kVirtualClosure &&
+							uContains(optimizedPoses, iter->first))
+						{
+							nextMargin.push_back(iter->first);
+						}
 					}
 				}
 			}
 		}
 		++m;
 	}
+
+	buffers.clear();
+	if(ownBuffers)
+	{
+		_traversalBuffersUsed = false;
+	}
 	return ids;
 }
 
@@ -1338,7 +1962,16 @@ void Memory::updateAge(int signatureId)
 	std::map<int, double>::iterator iter=_workingMem.find(signatureId);
 	if(iter!=_workingMem.end())
 	{
+		Signature * s = _transferSortingByWeightId?0:_signaturesTable.get(signatureId);
+		if(s)
+		{
+			removeFromTransferIndex(s, iter->second);
+		}
 		iter->second = UTimer::now();
+		if(s)
+		{
+			addToTransferIndex(s, iter->second);
+		}
 	}
 }
 
@@ -1368,6 +2001,31 @@ double Memory::getDbSavingTime() const
 	return _dbDriver?_dbDriver->getEmptyTrashesTime():0;
 }
 
+int Memory::getDbTrashSize() const
+{
+	return _dbDriver?_dbDriver->getTrashSize():0;
+}
+
+long long Memory::getDbTrashMemoryUsed() const
+{
+	return _dbDriver?_dbDriver->getTrashMemoryUsed():0;
+}
+
+long long Memory::getDbTrashSpilled() const
+{
+	return _dbDriver?_dbDriver->getTrashSpilled():0;
+}
+
+double Memory::getDbFlushLatency() const
+{
+	return _dbDriver?_dbDriver->getLastFlushLatency():0;
+}
+
+int Memory::getDbTrashBlocked() const
+{
+	return _dbDriver?_dbDriver->getTrashBlocked():0;
+}
+
 std::set<int> Memory::getAllSignatureIds() const
 {
 	std::set<int> ids;
@@ -1386,6 +2044,9 @@ void Memory::clear()
 {
 	UDEBUG("");
 
+	clearPrefetchedSignatures();
+	stopWarmUpThread();
+
 	// empty the STM
 	while(_stMem.size())
 	{
@@ -1458,11 +2119,16 @@ void Memory::clear()
 		ULOGGER_ERROR("_workingMem must be empty here, size=%d", _workingMem.size());
 	}
 	_workingMem.clear();
+	_workingMemTable.clear();
+	_transferIndex.clear();
 	if(_signatures.size()!=0)
 	{
 		ULOGGER_ERROR("_signatures must be empty here, size=%d", _signatures.size());
 	}
 	_signatures.clear();
+	_signaturesTable.clear();
+	_lazySignatures.clear();
+	clearNeighborsCache();
 
 	UDEBUG("");
 	// Wait until the db trash has finished cleaning the memory
@@ -1503,6 +2169,25 @@ void Memory::clear()
  */
 std::map<int, float> Memory::computeLikelihood(const Signature * signature, const std::list<int> & ids)
 {
+	int threads = 1;
+#ifdef _OPENMP
+	threads = _likelihoodThreads>0?_likelihoodThreads:omp_get_max_threads();
+#endif
+
+	// The compared nodes need their words. To not load the whole previous
+	// session on the first update (Mem/InitWMLazy), nodes queued for the
+	// warm-up thread are left to it and otherwise only a batch of them is
+	// loaded per update. Nodes not loaded yet have no words, so a null
+	// likelihood (set to 1 by Rtabmap::adjustLikelihood()).
+	if(_warmUpThread)
+	{
+		loadLazySignatures(std::set<int>()); // take the nodes already warmed up
+	}
+	else
+	{
+		loadLazySignatures(ids, _initWMLazyBatch);
+	}
+
 	if(!_tfIdfLikelihoodUsed)
 	{
 		UTimer timer;
@@ -1520,20 +2205,28 @@ std::map<int, float> Memory::computeLikelihood(const Signature * signature, cons
 			return likelihood;
 		}
 
-		for(std::list<int>::const_iterator iter = ids.begin(); iter!=ids.end(); ++iter)
+		// each similarity is independent
+		std::vector<int> idsVector(ids.begin(), ids.end());
+		std::vector<float> similarities(idsVector.size(), 0.0f);
+#ifdef _OPENMP
+		#pragma omp parallel for num_threads(threads) schedule(dynamic, 8)
+#endif
+		for(int i=0; i<(int)idsVector.size(); ++i)
 		{
-			float sim = 0.0f;
-			if(*iter > 0)
+			if(idsVector[i] > 0)
 			{
-				const Signature * sB = this->getSignature(*iter);
+				const Signature * sB = this->getSignature(idsVector[i]);
 				if(!sB)
 				{
-					UFATAL("Signature %d not found in WM ?!?", *iter);
+					UFATAL("Signature %d not found in WM ?!?", idsVector[i]);
 				}
-				sim = signature->compareTo(*sB);
+				similarities[i] = signature->compareTo(*sB);
 			}
+		}
 
-			likelihood.insert(likelihood.end(), std::pair<int, float>(*iter, sim));
+		for(unsigned int i=0; i<idsVector.size(); ++i)
+		{
+			likelihood.insert(likelihood.end(), std::pair<int, float>(idsVector[i], similarities[i]));
 		}
 
 		UDEBUG("compute likelihood (similarity)... %f s", timer.ticks());
@@ -1562,7 +2255,7 @@ std::map<int, float> Memory::computeLikelihood(const Signature * signature, cons
 			likelihood.insert(likelihood.end(), std::pair<int, float>(*iter, 0.0f));
 		}
 
-		const std::list<int> & wordIds = uUniqueKeys(signature->getWords());
+		const std::vector<int> words = signature->getUniqueWordIds();
 
 		float nwi; // nwi is the number of a specific word referenced by a place
 		float ni; // ni is the total of words referenced by a place
@@ -1570,40 +2263,60 @@ std::map<int, float> Memory::computeLikelihood(const Signature * signature, cons
 		float N; // N is the total number of places
 
 		float logNnw;
-		const VisualWord * vw;
 
 		N = this->getSignatures().size();
 
 		if(N)
 		{
 			UDEBUG("processing... ");
-			// Pour chaque mot dans la signature SURF
-			for(std::list<int>::const_iterator i=wordIds.begin(); i!=wordIds.end(); ++i)
+			// Scores are accumulated in arrays indexed by the nodes of the
+			// dictionary's inverted index. Ni is null for nodes of signatures
+			// not in ids, so they are ignored.
+			std::vector<float> nodesNi(_vwd->getNodesCount(), 0.0f);
+			std::vector<float> nodesScore(nodesNi.size(), 0.0f);
+			for(std::list<int>::const_iterator iter = ids.begin(); iter!=ids.end(); ++iter)
 			{
-				if(*i>0)
+				int node = _vwd->getNodeIndex(*iter);
+				if(node >= 0)
 				{
-					// "Inverted index" - Pour chaque endroit contenu dans chaque mot
-					vw = _vwd->getWord(*i);
-					UASSERT(vw!=0);
+					nodesNi[node] = this->getNi(*iter);
+				}
+			}
 
-					const std::map<int, int> & refs = vw->getReferences();
-					nw = refs.size();
-					if(nw)
+			// With many threads, words are splitted in a fixed number of
+			// partitions (not depending on the number of threads), each one
+			// accumulated in its own array, then summed in partition order.
+			int partitions = threads>1?std::min((int)words.size(), LIKELIHOOD_PARTIALS):1;
+			std::vector<std::vector<float> > partialScores(partitions>1?partitions:0);
+#ifdef _OPENMP
+			#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) private(nwi, ni, nw, logNnw) if(partitions>1)
+#endif
+			for(int p=0; p<partitions; ++p)
+			{
+				std::vector<float> & scores = partitions>1?partialScores[p]:nodesScore;
+				scores.resize(nodesNi.size(), 0.0f);
+				int end = (int)((p+1)*words.size()/partitions);
+				// Pour chaque mot dans la signature SURF
+				for(int i=(int)(p*words.size()/partitions); i<end; ++i)
+				{
+					if(words[i]>0)
 					{
-						logNnw = log10(N/nw);
-						if(logNnw)
+						// "Inverted index" - Pour chaque endroit contenu dans chaque mot
+						UASSERT(_vwd->getWord(words[i])!=0);
+						const std::vector<std::pair<int, int> > & postings = _vwd->getWordPostings(words[i]);
+						nw = postings.size();
+						if(nw)
 						{
-							for(std::map<int, int>::const_iterator j=refs.begin(); j!=refs.end(); ++j)
+							logNnw = log10(N/nw);
+							if(logNnw)
 							{
-								std::map<int, float>::iterator iter = likelihood.find(j->first);
-								if(iter != likelihood.end())
+								for(std::vector<std::pair<int, int> >::const_iterator j=postings.begin(); j!=postings.end(); ++j)
 								{
-									nwi = j->second;
-									ni = this->getNi(j->first);
+									ni = nodesNi[j->first];
 									if(ni != 0)
 									{
-										//UDEBUG("%d, %f %f %f %f", vw->id(), logNnw, nwi, ni, ( nwi  * logNnw ) / ni);
-										iter->second += ( nwi  * logNnw ) / ni;
+										nwi = j->second;
+										scores[j->first] += ( nwi  * logNnw ) / ni;
 									}
 								}
 							}
@@ -1611,6 +2324,30 @@ std::map<int, float> Memory::computeLikelihood(const Signature * signature, cons
 					}
 				}
 			}
+			if(partitions>1)
+			{
+#ifdef _OPENMP
+				#pragma omp parallel for num_threads(threads)
+#endif
+				for(int n=0; n<(int)nodesScore.size(); ++n)
+				{
+					float score = 0.0f;
+					for(int p=0; p<partitions; ++p)
+					{
+						score += partialScores[p][n];
+					}
+					nodesScore[n] = score;
+				}
+			}
+
+			for(std::map<int, float>::iterator iter=likelihood.begin(); iter!=likelihood.end(); ++iter)
+			{
+				int node = _vwd->getNodeIndex(iter->first);
+				if(node >= 0)
+				{
+					iter->second = nodesScore[node];
+				}
+			}
 		}
 
 		UDEBUG("compute likelihood (tf-idf) %f s", timer.ticks());
@@ -1626,7 +2363,7 @@ std::map<int, int> Memory::getWeights() const
 	{
 		if(iter->first > 0)
 		{
-			const Signature * s = this->getSignature(iter->first);
+			const Signature * s = _signaturesTable.get(iter->first);
 			if(!s)
 			{
 				UFATAL("Location %d must exist in memory", iter->first);
@@ -1826,6 +2563,8 @@ void Memory::emptyTrash()
 {
 	if(_dbDriver)
 	{
+		// once per update, for all nodes and words moved to trash since the last one
+		_dbDriver->applyTrashPolicy();
 		_dbDriver->emptyTrashes(true);
 	}
 }
@@ -1840,42 +2579,10 @@ void Memory::joinTrashThread()
 	}
 }
 
-class WeightAgeIdKey
-{
-public:
-	WeightAgeIdKey(int w, double a, int i) :
-		weight(w),
-		age(a),
-		id(i){}
-	bool operator<(const WeightAgeIdKey & k) const
-	{
-		if(weight < k.weight)
-		{
-			return true;
-		}
-		else if(weight == k.weight)
-		{
-			if(age < k.age)
-			{
-				return true;
-			}
-			else if(age == k.age)
-			{
-				if(id < k.id)
-				{
-					return true;
-				}
-			}
-		}
-		return false;
-	}
-	int weight, age, id;
-};
 std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<int> & ignoredIds)
 {
 	//UDEBUG("");
 	std::list<Signature *> removableSignatures;
-	std::map<WeightAgeIdKey, Signature *> weightAgeIdMap;
 
 	// Find the last index to check...
 	UDEBUG("mem.size()=%d, ignoredIds.size()=%d", (int)_workingMem.size(), (int)ignoredIds.size());
@@ -1905,6 +2612,7 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 			}
 			UDEBUG("currentRecentWmSize=%d, recentWmMaxSize=%d, _recentWmRatio=%f, end recent wM = %d", currentRecentWmSize, recentWmMaxSize, _recentWmRatio, _lastGlobalLoopClosureId);
 		}
+		bool recentWmIgnored = recentWmImmunized;
 
 		// Ignore neighbor of the last location in STM (for neighbor links redirection issue during Rehearsal).
 		Signature * lastInSTM = 0;
@@ -1913,63 +2621,55 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 			lastInSTM = _signatures.at(*_stMem.begin());
 		}
 
-		for(std::map<int, double>::const_iterator memIter = _workingMem.begin(); memIter != _workingMem.end(); ++memIter)
+		int recentWmCount = 0;
+		// make the list of removable signatures, the transfer
+		// index is already sorted by Weight -> Age -> ID
+		UDEBUG("transferIndex.size()=%d _lastGlobalLoopClosureId=%d currentRecentWmSize=%d recentWmMaxSize=%d",
+				(int)_transferIndex.size(), _lastGlobalLoopClosureId, currentRecentWmSize, recentWmMaxSize);
+		for(std::set<WeightAgeIdKey>::const_iterator iter=_transferIndex.begin();
+			iter!=_transferIndex.end();
+			++iter)
 		{
-			if( (recentWmImmunized && memIter->first > _lastGlobalLoopClosureId) ||
-				memIter->first == _lastGlobalLoopClosureId)
+			if( (recentWmIgnored && iter->id > _lastGlobalLoopClosureId) ||
+				iter->id == _lastGlobalLoopClosureId ||
+				ignoredIds.find(iter->id) != ignoredIds.end() ||
+				(lastInSTM && lastInSTM->hasLink(iter->id)))
 			{
 				// ignore recent memory
+				continue;
 			}
-			else if(memIter->first > 0 && ignoredIds.find(memIter->first) == ignoredIds.end() && (!lastInSTM || !lastInSTM->hasLink(memIter->first)))
+
+			Signature * s = _signaturesTable.get(iter->id);
+			if(s == 0 || s->getWeight() != iter->weight)
 			{
-				Signature * s = this->_getSignature(memIter->first);
-				if(s)
-				{
-					// Links must not be in STM to be removable, rehearsal issue
-					bool foundInSTM = false;
-					for(std::map<int, Link>::const_iterator iter = s->getLinks().begin(); iter!=s->getLinks().end(); ++iter)
-					{
-						if(_stMem.find(iter->first) != _stMem.end())
-						{
-							UDEBUG("Ignored %d because it has a link (%d) to STM", s->id(), iter->first);
-							foundInSTM = true;
-							break;
-						}
-					}
-					if(!foundInSTM)
-					{
-						// less weighted signature priority to be transferred
-						weightAgeIdMap.insert(std::make_pair(WeightAgeIdKey(s->getWeight(), _transferSortingByWeightId?0.0:memIter->second, s->id()), s));
-					}
-				}
-				else
+				ULOGGER_ERROR("Not supposed to occur!!! (transfer index of %d is not up to date)", iter->id);
+				continue;
+			}
+
+			// Links must not be in STM to be removable, rehearsal issue
+			bool foundInSTM = false;
+			for(std::map<int, Link>::const_iterator jter = s->getLinks().begin(); jter!=s->getLinks().end(); ++jter)
+			{
+				if(_stMem.find(jter->first) != _stMem.end())
 				{
-					ULOGGER_ERROR("Not supposed to occur!!!");
+					UDEBUG("Ignored %d because it has a link (%d) to STM", s->id(), jter->first);
+					foundInSTM = true;
+					break;
 				}
 			}
-			else
+			if(foundInSTM)
 			{
-				//UDEBUG("Ignoring id %d", memIter->first);
+				continue;
 			}
-		}
 
-		int recentWmCount = 0;
-		// make the list of removable signatures
-		// Criteria : Weight -> ID
-		UDEBUG("signatureMap.size()=%d _lastGlobalLoopClosureId=%d currentRecentWmSize=%d recentWmMaxSize=%d",
-				(int)weightAgeIdMap.size(), _lastGlobalLoopClosureId, currentRecentWmSize, recentWmMaxSize);
-		for(std::map<WeightAgeIdKey, Signature*>::iterator iter=weightAgeIdMap.begin();
-			iter!=weightAgeIdMap.end();
-			++iter)
-		{
 			if(!recentWmImmunized)
 			{
 				UDEBUG("weight=%d, id=%d",
-						iter->second->getWeight(),
-						iter->second->id());
-				removableSignatures.push_back(iter->second);
+						s->getWeight(),
+						s->id());
+				removableSignatures.push_back(s);
 
-				if(_lastGlobalLoopClosureId && iter->second->id() > _lastGlobalLoopClosureId)
+				if(_lastGlobalLoopClosureId && s->id() > _lastGlobalLoopClosureId)
 				{
 					++recentWmCount;
 					if(currentRecentWmSize - recentWmCount < recentWmMaxSize)
@@ -1979,12 +2679,12 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 					}
 				}
 			}
-			else if(_lastGlobalLoopClosureId == 0 || iter->second->id() < _lastGlobalLoopClosureId)
+			else if(_lastGlobalLoopClosureId == 0 || s->id() < _lastGlobalLoopClosureId)
 			{
 				UDEBUG("weight=%d, id=%d",
-						iter->second->getWeight(),
-						iter->second->id());
-				removableSignatures.push_back(iter->second);
+						s->getWeight(),
+						s->id());
+				removableSignatures.push_back(s);
 			}
 			if(removableSignatures.size() >= (unsigned int)count)
 			{
@@ -1996,7 +2696,52 @@ std::list<Signature *> Memory::getRemovableSignatures(int count, const std::set<
 	{
 		ULOGGER_WARN("not enough signatures to get an old one...");
 	}
-	return removableSignatures;
+	return removableSignatures;
+}
+
+void Memory::setWeight(Signature * s, int weight)
+{
+	UASSERT(s != 0);
+	std::map<int, double>::const_iterator iter = _workingMemTable.contains(s->id())?_workingMem.find(s->id()):_workingMem.end();
+	if(iter != _workingMem.end())
+	{
+		removeFromTransferIndex(s, iter->second);
+		s->setWeight(weight);
+		addToTransferIndex(s, iter->second);
+	}
+	else
+	{
+		s->setWeight(weight);
+	}
+}
+
+void Memory::addToTransferIndex(const Signature * s, double age)
+{
+	if(s->id() > 0)
+	{
+		_transferIndex.insert(WeightAgeIdKey(s->getWeight(), _transferSortingByWeightId?0.0:age, s->id()));
+	}
+}
+
+void Memory::removeFromTransferIndex(const Signature * s, double age)
+{
+	if(s->id() > 0)
+	{
+		_transferIndex.erase(WeightAgeIdKey(s->getWeight(), _transferSortingByWeightId?0.0:age, s->id()));
+	}
+}
+
+void Memory::rebuildTransferIndex()
+{
+	_transferIndex.clear();
+	for(std::map<int, double>::const_iterator iter=_workingMem.begin(); iter!=_workingMem.end(); ++iter)
+	{
+		const Signature * s = _signaturesTable.get(iter->first);
+		if(s)
+		{
+			addToTransferIndex(s, iter->second);
+		}
+	}
 }
 
 /**
@@ -2007,6 +2752,11 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 	UDEBUG("id=%d", s?s->id():0);
 	if(s)
 	{
+		// features and words of a lazy signature are not loaded (no word references)
+		bool lazy = _lazySignatures.erase(s->id()) != 0;
+
+		invalidateNeighborsCache(s->id(), true);
+
 		// If not saved to database or it is a bad signature (not saved), remove links!
 		if(!keepLinkedToGraph || (!s->isSaved() && s->isBadSignature() && _badSignaturesIgnored))
 		{
@@ -2018,7 +2768,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 			{
 				if(iter->second.from() != iter->second.to())
 				{
-					Signature * sTo = this->_getSignature(iter->first);
+					Signature * sTo = _signaturesTable.get(iter->first);
 					// neighbor to s
 					UASSERT_MSG(sTo!=0,
 								uFormat("A neighbor (%d) of the deleted location %d is "
@@ -2035,7 +2785,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 					// child
 					if(iter->second.type() == Link::kGlobalClosure && s->id() > sTo->id())
 					{
-						sTo->setWeight(sTo->getWeight() + s->getWeight()); // copy weight
+						setWeight(sTo, sTo->getWeight() + s->getWeight()); // copy weight
 					}
 
 					sTo->removeLink(s->id());
@@ -2043,7 +2793,7 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 
 			}
 			s->removeLinks(); // remove all links
-			s->setWeight(0);
+			setWeight(s, 0);
 			s->setLabel(""); // reset label
 		}
 		else
@@ -2057,8 +2807,8 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 		this->disableWordsRef(s->id());
 		if(!keepLinkedToGraph)
 		{
-			std::list<int> keys = uUniqueKeys(s->getWords());
-			for(std::list<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
+			std::vector<int> keys = s->getUniqueWordIds();
+			for(std::vector<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
 			{
 				// assume just removed word doesn't have any other references
 				VisualWord * w = _vwd->getUnusedWord(*i);
@@ -2076,9 +2826,16 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 			}
 		}
 
-		_workingMem.erase(s->id());
+		std::map<int, double>::iterator wmIter = _workingMem.find(s->id());
+		if(wmIter != _workingMem.end())
+		{
+			removeFromTransferIndex(s, wmIter->second);
+			_workingMem.erase(wmIter);
+		}
+		_workingMemTable.erase(s->id());
 		_stMem.erase(s->id());
 		_signatures.erase(s->id());
+		_signaturesTable.erase(s->id());
 		if(_signaturesAdded>0)
 		{
 			--_signaturesAdded;
@@ -2102,11 +2859,20 @@ void Memory::moveToTrash(Signature * s, bool keepLinkedToGraph, std::list<int> *
 			_lastGlobalLoopClosureId = 0;
 		}
 
+		// A not modified lazy signature is already up to date in the database
 		if(	(_notLinkedNodesKeptInDb || keepLinkedToGraph) &&
 			_dbDriver &&
 			s->id()>0 &&
-			(_incrementalMemory || s->isSaved()))
+			(_incrementalMemory || s->isSaved()) &&
+			(!lazy || s->isModified()))
 		{
+			if(lazy)
+			{
+				// A signature taken back from the trash should be complete
+				std::list<Signature *> signatures;
+				signatures.push_back(s);
+				_dbDriver->loadFeatures(signatures);
+			}
 			_dbDriver->asyncSave(s);
 		}
 		else
@@ -2166,6 +2932,7 @@ bool Memory::labelSignature(int id, const std::string & label)
 		}
 		else if(_dbDriver)
 		{
+			discardPrefetchedSignature(id);
 			std::list<int> ids;
 			ids.push_back(id);
 			std::list<Signature *> signatures;
@@ -2262,12 +3029,15 @@ void Memory::removeLink(int oldId, int newId)
 
 		if(oldS->hasLink(newS->id()) && newS->hasLink(oldS->id()))
 		{
+			invalidateNeighborsCache(oldS->id());
+			invalidateNeighborsCache(newS->id());
+
 			Link::Type type = oldS->getLinks().at(newS->id()).type();
 			if(type == Link::kGlobalClosure && newS->getWeight() > 0)
 			{
 				// adjust the weight
-				oldS->setWeight(oldS->getWeight()+1);
-				newS->setWeight(newS->getWeight()>0?newS->getWeight()-1:0);
+				setWeight(oldS, oldS->getWeight()+1);
+				setWeight(newS, newS->getWeight()>0?newS->getWeight()-1:0);
 			}
 
 
@@ -2346,6 +3116,11 @@ Transform Memory::computeTransform(
 		RegistrationInfo * info,
 		bool useKnownCorrespondencesIfPossible)
 {
+	std::list<int> ids;
+	ids.push_back(fromId);
+	ids.push_back(toId);
+	loadLazySignatures(ids);
+
 	Signature * fromS = this->_getSignature(fromId);
 	Signature * toS = this->_getSignature(toId);
 
@@ -2379,15 +3154,37 @@ Transform Memory::computeTransform(
 
 	// make sure we have all data needed
 	// load binary data from database if not in RAM (if image is already here, scan and userData should be or they are null)
-	if((((_reextractLoopClosureFeatures || _visCorType==1) && _registrationPipeline->isImageRequired()) && fromS.sensorData().imageCompressed().empty()) ||
-	   (_registrationPipeline->isScanRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().laserScanCompressed().isEmpty()) ||
-	   (_registrationPipeline->isUserDataRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().userDataCompressed().empty()))
+	bool loadFrom =
+		(((_reextractLoopClosureFeatures || _visCorType==1) && _registrationPipeline->isImageRequired()) && fromS.sensorData().imageCompressed().empty()) ||
+		(_registrationPipeline->isScanRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().laserScanCompressed().isEmpty()) ||
+		(_registrationPipeline->isUserDataRequired() && fromS.sensorData().imageCompressed().empty() && fromS.sensorData().userDataCompressed().empty());
+	bool loadTo =
+		(((_reextractLoopClosureFeatures || _visCorType==1) && _registrationPipeline->isImageRequired()) && toS.sensorData().imageCompressed().empty()) ||
+		(_registrationPipeline->isScanRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().laserScanCompressed().isEmpty()) ||
+		(_registrationPipeline->isUserDataRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().userDataCompressed().empty());
+	if(loadFrom && loadTo)
+	{
+		// both nodes in one query, and uncompress in parallel only what we need
+		std::vector<int> ids(2);
+		ids[0] = fromS.id();
+		ids[1] = toS.id();
+		std::vector<SensorData> data = getNodesData(ids);
+		if(_dbDriver)
+		{
+			_dbDriver->uncompressNodesData(data,
+					(_reextractLoopClosureFeatures || _visCorType==1) && _registrationPipeline->isImageRequired(),
+					_registrationPipeline->isScanRequired(),
+					_registrationPipeline->isUserDataRequired(),
+					false);
+		}
+		fromS.sensorData() = data[0];
+		toS.sensorData() = data[1];
+	}
+	else if(loadFrom)
 	{
 		fromS.sensorData() = getNodeData(fromS.id());
 	}
-	if((((_reextractLoopClosureFeatures || _visCorType==1) && _registrationPipeline->isImageRequired()) && toS.sensorData().imageCompressed().empty()) ||
-	   (_registrationPipeline->isScanRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().laserScanCompressed().isEmpty()) ||
-	   (_registrationPipeline->isUserDataRequired() && toS.sensorData().imageCompressed().empty() && toS.sensorData().userDataCompressed().empty()))
+	else if(loadTo)
 	{
 		toS.sensorData() = getNodeData(toS.id());
 	}
@@ -2409,7 +3206,7 @@ Transform Memory::computeTransform(
 	// compute transform fromId -> toId
 	std::vector<int> inliersV;
 	if((_reextractLoopClosureFeatures && _registrationPipeline->isImageRequired()) ||
-		(fromS.getWords().size() && toS.getWords().size()) ||
+		(fromS.getWordIds().size() && toS.getWordIds().size()) ||
 		(!guess.isNull() && !_registrationPipeline->isImageRequired()))
 	{
 		Signature tmpFrom = fromS;
@@ -2492,8 +3289,8 @@ Transform Memory::computeIcpTransformMulti(
 		const std::map<int, Transform> & poses,
 		RegistrationInfo * info)
 {
-	UASSERT(uContains(poses, fromId) && uContains(_signatures, fromId));
-	UASSERT(uContains(poses, toId) && uContains(_signatures, toId));
+	UASSERT(uContains(poses, fromId) && _signaturesTable.contains(fromId));
+	UASSERT(uContains(poses, toId) && _signaturesTable.contains(toId));
 
 	UDEBUG("%d -> %d, Guess=%s", fromId, toId, (poses.at(fromId).inverse() * poses.at(toId)).prettyPrint().c_str());
 	if(ULogger::level() == ULogger::kDebug)
@@ -2651,6 +3448,8 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 	ULOGGER_INFO("to=%d, from=%d transform: %s var=%f", link.to(), link.from(), link.transform().prettyPrint().c_str(), link.transVariance());
 	Signature * toS = _getSignature(link.to());
 	Signature * fromS = _getSignature(link.from());
+	invalidateNeighborsCache(link.from());
+	invalidateNeighborsCache(link.to());
 	if(toS && fromS)
 	{
 		if(toS->hasLink(link.from()))
@@ -2684,13 +3483,13 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 					if((_reduceGraph && fromS->id() < toS->id()) ||
 					   (!_reduceGraph && fromS->id() > toS->id()))
 					{
-						fromS->setWeight(fromS->getWeight() + toS->getWeight());
-						toS->setWeight(0);
+						setWeight(fromS, fromS->getWeight() + toS->getWeight());
+						setWeight(toS, 0);
 					}
 					else
 					{
-						toS->setWeight(toS->getWeight() + fromS->getWeight());
-						fromS->setWeight(0);
+						setWeight(toS, toS->getWeight() + fromS->getWeight());
+						setWeight(fromS, 0);
 					}
 				}
 			}
@@ -2711,18 +3510,22 @@ bool Memory::addLink(const Link & link, bool addInDatabase)
 	else if(fromS)
 	{
 		UDEBUG("Add link between %d and %d (db)", link.from(), link.to());
+		discardPrefetchedSignature(link.to());
 		fromS->addLink(link);
 		_dbDriver->addLink(link.inverse());
 	}
 	else if(toS)
 	{
 		UDEBUG("Add link between %d (db) and %d", link.from(), link.to());
+		discardPrefetchedSignature(link.from());
 		_dbDriver->addLink(link);
 		toS->addLink(link.inverse());
 	}
 	else
 	{
 		UDEBUG("Add link between %d (db) and %d (db)", link.from(), link.to());
+		discardPrefetchedSignature(link.from());
+		discardPrefetchedSignature(link.to());
 		_dbDriver->addLink(link);
 		_dbDriver->addLink(link.inverse());
 	}
@@ -2733,6 +3536,8 @@ void Memory::updateLink(const Link & link, bool updateInDatabase)
 {
 	Signature * fromS = this->_getSignature(link.from());
 	Signature * toS = this->_getSignature(link.to());
+	invalidateNeighborsCache(link.from());
+	invalidateNeighborsCache(link.to());
 
 	if(fromS && toS)
 	{
@@ -2770,6 +3575,7 @@ void Memory::updateLink(const Link & link, bool updateInDatabase)
 	else if(fromS)
 	{
 		UDEBUG("Update link between %d and %d (db)", link.from(), link.to());
+		discardPrefetchedSignature(link.to());
 		fromS->removeLink(link.to());
 		fromS->addLink(link);
 		_dbDriver->updateLink(link.inverse());
@@ -2777,6 +3583,7 @@ void Memory::updateLink(const Link & link, bool updateInDatabase)
 	else if(toS)
 	{
 		UDEBUG("Update link between %d (db) and %d", link.from(), link.to());
+		discardPrefetchedSignature(link.from());
 		toS->removeLink(link.from());
 		toS->addLink(link.inverse());
 		_dbDriver->updateLink(link);
@@ -2784,6 +3591,8 @@ void Memory::updateLink(const Link & link, bool updateInDatabase)
 	else
 	{
 		UDEBUG("Update link between %d (db) and %d (db)", link.from(), link.to());
+		discardPrefetchedSignature(link.from());
+		discardPrefetchedSignature(link.to());
 		_dbDriver->updateLink(link);
 		_dbDriver->updateLink(link.inverse());
 	}
@@ -2796,6 +3605,7 @@ void Memory::removeAllVirtualLinks()
 	{
 		iter->second->removeVirtualLinks();
 	}
+	clearNeighborsCache();
 }
 
 void Memory::removeVirtualLinks(int signatureId)
@@ -2810,6 +3620,8 @@ void Memory::removeVirtualLinks(int signatureId)
 			if(iter->second.type() == Link::kVirtualClosure)
 			{
 				Signature * sTo = this->_getSignature(iter->first);
+				invalidateNeighborsCache(s->id());
+				invalidateNeighborsCache(iter->first);
 				if(sTo)
 				{
 					sTo->removeLink(s->id());
@@ -2867,23 +3679,24 @@ void Memory::dumpSignatures(const char * fileNameSign, bool words3D) const
 			{
 				if(words3D)
 				{
-					const std::multimap<int, cv::Point3f> & ref = ss->getWords3();
-					for(std::multimap<int, cv::Point3f>::const_iterator jter=ref.begin(); jter!=ref.end(); ++jter)
+					const std::vector<int> & ids = ss->getWordIds();
+					const std::vector<cv::Point3f> & ref = ss->getWords3Pts();
+					for(unsigned int j=0; j<ref.size(); ++j)
 					{
 						//show only valid point according to current parameters
-						if(pcl::isFinite(jter->second) &&
-						   (jter->second.x != 0 || jter->second.y != 0 || jter->second.z != 0))
+						if(pcl::isFinite(ref[j]) &&
+						   (ref[j].x != 0 || ref[j].y != 0 || ref[j].z != 0))
 						{
-							fprintf(foutSign, "%d ", (*jter).first);
+							fprintf(foutSign, "%d ", ids[j]);
 						}
 					}
 				}
 				else
 				{
-					const std::multimap<int, cv::KeyPoint> & ref = ss->getWords();
-					for(std::multimap<int, cv::KeyPoint>::const_iterator jter=ref.begin(); jter!=ref.end(); ++jter)
+					const std::vector<int> & ids = ss->getWordIds();
+					for(unsigned int j=0; j<ids.size(); ++j)
 					{
-						fprintf(foutSign, "%d ", (*jter).first);
+						fprintf(foutSign, "%d ", ids[j]);
 					}
 				}
 			}
@@ -2960,25 +3773,42 @@ void Memory::rehearsal(Signature * signature, Statistics * stats)
 	}
 
 	//============================================================
-	// Compare with the last (not intermediate node)
+	// Compare with the last ones (not intermediate nodes)
 	//============================================================
-	Signature * sB = 0;
-	for(std::set<int>::reverse_iterator iter=_stMem.rbegin(); iter!=_stMem.rend(); ++iter)
+	std::vector<const Signature *> lastSignatures;
+	for(std::set<int>::reverse_iterator iter=_stMem.rbegin(); iter!=_stMem.rend() && (int)lastSignatures.size() < _rehearsalMaxCompared; ++iter)
 	{
 		Signature * s = this->_getSignature(*iter);
 		UASSERT(s!=0);
 		if(s->getWeight() >= 0 && s->id() != signature->id())
 		{
-			sB = s;
-			break;
+			lastSignatures.push_back(s);
 		}
 	}
-	if(sB)
+	if(lastSignatures.size())
 	{
-		int id = sB->id();
-		UDEBUG("Comparing with signature (%d)...", id);
+		UDEBUG("Comparing with %d signatures (last=%d)...", (int)lastSignatures.size(), lastSignatures.front()->id());
 
-		float sim = signature->compareTo(*sB);
+		// keep the most similar, the most recent on equality
+		const Signature * sB = lastSignatures.front();
+		float sim = 0.0f;
+		if(lastSignatures.size() == 1)
+		{
+			sim = signature->compareTo(*sB);
+		}
+		else
+		{
+			std::vector<float> similarities = signature->compareTo(lastSignatures);
+			for(unsigned int i=0; i<similarities.size(); ++i)
+			{
+				if(similarities[i] > sim)
+				{
+					sim = similarities[i];
+					sB = lastSignatures[i];
+				}
+			}
+		}
+		int id = sB->id();
 
 		int merged = 0;
 		if(sim >= _similarityThreshold)
@@ -2992,7 +3822,7 @@ void Memory::rehearsal(Signature * signature, Statistics * stats)
 			}
 			else
 			{
-				signature->setWeight(signature->getWeight() + 1 + sB->getWeight());
+				setWeight(signature, signature->getWeight() + 1 + sB->getWeight());
 			}
 		}
 
@@ -3032,6 +3862,10 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 				oldS->id(), oldS->getWeight(),
 				newS->id(), newS->getWeight());
 
+		// links or weights (intermediate nodes) of both nodes will change
+		invalidateNeighborsCache(oldS->id(), true);
+		invalidateNeighborsCache(newS->id(), true);
+
 		bool fullMerge;
 		bool intermediateMerge = false;
 		if(!newS->getLinks().empty() && !newS->getLinks().begin()->second.transform().isNull())
@@ -3104,7 +3938,7 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 				this->copyData(oldS, newS);
 
 				// update weight
-				newS->setWeight(newS->getWeight() + 1 + oldS->getWeight());
+				setWeight(newS, newS->getWeight() + 1 + oldS->getWeight());
 
 				if(_lastGlobalLoopClosureId == oldS->id())
 				{
@@ -3116,7 +3950,7 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 				newS->addLink(Link(newS->id(), oldS->id(), Link::kGlobalClosure, Transform() , cv::Mat::eye(6,6,CV_64FC1))); // to keep track of the merged location
 
 				// update weight
-				oldS->setWeight(newS->getWeight() + 1 + oldS->getWeight());
+				setWeight(oldS, newS->getWeight() + 1 + oldS->getWeight());
 
 				if(_lastSignature == newS)
 				{
@@ -3136,8 +3970,8 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 			{
 				// just update weight
 				int w = oldS->getWeight()>=0?oldS->getWeight():0;
-				newS->setWeight(w + newS->getWeight() + 1);
-				oldS->setWeight(intermediateMerge?-1:0); // convert to intermediate node
+				setWeight(newS, w + newS->getWeight() + 1);
+				setWeight(oldS, intermediateMerge?-1:0); // convert to intermediate node
 
 				if(_lastGlobalLoopClosureId == oldS->id())
 				{
@@ -3147,8 +3981,8 @@ bool Memory::rehearsalMerge(int oldId, int newId)
 			else // !_idUpdatedToNewOneRehearsal
 			{
 				int w = newS->getWeight()>=0?newS->getWeight():0;
-				oldS->setWeight(w + oldS->getWeight() + 1);
-				newS->setWeight(intermediateMerge?-1:0); // convert to intermediate node
+				setWeight(oldS, w + oldS->getWeight() + 1);
+				setWeight(newS, intermediateMerge?-1:0); // convert to intermediate node
 			}
 		}
 	}
@@ -3261,12 +4095,62 @@ SensorData Memory::getNodeData(int nodeId, bool uncompressedData) const
 	return r;
 }
 
+std::vector<SensorData> Memory::getNodesData(const std::vector<int> & nodeIds, bool uncompressedData) const
+{
+	UDEBUG("nodes=%d", (int)nodeIds.size());
+	std::vector<SensorData> r(nodeIds.size());
+	std::vector<int> idsToLoad;
+	std::vector<int> indexesToLoad;
+	for(unsigned int i=0; i<nodeIds.size(); ++i)
+	{
+		Signature * s = this->_getSignature(nodeIds[i]);
+		if(s && !s->sensorData().imageCompressed().empty())
+		{
+			r[i] = s->sensorData();
+		}
+		else if(_dbDriver)
+		{
+			idsToLoad.push_back(nodeIds[i]);
+			indexesToLoad.push_back(i);
+		}
+	}
+
+	if(idsToLoad.size())
+	{
+		// load from database
+		std::vector<SensorData> loaded;
+		_dbDriver->getNodesData(idsToLoad, loaded, true, true, true, true, false);
+		for(unsigned int i=0; i<indexesToLoad.size(); ++i)
+		{
+			r[indexesToLoad[i]] = loaded[i];
+		}
+	}
+
+	if(uncompressedData)
+	{
+		if(_dbDriver)
+		{
+			_dbDriver->uncompressNodesData(r);
+		}
+		else
+		{
+			for(unsigned int i=0; i<r.size(); ++i)
+			{
+				r[i].uncompressData();
+			}
+		}
+	}
+
+	return r;
+}
+
 void Memory::getNodeWords(int nodeId,
 		std::multimap<int, cv::KeyPoint> & words,
 		std::multimap<int, cv::Point3f> & words3,
 		std::multimap<int, cv::Mat> & wordsDescriptors)
 {
 	UDEBUG("nodeId=%d", nodeId);
+	loadLazySignatures(std::list<int>(1, nodeId));
 	Signature * s = this->_getSignature(nodeId);
 	if(s)
 	{
@@ -3357,7 +4241,7 @@ int Memory::getNi(int signatureId) const
 	const Signature * s = this->getSignature(signatureId);
 	if(s)
 	{
-		ni = (int)((Signature *)s)->getWords().size();
+		ni = (int)s->getWordIds().size();
 	}
 	else
 	{
@@ -3375,7 +4259,7 @@ void Memory::copyData(const Signature * from, Signature * to)
 	{
 		// words 2d
 		this->disableWordsRef(to->id());
-		to->setWords(from->getWords());
+		to->setWords(from->getWordIds(), from->getWordsKpts(), from->getWords3Pts(), from->getWordsDescriptorsMat());
 		std::list<int> id;
 		id.push_back(to->id());
 		this->enableWordsRef(id);
@@ -3392,8 +4276,6 @@ void Memory::copyData(const Signature * from, Signature * to)
 		to->sensorData().setId(to->id());
 
 		to->setPose(from->getPose());
-		to->setWords3(from->getWords3());
-		to->setWordsDescriptors(from->getWordsDescriptors());
 	}
 	else
 	{
@@ -3418,6 +4300,209 @@ private:
 	VWDictionary * _vwp;
 };
 
+// Post-decimation and compression of the images of a new signature
+class SignatureImagesStage : public UThread
+{
+public:
+	SignatureImagesStage(
+			const SensorData & data,
+			int postDecimation,
+			bool compressed,
+			bool saveDepth16Format,
+			bool compressionParallelized) :
+		_image(data.imageRaw()),
+		_depthOrRightImage(data.depthOrRightRaw()),
+		_cameraModels(data.cameraModels()),
+		_stereoCameraModel(data.stereoCameraModel()),
+		_depthDecimated(!data.rightRaw().empty() ||
+				(data.depthRaw().rows == data.imageRaw().rows && data.depthRaw().cols == data.imageRaw().cols)),
+		_postDecimation(postDecimation),
+		_compressed(compressed),
+		_saveDepth16Format(saveDepth16Format),
+		_compressionParallelized(compressionParallelized),
+		_decimationTime(0.0),
+		_compressionTime(0.0)
+	{}
+	virtual ~SignatureImagesStage() {}
+
+	void process()
+	{
+		UTimer timer;
+		if(_postDecimation > 1)
+		{
+			if(_depthDecimated)
+			{
+				_depthOrRightImage = util2d::decimate(_depthOrRightImage, _postDecimation);
+			}
+			_image = util2d::decimate(_image, _postDecimation);
+			for(unsigned int i=0; i<_cameraModels.size(); ++i)
+			{
+				_cameraModels[i] = _cameraModels[i].scaled(1.0/double(_postDecimation));
+			}
+			if(_stereoCameraModel.isValidForProjection())
+			{
+				_stereoCameraModel.scale(1.0/double(_postDecimation));
+			}
+			_decimationTime = timer.ticks();
+		}
+
+		if(_compressed)
+		{
+			if(_saveDepth16Format && !_depthOrRightImage.empty() && _depthOrRightImage.type() == CV_32FC1)
+			{
+				UWARN("Save depth data to 16 bits format: depth type detected is 32FC1, use 16UC1 depth format to avoid this conversion (or set parameter \"Mem/SaveDepth16Format\"=false to use 32bits format).");
+				_depthOrRightImage = util2d::cvtDepthFromFloat(_depthOrRightImage);
+			}
+			if(_compressionParallelized)
+			{
+				rtabmap::CompressionThread ctDepth(_depthOrRightImage, std::string(".png"));
+				if(!_depthOrRightImage.empty())
+				{
+					ctDepth.start();
+				}
+				_compressedImage = compressImage2(_image, std::string(".jpg"));
+				ctDepth.join();
+				_compressedDepth = ctDepth.getCompressedData();
+			}
+			else
+			{
+				_compressedImage = compressImage2(_image, std::string(".jpg"));
+				_compressedDepth = compressImage2(_depthOrRightImage, _depthOrRightImage.type() == CV_32FC1 || _depthOrRightImage.type() == CV_16UC1?std::string(".png"):std::string(".jpg"));
+			}
+			_compressionTime = timer.ticks();
+		}
+	}
+
+	const cv::Mat & image() const {return _image;}
+	const cv::Mat & depthOrRightImage() const {return _depthOrRightImage;}
+	const std::vector<CameraModel> & cameraModels() const {return _cameraModels;}
+	const StereoCameraModel & stereoCameraModel() const {return _stereoCameraModel;}
+	const cv::Mat & compressedImage() const {return _compressedImage;}
+	const cv::Mat & compressedDepth() const {return _compressedDepth;}
+	double decimationTime() const {return _decimationTime;}
+	double compressionTime() const {return _compressionTime;}
+
+private:
+	virtual void mainLoop()
+	{
+		process();
+		this->kill();
+	}
+
+private:
+	cv::Mat _image;
+	cv::Mat _depthOrRightImage;
+	std::vector<CameraModel> _cameraModels;
+	StereoCameraModel _stereoCameraModel;
+	bool _depthDecimated;
+	int _postDecimation;
+	bool _compressed;
+	bool _saveDepth16Format;
+	bool _compressionParallelized;
+	cv::Mat _compressedImage;
+	cv::Mat _compressedDepth;
+	double _decimationTime;
+	double _compressionTime;
+};
+
+// Filtering and compression of the laser scan of a new signature
+class SignatureScanStage : public UThread
+{
+public:
+	SignatureScanStage(
+			const LaserScan & scan,
+			bool filtered,
+			int downsampleStepSize,
+			float voxelSize,
+			int normalK,
+			float normalRadius,
+			bool compressed) :
+		_scan(scan),
+		_filtered(filtered),
+		_downsampleStepSize(downsampleStepSize),
+		_voxelSize(voxelSize),
+		_normalK(normalK),
+		_normalRadius(normalRadius),
+		_compressed(compressed),
+		_filteringTime(0.0),
+		_compressionTime(0.0)
+	{}
+	virtual ~SignatureScanStage() {}
+
+	void process()
+	{
+		UTimer timer;
+		if(_filtered && _scan.size())
+		{
+			if(_scan.maxRange() == 0.0f)
+			{
+				bool id2d = _scan.is2d();
+				float maxRange = 0.0f;
+				for(int i=0; i<_scan.size(); ++i)
+				{
+					const float * ptr = _scan.data().ptr<float>(0, i);
+					float r;
+					if(id2d)
+					{
+						r = ptr[0]*ptr[0] + ptr[1]*ptr[1];
+					}
+					else
+					{
+						r = ptr[0]*ptr[0] + ptr[1]*ptr[1] + ptr[2]*ptr[2];
+					}
+					if(r>maxRange)
+					{
+						maxRange = r;
+					}
+				}
+				if(maxRange > 0.0f)
+				{
+					_scan=LaserScan(_scan.data(), _scan.maxPoints(), sqrt(maxRange), _scan.format(), _scan.localTransform());
+				}
+			}
+
+			_scan = util3d::commonFiltering(_scan,
+					_downsampleStepSize,
+					0,
+					0,
+					_voxelSize,
+					_normalK,
+					_normalRadius);
+			_filteringTime = timer.ticks();
+		}
+
+		if(_compressed && !_scan.isEmpty())
+		{
+			_compressedScan = compressData2(_scan.data());
+			_compressionTime = timer.ticks();
+		}
+	}
+
+	const LaserScan & scan() const {return _scan;}
+	const cv::Mat & compressedScan() const {return _compressedScan;}
+	double filteringTime() const {return _filteringTime;}
+	double compressionTime() const {return _compressionTime;}
+
+private:
+	virtual void mainLoop()
+	{
+		process();
+		this->kill();
+	}
+
+private:
+	LaserScan _scan;
+	bool _filtered;
+	int _downsampleStepSize;
+	float _voxelSize;
+	int _normalK;
+	float _normalRadius;
+	bool _compressed;
+	cv::Mat _compressedScan;
+	double _filteringTime;
+	double _compressionTime;
+};
+
 Signature * Memory::createSignature(const SensorData & inputData, const Transform & pose, Statistics * stats)
 {
 	UDEBUG("");
@@ -3550,6 +4635,30 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		preUpdateThread.start();
 	}
 
+	// Stages not depending on visual features
+	bool dataCompressed = this->isBinDataKept() && (!isIntermediateNode || _saveIntermediateNodeData);
+	bool compressionRequired = dataCompressed || !isIntermediateNode; // scans can be used for local scan matching
+	SignatureImagesStage imagesStage(
+			data,
+			isIntermediateNode?1:_imagePostDecimation,
+			dataCompressed,
+			_saveDepth16Format,
+			_compressionParallelized);
+	SignatureScanStage scanStage(
+			data.laserScanRaw(),
+			!isIntermediateNode,
+			_laserScanDownsampleStepSize,
+			_laserScanVoxelSize,
+			_laserScanNormalK,
+			_laserScanNormalRadius,
+			compressionRequired);
+	if(_signatureStagesParallelized)
+	{
+		UDEBUG("Start images and scan stages");
+		imagesStage.start();
+		scanStage.start();
+	}
+
 	int preDecimation = 1;
 	std::vector<cv::Point3f> keypoints3D;
 	if(!_useOdometryFeatures || data.keypoints().empty() || (int)data.keypoints().size() != data.descriptors().rows)
@@ -3826,37 +4935,35 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		UDEBUG("id %d is a bad signature", id);
 	}
 
-	std::multimap<int, cv::KeyPoint> words;
-	std::multimap<int, cv::Point3f> words3D;
-	std::multimap<int, cv::Mat> wordsDescriptors;
+	// words in keypoints order, the signature sorts them by id
+	std::vector<int> words;
+	std::vector<cv::KeyPoint> wordsKpts;
+	std::vector<cv::Point3f> words3D;
+	cv::Mat wordsDescriptors;
 	if(wordIds.size() > 0)
 	{
 		UASSERT(wordIds.size() == keypoints.size());
 		UASSERT(keypoints3D.size() == 0 || keypoints3D.size() == wordIds.size());
-		unsigned int i=0;
-		float decimationRatio = preDecimation / _imagePostDecimation;
-		double log2value = log(double(preDecimation))/log(2.0);
-		for(std::list<int>::iterator iter=wordIds.begin(); iter!=wordIds.end() && i < keypoints.size(); ++iter, ++i)
-		{
-			cv::KeyPoint kpt = keypoints[i];
-			if(preDecimation != _imagePostDecimation)
+		words = uListToVector(wordIds);
+		wordsKpts = keypoints;
+		if(preDecimation != _imagePostDecimation)
+		{
+			// remap keypoints to final image size
+			float decimationRatio = preDecimation / _imagePostDecimation;
+			double log2value = log(double(preDecimation))/log(2.0);
+			for(unsigned int i=0; i<wordsKpts.size(); ++i)
 			{
-				// remap keypoints to final image size
+				cv::KeyPoint & kpt = wordsKpts[i];
 				kpt.pt.x *= decimationRatio;
 				kpt.pt.y *= decimationRatio;
 				kpt.size *= decimationRatio;
 				kpt.octave += log2value;
 			}
-			words.insert(std::pair<int, cv::KeyPoint>(*iter, kpt));
-
-			if(keypoints3D.size())
-			{
-				words3D.insert(std::pair<int, cv::Point3f>(*iter, keypoints3D.at(i)));
-			}
-			if(_rawDescriptorsKept)
-			{
-				wordsDescriptors.insert(std::pair<int, cv::Mat>(*iter, descriptors.row(i).clone()));
-			}
+		}
+		words3D = keypoints3D;
+		if(_rawDescriptorsKept)
+		{
+			wordsDescriptors = descriptors.rowRange(0, (int)words.size());
 		}
 	}
 
@@ -3869,28 +4976,43 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 	{
 		UDEBUG("Generate 3D words using odometry");
 		Signature * previousS = _signatures.rbegin()->second;
-		if(previousS->getWords().size() > 8 && words.size() > 8 && !previousS->getPose().isNull())
+		if(previousS->getWordIds().size() > 8 && words.size() > 8 && !previousS->getPose().isNull())
 		{
 			Transform cameraTransform = pose.inverse() * previousS->getPose();
+			std::map<int, cv::KeyPoint> uniqueWords;
+			std::map<int, int> wordCounts;
+			for(unsigned int i=0; i<words.size(); ++i)
+			{
+				uniqueWords.insert(std::make_pair(words[i], wordsKpts[i]));
+				++wordCounts[words[i]];
+			}
+			for(std::map<int, int>::iterator iter=wordCounts.begin(); iter!=wordCounts.end(); ++iter)
+			{
+				if(iter->second > 1)
+				{
+					uniqueWords.erase(iter->first);
+				}
+			}
 			// compute 3D words by epipolar geometry with the previous signature
 			std::map<int, cv::Point3f> inliers = util3d::generateWords3DMono(
-					uMultimapToMapUnique(words),
-					uMultimapToMapUnique(previousS->getWords()),
+					uniqueWords,
+					previousS->getUniqueWordsKpts(),
 					data.cameraModels()[0],
 					cameraTransform);
 
 			// words3D should have the same size than words
 			float bad_point = std::numeric_limits<float>::quiet_NaN ();
-			for(std::multimap<int, cv::KeyPoint>::const_iterator iter=words.begin(); iter!=words.end(); ++iter)
+			words3D.resize(words.size());
+			for(unsigned int i=0; i<words.size(); ++i)
 			{
-				std::map<int, cv::Point3f>::iterator jter=inliers.find(iter->first);
+				std::map<int, cv::Point3f>::iterator jter=inliers.find(words[i]);
 				if(jter != inliers.end())
 				{
-					words3D.insert(std::make_pair(iter->first, jter->second));
+					words3D[i] = jter->second;
 				}
 				else
 				{
-					words3D.insert(std::make_pair(iter->first, cv::Point3f(bad_point,bad_point,bad_point)));
+					words3D[i] = cv::Point3f(bad_point,bad_point,bad_point);
 				}
 			}
 
@@ -3901,198 +5023,55 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 		}
 	}
 
-	cv::Mat image = data.imageRaw();
-	cv::Mat depthOrRightImage = data.depthOrRightRaw();
-	std::vector<CameraModel> cameraModels = data.cameraModels();
-	StereoCameraModel stereoCameraModel = data.stereoCameraModel();
-
-	// apply decimation?
-	if(_imagePostDecimation > 1 && !isIntermediateNode)
+	// compress user data while the other stages are running
+	timer.ticks();
+	cv::Mat compressedUserData;
+	if(compressionRequired && !data.userDataRaw().empty())
 	{
-		if(!data.rightRaw().empty() ||
-			(data.depthRaw().rows == image.rows && data.depthRaw().cols == image.cols))
-		{
-			depthOrRightImage = util2d::decimate(depthOrRightImage, _imagePostDecimation);
-		}
-		image = util2d::decimate(image, _imagePostDecimation);
-		for(unsigned int i=0; i<cameraModels.size(); ++i)
-		{
-			cameraModels[i] = cameraModels[i].scaled(1.0/double(_imagePostDecimation));
-		}
-		if(stereoCameraModel.isValidForProjection())
-		{
-			stereoCameraModel.scale(1.0/double(_imagePostDecimation));
-		}
-
-		t = timer.ticks();
-		if(stats) stats->addStatistic(Statistics::kTimingMemPost_decimation(), t*1000.0f);
-		UDEBUG("time post-decimation = %fs", t);
+		compressedUserData = compressData2(data.userDataRaw());
 	}
+	double userDataCompressionTime = timer.ticks();
 
-	// Filter the laser scan?
-	LaserScan laserScan = data.laserScanRaw();
-	if(!isIntermediateNode && laserScan.size())
+	// Feature-independent stages should be finished at this point
+	if(_signatureStagesParallelized)
 	{
-		if(laserScan.maxRange() == 0.0f)
-		{
-			bool id2d = laserScan.is2d();
-			float maxRange = 0.0f;
-			for(int i=0; i<laserScan.size(); ++i)
-			{
-				const float * ptr = laserScan.data().ptr<float>(0, i);
-				float r;
-				if(id2d)
-				{
-					r = ptr[0]*ptr[0] + ptr[1]*ptr[1];
-				}
-				else
-				{
-					r = ptr[0]*ptr[0] + ptr[1]*ptr[1] + ptr[2]*ptr[2];
-				}
-				if(r>maxRange)
-				{
-					maxRange = r;
-				}
-			}
-			if(maxRange > 0.0f)
-			{
-				laserScan=LaserScan(laserScan.data(), laserScan.maxPoints(), sqrt(maxRange), laserScan.format(), laserScan.localTransform());
-			}
-		}
-
-		laserScan = util3d::commonFiltering(laserScan,
-				_laserScanDownsampleStepSize,
-				0,
-				0,
-				_laserScanVoxelSize,
-				_laserScanNormalK,
-				_laserScanNormalRadius);
+		imagesStage.join();
+		scanStage.join();
 		t = timer.ticks();
-		if(stats) stats->addStatistic(Statistics::kTimingMemScan_filtering(), t*1000.0f);
-		UDEBUG("time normals scan = %fs", t);
+		if(stats) stats->addStatistic(Statistics::kTimingMemJoining_stages(), t*1000.0f);
+		UDEBUG("time joining stages = %fs", t);
 	}
-
-	Signature * s;
-	if(this->isBinDataKept() && (!isIntermediateNode || _saveIntermediateNodeData))
+	else
 	{
-		UDEBUG("Bin data kept: rgb=%d, depth=%d, scan=%d, userData=%d",
-				image.empty()?0:1,
-				depthOrRightImage.empty()?0:1,
-				laserScan.isEmpty()?0:1,
-				data.userDataRaw().empty()?0:1);
-
-		std::vector<unsigned char> imageBytes;
-		std::vector<unsigned char> depthBytes;
-
-		if(_saveDepth16Format && !depthOrRightImage.empty() && depthOrRightImage.type() == CV_32FC1)
-		{
-			UWARN("Save depth data to 16 bits format: depth type detected is 32FC1, use 16UC1 depth format to avoid this conversion (or set parameter \"Mem/SaveDepth16Format\"=false to use 32bits format).");
-			depthOrRightImage = util2d::cvtDepthFromFloat(depthOrRightImage);
-		}
-
-		cv::Mat compressedImage;
-		cv::Mat compressedDepth;
-		cv::Mat compressedScan;
-		cv::Mat compressedUserData;
-		if(_compressionParallelized)
-		{
-			rtabmap::CompressionThread ctImage(image, std::string(".jpg"));
-			rtabmap::CompressionThread ctDepth(depthOrRightImage, std::string(".png"));
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			if(!image.empty())
-			{
-				ctImage.start();
-			}
-			if(!depthOrRightImage.empty())
-			{
-				ctDepth.start();
-			}
-			if(!laserScan.isEmpty())
-			{
-				ctLaserScan.start();
-			}
-			if(!data.userDataRaw().empty())
-			{
-				ctUserData.start();
-			}
-			ctImage.join();
-			ctDepth.join();
-			ctLaserScan.join();
-			ctUserData.join();
-
-			compressedImage = ctImage.getCompressedData();
-			compressedDepth = ctDepth.getCompressedData();
-			compressedScan = ctLaserScan.getCompressedData();
-			compressedUserData = ctUserData.getCompressedData();
-		}
-		else
-		{
-			compressedImage = compressImage2(image, std::string(".jpg"));
-			compressedDepth = compressImage2(depthOrRightImage, depthOrRightImage.type() == CV_32FC1 || depthOrRightImage.type() == CV_16UC1?std::string(".png"):std::string(".jpg"));
-			compressedScan = compressData2(laserScan.data());
-			compressedUserData = compressData2(data.userDataRaw());
-		}
-
-		s = new Signature(id,
-			_idMapCount,
-			isIntermediateNode?-1:0, // tag intermediate nodes as weight=-1
-			data.stamp(),
-			"",
-			pose,
-			data.groundTruth(),
-			stereoCameraModel.isValidForProjection()?
-				SensorData(
-						LaserScan(compressedScan, laserScan.maxPoints(), laserScan.maxRange(), laserScan.format(), laserScan.localTransform()),
-						compressedImage,
-						compressedDepth,
-						stereoCameraModel,
-						id,
-						0,
-						compressedUserData):
-				SensorData(
-						LaserScan(compressedScan, laserScan.maxPoints(), laserScan.maxRange(), laserScan.format(), laserScan.localTransform()),
-						compressedImage,
-						compressedDepth,
-						cameraModels,
-						id,
-						0,
-						compressedUserData));
+		imagesStage.process();
+		scanStage.process();
+		timer.ticks();
 	}
-	else
+	if(imagesStage.decimationTime() > 0.0)
 	{
-		UDEBUG("Bin data kept: scan=%d, userData=%d",
-						laserScan.isEmpty()?0:1,
-						data.userDataRaw().empty()?0:1);
+		if(stats) stats->addStatistic(Statistics::kTimingMemPost_decimation(), imagesStage.decimationTime()*1000.0f);
+		UDEBUG("time post-decimation = %fs", imagesStage.decimationTime());
+	}
+	if(scanStage.filteringTime() > 0.0)
+	{
+		if(stats) stats->addStatistic(Statistics::kTimingMemScan_filtering(), scanStage.filteringTime()*1000.0f);
+		UDEBUG("time normals scan = %fs", scanStage.filteringTime());
+	}
 
-		// just compress user data and laser scan (scans can be used for local scan matching)
-		cv::Mat compressedScan;
-		cv::Mat compressedUserData;
-		if(_compressionParallelized)
-		{
-			rtabmap::CompressionThread ctUserData(data.userDataRaw());
-			rtabmap::CompressionThread ctLaserScan(laserScan.data());
-			if(!data.userDataRaw().empty() && !isIntermediateNode)
-			{
-				ctUserData.start();
-			}
-			if(!laserScan.isEmpty() && !isIntermediateNode)
-			{
-				ctLaserScan.start();
-			}
-			ctUserData.join();
-			ctLaserScan.join();
+	const cv::Mat & image = imagesStage.image();
+	const cv::Mat & depthOrRightImage = imagesStage.depthOrRightImage();
+	const std::vector<CameraModel> & cameraModels = imagesStage.cameraModels();
+	const StereoCameraModel & stereoCameraModel = imagesStage.stereoCameraModel();
+	const LaserScan & laserScan = scanStage.scan();
+	const cv::Mat & compressedScan = scanStage.compressedScan();
 
-			compressedScan = ctLaserScan.getCompressedData();
-			compressedUserData = ctUserData.getCompressedData();
-		}
-		else
-		{
-			compressedScan = compressData2(laserScan.data());
-			compressedUserData = compressData2(data.userDataRaw());
-		}
+	UDEBUG("Bin data kept: rgb=%d, depth=%d, scan=%d, userData=%d",
+			imagesStage.compressedImage().empty()?0:1,
+			imagesStage.compressedDepth().empty()?0:1,
+			compressedScan.empty()?0:1,
+			compressedUserData.empty()?0:1);
 
-		s = new Signature(id,
+	Signature * s = new Signature(id,
 			_idMapCount,
 			isIntermediateNode?-1:0, // tag intermediate nodes as weight=-1
 			data.stamp(),
@@ -4102,25 +5081,22 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 			stereoCameraModel.isValidForProjection()?
 				SensorData(
 						LaserScan(compressedScan, laserScan.maxPoints(), laserScan.maxRange(), laserScan.format(), laserScan.localTransform()),
-						cv::Mat(),
-						cv::Mat(),
+						imagesStage.compressedImage(),
+						imagesStage.compressedDepth(),
 						stereoCameraModel,
 						id,
 						0,
 						compressedUserData):
 				SensorData(
 						LaserScan(compressedScan, laserScan.maxPoints(), laserScan.maxRange(), laserScan.format(), laserScan.localTransform()),
-						cv::Mat(),
-						cv::Mat(),
+						imagesStage.compressedImage(),
+						imagesStage.compressedDepth(),
 						cameraModels,
 						id,
 						0,
 						compressedUserData));
-	}
 
-	s->setWords(words);
-	s->setWords3(words3D);
-	s->setWordsDescriptors(wordsDescriptors);
+	s->setWords(words, wordsKpts, words3D, wordsDescriptors);
 
 	// set raw data
 	s->sensorData().setImageRaw(image);
@@ -4131,7 +5107,8 @@ Signature * Memory::createSignature(const SensorData & inputData, const Transfor
 	s->sensorData().setGroundTruth(data.groundTruth());
 	s->sensorData().setGPS(data.gps());
 
-	t = timer.ticks();
+	timer.ticks();
+	t = float(imagesStage.compressionTime() + scanStage.compressionTime() + userDataCompressionTime);
 	if(stats) stats->addStatistic(Statistics::kTimingMemCompressing_data(), t*1000.0f);
 	UDEBUG("time compressing data (id=%d) %fs", id, t);
 	if(words.size())
@@ -4200,11 +5177,10 @@ void Memory::disableWordsRef(int signatureId)
 	Signature * ss = this->_getSignature(signatureId);
 	if(ss && ss->isEnabled())
 	{
-		const std::multimap<int, cv::KeyPoint> & words = ss->getWords();
-		const std::list<int> & keys = uUniqueKeys(words);
+		const std::vector<int> & keys = ss->getUniqueWordIds();
 		int count = _vwd->getTotalActiveReferences();
 		// First remove all references
-		for(std::list<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
+		for(std::vector<int>::const_iterator i=keys.begin(); i!=keys.end(); ++i)
 		{
 			_vwd->removeAllWordRef(*i, signatureId);
 		}
@@ -4257,10 +5233,10 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 		if(ss && !ss->isEnabled())
 		{
 			surfSigns.push_back(ss);
-			std::list<int> uniqueKeys = uUniqueKeys(ss->getWords());
+			std::vector<int> uniqueKeys = ss->getUniqueWordIds();
 
 			//Find words in the signature which they are not in the current dictionary
-			for(std::list<int>::const_iterator k=uniqueKeys.begin(); k!=uniqueKeys.end(); ++k)
+			for(std::vector<int>::const_iterator k=uniqueKeys.begin(); k!=uniqueKeys.end(); ++k)
 			{
 				if(*k>0 && _vwd->getWord(*k) == 0 && _vwd->getUnusedWord(*k) == 0)
 				{
@@ -4276,8 +5252,27 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 	std::list<VisualWord *> vws;
 	if(oldWordIds.size() && _dbDriver)
 	{
-		// get the descriptors
-		_dbDriver->loadWords(oldWordIds, vws);
+		// take first the words already loaded in background
+		std::set<int> wordIdsNotPrefetched;
+		for(std::set<int>::iterator iter=oldWordIds.begin(); iter!=oldWordIds.end(); ++iter)
+		{
+			std::map<int, VisualWord *>::iterator jter = _prefetchedWords.find(*iter);
+			if(jter != _prefetchedWords.end())
+			{
+				vws.push_back(jter->second);
+				_prefetchedWords.erase(jter);
+			}
+			else
+			{
+				wordIdsNotPrefetched.insert(wordIdsNotPrefetched.end(), *iter);
+			}
+		}
+		UDEBUG("prefetched words = %d", (int)vws.size());
+		if(wordIdsNotPrefetched.size())
+		{
+			// get the descriptors
+			_dbDriver->loadWords(wordIdsNotPrefetched, vws);
+		}
 	}
 	UDEBUG("loading words(%d) time=%fs", oldWordIds.size(), timer.ticks());
 
@@ -4312,13 +5307,12 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 		}
 		UDEBUG("Added %d to dictionary, time=%fs", vws.size()-refsToChange.size(), timer.ticks());
 
-		//update the global references map and update the signatures reactivated
-		for(std::map<int, int>::const_iterator iter=refsToChange.begin(); iter != refsToChange.end(); ++iter)
+		//update the signatures reactivated, all references of a signature at once
+		if(refsToChange.size())
 		{
-			//uInsert(_wordRefsToChange, (const std::pair<int, int>)*iter); // This will be used to change references in the database
 			for(std::list<Signature *>::iterator j=surfSigns.begin(); j!=surfSigns.end(); ++j)
 			{
-				(*j)->changeWordsRef(iter->first, iter->second);
+				(*j)->changeWordsRef(refsToChange);
 			}
 		}
 		UDEBUG("changing ref, total=%d, time=%fs", refsToChange.size(), timer.ticks());
@@ -4329,7 +5323,7 @@ void Memory::enableWordsRef(const std::list<int> & signatureIds)
 	// Reactivate references and signatures
 	for(std::list<Signature *>::iterator j=surfSigns.begin(); j!=surfSigns.end(); ++j)
 	{
-		const std::vector<int> & keys = uKeys((*j)->getWords());
+		const std::vector<int> & keys = (*j)->getWordIds();
 		if(keys.size())
 		{
 			// Add all references
@@ -4373,9 +5367,31 @@ std::set<int> Memory::reactivateSignatures(const std::list<int> & ids, unsigned
 	UDEBUG("idsToLoad = %d", idsToLoad.size());
 
 	std::list<Signature *> reactivatedSigns;
+	_lastSignaturesPrefetched = 0;
 	if(_dbDriver)
 	{
-		_dbDriver->loadSignatures(idsToLoad, reactivatedSigns);
+		// take first the signatures already loaded in background
+		joinPrefetchThread();
+		std::list<int> idsNotPrefetched;
+		for(std::list<int>::iterator iter=idsToLoad.begin(); iter!=idsToLoad.end(); ++iter)
+		{
+			std::map<int, Signature *>::iterator jter = _prefetchedSignatures.find(*iter);
+			if(jter != _prefetchedSignatures.end())
+			{
+				reactivatedSigns.push_back(jter->second);
+				_prefetchedSignatures.erase(jter);
+				++_lastSignaturesPrefetched;
+			}
+			else
+			{
+				idsNotPrefetched.push_back(*iter);
+			}
+		}
+		UDEBUG("prefetched = %d", _lastSignaturesPrefetched);
+		if(idsNotPrefetched.size())
+		{
+			_dbDriver->loadSignatures(idsNotPrefetched, reactivatedSigns);
+		}
 	}
 	timeDbAccess = timer.getElapsedTime();
 	std::list<int> idsLoaded;
@@ -4390,6 +5406,36 @@ std::set<int> Memory::reactivateSignatures(const std::list<int> & ids, unsigned
 	return std::set<int>(idsToLoad.begin(), idsToLoad.end());
 }
 
+void Memory::prefetchSignatures(const std::list<int> & ids)
+{
+	// Prefetched signatures not reactivated since the last call were not
+	// predicted correctly, give them back to database.
+	clearPrefetchedSignatures();
+	_lastSignaturesPrefetched = 0;
+
+	if(!_dbDriver || !_dbDriver->isConnected())
+	{
+		return;
+	}
+
+	std::list<int> idsToLoad;
+	std::set<int> added;
+	for(std::list<int>::const_iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		if(*iter > 0 && this->_getSignature(*iter) == 0 && added.insert(*iter).second)
+		{
+			idsToLoad.push_back(*iter);
+		}
+	}
+
+	if(idsToLoad.size())
+	{
+		UDEBUG("Prefetching %d signatures", (int)idsToLoad.size());
+		_prefetchThread = new SignaturePrefetchThread(_dbDriver, idsToLoad);
+		_prefetchThread->start();
+	}
+}
+
 // return all non-null poses
 // return unique links between nodes (for neighbors: old->new, for loops: parent->child)
 void Memory::getMetricConstraints(
@@ -0,0 +1,335 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap/core/ObjectPool.h"
+#include "rtabmap/utilite/ULogger.h"
+#include "rtabmap/utilite/UConversion.h"
+#include <new>
+
+namespace rtabmap {
+
+// header at the beginning of each chunk, followed by its blocks
+struct ObjectPool::Chunk
+{
+	FreeBlock * freeList;
+	size_t freeBlocks;
+	Chunk * previous; // in the available list
+	Chunk * next;
+};
+
+// free blocks of a thread, registered in the pool to be released with it
+struct ObjectPool::ThreadCache
+{
+	ObjectPool * pool;
+	FreeBlock * freeList;
+	size_t size;
+	ThreadCache * previous;
+	ThreadCache * next;
+};
+
+ObjectPool::ObjectPool(size_t blockSize, size_t blocksPerChunk) :
+		blockSize_(blockSize),
+		blocksPerChunk_(blocksPerChunk),
+		headerSize_(0),
+		batchSize_(0),
+		available_(0),
+		emptyChunks_(0),
+		caches_(0),
+		used_(0),
+		peak_(0)
+{
+	UASSERT(blockSize > 0 && blocksPerChunk > 0);
+	// keep blocks aligned for any type
+	const size_t alignment = 16;
+	if(blockSize_ < sizeof(FreeBlock))
+	{
+		blockSize_ = sizeof(FreeBlock);
+	}
+	blockSize_ = ((blockSize_ + alignment - 1) / alignment) * alignment;
+	headerSize_ = ((sizeof(Chunk) + alignment - 1) / alignment) * alignment;
+	batchSize_ = blocksPerChunk_/2 < 32?blocksPerChunk_/2:32;
+	if(batchSize_ == 0)
+	{
+		batchSize_ = 1;
+	}
+#ifdef _WIN32
+	cacheKey_ = FlsAlloc(&ObjectPool::releaseThreadCache);
+	UASSERT_MSG(cacheKey_ != FLS_OUT_OF_INDEXES, "Cannot allocate the thread caches of the pool!");
+#else
+	int error = pthread_key_create(&cacheKey_, &ObjectPool::releaseThreadCache);
+	UASSERT_MSG(error == 0, uFormat("Cannot allocate the thread caches of the pool (error=%d)!", error).c_str());
+#endif
+}
+
+ObjectPool::~ObjectPool()
+{
+	// Caches of exited threads are already back in the chunks. On Windows,
+	// FlsFree() releases the remaining ones, pthread_key_delete() doesn't.
+#ifdef _WIN32
+	FlsFree(cacheKey_);
+#else
+	pthread_key_delete(cacheKey_);
+#endif
+	UScopeMutex lock(mutex_);
+	while(caches_)
+	{
+		ThreadCache * cache = caches_;
+		caches_ = cache->next;
+		used_ -= cache->size;
+		delete cache;
+	}
+	if(used_)
+	{
+		UWARN("%d blocks of %d bytes are still used, they are freed anyway!", (int)used_, (int)blockSize_);
+	}
+	for(std::set<Chunk*>::iterator iter=chunks_.begin(); iter!=chunks_.end(); ++iter)
+	{
+		::operator delete(*iter);
+	}
+}
+
+void * ObjectPool::allocate()
+{
+	ThreadCache * cache = threadCache();
+	if(cache->freeList == 0)
+	{
+		UScopeMutex lock(mutex_);
+		refill(cache);
+	}
+	FreeBlock * block = cache->freeList;
+	cache->freeList = block->next;
+	--cache->size;
+	return block;
+}
+
+void ObjectPool::deallocate(void * p)
+{
+	if(p == 0)
+	{
+		return;
+	}
+	ThreadCache * cache = threadCache();
+	FreeBlock * block = (FreeBlock *)p;
+	block->next = cache->freeList;
+	cache->freeList = block;
+	// blocks freed by another thread than the one allocating them (e.g., the
+	// trash thread) go back to the chunks
+	if(++cache->size >= 2*batchSize_)
+	{
+		UScopeMutex lock(mutex_);
+		flush(cache, batchSize_);
+	}
+}
+
+size_t ObjectPool::capacity() const
+{
+	UScopeMutex lock(mutex_);
+	return chunks_.size() * blocksPerChunk_;
+}
+
+size_t ObjectPool::used() const
+{
+	UScopeMutex lock(mutex_);
+	return used_;
+}
+
+size_t ObjectPool::peak() const
+{
+	UScopeMutex lock(mutex_);
+	return peak_;
+}
+
+ObjectPool::ThreadCache * ObjectPool::threadCache()
+{
+#ifdef _WIN32
+	ThreadCache * cache = (ThreadCache *)FlsGetValue(cacheKey_);
+#else
+	ThreadCache * cache = (ThreadCache *)pthread_getspecific(cacheKey_);
+#endif
+	if(cache == 0)
+	{
+		cache = new ThreadCache();
+		cache->pool = this;
+		cache->freeList = 0;
+		cache->size = 0;
+		cache->previous = 0;
+		mutex_.lock();
+		cache->next = caches_;
+		if(caches_)
+		{
+			caches_->previous = cache;
+		}
+		caches_ = cache;
+		mutex_.unlock();
+#ifdef _WIN32
+		FlsSetValue(cacheKey_, cache);
+#else
+		pthread_setspecific(cacheKey_, cache);
+#endif
+	}
+	return cache;
+}
+
+#ifdef _WIN32
+void WINAPI ObjectPool::releaseThreadCache(void * p)
+#else
+void ObjectPool::releaseThreadCache(void * p)
+#endif
+{
+	ThreadCache * cache = (ThreadCache *)p;
+	if(cache)
+	{
+		ObjectPool * pool = cache->pool;
+		UScopeMutex lock(pool->mutex_);
+		pool->flush(cache, cache->size);
+		if(cache->previous)
+		{
+			cache->previous->next = cache->next;
+		}
+		else
+		{
+			pool->caches_ = cache->next;
+		}
+		if(cache->next)
+		{
+			cache->next->previous = cache->previous;
+		}
+		delete cache;
+	}
+}
+
+void ObjectPool::refill(ThreadCache * cache)
+{
+	for(size_t i=0; i<batchSize_; ++i)
+	{
+		if(available_ == 0)
+		{
+			// ::operator new returns memory aligned for any type
+			char * data = (char *)::operator new(headerSize_ + blockSize_ * blocksPerChunk_);
+			Chunk * chunk = (Chunk *)data;
+			chunk->freeList = 0;
+			chunk->freeBlocks = blocksPerChunk_;
+			chunk->previous = 0;
+			chunk->next = 0;
+			for(size_t j=blocksPerChunk_; j>0; --j)
+			{
+				FreeBlock * block = (FreeBlock *)(data + headerSize_ + (j-1)*blockSize_);
+				block->next = chunk->freeList;
+				chunk->freeList = block;
+			}
+			chunks_.insert(chunk);
+			available_ = chunk;
+			++emptyChunks_;
+		}
+		Chunk * chunk = available_;
+		if(chunk->freeBlocks == blocksPerChunk_)
+		{
+			--emptyChunks_;
+		}
+		FreeBlock * block = chunk->freeList;
+		chunk->freeList = block->next;
+		if(--chunk->freeBlocks == 0)
+		{
+			available_ = chunk->next;
+			if(available_)
+			{
+				available_->previous = 0;
+			}
+			chunk->next = 0;
+		}
+		block->next = cache->freeList;
+		cache->freeList = block;
+		++cache->size;
+	}
+	used_ += batchSize_;
+	if(used_ > peak_)
+	{
+		peak_ = used_;
+	}
+}
+
+void ObjectPool::flush(ThreadCache * cache, size_t blocks)
+{
+	UASSERT(blocks <= cache->size && blocks <= used_);
+	for(size_t i=0; i<blocks; ++i)
+	{
+		FreeBlock * block = cache->freeList;
+		cache->freeList = block->next;
+
+		// the chunk of the block is the last one starting before it
+		std::set<Chunk*>::iterator iter = chunks_.upper_bound((Chunk*)block);
+		UASSERT_MSG(iter != chunks_.begin(), "The block was not allocated by this pool!");
+		Chunk * chunk = *(--iter);
+		UASSERT_MSG((char*)block < (char*)chunk + headerSize_ + blockSize_ * blocksPerChunk_, "The block was not allocated by this pool!");
+
+		block->next = chunk->freeList;
+		chunk->freeList = block;
+		if(chunk->freeBlocks++ == 0)
+		{
+			chunk->previous = 0;
+			chunk->next = available_;
+			if(available_)
+			{
+				available_->previous = chunk;
+			}
+			available_ = chunk;
+		}
+		if(chunk->freeBlocks == blocksPerChunk_)
+		{
+			if(emptyChunks_ > 0)
+			{
+				releaseChunk(chunk);
+			}
+			else
+			{
+				++emptyChunks_;
+			}
+		}
+	}
+	cache->size -= blocks;
+	used_ -= blocks;
+}
+
+void ObjectPool::releaseChunk(Chunk * chunk)
+{
+	if(chunk->previous)
+	{
+		chunk->previous->next = chunk->next;
+	}
+	else
+	{
+		available_ = chunk->next;
+	}
+	if(chunk->next)
+	{
+		chunk->next->previous = chunk->previous;
+	}
+	chunks_.erase(chunk);
+	::operator delete(chunk);
+}
+
+} /* namespace rtabmap */
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/Quantization.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <string.h>
+
+namespace rtabmap {
+
+namespace quantization {
+
+// minimum and step
+#define QUANTIZATION_HEADER_SIZE (2*sizeof(float))
+
+int quantizedSize(int dim)
+{
+	return dim + QUANTIZATION_HEADER_SIZE;
+}
+
+bool isQuantized(int bytes, int dim)
+{
+	return dim > 0 && bytes == quantizedSize(dim);
+}
+
+cv::Mat quantize(const cv::Mat & descriptors)
+{
+	UASSERT(descriptors.empty() || descriptors.type() == CV_32FC1);
+	cv::Mat quantized(descriptors.rows, quantizedSize(descriptors.cols), CV_8UC1);
+	for(int i=0; i<descriptors.rows; ++i)
+	{
+		const float * d = descriptors.ptr<float>(i);
+		unsigned char * q = quantized.ptr<unsigned char>(i);
+		float minValue = d[0];
+		float maxValue = d[0];
+		for(int j=1; j<descriptors.cols; ++j)
+		{
+			if(d[j] < minValue)
+			{
+				minValue = d[j];
+			}
+			else if(d[j] > maxValue)
+			{
+				maxValue = d[j];
+			}
+		}
+		float step = (maxValue - minValue) / 255.0f;
+		memcpy(q, &minValue, sizeof(float));
+		memcpy(q+sizeof(float), &step, sizeof(float));
+		q += QUANTIZATION_HEADER_SIZE;
+		float scale = step > 0.0f?1.0f/step:0.0f;
+		for(int j=0; j<descriptors.cols; ++j)
+		{
+			q[j] = (unsigned char)((d[j] - minValue) * scale + 0.5f);
+		}
+	}
+	return quantized;
+}
+
+cv::Mat dequantize(const cv::Mat & quantized)
+{
+	UASSERT(quantized.empty() || (quantized.type() == CV_8UC1 && quantized.cols > (int)QUANTIZATION_HEADER_SIZE));
+	int dim = quantized.cols - QUANTIZATION_HEADER_SIZE;
+	cv::Mat descriptors(quantized.rows, dim, CV_32FC1);
+	for(int i=0; i<quantized.rows; ++i)
+	{
+		const unsigned char * q = quantized.ptr<unsigned char>(i);
+		float * d = descriptors.ptr<float>(i);
+		float minValue, step;
+		memcpy(&minValue, q, sizeof(float));
+		memcpy(&step, q+sizeof(float), sizeof(float));
+		q += QUANTIZATION_HEADER_SIZE;
+		for(int j=0; j<dim; ++j)
+		{
+			d[j] = minValue + float(q[j]) * step;
+		}
+	}
+	return descriptors;
+}
+
+} /* namespace quantization */
+
+} /* namespace rtabmap */
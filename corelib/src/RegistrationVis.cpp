@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/VisualWord.h>
 #include <rtabmap/core/Optimizer.h>
 #include <rtabmap/core/util3d_transforms.h>
+#include <rtabmap/core/SimdDistance.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/utilite/UConversion.h>
 #include <rtabmap/utilite/UStl.h>
@@ -210,9 +211,9 @@ Transform RegistrationVis::computeTransformationImpl(
 
 	UDEBUG("Input(%d): from=%d words, %d 3D words, %d words descriptors,  %d kpts, %d kpts3D, %d descriptors, image=%dx%d",
 			fromSignature.id(),
-			(int)fromSignature.getWords().size(),
-			(int)fromSignature.getWords3().size(),
-			(int)fromSignature.getWordsDescriptors().size(),
+			(int)fromSignature.getWordIds().size(),
+			(int)fromSignature.getWords3Pts().size(),
+			fromSignature.getWordsDescriptorsMat().rows,
 			(int)fromSignature.sensorData().keypoints().size(),
 			(int)fromSignature.sensorData().keypoints3D().size(),
 			fromSignature.sensorData().descriptors().rows,
@@ -221,9 +222,9 @@ Transform RegistrationVis::computeTransformationImpl(
 
 	UDEBUG("Input(%d): to=%d words, %d 3D words, %d words descriptors, %d kpts, %d kpts3D, %d descriptors, image=%dx%d",
 			toSignature.id(),
-			(int)toSignature.getWords().size(),
-			(int)toSignature.getWords3().size(),
-			(int)toSignature.getWordsDescriptors().size(),
+			(int)toSignature.getWordIds().size(),
+			(int)toSignature.getWords3Pts().size(),
+			toSignature.getWordsDescriptorsMat().rows,
 			(int)toSignature.sensorData().keypoints().size(),
 			(int)toSignature.sensorData().keypoints3D().size(),
 			toSignature.sensorData().descriptors().rows,
@@ -237,11 +238,11 @@ Transform RegistrationVis::computeTransformationImpl(
 	// Find correspondences
 	////////////////////
 	//recompute correspondences if descriptors are provided
-	if((fromSignature.getWordsDescriptors().empty() && toSignature.getWordsDescriptors().empty()) &&
-	   (_estimationType<2 || fromSignature.getWords().size()) && // required only for 2D->2D
-	   (_estimationType==0 || toSignature.getWords().size()) && // required only for 3D->2D or 2D->2D
-	   fromSignature.getWords3().size() && // required in all estimation approaches
-	   (_estimationType==1 || toSignature.getWords3().size())) // required only for 3D->3D and 2D->2D
+	if((fromSignature.getWordsDescriptorsMat().empty() && toSignature.getWordsDescriptorsMat().empty()) &&
+	   (_estimationType<2 || fromSignature.getWordIds().size()) && // required only for 2D->2D
+	   (_estimationType==0 || toSignature.getWordIds().size()) && // required only for 3D->2D or 2D->2D
+	   fromSignature.getWords3Pts().size() && // required in all estimation approaches
+	   (_estimationType==1 || toSignature.getWords3Pts().size())) // required only for 3D->3D and 2D->2D
 	{
 		// no need to extract new features, we have all the data we need
 		UDEBUG("");
@@ -250,20 +251,20 @@ Transform RegistrationVis::computeTransformationImpl(
 	{
 		UDEBUG("");
 		// just some checks to make sure that input data are ok
-		UASSERT(fromSignature.getWords().empty() ||
-				fromSignature.getWords3().empty() ||
-				(fromSignature.getWords().size() == fromSignature.getWords3().size()));
+		UASSERT(fromSignature.getWordIds().empty() ||
+				fromSignature.getWords3Pts().empty() ||
+				(fromSignature.getWordIds().size() == fromSignature.getWords3Pts().size()));
 		UASSERT((int)fromSignature.sensorData().keypoints().size() == fromSignature.sensorData().descriptors().rows ||
-				fromSignature.getWords().size() == fromSignature.getWordsDescriptors().size() ||
+				(int)fromSignature.getWordIds().size() == fromSignature.getWordsDescriptorsMat().rows ||
 				fromSignature.sensorData().descriptors().rows == 0 ||
-				fromSignature.getWordsDescriptors().size() == 0);
-		UASSERT((toSignature.getWords().empty() && toSignature.getWords3().empty())||
-				(toSignature.getWords().size() && toSignature.getWords3().empty())||
-				(toSignature.getWords().size() == toSignature.getWords3().size()));
+				fromSignature.getWordsDescriptorsMat().empty());
+		UASSERT((toSignature.getWordIds().empty() && toSignature.getWords3Pts().empty())||
+				(toSignature.getWordIds().size() && toSignature.getWords3Pts().empty())||
+				(toSignature.getWordIds().size() == toSignature.getWords3Pts().size()));
 		UASSERT((int)toSignature.sensorData().keypoints().size() == toSignature.sensorData().descriptors().rows ||
-				toSignature.getWords().size() == toSignature.getWordsDescriptors().size() ||
+				(int)toSignature.getWordIds().size() == toSignature.getWordsDescriptorsMat().rows ||
 				toSignature.sensorData().descriptors().rows == 0 ||
-				toSignature.getWordsDescriptors().size() == 0);
+				toSignature.getWordsDescriptorsMat().empty());
 		UASSERT(fromSignature.sensorData().imageRaw().empty() ||
 				fromSignature.sensorData().imageRaw().type() == CV_8UC1 ||
 				fromSignature.sensorData().imageRaw().type() == CV_8UC3);
@@ -277,7 +278,7 @@ Transform RegistrationVis::computeTransformationImpl(
 		cv::Mat imageTo = toSignature.sensorData().imageRaw();
 
 		std::vector<int> orignalWordsFromIds;
-		if(fromSignature.getWords().empty())
+		if(fromSignature.getWordIds().empty())
 		{
 			if(fromSignature.sensorData().keypoints().empty())
 			{
@@ -313,19 +314,15 @@ Transform RegistrationVis::computeTransformationImpl(
 		}
 		else
 		{
-			kptsFrom.resize(fromSignature.getWords().size());
-			orignalWordsFromIds.resize(fromSignature.getWords().size());
-			int i=0;
+			kptsFrom = fromSignature.getWordsKpts();
+			orignalWordsFromIds = fromSignature.getWordIds();
 			bool allUniques = true;
-			for(std::multimap<int, cv::KeyPoint>::const_iterator iter=fromSignature.getWords().begin(); iter!=fromSignature.getWords().end(); ++iter)
+			for(unsigned int i=1; i<orignalWordsFromIds.size() && allUniques; ++i)
 			{
-				kptsFrom[i] = iter->second;
-				orignalWordsFromIds[i] = iter->first;
-				if(i>0 && iter->first==orignalWordsFromIds[i-1])
+				if(orignalWordsFromIds[i]==orignalWordsFromIds[i-1])
 				{
 					allUniques = false;
 				}
-				++i;
 			}
 			if(!allUniques)
 			{
@@ -358,9 +355,9 @@ Transform RegistrationVis::computeTransformationImpl(
 			}
 
 			std::vector<cv::Point3f> kptsFrom3D;
-			if(kptsFrom.size() == fromSignature.getWords3().size())
+			if(kptsFrom.size() == fromSignature.getWords3Pts().size())
 			{
-				kptsFrom3D = uValues(fromSignature.getWords3());
+				kptsFrom3D = fromSignature.getWords3Pts();
 			}
 			else if(kptsFrom.size() == fromSignature.sensorData().keypoints3D().size())
 			{
@@ -486,7 +483,7 @@ Transform RegistrationVis::computeTransformationImpl(
 		{
 			UDEBUG("");
 			std::vector<cv::KeyPoint> kptsTo;
-			if(toSignature.getWords().empty())
+			if(toSignature.getWordIds().empty())
 			{
 				if(toSignature.sensorData().keypoints().empty() &&
 				   !imageTo.empty())
@@ -520,27 +517,18 @@ Transform RegistrationVis::computeTransformationImpl(
 			}
 			else
 			{
-				kptsTo = uValues(toSignature.getWords());
+				kptsTo = toSignature.getWordsKpts();
 			}
 
 			// extract descriptors
 			UDEBUG("kptsFrom=%d", (int)kptsFrom.size());
 			UDEBUG("kptsTo=%d", (int)kptsTo.size());
 			cv::Mat descriptorsFrom;
-			if(fromSignature.getWordsDescriptors().size() &&
-					((kptsFrom.empty() && fromSignature.getWordsDescriptors().size()) ||
-					 fromSignature.getWordsDescriptors().size() == kptsFrom.size()))
+			if(!fromSignature.getWordsDescriptorsMat().empty() &&
+					(kptsFrom.empty() ||
+					 fromSignature.getWordsDescriptorsMat().rows == (int)kptsFrom.size()))
 			{
-				descriptorsFrom = cv::Mat(fromSignature.getWordsDescriptors().size(),
-						fromSignature.getWordsDescriptors().begin()->second.cols,
-						fromSignature.getWordsDescriptors().begin()->second.type());
-				int i=0;
-				for(std::multimap<int, cv::Mat>::const_iterator iter=fromSignature.getWordsDescriptors().begin();
-					iter!=fromSignature.getWordsDescriptors().end();
-					++iter, ++i)
-				{
-					iter->second.copyTo(descriptorsFrom.row(i));
-				}
+				descriptorsFrom = fromSignature.getWordsDescriptorsMat().clone();
 			}
 			else if(fromSignature.sensorData().descriptors().rows == (int)kptsFrom.size())
 			{
@@ -561,18 +549,9 @@ Transform RegistrationVis::computeTransformationImpl(
 			cv::Mat descriptorsTo;
 			if(kptsTo.size())
 			{
-				if(toSignature.getWordsDescriptors().size() == kptsTo.size())
+				if(toSignature.getWordsDescriptorsMat().rows == (int)kptsTo.size())
 				{
-					descriptorsTo = cv::Mat(toSignature.getWordsDescriptors().size(),
-							toSignature.getWordsDescriptors().begin()->second.cols,
-							toSignature.getWordsDescriptors().begin()->second.type());
-					int i=0;
-					for(std::multimap<int, cv::Mat>::const_iterator iter=toSignature.getWordsDescriptors().begin();
-						iter!=toSignature.getWordsDescriptors().end();
-						++iter, ++i)
-					{
-						iter->second.copyTo(descriptorsTo.row(i));
-					}
+					descriptorsTo = toSignature.getWordsDescriptorsMat().clone();
 				}
 				else if(toSignature.sensorData().descriptors().rows == (int)kptsTo.size())
 				{
@@ -594,9 +573,9 @@ Transform RegistrationVis::computeTransformationImpl(
 			// create 3D keypoints
 			std::vector<cv::Point3f> kptsFrom3D;
 			std::vector<cv::Point3f> kptsTo3D;
-			if(kptsFrom.size() == fromSignature.getWords3().size())
+			if(kptsFrom.size() == fromSignature.getWords3Pts().size())
 			{
-				kptsFrom3D = uValues(fromSignature.getWords3());
+				kptsFrom3D = fromSignature.getWords3Pts();
 			}
 			else if(kptsFrom.size() == fromSignature.sensorData().keypoints3D().size())
 			{
@@ -604,12 +583,12 @@ Transform RegistrationVis::computeTransformationImpl(
 			}
 			else
 			{
-				if(fromSignature.getWords3().size() && kptsFrom.size() != fromSignature.getWords3().size())
+				if(fromSignature.getWords3Pts().size() && kptsFrom.size() != fromSignature.getWords3Pts().size())
 				{
 					UWARN("kptsFrom (%d) is not the same size as fromSignature.getWords3() (%d), there "
 						   "is maybe a problem with the logic above (getWords3() should be null or equal to kptsfrom). Regenerating kptsFrom3D...",
 						   kptsFrom.size(),
-						   fromSignature.getWords3().size());
+						   fromSignature.getWords3Pts().size());
 				}
 				else if(fromSignature.sensorData().keypoints3D().size() && kptsFrom.size() != fromSignature.sensorData().keypoints3D().size())
 				{
@@ -664,9 +643,9 @@ Transform RegistrationVis::computeTransformationImpl(
 				}
 			}
 
-			if(kptsTo.size() == toSignature.getWords3().size())
+			if(kptsTo.size() == toSignature.getWords3Pts().size())
 			{
-				kptsTo3D = uValues(toSignature.getWords3());
+				kptsTo3D = toSignature.getWords3Pts();
 			}
 			else if(kptsTo.size() == toSignature.sensorData().keypoints3D().size())
 			{
@@ -674,12 +653,12 @@ Transform RegistrationVis::computeTransformationImpl(
 			}
 			else
 			{
-				if(toSignature.getWords3().size() && kptsTo.size() != toSignature.getWords3().size())
+				if(toSignature.getWords3Pts().size() && kptsTo.size() != toSignature.getWords3Pts().size())
 				{
 					UWARN("kptsTo (%d) is not the same size as toSignature.getWords3() (%d), there "
 						   "is maybe a problem with the logic above (getWords3() should be null or equal to kptsTo). Regenerating kptsTo3D...",
 						   (int)kptsTo.size(),
-						   (int)toSignature.getWords3().size());
+						   (int)toSignature.getWords3Pts().size());
 				}
 				else if(toSignature.sensorData().keypoints3D().size() && kptsTo.size() != toSignature.sensorData().keypoints3D().size())
 				{
@@ -847,8 +826,8 @@ Transform RegistrationVis::computeTransformationImpl(
 										if(oi >=2)
 										{
 											std::vector<std::vector<cv::DMatch> > matches;
-											cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-											matcher.knnMatch(descriptorsTo.row(i), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											// same as cv::BFMatcher with NORM_HAMMING/NORM_L2SQR
+											simd::knnMatch(descriptorsTo.row(i), std::vector<cv::Mat>(1, cv::Mat(descriptors, cv::Range(0, oi))), matches, 2);
 											UASSERT(matches.size() == 1);
 											UASSERT(matches[0].size() == 2);
 											if(matches[0].at(0).distance < _nndr * matches[0].at(1).distance)
@@ -998,8 +977,8 @@ Transform RegistrationVis::computeTransformationImpl(
 										if(oi >=2)
 										{
 											std::vector<std::vector<cv::DMatch> > matches;
-											cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-											matcher.knnMatch(descriptorsFrom.row(matchedIndexFrom), cv::Mat(descriptors, cv::Range(0, oi)), matches, 2);
+											// same as cv::BFMatcher with NORM_HAMMING/NORM_L2SQR
+											simd::knnMatch(descriptorsFrom.row(matchedIndexFrom), std::vector<cv::Mat>(1, cv::Mat(descriptors, cv::Range(0, oi))), matches, 2);
 											UASSERT(matches.size() == 1);
 											UASSERT(matches[0].size() == 2);
 											bruteForceTotalTime+=bruteForceTimer.elapsed();
@@ -1197,7 +1176,7 @@ Transform RegistrationVis::computeTransformationImpl(
 	int matchesCount = 0;
 	info.inliersIDs.clear();
 	info.matchesIDs.clear();
-	if(toSignature.getWords().size())
+	if(toSignature.getWordIds().size())
 	{
 		Transform transforms[2];
 		std::vector<int> inliers[2];
@@ -1229,8 +1208,8 @@ Transform RegistrationVis::computeTransformationImpl(
 				{
 					UERROR("Calibrated camera required (multi-cameras not supported).");
 				}
-				else if((int)signatureA->getWords().size() >= _minInliers &&
-						(int)signatureB->getWords().size() >= _minInliers)
+				else if((int)signatureA->getWordIds().size() >= _minInliers &&
+						(int)signatureB->getWordIds().size() >= _minInliers)
 				{
 					UASSERT(signatureA->sensorData().stereoCameraModel().isValidForProjection() || (signatureA->sensorData().cameraModels().size() == 1 && signatureA->sensorData().cameraModels()[0].isValidForProjection()));
 					const CameraModel & cameraModel = signatureA->sensorData().stereoCameraModel().isValidForProjection()?signatureA->sensorData().stereoCameraModel().left():signatureA->sensorData().cameraModels()[0];
@@ -1239,8 +1218,8 @@ Transform RegistrationVis::computeTransformationImpl(
 					Transform cameraTransform;
 					double variance = 1.0f;
 					std::map<int, cv::Point3f> inliers3D = util3d::generateWords3DMono(
-							uMultimapToMapUnique(signatureA->getWords()),
-							uMultimapToMapUnique(signatureB->getWords()),
+							signatureA->getUniqueWordsKpts(),
+							signatureB->getUniqueWordsKpts(),
 							cameraModel,
 							cameraTransform,
 							_iterations,
@@ -1249,7 +1228,7 @@ Transform RegistrationVis::computeTransformationImpl(
 							_PnPRefineIterations,
 							1.0f,
 							0.99f,
-							uMultimapToMapUnique(signatureA->getWords3()), // for scale estimation
+							signatureA->getUniqueWords3(), // for scale estimation
 							&variance);
 					covariances[dir] *= variance;
 					inliers[dir] = uKeys(inliers3D);
@@ -1287,9 +1266,9 @@ Transform RegistrationVis::computeTransformationImpl(
 						UINFO(msg.c_str());
 					}
 				}
-				else if(signatureA->getWords().size() == 0)
+				else if(signatureA->getWordIds().size() == 0)
 				{
-					msg = uFormat("No enough features (%d)", (int)signatureA->getWords().size());
+					msg = uFormat("No enough features (%d)", (int)signatureA->getWordIds().size());
 					UWARN(msg.c_str());
 				}
 				else
@@ -1313,10 +1292,10 @@ Transform RegistrationVis::computeTransformationImpl(
 				}
 				else
 				{
-					UDEBUG("words from3D=%d to2D=%d", (int)signatureA->getWords3().size(), (int)signatureB->getWords().size());
+					UDEBUG("words from3D=%d to2D=%d", (int)signatureA->getWords3Pts().size(), (int)signatureB->getWordIds().size());
 					// 3D to 2D
-					if((int)signatureA->getWords3().size() >= _minInliers &&
-					   (int)signatureB->getWords().size() >= _minInliers)
+					if((int)signatureA->getWords3Pts().size() >= _minInliers &&
+					   (int)signatureB->getWordIds().size() >= _minInliers)
 					{
 						UASSERT(signatureB->sensorData().stereoCameraModel().isValidForProjection() || (signatureB->sensorData().cameraModels().size() == 1 && signatureB->sensorData().cameraModels()[0].isValidForProjection()));
 						const CameraModel & cameraModel = signatureB->sensorData().stereoCameraModel().isValidForProjection()?signatureB->sensorData().stereoCameraModel().left():signatureB->sensorData().cameraModels()[0];
@@ -1324,8 +1303,8 @@ Transform RegistrationVis::computeTransformationImpl(
 						std::vector<int> inliersV;
 						std::vector<int> matchesV;
 						transforms[dir] = util3d::estimateMotion3DTo2D(
-								uMultimapToMapUnique(signatureA->getWords3()),
-								uMultimapToMapUnique(signatureB->getWords()),
+								signatureA->getUniqueWords3(),
+								signatureB->getUniqueWordsKpts(),
 								cameraModel,
 								_minInliers,
 								_iterations,
@@ -1333,7 +1312,7 @@ Transform RegistrationVis::computeTransformationImpl(
 								_PnPFlags,
 								_PnPRefineIterations,
 								dir==0?(!guess.isNull()?guess:Transform::getIdentity()):!transforms[0].isNull()?transforms[0].inverse():(!guess.isNull()?guess.inverse():Transform::getIdentity()),
-								uMultimapToMapUnique(signatureB->getWords3()),
+								signatureB->getUniqueWords3(),
 								&covariances[dir],
 								&matchesV,
 								&inliersV);
@@ -1353,7 +1332,7 @@ Transform RegistrationVis::computeTransformationImpl(
 					else
 					{
 						msg = uFormat("Not enough features in images (old=%d, new=%d, min=%d)",
-								(int)signatureA->getWords3().size(), (int)signatureB->getWords().size(), _minInliers);
+								(int)signatureA->getWords3Pts().size(), (int)signatureB->getWordIds().size(), _minInliers);
 						UINFO(msg.c_str());
 					}
 				}
@@ -1363,14 +1342,14 @@ Transform RegistrationVis::computeTransformationImpl(
 			{
 				UDEBUG("");
 				// 3D -> 3D
-				if((int)signatureA->getWords3().size() >= _minInliers &&
-				   (int)signatureB->getWords3().size() >= _minInliers)
+				if((int)signatureA->getWords3Pts().size() >= _minInliers &&
+				   (int)signatureB->getWords3Pts().size() >= _minInliers)
 				{
 					std::vector<int> inliersV;
 					std::vector<int> matchesV;
 					transforms[dir] = util3d::estimateMotion3DTo3D(
-							uMultimapToMapUnique(signatureA->getWords3()),
-							uMultimapToMapUnique(signatureB->getWords3()),
+							signatureA->getUniqueWords3(),
+							signatureB->getUniqueWords3(),
 							_minInliers,
 							_inlierDistance,
 							_iterations,
@@ -1394,7 +1373,7 @@ Transform RegistrationVis::computeTransformationImpl(
 				else
 				{
 					msg = uFormat("Not enough 3D features in images (old=%d, new=%d, min=%d)",
-							(int)signatureA->getWords3().size(), (int)signatureB->getWords3().size(), _minInliers);
+							(int)signatureA->getWords3Pts().size(), (int)signatureB->getWords3Pts().size(), _minInliers);
 					UINFO(msg.c_str());
 				}
 			}
@@ -1441,8 +1420,8 @@ Transform RegistrationVis::computeTransformationImpl(
 			_estimationType < 2 &&
 			!transforms[0].isNull() &&
 			allInliers.size() &&
-			fromSignature.getWords3().size() &&
-			toSignature.getWords().size() &&
+			fromSignature.getWords3Pts().size() &&
+			toSignature.getWordIds().size() &&
 			fromSignature.sensorData().cameraModels().size() <= 1 &&
 			toSignature.sensorData().cameraModels().size() <= 1)
 		{
@@ -1539,21 +1518,24 @@ Transform RegistrationVis::computeTransformationImpl(
 			for(unsigned int i=0; i<allInliers.size(); ++i)
 			{
 				int wordId = allInliers[i];
-				const cv::Point3f & pt3D = fromSignature.getWords3().find(wordId)->second;
+				std::pair<int, int> rangeFrom = fromSignature.getWordRange(wordId);
+				UASSERT(rangeFrom.first < rangeFrom.second && rangeFrom.first < (int)fromSignature.getWords3Pts().size());
+				const cv::Point3f & pt3D = fromSignature.getWords3Pts()[rangeFrom.first];
 				points3DMap.insert(std::make_pair(wordId, pt3D));
 
 				std::map<int, cv::Point3f> ptMap;
-				if(fromSignature.getWords().size() && cameraModelFrom.isValidForProjection())
+				if(fromSignature.getWordIds().size() && cameraModelFrom.isValidForProjection())
 				{
 					float depthFrom = util3d::transformPoint(pt3D, invLocalTransformFrom).z;
-					const cv::Point2f & kpt = fromSignature.getWords().find(wordId)->second.pt;
+					const cv::Point2f & kpt = fromSignature.getWordsKpts()[rangeFrom.first].pt;
 					ptMap.insert(std::make_pair(1,cv::Point3f(kpt.x, kpt.y, depthFrom)));
 				}
-				if(toSignature.getWords().size() && cameraModelTo.isValidForProjection())
+				if(toSignature.getWordIds().size() && cameraModelTo.isValidForProjection())
 				{
-					float depthTo = util3d::transformPoint(toSignature.getWords3().find(wordId)->second, invLocalTransformTo).z;
-					const cv::Point2f & kpt = toSignature.getWords().find(wordId)->second.pt;
-					UASSERT(toSignature.getWords3().find(wordId) != toSignature.getWords3().end());
+					std::pair<int, int> rangeTo = toSignature.getWordRange(wordId);
+					UASSERT(rangeTo.first < rangeTo.second && rangeTo.first < (int)toSignature.getWords3Pts().size());
+					float depthTo = util3d::transformPoint(toSignature.getWords3Pts()[rangeTo.first], invLocalTransformTo).z;
+					const cv::Point2f & kpt = toSignature.getWordsKpts()[rangeTo.first].pt;
 					ptMap.insert(std::make_pair(2,cv::Point3f(kpt.x, kpt.y, depthTo)));
 				}
 
@@ -1652,8 +1634,8 @@ Transform RegistrationVis::computeTransformationImpl(
 	{
 		UWARN("Missing correspondences for registration (%d->%d). fromWords = %d fromImageEmpty=%d toWords = %d toImageEmpty=%d",
 				fromSignature.id(), toSignature.id(),
-				(int)fromSignature.getWords().size(), fromSignature.sensorData().imageRaw().empty()?1:0,
-				(int)toSignature.getWords().size(), toSignature.sensorData().imageRaw().empty()?1:0);
+				(int)fromSignature.getWordIds().size(), fromSignature.sensorData().imageRaw().empty()?1:0,
+				(int)toSignature.getWordIds().size(), toSignature.sensorData().imageRaw().empty()?1:0);
 	}
 
 	info.inliers = inliersCount;
@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/Optimizer.h"
 #include "rtabmap/core/Graph.h"
 #include "rtabmap/core/Signature.h"
+#include "rtabmap/core/VisualWord.h"
+#include "rtabmap/core/ObjectPool.h"
 
 #include "rtabmap/core/EpipolarGeometry.h"
 
@@ -89,6 +91,7 @@ Rtabmap::Rtabmap() :
 	_loopRatio(Parameters::defaultRtabmapLoopRatio()),
 	_verifyLoopClosureHypothesis(Parameters::defaultVhEpEnabled()),
 	_maxRetrieved(Parameters::defaultRtabmapMaxRetrieved()),
+	_prefetchHypotheses(Parameters::defaultRtabmapPrefetchHypotheses()),
 	_maxLocalRetrieved(Parameters::defaultRGBDMaxLocalRetrieved()),
 	_rawDataKept(Parameters::defaultMemImageKept()),
 	_statisticLogsBufferedInRAM(Parameters::defaultRtabmapStatisticLogsBufferedInRAM()),
@@ -430,6 +433,7 @@ void Rtabmap::parseParameters(const ParametersMap & parameters)
 	Parameters::parse(parameters, Parameters::kRtabmapLoopRatio(), _loopRatio);
 	Parameters::parse(parameters, Parameters::kVhEpEnabled(), _verifyLoopClosureHypothesis);
 	Parameters::parse(parameters, Parameters::kRtabmapMaxRetrieved(), _maxRetrieved);
+	Parameters::parse(parameters, Parameters::kRtabmapPrefetchHypotheses(), _prefetchHypotheses);
 	Parameters::parse(parameters, Parameters::kRGBDMaxLocalRetrieved(), _maxLocalRetrieved);
 	Parameters::parse(parameters, Parameters::kMemImageKept(), _rawDataKept);
 	Parameters::parse(parameters, Parameters::kRGBDEnabled(), _rgbdSlamMode);
@@ -599,10 +603,20 @@ std::multimap<int, cv::KeyPoint> Rtabmap::getWords(int locationId) const
 {
 	if(_memory)
 	{
+		// words of a previous session node may not be loaded yet (Mem/InitWMLazy)
+		_memory->loadLazySignatures(std::list<int>(1, locationId));
 		const Signature * s = _memory->getSignature(locationId);
 		if(s)
 		{
-			return s->getWords();
+			// built from the flat words, without creating the view kept by the signature
+			std::multimap<int, cv::KeyPoint> words;
+			const std::vector<int> & ids = s->getWordIds();
+			const std::vector<cv::KeyPoint> & keypoints = s->getWordsKpts();
+			for(unsigned int i=0; i<ids.size(); ++i)
+			{
+				words.insert(words.end(), std::make_pair(ids[i], keypoints[i]));
+			}
+			return words;
 		}
 	}
 	return std::multimap<int, cv::KeyPoint>();
@@ -1364,15 +1378,15 @@ bool Rtabmap::process(
 			ULOGGER_INFO("computing likelihood...");
 
 			std::list<int> signaturesToCompare;
-			for(std::map<int, double>::const_iterator iter=_memory->getWorkingMem().begin();
-				iter!=_memory->getWorkingMem().end();
+			// weights only, the signatures are not accessed (they may not be loaded yet)
+			weights = _memory->getWeights();
+			for(std::map<int, int>::const_iterator iter=weights.begin();
+				iter!=weights.end();
 				++iter)
 			{
 				if(iter->first > 0)
 				{
-					const Signature * s = _memory->getSignature(iter->first);
-					UASSERT(s!=0);
-					if(s->getWeight() != -1) // ignore intermediate nodes
+					if(iter->second != -1) // ignore intermediate nodes
 					{
 						signaturesToCompare.push_back(iter->first);
 					}
@@ -1404,12 +1418,6 @@ bool Rtabmap::process(
 			timePosteriorCalculation = timer.ticks();
 			ULOGGER_INFO("timePosteriorCalculation=%fs",timePosteriorCalculation);
 
-			// For statistics, copy weights
-			if(_publishStats && (_publishLikelihood || _publishPdf))
-			{
-				weights = _memory->getWeights();
-			}
-
 			//============================================================
 			// Select the highest hypothesis
 			//============================================================
@@ -1450,6 +1458,11 @@ bool Rtabmap::process(
 				if(_highestHypothesis.second >= loopThr)
 				{
 					rejectedHypothesis = true;
+					if(_verifyLoopClosureHypothesis)
+					{
+						// the words of the hypothesis may not be loaded yet (Mem/InitWMLazy)
+						_memory->loadLazySignatures(std::list<int>(1, _highestHypothesis.first));
+					}
 					if(posterior.size() <= 2 && loopThr>0.0f)
 					{
 						// Ignore loop closure if there is only one loop closure hypothesis
@@ -2402,8 +2415,8 @@ bool Rtabmap::process(
 		lcHypothesisReactivated = sLoop->isSaved()?1.0f:0.0f;
 	}
 	dictionarySize = (int)_memory->getVWDictionary()->getVisualWords().size();
-	refWordsCount = (int)signature->getWords().size();
-	refUniqueWordsCount = (int)uUniqueKeys(signature->getWords()).size();
+	refWordsCount = (int)signature->getWordIds().size();
+	refUniqueWordsCount = (int)signature->getUniqueWordIds().size();
 
 	// Posterior is empty if a bad signature is detected
 	float vpHypothesis = posterior.size()?posterior.at(Memory::kIdVirtual):0.0f;
@@ -2473,6 +2486,7 @@ bool Rtabmap::process(
 
 			// retrieval
 			statistics_.addStatistic(Statistics::kMemorySignatures_retrieved(), (float)signaturesRetrieved.size());
+			statistics_.addStatistic(Statistics::kMemorySignatures_prefetched(), (float)_memory->getLastSignaturesPrefetched());
 
 			// Surf specific parameters
 			statistics_.addStatistic(Statistics::kKeypointDictionary_size(), dictionarySize);
@@ -2696,6 +2710,7 @@ bool Rtabmap::process(
 		statistics_.addStatistic(Statistics::kTimingForgetting(), timeRealTimeLimitReachedProcess*1000);
 		statistics_.addStatistic(Statistics::kTimingJoining_trash(), timeJoiningTrash*1000);
 		statistics_.addStatistic(Statistics::kTimingEmptying_trash(), timeEmptyingTrash*1000);
+		statistics_.addStatistic(Statistics::kTimingDb_flush_latency(), _memory->getDbFlushLatency()*1000);
 		statistics_.addStatistic(Statistics::kTimingMemory_cleanup(), timeMemoryCleanup*1000);
 
 		// Transfer
@@ -2708,6 +2723,14 @@ bool Rtabmap::process(
 		statistics_.addStatistic(Statistics::kMemoryWorking_memory_size(), _memory->getWorkingMem().size());
 		statistics_.addStatistic(Statistics::kMemoryShort_time_memory_size(), _memory->getStMem().size());
 		statistics_.addStatistic(Statistics::kMemoryDatabase_memory_used(), _memory->getDatabaseMemoryUsed());
+		statistics_.addStatistic(Statistics::kMemorySignatures_pool_used(), (float)Signature::pool().used());
+		statistics_.addStatistic(Statistics::kMemorySignatures_pool_capacity(), (float)Signature::pool().capacity());
+		statistics_.addStatistic(Statistics::kMemoryWords_pool_used(), (float)VisualWord::pool().used());
+		statistics_.addStatistic(Statistics::kMemoryWords_pool_capacity(), (float)VisualWord::pool().capacity());
+		statistics_.addStatistic(Statistics::kMemoryDb_trash_size(), (float)_memory->getDbTrashSize());
+		statistics_.addStatistic(Statistics::kMemoryDb_trash_memory(), (float)_memory->getDbTrashMemoryUsed()/(1024.0f*1024.0f));
+		statistics_.addStatistic(Statistics::kMemoryDb_trash_blocked(), (float)_memory->getDbTrashBlocked());
+		statistics_.addStatistic(Statistics::kMemoryDb_trash_spilled(), (float)_memory->getDbTrashSpilled()/(1024.0f*1024.0f));
 
 		std::map<int, Signature> signatures;
 		if(_publishLastSignatureData)
@@ -2843,6 +2866,50 @@ bool Rtabmap::process(
 	UDEBUG("Empty trash...");
 	_memory->emptyTrash();
 
+	//============================================================
+	// Prefetch the LTM neighbors of the highest hypotheses, which
+	// are likely to be retrieved on next update
+	//============================================================
+	if(_prefetchHypotheses > 0 && _maxRetrieved > 0)
+	{
+		std::multimap<float, int> hypotheses; // sorted by posterior
+		const std::map<int, float> & posterior = _bayesFilter->getPosterior();
+		for(std::map<int, float>::const_iterator iter=posterior.begin(); iter!=posterior.end(); ++iter)
+		{
+			if(iter->first > 0)
+			{
+				hypotheses.insert(std::make_pair(iter->second, iter->first));
+			}
+		}
+		std::list<int> prefetchIds;
+		std::set<int> prefetchIdsSet;
+		unsigned int hypothesesChecked = 0;
+		for(std::multimap<float, int>::reverse_iterator iter=hypotheses.rbegin();
+			iter!=hypotheses.rend() && hypothesesChecked < _prefetchHypotheses && prefetchIds.size() < _maxRetrieved;
+			++iter, ++hypothesesChecked)
+		{
+			const Signature * s = _memory->getSignature(iter->second);
+			if(s)
+			{
+				// only direct neighbors, links of nodes in LTM are not known without a database access
+				const std::map<int, Link> & links = s->getLinks();
+				for(std::map<int, Link>::const_reverse_iterator jter=links.rbegin();
+					jter!=links.rend() && prefetchIds.size() < _maxRetrieved;
+					++jter)
+				{
+					if(jter->first > 0 &&
+					   _memory->getSignature(jter->first) == 0 &&
+					   prefetchIdsSet.insert(jter->first).second)
+					{
+						prefetchIds.push_back(jter->first);
+					}
+				}
+			}
+		}
+		UDEBUG("Prefetching %d locations around %d hypotheses", (int)prefetchIds.size(), (int)hypothesesChecked);
+		_memory->prefetchSignatures(prefetchIds);
+	}
+
 	// Log info...
 	// TODO : use a specific class which will handle the RtabmapEvent
 	if(_foutFloat && _foutInt)
@@ -3426,15 +3493,14 @@ void Rtabmap::dumpPrediction() const
 			return;
 		}
 		std::list<int> signaturesToCompare;
-		for(std::map<int, double>::const_iterator iter=_memory->getWorkingMem().begin();
-			iter!=_memory->getWorkingMem().end();
+		std::map<int, int> weights = _memory->getWeights();
+		for(std::map<int, int>::const_iterator iter=weights.begin();
+			iter!=weights.end();
 			++iter)
 		{
 			if(iter->first > 0)
 			{
-				const Signature * s = _memory->getSignature(iter->first);
-				UASSERT(s!=0);
-				if(s->getWeight() != -1) // ignore intermediate nodes
+				if(iter->second != -1) // ignore intermediate nodes
 				{
 					signaturesToCompare.push_back(iter->first);
 				}
@@ -3479,7 +3545,8 @@ void Rtabmap::get3DMap(
 		std::map<int, Transform> & poses,
 		std::multimap<int, Link> & constraints,
 		bool optimized,
-		bool global) const
+		bool global,
+		bool uncompressedData) const
 {
 	UDEBUG("");
 	if(_memory && _memory->getLastWorkingSignature())
@@ -3516,6 +3583,9 @@ void Rtabmap::get3DMap(
 			ids = _memory->getAllSignatureIds(); // STM + WM + LTM
 		}
 
+		// data of the nodes in LTM are loaded in one query
+		std::vector<SensorData> nodesData = _memory->getNodesData(std::vector<int>(ids.begin(), ids.end()), uncompressedData);
+		int i = 0;
 		for(std::set<int>::iterator iter = ids.begin(); iter!=ids.end(); ++iter)
 		{
 			Transform odomPoseLocal;
@@ -3527,7 +3597,7 @@ void Rtabmap::get3DMap(
 			std::vector<float> velocity;
 			GPS gps;
 			_memory->getNodeInfo(*iter, odomPoseLocal, mapId, weight, label, stamp, groundTruth, velocity, gps, true);
-			SensorData data = _memory->getNodeData(*iter);
+			SensorData & data = nodesData[i++];
 			data.setId(*iter);
 			std::multimap<int, cv::KeyPoint> words;
 			std::multimap<int, cv::Point3f> words3;
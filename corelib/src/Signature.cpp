@@ -29,13 +29,110 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/EpipolarGeometry.h"
 #include "rtabmap/core/Memory.h"
 #include "rtabmap/core/Compression.h"
+#include "rtabmap/core/ObjectPool.h"
 #include <opencv2/highgui/highgui.hpp>
 
 #include <rtabmap/utilite/UtiLite.h>
+#include <algorithm>
 
 namespace rtabmap
 {
 
+// Sort indexes of words by id
+class WordIdIndexLess
+{
+public:
+	WordIdIndexLess(const std::vector<int> & ids) : ids_(ids) {}
+	bool operator()(int a, int b) const {return ids_[a] < ids_[b];}
+private:
+	const std::vector<int> & ids_;
+};
+
+// Sort indexes of words by id, changed words after those already having the id
+class ChangedWordIndexLess
+{
+public:
+	ChangedWordIndexLess(const std::vector<int> & ids, const std::vector<unsigned char> & changed) : ids_(ids), changed_(changed) {}
+	bool operator()(int a, int b) const {return ids_[a] < ids_[b] || (ids_[a] == ids_[b] && changed_[a] < changed_[b]);}
+private:
+	const std::vector<int> & ids_;
+	const std::vector<unsigned char> & changed_;
+};
+
+// Words with an id appearing once in the sorted ids
+template<typename T>
+static std::map<int, T> uniqueWords(const std::vector<int> & sortedIds, const std::vector<T> & values)
+{
+	std::map<int, T> words;
+	if(values.size() == sortedIds.size())
+	{
+		for(unsigned int i=0; i<sortedIds.size(); ++i)
+		{
+			if((i == 0 || sortedIds[i-1] != sortedIds[i]) &&
+			   (i+1 == sortedIds.size() || sortedIds[i+1] != sortedIds[i]))
+			{
+				words.insert(words.end(), std::make_pair(sortedIds[i], values[i]));
+			}
+		}
+	}
+	return words;
+}
+
+// ids <= 0 are invalid, they are always at the beginning of the sorted ids
+static int countInvalidWords(const std::vector<int> & sortedIds)
+{
+	return int(std::upper_bound(sortedIds.begin(), sortedIds.end(), 0) - sortedIds.begin());
+}
+
+// First id >= value from "first", found with an exponential search. It
+// is faster than a linear merge when the other ids are much sparser.
+static std::vector<int>::const_iterator gallopLowerBound(
+		std::vector<int>::const_iterator first,
+		std::vector<int>::const_iterator last,
+		int value)
+{
+	if(first == last || *first >= value)
+	{
+		return first;
+	}
+	// *first < value
+	size_t step = 1;
+	while(size_t(last - first) > step && *(first + step) < value)
+	{
+		first += step;
+		step *= 2;
+	}
+	std::vector<int>::const_iterator end = size_t(last - first) > step?first + step + 1:last;
+	return std::lower_bound(first + 1, end, value);
+}
+
+// Number of pairs between two sorted arrays of valid ids: an id appearing
+// n times in one array and m times in the other makes min(n,m) pairs.
+static int countWordPairs(
+		std::vector<int>::const_iterator firstA,
+		std::vector<int>::const_iterator lastA,
+		std::vector<int>::const_iterator firstB,
+		std::vector<int>::const_iterator lastB)
+{
+	// iterate on the smallest array, gallop in the other one
+	if(lastA - firstA > lastB - firstB)
+	{
+		std::swap(firstA, firstB);
+		std::swap(lastA, lastB);
+	}
+	int pairs = 0;
+	for(; firstA != lastA && firstB != lastB; ++firstA)
+	{
+		firstB = gallopLowerBound(firstB, lastB, *firstA);
+		if(firstB != lastB && *firstB == *firstA)
+		{
+			++pairs;
+			++firstB;
+		}
+	}
+	return pairs;
+}
+
 Signature::Signature() :
 	_id(0), // invalid id
 	_mapId(-1),
@@ -45,7 +142,10 @@ Signature::Signature() :
 	_modified(true),
 	_linksModified(true),
 	_enabled(false),
-	_invalidWordsCount(0)
+	_invalidWordsCount(0),
+	_wordsViewValid(false),
+	_words3ViewValid(false),
+	_wordsDescriptorsViewValid(false)
 {
 }
 
@@ -70,7 +170,10 @@ Signature::Signature(
 	_invalidWordsCount(0),
 	_pose(pose),
 	_groundTruthPose(groundTruthPose),
-	_sensorData(sensorData)
+	_sensorData(sensorData),
+	_wordsViewValid(false),
+	_words3ViewValid(false),
+	_wordsDescriptorsViewValid(false)
 {
 	if(_sensorData.id() == 0)
 	{
@@ -92,7 +195,10 @@ Signature::Signature(const SensorData & data) :
 	_invalidWordsCount(0),
 	_pose(Transform::getIdentity()),
 	_groundTruthPose(data.groundTruth()),
-	_sensorData(data)
+	_sensorData(data),
+	_wordsViewValid(false),
+	_words3ViewValid(false),
+	_wordsDescriptorsViewValid(false)
 {
 
 }
@@ -102,6 +208,38 @@ Signature::~Signature()
 	//UDEBUG("id=%d", _id);
 }
 
+static ObjectPool & signaturesPool()
+{
+	// never deleted, signatures may still be deleted during static destruction
+	static ObjectPool * pool = new ObjectPool(sizeof(Signature));
+	return *pool;
+}
+
+void * Signature::operator new(size_t size)
+{
+	if(size != sizeof(Signature))
+	{
+		// derived classes
+		return ::operator new(size);
+	}
+	return signaturesPool().allocate();
+}
+
+void Signature::operator delete(void * p, size_t size)
+{
+	if(size != sizeof(Signature))
+	{
+		::operator delete(p);
+		return;
+	}
+	signaturesPool().deallocate(p);
+}
+
+const ObjectPool & Signature::pool()
+{
+	return signaturesPool();
+}
+
 void Signature::addLinks(const std::list<Link> & links)
 {
 	for(std::list<Link>::const_iterator iter = links.begin(); iter!=links.end(); ++iter)
@@ -180,95 +318,361 @@ void Signature::removeVirtualLinks()
 float Signature::compareTo(const Signature & s) const
 {
 	float similarity = 0.0f;
-	const std::multimap<int, cv::KeyPoint> & words = s.getWords();
 
 	if(!s.isBadSignature() && !this->isBadSignature())
 	{
-		std::list<std::pair<int, std::pair<cv::KeyPoint, cv::KeyPoint> > > pairs;
-		int totalWords = ((int)_words.size()-_invalidWordsCount)>((int)words.size()-s.getInvalidWordsCount())?((int)_words.size()-_invalidWordsCount):((int)words.size()-s.getInvalidWordsCount());
+		int wordsA = (int)s.getWordIds().size()-s.getInvalidWordsCount();
+		int wordsB = (int)_wordIds.size()-_invalidWordsCount;
+		int totalWords = wordsA>wordsB?wordsA:wordsB;
 		UASSERT(totalWords > 0);
-		EpipolarGeometry::findPairs(words, _words, pairs);
 
-		similarity = float(pairs.size()) / float(totalWords);
+		// invalid ids are at the beginning of the sorted ids
+		const std::vector<int> & idsA = s.getWordIds();
+		int pairs = countWordPairs(
+				idsA.begin() + s.getInvalidWordsCount(),
+				idsA.end(),
+				_wordIds.begin() + _invalidWordsCount,
+				_wordIds.end());
+
+		similarity = float(pairs) / float(totalWords);
 	}
 	return similarity;
 }
 
-void Signature::changeWordsRef(int oldWordId, int activeWordId)
+std::vector<float> Signature::compareTo(const std::vector<const Signature *> & signatures) const
 {
-	std::list<cv::KeyPoint> kps = uValues(_words, oldWordId);
-	if(kps.size())
+	std::vector<float> similarities(signatures.size(), 0.0f);
+	if(this->isBadSignature())
 	{
-		std::list<cv::Point3f> pts = uValues(_words3, oldWordId);
-		std::list<cv::Mat> descriptors = uValues(_wordsDescriptors, oldWordId);
-		if(oldWordId<=0)
+		return similarities;
+	}
+
+	// a cursor in the sorted ids of each signature
+	std::vector<std::vector<int>::const_iterator> cursors(signatures.size());
+	std::vector<int> pairs(signatures.size(), 0);
+	for(unsigned int k=0; k<signatures.size(); ++k)
+	{
+		UASSERT(signatures[k] != 0);
+		const std::vector<int> & ids = signatures[k]->getWordIds();
+		cursors[k] = signatures[k]->isBadSignature()?ids.end():ids.begin() + signatures[k]->getInvalidWordsCount();
+	}
+
+	for(std::vector<int>::const_iterator iter=_wordIds.begin()+_invalidWordsCount; iter!=_wordIds.end(); ++iter)
+	{
+		for(unsigned int k=0; k<signatures.size(); ++k)
 		{
-			_invalidWordsCount-=(int)_words.erase(oldWordId);
-			UASSERT(_invalidWordsCount>=0);
+			std::vector<int>::const_iterator end = signatures[k]->getWordIds().end();
+			cursors[k] = gallopLowerBound(cursors[k], end, *iter);
+			if(cursors[k] != end && *cursors[k] == *iter)
+			{
+				++pairs[k];
+				++cursors[k];
+			}
 		}
-		else
+	}
+
+	int words = (int)_wordIds.size()-_invalidWordsCount;
+	for(unsigned int k=0; k<signatures.size(); ++k)
+	{
+		if(!signatures[k]->isBadSignature())
 		{
-			_words.erase(oldWordId);
+			int wordsK = (int)signatures[k]->getWordIds().size()-signatures[k]->getInvalidWordsCount();
+			int totalWords = words>wordsK?words:wordsK;
+			UASSERT(totalWords > 0);
+			similarities[k] = float(pairs[k]) / float(totalWords);
 		}
-		_words3.erase(oldWordId);
-		_wordsDescriptors.erase(oldWordId);
-		_wordsChanged.insert(std::make_pair(oldWordId, activeWordId));
-		for(std::list<cv::KeyPoint>::const_iterator iter=kps.begin(); iter!=kps.end(); ++iter)
+	}
+	return similarities;
+}
+
+void Signature::changeWordsRef(int oldWordId, int activeWordId)
+{
+	std::map<int, int> refsToChange;
+	refsToChange.insert(std::make_pair(oldWordId, activeWordId));
+	changeWordsRef(refsToChange);
+}
+
+void Signature::changeWordsRef(const std::map<int, int> & refsToChange)
+{
+	// ids and refsToChange are both sorted, ids after "wordIter" are not changed yet
+	std::vector<unsigned char> changed;
+	std::vector<int>::iterator wordIter = _wordIds.begin();
+	for(std::map<int, int>::const_iterator iter=refsToChange.begin(); iter!=refsToChange.end() && wordIter!=_wordIds.end(); ++iter)
+	{
+		wordIter = std::lower_bound(wordIter, _wordIds.end(), iter->first);
+		if(wordIter != _wordIds.end() && *wordIter == iter->first)
 		{
-			_words.insert(std::pair<int, cv::KeyPoint>(activeWordId, (*iter)));
+			_wordsChanged.insert(*iter);
+			if(changed.empty())
+			{
+				changed.resize(_wordIds.size(), 0);
+			}
+			for(; wordIter!=_wordIds.end() && *wordIter == iter->first; ++wordIter)
+			{
+				*wordIter = iter->second;
+				changed[wordIter - _wordIds.begin()] = 1;
+			}
 		}
-		for(std::list<cv::Point3f>::const_iterator iter=pts.begin(); iter!=pts.end(); ++iter)
+	}
+	if(changed.empty())
+	{
+		return;
+	}
+
+	// Sort the words again in a single pass, changed words go after
+	// those already referring to their new id
+	std::vector<int> indexes(_wordIds.size());
+	for(unsigned int i=0; i<indexes.size(); ++i)
+	{
+		indexes[i] = i;
+	}
+	std::stable_sort(indexes.begin(), indexes.end(), ChangedWordIndexLess(_wordIds, changed));
+
+	std::vector<int> ids(indexes.size());
+	std::vector<cv::KeyPoint> keypoints(indexes.size());
+	std::vector<cv::Point3f> points(_words3.size());
+	// the descriptors may be shared with other signatures, don't modify them
+	cv::Mat descriptors = _wordsDescriptors.empty()?cv::Mat():cv::Mat(_wordsDescriptors.rows, _wordsDescriptors.cols, _wordsDescriptors.type());
+	for(unsigned int i=0; i<indexes.size(); ++i)
+	{
+		int k = indexes[i];
+		ids[i] = _wordIds[k];
+		keypoints[i] = _wordsKpts[k];
+		if(!points.empty())
 		{
-			_words3.insert(std::pair<int, cv::Point3f>(activeWordId, (*iter)));
+			points[i] = _words3[k];
 		}
-		for(std::list<cv::Mat>::const_iterator iter=descriptors.begin(); iter!=descriptors.end(); ++iter)
+		if(!descriptors.empty())
 		{
-			_wordsDescriptors.insert(std::pair<int, cv::Mat>(activeWordId, (*iter)));
+			_wordsDescriptors.row(k).copyTo(descriptors.row(i));
 		}
 	}
+	_wordIds.swap(ids);
+	_wordsKpts.swap(keypoints);
+	_words3.swap(points);
+	_wordsDescriptors = descriptors;
+
+	_invalidWordsCount = countInvalidWords(_wordIds);
+	invalidateWordsViews();
 }
 
 void Signature::setWords(const std::multimap<int, cv::KeyPoint> & words)
 {
 	_enabled = false;
-	_words = words;
-	_invalidWordsCount = 0;
-	for(std::multimap<int, cv::KeyPoint>::iterator iter=_words.begin(); iter!=_words.end(); ++iter)
+
+	std::vector<int> ids(words.size());
+	_wordsKpts.resize(words.size());
+	int i=0;
+	for(std::multimap<int, cv::KeyPoint>::const_iterator iter=words.begin(); iter!=words.end(); ++iter, ++i)
+	{
+		ids[i] = iter->first;
+		_wordsKpts[i] = iter->second;
+	}
+	if(ids != _wordIds)
+	{
+		// 3D points and descriptors don't match the new words anymore
+		_words3.clear();
+		_wordsDescriptors = cv::Mat();
+		_wordIds = ids;
+	}
+	_invalidWordsCount = countInvalidWords(_wordIds);
+	invalidateWordsViews();
+}
+
+void Signature::setWords(
+		const std::vector<int> & ids,
+		const std::vector<cv::KeyPoint> & keypoints,
+		const std::vector<cv::Point3f> & points,
+		const cv::Mat & descriptors)
+{
+	UASSERT(ids.size() == keypoints.size());
+	UASSERT_MSG(points.empty() || points.size() == ids.size(),
+			uFormat("points=%d ids=%d", (int)points.size(), (int)ids.size()).c_str());
+	UASSERT_MSG(descriptors.empty() || descriptors.rows == (int)ids.size(),
+			uFormat("descriptors=%d ids=%d", descriptors.rows, (int)ids.size()).c_str());
+
+	_enabled = false;
+
+	std::vector<int> indexes(ids.size());
+	for(unsigned int i=0; i<indexes.size(); ++i)
+	{
+		indexes[i] = i;
+	}
+	std::stable_sort(indexes.begin(), indexes.end(), WordIdIndexLess(ids));
+
+	_wordIds.resize(ids.size());
+	_wordsKpts.resize(ids.size());
+	_words3.resize(points.size());
+	_wordsDescriptors = descriptors.empty()?cv::Mat():cv::Mat(descriptors.rows, descriptors.cols, descriptors.type());
+	for(unsigned int i=0; i<indexes.size(); ++i)
+	{
+		int k = indexes[i];
+		_wordIds[i] = ids[k];
+		_wordsKpts[i] = keypoints[k];
+		if(!points.empty())
+		{
+			_words3[i] = points[k];
+		}
+		if(!descriptors.empty())
+		{
+			descriptors.row(k).copyTo(_wordsDescriptors.row(i));
+		}
+	}
+	_invalidWordsCount = countInvalidWords(_wordIds);
+	invalidateWordsViews();
+}
+
+void Signature::setWords3(const std::multimap<int, cv::Point3f> & words3)
+{
+	if(words3.empty())
+	{
+		_words3.clear();
+	}
+	else
+	{
+		UASSERT_MSG(words3.size() == _wordIds.size(),
+				uFormat("words3=%d words=%d (words3 should be empty or match the words)", (int)words3.size(), (int)_wordIds.size()).c_str());
+		_words3.resize(words3.size());
+		int i=0;
+		for(std::multimap<int, cv::Point3f>::const_iterator iter=words3.begin(); iter!=words3.end(); ++iter, ++i)
+		{
+			UASSERT(iter->first == _wordIds[i]); // must be same id!
+			_words3[i] = iter->second;
+		}
+	}
+	invalidateWordsViews();
+}
+
+void Signature::setWordsDescriptors(const std::multimap<int, cv::Mat> & descriptors)
+{
+	if(descriptors.empty())
+	{
+		_wordsDescriptors = cv::Mat();
+	}
+	else
+	{
+		UASSERT_MSG(descriptors.size() == _wordIds.size(),
+				uFormat("descriptors=%d words=%d (descriptors should be empty or match the words)", (int)descriptors.size(), (int)_wordIds.size()).c_str());
+		const cv::Mat & first = descriptors.begin()->second;
+		_wordsDescriptors = cv::Mat((int)descriptors.size(), first.cols, first.type());
+		int i=0;
+		for(std::multimap<int, cv::Mat>::const_iterator iter=descriptors.begin(); iter!=descriptors.end(); ++iter, ++i)
+		{
+			UASSERT(iter->first == _wordIds[i]); // must be same id!
+			UASSERT(iter->second.rows == 1 && iter->second.cols == first.cols && iter->second.type() == first.type());
+			iter->second.copyTo(_wordsDescriptors.row(i));
+		}
+	}
+	invalidateWordsViews();
+}
+
+std::vector<int> Signature::getUniqueWordIds() const
+{
+	std::vector<int> ids(_wordIds.size());
+	ids.resize(std::unique_copy(_wordIds.begin(), _wordIds.end(), ids.begin()) - ids.begin());
+	return ids;
+}
+
+std::map<int, cv::KeyPoint> Signature::getUniqueWordsKpts() const
+{
+	return uniqueWords(_wordIds, _wordsKpts);
+}
+
+std::map<int, cv::Point3f> Signature::getUniqueWords3() const
+{
+	return uniqueWords(_wordIds, _words3);
+}
+
+std::pair<int, int> Signature::getWordRange(int wordId) const
+{
+	std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator> range =
+			std::equal_range(_wordIds.begin(), _wordIds.end(), wordId);
+	return std::make_pair(int(range.first - _wordIds.begin()), int(range.second - _wordIds.begin()));
+}
+
+const std::multimap<int, cv::KeyPoint> & Signature::getWords() const
+{
+	if(!_wordsViewValid)
 	{
-		if(iter->first>0)
+		_wordsView.clear();
+		for(unsigned int i=0; i<_wordIds.size(); ++i)
 		{
-			break;
+			_wordsView.insert(_wordsView.end(), std::make_pair(_wordIds[i], _wordsKpts[i]));
 		}
-		++_invalidWordsCount;
+		_wordsViewValid = true;
 	}
+	return _wordsView;
+}
+
+const std::multimap<int, cv::Point3f> & Signature::getWords3() const
+{
+	if(!_words3ViewValid)
+	{
+		_words3View.clear();
+		for(unsigned int i=0; i<_words3.size(); ++i)
+		{
+			_words3View.insert(_words3View.end(), std::make_pair(_wordIds[i], _words3[i]));
+		}
+		_words3ViewValid = true;
+	}
+	return _words3View;
+}
+
+const std::multimap<int, cv::Mat> & Signature::getWordsDescriptors() const
+{
+	if(!_wordsDescriptorsViewValid)
+	{
+		_wordsDescriptorsView.clear();
+		for(int i=0; i<_wordsDescriptors.rows; ++i)
+		{
+			// rows share the data of the flat descriptors
+			_wordsDescriptorsView.insert(_wordsDescriptorsView.end(), std::make_pair(_wordIds[i], _wordsDescriptors.row(i)));
+		}
+		_wordsDescriptorsViewValid = true;
+	}
+	return _wordsDescriptorsView;
+}
+
+void Signature::invalidateWordsViews()
+{
+	_wordsView.clear();
+	_words3View.clear();
+	_wordsDescriptorsView.clear();
+	_wordsViewValid = false;
+	_words3ViewValid = false;
+	_wordsDescriptorsViewValid = false;
 }
 
 bool Signature::isBadSignature() const
 {
-	return _words.size()-_invalidWordsCount <= 0;
+	return (int)_wordIds.size()-_invalidWordsCount <= 0;
 }
 
 void Signature::removeAllWords()
 {
-	_words.clear();
+	_wordIds.clear();
+	_wordsKpts.clear();
 	_words3.clear();
-	_wordsDescriptors.clear();
+	_wordsDescriptors = cv::Mat();
 	_invalidWordsCount = 0;
+	invalidateWordsViews();
 }
 
 void Signature::removeWord(int wordId)
 {
-	if(wordId<=0)
-	{
-		_invalidWordsCount-=(int)_words.erase(wordId);
-		UASSERT(_invalidWordsCount>=0);
-	}
-	else
+	std::pair<int, int> range = getWordRange(wordId);
+	if(range.first < range.second)
 	{
-		_words.erase(wordId);
+		_wordIds.erase(_wordIds.begin()+range.first, _wordIds.begin()+range.second);
+		_wordsKpts.erase(_wordsKpts.begin()+range.first, _wordsKpts.begin()+range.second);
+		if(!_words3.empty())
+		{
+			_words3.erase(_words3.begin()+range.first, _words3.begin()+range.second);
+		}
+		_invalidWordsCount = countInvalidWords(_wordIds);
 	}
-	_words3.erase(wordId);
-	_wordsDescriptors.clear();
+	_wordsDescriptors = cv::Mat();
+	invalidateWordsViews();
 }
 
 cv::Mat Signature::getPoseCovariance() const
@@ -294,13 +698,10 @@ cv::Mat Signature::getPoseCovariance() const
 
 long Signature::getMemoryUsed(bool withSensorData) const // Return memory usage in Bytes
 {
-	long total =  _words.size() * sizeof(float) * 8 +
-				  _words3.size() * sizeof(float) * 4;
-	if(!_wordsDescriptors.empty())
-	{
-		total += _wordsDescriptors.size() * sizeof(int);
-		total += _wordsDescriptors.size() * _wordsDescriptors.begin()->second.total() * _wordsDescriptors.begin()->second.elemSize();
-	}
+	long total =  _wordIds.size() * sizeof(int) +
+				  _wordsKpts.size() * sizeof(cv::KeyPoint) +
+				  _words3.size() * sizeof(cv::Point3f) +
+				  _wordsDescriptors.total() * _wordsDescriptors.elemSize();
 	if(withSensorData)
 	{
 		total+=_sensorData.getMemoryUsed();
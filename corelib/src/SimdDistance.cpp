@@ -0,0 +1,284 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/SimdDistance.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace rtabmap {
+
+namespace simd {
+
+// Kernels compiled with specific instructions (see SimdDistance_*.cpp)
+#ifdef RTABMAP_SIMD_SSE42
+unsigned int hammingSSE42(const unsigned char * a, const unsigned char * b, int size);
+float l2SqrSSE42(const float * a, const float * b, int size);
+#endif
+#ifdef RTABMAP_SIMD_AVX2
+unsigned int hammingAVX2(const unsigned char * a, const unsigned char * b, int size);
+float l2SqrAVX2(const float * a, const float * b, int size);
+#endif
+
+static unsigned int popcnt64(uint64_t n)
+{
+	n -= ((n >> 1) & 0x5555555555555555LL);
+	n = (n & 0x3333333333333333LL) + ((n >> 2) & 0x3333333333333333LL);
+	return (((n + (n >> 4))& 0x0f0f0f0f0f0f0f0fLL)* 0x0101010101010101LL) >> 56;
+}
+
+static unsigned int hammingScalar(const unsigned char * a, const unsigned char * b, int size)
+{
+	unsigned int result = 0;
+	int i=0;
+	for(; i+8<=size; i+=8)
+	{
+		uint64_t va, vb;
+		memcpy(&va, a+i, 8);
+		memcpy(&vb, b+i, 8);
+		result += popcnt64(va ^ vb);
+	}
+	for(; i<size; ++i)
+	{
+		result += popcnt64(a[i] ^ b[i]);
+	}
+	return result;
+}
+
+static float l2SqrScalar(const float * a, const float * b, int size)
+{
+	float result = 0.0f;
+	int i=0;
+	for(; i+4<=size; i+=4)
+	{
+		float d0 = a[i] - b[i];
+		float d1 = a[i+1] - b[i+1];
+		float d2 = a[i+2] - b[i+2];
+		float d3 = a[i+3] - b[i+3];
+		result += d0*d0 + d1*d1 + d2*d2 + d3*d3;
+	}
+	for(; i<size; ++i)
+	{
+		float d = a[i] - b[i];
+		result += d*d;
+	}
+	return result;
+}
+
+static Instructions detectInstructions()
+{
+	bool popcnt = false;
+	bool sse42 = false;
+	bool avx2 = false;
+	bool fma = false;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	popcnt = __builtin_cpu_supports("popcnt");
+	sse42 = __builtin_cpu_supports("sse4.2");
+	avx2 = __builtin_cpu_supports("avx2");
+	fma = __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	int maxId = info[0];
+	__cpuid(info, 1);
+	popcnt = (info[2] & (1<<23)) != 0;
+	sse42 = (info[2] & (1<<20)) != 0;
+	fma = (info[2] & (1<<12)) != 0;
+	bool osAvx = (info[2] & (1<<27)) != 0 && (info[2] & (1<<28)) != 0 && (_xgetbv(0) & 6) == 6;
+	if(maxId >= 7 && osAvx)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1<<5)) != 0;
+	}
+#endif
+	UDEBUG("popcnt=%d sse4.2=%d avx2=%d fma=%d", popcnt?1:0, sse42?1:0, avx2?1:0, fma?1:0);
+
+#ifdef RTABMAP_SIMD_AVX2
+	if(popcnt && avx2 && fma)
+	{
+		return kAVX2;
+	}
+#endif
+#ifdef RTABMAP_SIMD_SSE42
+	if(popcnt && sse42)
+	{
+		return kSSE42;
+	}
+#endif
+	return kScalar;
+}
+
+class Kernels
+{
+public:
+	Kernels()
+	{
+		supported = detectInstructions();
+		set(supported);
+	}
+	void set(Instructions instructions)
+	{
+		used = instructions;
+		hamming = &hammingScalar;
+		l2Sqr = &l2SqrScalar;
+#ifdef RTABMAP_SIMD_SSE42
+		if(instructions == kSSE42)
+		{
+			hamming = &hammingSSE42;
+			l2Sqr = &l2SqrSSE42;
+		}
+#endif
+#ifdef RTABMAP_SIMD_AVX2
+		if(instructions == kAVX2)
+		{
+			hamming = &hammingAVX2;
+			l2Sqr = &l2SqrAVX2;
+		}
+#endif
+	}
+
+	Instructions supported;
+	Instructions used;
+	unsigned int (*hamming)(const unsigned char *, const unsigned char *, int);
+	float (*l2Sqr)(const float *, const float *, int);
+};
+
+static Kernels & kernels()
+{
+	static Kernels k;
+	return k;
+}
+
+Instructions supportedInstructions()
+{
+	return kernels().supported;
+}
+
+Instructions instructions()
+{
+	return kernels().used;
+}
+
+Instructions setInstructions(Instructions instructions)
+{
+	if(instructions > kernels().supported)
+	{
+		UWARN("Instructions %s are not supported, using %s.", instructionsName(instructions), instructionsName(kernels().supported));
+		instructions = kernels().supported;
+	}
+	kernels().set(instructions);
+	return instructions;
+}
+
+const char * instructionsName(Instructions instructions)
+{
+	if(instructions == kAVX2)
+	{
+		return "AVX2";
+	}
+	else if(instructions == kSSE42)
+	{
+		return "SSE4.2";
+	}
+	return "Scalar";
+}
+
+unsigned int hamming(const unsigned char * a, const unsigned char * b, int size)
+{
+	return kernels().hamming(a, b, size);
+}
+
+float l2Sqr(const float * a, const float * b, int size)
+{
+	return kernels().l2Sqr(a, b, size);
+}
+
+void knnMatch(
+		const cv::Mat & query,
+		const std::vector<cv::Mat> & train,
+		std::vector<std::vector<cv::DMatch> > & matches,
+		int k,
+		int threads)
+{
+	UASSERT(query.empty() || query.type() == CV_8UC1 || query.type() == CV_32FC1);
+	UASSERT(k > 0);
+	matches = std::vector<std::vector<cv::DMatch> >(query.rows);
+	if(query.empty())
+	{
+		return;
+	}
+	for(unsigned int t=0; t<train.size(); ++t)
+	{
+		UASSERT_MSG(train[t].empty() || (train[t].type() == query.type() && train[t].cols == query.cols),
+				uFormat("train %d: type=%d cols=%d, query: type=%d cols=%d",
+						t, train[t].type(), train[t].cols, query.type(), query.cols).c_str());
+	}
+
+	const Kernels & kernel = kernels();
+	bool binary = query.type() == CV_8UC1;
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(threads>0?threads:1) schedule(dynamic, 16)
+#endif
+	for(int i=0; i<query.rows; ++i)
+	{
+		std::vector<cv::DMatch> & best = matches[i];
+		best.reserve(k+1);
+		for(unsigned int t=0; t<train.size(); ++t)
+		{
+			for(int j=0; j<train[t].rows; ++j)
+			{
+				float d = binary?
+						(float)kernel.hamming(query.ptr<unsigned char>(i), train[t].ptr<unsigned char>(j), query.cols):
+						kernel.l2Sqr(query.ptr<float>(i), train[t].ptr<float>(j), query.cols);
+				if((int)best.size() < k || d < best.back().distance)
+				{
+					// insertion sort, k is small
+					std::vector<cv::DMatch>::iterator iter = best.end();
+					while(iter != best.begin() && (iter-1)->distance > d)
+					{
+						--iter;
+					}
+					best.insert(iter, cv::DMatch(i, j, (int)t, d));
+					if((int)best.size() > k)
+					{
+						best.pop_back();
+					}
+				}
+			}
+		}
+	}
+}
+
+} /* namespace simd */
+
+} /* namespace rtabmap */
@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compiled with AVX2, FMA and POPCNT instructions enabled (see CMakeLists.txt),
+// only called if the CPU supports them (see SimdDistance.cpp).
+
+#include <immintrin.h>
+#include <string.h>
+#include <stdint.h>
+
+namespace rtabmap {
+
+namespace simd {
+
+unsigned int hammingAVX2(const unsigned char * a, const unsigned char * b, int size)
+{
+	unsigned int result = 0;
+	int i=0;
+	if(size >= 32)
+	{
+		// popcount of each byte with a 4 bits lookup table, summed with SAD
+		const __m256i lookup = _mm256_setr_epi8(
+				0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+				0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i lowMask = _mm256_set1_epi8(0x0f);
+		__m256i acc = _mm256_setzero_si256();
+		for(; i+32<=size; i+=32)
+		{
+			__m256i v = _mm256_xor_si256(
+					_mm256_loadu_si256((const __m256i*)(a+i)),
+					_mm256_loadu_si256((const __m256i*)(b+i)));
+			__m256i cnt = _mm256_add_epi8(
+					_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, lowMask)),
+					_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask)));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+		}
+		__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		result = (unsigned int)(_mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2));
+	}
+#if defined(__x86_64__) || defined(_M_X64)
+	for(; i+8<=size; i+=8)
+	{
+		uint64_t va, vb;
+		memcpy(&va, a+i, 8);
+		memcpy(&vb, b+i, 8);
+		result += (unsigned int)_mm_popcnt_u64(va ^ vb);
+	}
+#endif
+	for(; i+4<=size; i+=4)
+	{
+		uint32_t va, vb;
+		memcpy(&va, a+i, 4);
+		memcpy(&vb, b+i, 4);
+		result += _mm_popcnt_u32(va ^ vb);
+	}
+	for(; i<size; ++i)
+	{
+		result += _mm_popcnt_u32(a[i] ^ b[i]);
+	}
+	return result;
+}
+
+float l2SqrAVX2(const float * a, const float * b, int size)
+{
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	int i=0;
+	for(; i+16<=size; i+=16)
+	{
+		__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i));
+		__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8));
+		acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+		acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+	}
+	for(; i+8<=size; i+=8)
+	{
+		__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i));
+		acc0 = _mm256_fmadd_ps(d, d, acc0);
+	}
+	acc0 = _mm256_add_ps(acc0, acc1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+	sum = _mm_hadd_ps(sum, sum);
+	sum = _mm_hadd_ps(sum, sum);
+	float result = _mm_cvtss_f32(sum);
+	for(; i<size; ++i)
+	{
+		float d = a[i] - b[i];
+		result += d*d;
+	}
+	return result;
+}
+
+} /* namespace simd */
+
+} /* namespace rtabmap */
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compiled with SSE4.2 and POPCNT instructions enabled (see CMakeLists.txt),
+// only called if the CPU supports them (see SimdDistance.cpp).
+
+#include <nmmintrin.h>
+#include <string.h>
+#include <stdint.h>
+
+namespace rtabmap {
+
+namespace simd {
+
+unsigned int hammingSSE42(const unsigned char * a, const unsigned char * b, int size)
+{
+	unsigned int result = 0;
+	int i=0;
+#if defined(__x86_64__) || defined(_M_X64)
+	for(; i+8<=size; i+=8)
+	{
+		uint64_t va, vb;
+		memcpy(&va, a+i, 8);
+		memcpy(&vb, b+i, 8);
+		result += (unsigned int)_mm_popcnt_u64(va ^ vb);
+	}
+#endif
+	for(; i+4<=size; i+=4)
+	{
+		uint32_t va, vb;
+		memcpy(&va, a+i, 4);
+		memcpy(&vb, b+i, 4);
+		result += _mm_popcnt_u32(va ^ vb);
+	}
+	for(; i<size; ++i)
+	{
+		result += _mm_popcnt_u32(a[i] ^ b[i]);
+	}
+	return result;
+}
+
+float l2SqrSSE42(const float * a, const float * b, int size)
+{
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	int i=0;
+	for(; i+8<=size; i+=8)
+	{
+		__m128 d0 = _mm_sub_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(a+i+4), _mm_loadu_ps(b+i+4));
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+	}
+	for(; i+4<=size; i+=4)
+	{
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(d, d));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_hadd_ps(acc0, acc0);
+	acc0 = _mm_hadd_ps(acc0, acc0);
+	float result = _mm_cvtss_f32(acc0);
+	for(; i<size; ++i)
+	{
+		float d = a[i] - b[i];
+		result += d*d;
+	}
+	return result;
+}
+
+} /* namespace simd */
+
+} /* namespace rtabmap */
@@ -32,6 +32,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/core/DBDriver.h"
 #include "rtabmap/core/Parameters.h"
 #include "rtabmap/core/FlannIndex.h"
+#include "rtabmap/core/HnswIndex.h"
+#include "rtabmap/core/VocabularyTree.h"
+#include "rtabmap/core/MappedFile.h"
+#include "rtabmap/core/SimdDistance.h"
 
 #include "rtabmap/utilite/UtiLite.h"
 
@@ -51,12 +55,168 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <string>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #define KDTREE_SIZE 4
 #define KNN_CHECKS 32
+#define ARENA_BLOCK_ROWS 4096
+#define NEW_WORDS_PARALLEL_MIN_WORDS 256
+#define VOCABULARY_MAGIC "RTABVOC"
+#define VOCABULARY_VERSION 2
+#define VOCABULARY_ALIGNMENT 64
 
 namespace rtabmap
 {
 
+static int nnThreads(int threads)
+{
+#ifdef _OPENMP
+	return threads>0?threads:omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// Binary vocabulary exported by VWDictionary::exportVocabulary(). The file is
+// mapped in memory: sections (ids, descriptors, index) are aligned so that
+// the descriptors can be used directly.
+struct VocabularyHeader
+{
+	char magic[8];
+	int version;
+	int type;
+	int dim;
+	int words;
+	unsigned long long idsOffset;         // int[words]
+	unsigned long long descriptorsOffset; // words x dim (type)
+	unsigned long long indexOffset;       // see VocabularyTree::save()
+	unsigned long long indexSize;         // 0 if there is no index
+	char reserved[8];
+};
+
+static unsigned long long vocabularyAlign(unsigned long long offset)
+{
+	return (offset + VOCABULARY_ALIGNMENT - 1) / VOCABULARY_ALIGNMENT * VOCABULARY_ALIGNMENT;
+}
+
+static void writeVocabularyPadding(std::ofstream & file, unsigned long long offset)
+{
+	while((unsigned long long)file.tellp() < offset)
+	{
+		file.put(0);
+	}
+}
+
+bool VWDictionary::isVocabularyFile(const std::string & path)
+{
+	char magic[sizeof(VOCABULARY_MAGIC)] = {0};
+	std::ifstream file(path.c_str(), std::ifstream::in | std::ifstream::binary);
+	file.read(magic, sizeof(magic));
+	return file.good() && memcmp(magic, VOCABULARY_MAGIC, sizeof(magic)) == 0;
+}
+
+// Distance used to compare new words together (same as cv::BFMatcher)
+static float newWordsDistance(const cv::Mat & descriptors, int i, int j, bool useDistanceL1)
+{
+	if(descriptors.type() == CV_8U)
+	{
+		return (float)simd::hamming(descriptors.ptr<unsigned char>(i), descriptors.ptr<unsigned char>(j), descriptors.cols);
+	}
+	else if(useDistanceL1)
+	{
+		return (float)cv::norm(descriptors.row(i), descriptors.row(j), cv::NORM_L1);
+	}
+	return simd::l2Sqr(descriptors.ptr<float>(i), descriptors.ptr<float>(j), descriptors.cols);
+}
+
+static void buildFlannIndex(FlannIndex * index, VWDictionary::NNStrategy strategy, const cv::Mat & data, bool useDistanceL1, float rebalancingFactor)
+{
+	switch(strategy)
+	{
+	case VWDictionary::kNNFlannNaive:
+		index->buildLinearIndex(data, useDistanceL1, rebalancingFactor);
+		break;
+	case VWDictionary::kNNFlannKdTree:
+		UASSERT_MSG(data.type() == CV_32F, "To use KdTree dictionary, float descriptors are required!");
+		index->buildKDTreeIndex(data, KDTREE_SIZE, useDistanceL1, rebalancingFactor);
+		break;
+	case VWDictionary::kNNFlannLSH:
+		UASSERT_MSG(data.type() == CV_8U, "To use LSH dictionary, binary descriptors are required!");
+		index->buildLSHIndex(data, 12, 20, 2, rebalancingFactor);
+		break;
+	default:
+		UFATAL("Not supposed to be here!");
+		break;
+	}
+}
+
+// The first block is indexed, the other ones are added then the index is
+// rebuilt once over all of them. Row i of block b has index b*blocks[0].rows+i.
+static void buildFlannIndex(FlannIndex * index, VWDictionary::NNStrategy strategy, const std::vector<cv::Mat> & blocks, bool useDistanceL1, float rebalancingFactor)
+{
+	UASSERT(blocks.size());
+	buildFlannIndex(index, strategy, blocks[0], useDistanceL1, blocks.size()>1?0.0f:rebalancingFactor);
+	if(blocks.size() > 1)
+	{
+		for(unsigned int i=1; i<blocks.size(); ++i)
+		{
+			UASSERT(blocks[i-1].rows == blocks[0].rows);
+			index->addPoints(blocks[i]);
+		}
+		index->rebuildIndex(rebalancingFactor);
+	}
+}
+
+// Build a FLANN index over the words (the blocks of the arena, or a copy
+// if the descriptors are converted), the index is taken by the dictionary
+// when the thread is done. Removed indexes are the free rows of the blocks.
+class FlannRebuildThread : public UThread
+{
+public:
+	FlannRebuildThread(const std::vector<cv::Mat> & blocks, const std::vector<int> & removedIndexes, VWDictionary::NNStrategy strategy, bool useDistanceL1) :
+		_blocks(blocks),
+		_removedIndexes(removedIndexes),
+		_strategy(strategy),
+		_useDistanceL1(useDistanceL1),
+		_index(new FlannIndex())
+	{}
+	virtual ~FlannRebuildThread()
+	{
+		this->join(true);
+		delete _index;
+	}
+	FlannIndex * takeIndex()
+	{
+		FlannIndex * index = _index;
+		_index = 0;
+		return index;
+	}
+
+private:
+	virtual void mainLoop()
+	{
+		UTimer timer;
+		// The dictionary decides when to rebuild, the index doesn't rebuild itself
+		buildFlannIndex(_index, _strategy, _blocks, _useDistanceL1, 0.0f);
+		for(unsigned int i=0; i<_removedIndexes.size(); ++i)
+		{
+			_index->removePoint(_removedIndexes[i]);
+		}
+		UDEBUG("FLANN index rebuilt in background (%d words, %d blocks) = %fs",
+				(int)_index->indexedFeatures(), (int)_blocks.size(), timer.ticks());
+		this->kill();
+	}
+
+private:
+	std::vector<cv::Mat> _blocks;
+	std::vector<int> _removedIndexes;
+	VWDictionary::NNStrategy _strategy;
+	bool _useDistanceL1;
+	FlannIndex * _index;
+};
+
 const int VWDictionary::ID_START = 1;
 const int VWDictionary::ID_INVALID = 0;
 
@@ -65,13 +225,26 @@ VWDictionary::VWDictionary(const ParametersMap & parameters) :
 	_incrementalDictionary(Parameters::defaultKpIncrementalDictionary()),
 	_incrementalFlann(Parameters::defaultKpIncrementalFlann()),
 	_rebalancingFactor(Parameters::defaultKpFlannRebalancingFactor()),
+	_flannBackgroundRebuild(Parameters::defaultKpFlannBackgroundRebuild()),
+	_hnswM(Parameters::defaultKpHnswM()),
+	_hnswEfConstruction(Parameters::defaultKpHnswEfConstruction()),
+	_hnswEfSearch(Parameters::defaultKpHnswEfSearch()),
+	_vocTreeBranching(Parameters::defaultKpVocTreeBranching()),
+	_vocTreeDepth(Parameters::defaultKpVocTreeDepth()),
 	_nndrRatio(Parameters::defaultKpNndrRatio()),
 	_dictionaryPath(Parameters::defaultKpDictionaryPath()),
 	_newWordsComparedTogether(Parameters::defaultKpNewWordsComparedTogether()),
+	_nnThreads(Parameters::defaultKpNNThreads()),
 	_lastWordId(0),
 	useDistanceL1_(false),
 	_flannIndex(new FlannIndex()),
-	_strategy(kNNBruteForce)
+	_hnswIndex(new HnswIndex()),
+	_vocTree(new VocabularyTree()),
+	_vocabularyFile(0),
+	_strategy(kNNBruteForce),
+	_flannSizeAtBuild(0),
+	_flannAddedSinceBuild(0),
+	_flannRebuildThread(0)
 {
 	this->setNNStrategy((NNStrategy)Parameters::defaultKpNNStrategy());
 	this->parseParameters(parameters);
@@ -81,6 +254,9 @@ VWDictionary::~VWDictionary()
 {
 	this->clear();
 	delete _flannIndex;
+	delete _hnswIndex;
+	delete _vocTree;
+	delete _vocabularyFile;
 }
 
 void VWDictionary::parseParameters(const ParametersMap & parameters)
@@ -88,9 +264,17 @@ void VWDictionary::parseParameters(const ParametersMap & parameters)
 	ParametersMap::const_iterator iter;
 	Parameters::parse(parameters, Parameters::kKpNndrRatio(), _nndrRatio);
 	Parameters::parse(parameters, Parameters::kKpNewWordsComparedTogether(), _newWordsComparedTogether);
+	Parameters::parse(parameters, Parameters::kKpNNThreads(), _nnThreads);
 	Parameters::parse(parameters, Parameters::kKpIncrementalFlann(), _incrementalFlann);
 	Parameters::parse(parameters, Parameters::kKpFlannRebalancingFactor(), _rebalancingFactor);
-
+	Parameters::parse(parameters, Parameters::kKpFlannBackgroundRebuild(), _flannBackgroundRebuild);
+	Parameters::parse(parameters, Parameters::kKpHnswM(), _hnswM);
+	Parameters::parse(parameters, Parameters::kKpHnswEfConstruction(), _hnswEfConstruction);
+	Parameters::parse(parameters, Parameters::kKpHnswEfSearch(), _hnswEfSearch);
+	Parameters::parse(parameters, Parameters::kKpVocTreeBranching(), _vocTreeBranching);
+	Parameters::parse(parameters, Parameters::kKpVocTreeDepth(), _vocTreeDepth);
+
+	UASSERT(_vocTreeBranching >= 2 && _vocTreeDepth >= 1);
 	UASSERT_MSG(_nndrRatio > 0.0f, uFormat("String=%s value=%f", uContains(parameters, Parameters::kKpNndrRatio())?parameters.at(Parameters::kKpNndrRatio()).c_str():"", _nndrRatio).c_str());
 
 	std::string dictionaryPath = _dictionaryPath;
@@ -144,7 +328,17 @@ void VWDictionary::setFixedDictionary(const std::string & dictionaryPath)
 		{
 			std::ifstream file;
 			file.open(dictionaryPath.c_str(), std::ifstream::in);
-			if(file.good())
+			if(isVocabularyFile(dictionaryPath))
+			{
+				UDEBUG("Mapping the vocabulary from \"%s\"", dictionaryPath.c_str());
+				UTimer timer;
+				if(this->loadVocabulary(dictionaryPath))
+				{
+					_incrementalDictionary = false;
+				}
+				UDEBUG("Time changing dictionary = %fs", timer.ticks());
+			}
+			else if(file.good())
 			{
 				UDEBUG("Deleting old dictionary and loading the new one from \"%s\"", dictionaryPath.c_str());
 				UTimer timer;
@@ -197,6 +391,7 @@ void VWDictionary::setFixedDictionary(const std::string & dictionaryPath)
 							VisualWord * vw = new VisualWord(id, descriptor, 0);
 							_visualWords.insert(_visualWords.end(), std::pair<int, VisualWord*>(id, vw));
 							_notIndexedWords.insert(_notIndexedWords.end(), id);
+							this->addDescriptorToArena(vw);
 						}
 						else
 						{
@@ -274,7 +469,13 @@ void VWDictionary::setNNStrategy(NNStrategy strategy)
 		_strategy = strategy;
 		if(update)
 		{
+			this->cancelFlannRebuild();
 			_dataTree = cv::Mat();
+			_mapIndexId.clear();
+			_mapIdIndex.clear();
+			_flannIndex->release();
+			_hnswIndex->release();
+			_vocTree->release();
 			_notIndexedWords = uKeysSet(_visualWords);
 			_removedIndexedWords.clear();
 			this->update();
@@ -296,11 +497,42 @@ int VWDictionary::getLastIndexedWordId() const
 
 unsigned int VWDictionary::getIndexedWordsCount() const
 {
+	if(_strategy == kNNHnsw)
+	{
+		return _hnswIndex->indexedFeatures();
+	}
+	else if(_strategy == kNNVocabularyTree)
+	{
+		return _vocTree->indexedFeatures();
+	}
+	else if(_strategy == kNNBruteForce || _strategy == kNNBruteForceGPU)
+	{
+		return (unsigned int)_mapIdArenaSlot.size();
+	}
 	return _flannIndex->indexedFeatures();
 }
 
 unsigned int VWDictionary::getIndexMemoryUsed() const
 {
+	if(_strategy == kNNHnsw)
+	{
+		return _hnswIndex->memoryUsed();
+	}
+	else if(_strategy == kNNVocabularyTree)
+	{
+		// tree and the indexed descriptors
+		return _vocTree->memoryUsed() +
+				(unsigned int)(_vocTree->indexedFeatures()*_vocTree->featuresDim()*(_vocTree->featuresType()==CV_32FC1?sizeof(float):1)/1000);
+	}
+	else if(_strategy == kNNBruteForce || _strategy == kNNBruteForceGPU)
+	{
+		size_t bytes = 0;
+		for(unsigned int i=0; i<_arenaBlocks.size(); ++i)
+		{
+			bytes += _arenaBlocks[i].total() * _arenaBlocks[i].elemSize();
+		}
+		return bytes/1000;
+	}
 	return _flannIndex->memoryUsed();
 }
 
@@ -315,12 +547,80 @@ void VWDictionary::update()
 		return;
 	}
 
+	if(_flannRebuildThread)
+	{
+		if(_flannRebuildThread->isRunning())
+		{
+			UDEBUG("FLANN index is rebuilding in background (not indexed=%d removed=%d)",
+					(int)_notIndexedWords.size(), (int)_removedIndexedWords.size());
+			return;
+		}
+		this->swapFlannRebuild();
+	}
+
+	// Background rebuild of FLANN index, words are kept in the not indexed words until the new index is swapped
+	bool backgroundRebuild = _flannBackgroundRebuild && _incrementalDictionary && _strategy < kNNBruteForce;
+	float rebalancingFactor = backgroundRebuild?0.0f:_rebalancingFactor;
+
 	if(_notIndexedWords.size() || _visualWords.size() == 0 || _removedIndexedWords.size())
 	{
-		if(_incrementalFlann &&
+		if(_strategy == kNNHnsw && _visualWords.size())
+		{
+			// HNSW graph is always updated incrementally, it is never rebuilt
+			ULOGGER_DEBUG("HNSW: Removing %d words...", (int)_removedIndexedWords.size());
+			for(std::set<int>::iterator iter=_removedIndexedWords.begin(); iter!=_removedIndexedWords.end(); ++iter)
+			{
+				UASSERT(uContains(_mapIdIndex, *iter));
+				UASSERT(uContains(_mapIndexId, _mapIdIndex.at(*iter)));
+				_hnswIndex->removePoint(_mapIdIndex.at(*iter));
+				_mapIndexId.erase(_mapIdIndex.at(*iter));
+				_mapIdIndex.erase(*iter);
+			}
+			ULOGGER_DEBUG("HNSW: Removing %d words... done!", (int)_removedIndexedWords.size());
+
+			if(_notIndexedWords.size())
+			{
+				ULOGGER_DEBUG("HNSW: Inserting %d words...", (int)_notIndexedWords.size());
+				for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end(); ++iter)
+				{
+					VisualWord* w = uValue(_visualWords, *iter, (VisualWord*)0);
+					UASSERT(w);
+
+					int index = 0;
+					if(!_hnswIndex->isBuilt())
+					{
+						UDEBUG("Building HNSW index...");
+						_hnswIndex->buildIndex(w->getDescriptor(), _hnswM, _hnswEfConstruction, _hnswEfSearch);
+						UDEBUG("Building HNSW index... done!");
+					}
+					else
+					{
+						UASSERT(w->getDescriptor().cols == _hnswIndex->featuresDim());
+						UASSERT(w->getDescriptor().type() == _hnswIndex->featuresType());
+						index = _hnswIndex->addPoint(w->getDescriptor());
+					}
+					std::pair<std::map<int, int>::iterator, bool> inserted;
+					inserted = _mapIndexId.insert(std::pair<int, int>(index, w->id()));
+					UASSERT(inserted.second);
+					inserted = _mapIdIndex.insert(std::pair<int, int>(w->id(), index));
+					UASSERT(inserted.second);
+				}
+				ULOGGER_DEBUG("HNSW: Inserting %d words... done!", (int)_notIndexedWords.size());
+			}
+		}
+		else if(_incrementalFlann &&
 		   _strategy < kNNBruteForce &&
 		   _visualWords.size())
 		{
+			if(backgroundRebuild &&
+			   (!_flannIndex->isBuilt() ||
+				(_rebalancingFactor > 1.0f &&
+				 float(_flannSizeAtBuild) * _rebalancingFactor < float(_flannSizeAtBuild + _flannAddedSinceBuild + _notIndexedWords.size()))))
+			{
+				this->startFlannRebuild();
+				return;
+			}
+
 			ULOGGER_DEBUG("Incremental FLANN: Removing %d words...", (int)_removedIndexedWords.size());
 			for(std::set<int>::iterator iter=_removedIndexedWords.begin(); iter!=_removedIndexedWords.end(); ++iter)
 			{
@@ -362,23 +662,9 @@ void VWDictionary::update()
 					if(!_flannIndex->isBuilt())
 					{
 						UDEBUG("Building FLANN index...");
-						switch(_strategy)
-						{
-						case kNNFlannNaive:
-							_flannIndex->buildLinearIndex(descriptor, useDistanceL1_, _rebalancingFactor);
-							break;
-						case kNNFlannKdTree:
-							UASSERT_MSG(descriptor.type() == CV_32F, "To use KdTree dictionary, float descriptors are required!");
-							_flannIndex->buildKDTreeIndex(descriptor, KDTREE_SIZE, useDistanceL1_, _rebalancingFactor);
-							break;
-						case kNNFlannLSH:
-							UASSERT_MSG(descriptor.type() == CV_8U, "To use LSH dictionary, binary descriptors are required!");
-							_flannIndex->buildLSHIndex(descriptor, 12, 20, 2, _rebalancingFactor);
-							break;
-						default:
-							UFATAL("Not supposed to be here!");
-							break;
-						}
+						buildFlannIndex(_flannIndex, _strategy, descriptor, useDistanceL1_, rebalancingFactor);
+						_flannSizeAtBuild = 1;
+						_flannAddedSinceBuild = 0;
 						UDEBUG("Building FLANN index... done!");
 					}
 					else
@@ -386,6 +672,7 @@ void VWDictionary::update()
 						UASSERT(descriptor.cols == _flannIndex->featuresDim());
 						UASSERT(descriptor.type() == _flannIndex->featuresType());
 						index = _flannIndex->addPoints(descriptor);
+						++_flannAddedSinceBuild;
 					}
 					std::pair<std::map<int, int>::iterator, bool> inserted;
 					inserted = _mapIndexId.insert(std::pair<int, int>(index, w->id()));
@@ -396,161 +683,522 @@ void VWDictionary::update()
 				ULOGGER_DEBUG("Incremental FLANN: Inserting %d words... done!", (int)_notIndexedWords.size());
 			}
 		}
-		else if(_strategy >= kNNBruteForce &&
-				_notIndexedWords.size() &&
-				_removedIndexedWords.size() == 0 &&
-				_visualWords.size() &&
-				_dataTree.rows)
+		else if(_strategy == kNNBruteForce || _strategy == kNNBruteForceGPU)
+		{
+			// Brute force matching is done directly on the descriptors
+			// arena, just move the last words in the rows of removed words
+			_mapIndexId.clear();
+			_mapIdIndex.clear();
+			_dataTree = cv::Mat();
+			_flannIndex->release();
+			this->compactArena();
+		}
+		else if(_strategy == kNNVocabularyTree)
 		{
-			//just add not indexed words
-			int i = _dataTree.rows;
-			_dataTree.reserve(_dataTree.rows + _notIndexedWords.size());
-			for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end(); ++iter)
+			// The tree cannot be updated incrementally, it is rebuilt over
+			// all words. With an incremental dictionary, it is rebuilt only
+			// when the dictionary has changed by the factor Kp/FlannRebalancingFactor
+			// since the last build: in the meantime, the added words are searched
+			// with the not indexed words and the removed words are ignored.
+			if(_incrementalDictionary &&
+			   _vocTree->isBuilt() &&
+			   _rebalancingFactor > 1.0f &&
+			   float(_vocTree->indexedFeatures()) * _rebalancingFactor >= float(_vocTree->indexedFeatures() + _notIndexedWords.size() + _removedIndexedWords.size()))
+			{
+				UDEBUG("Vocabulary tree not rebuilt (indexed=%d not indexed=%d removed=%d)",
+						(int)_vocTree->indexedFeatures(), (int)_notIndexedWords.size(), (int)_removedIndexedWords.size());
+				return;
+			}
+			_mapIndexId.clear();
+			_mapIdIndex.clear();
+			_dataTree = cv::Mat();
+			_flannIndex->release();
+			_vocTree->release();
+
+			// The old tree doesn't use the arena anymore, the
+			// new one is built directly on its compacted blocks
+			this->compactArena();
+			std::vector<cv::Mat> blocks = this->createArenaData(_mapIndexId, _mapIdIndex);
+			if(blocks.size())
 			{
-				VisualWord* w = uValue(_visualWords, *iter, (VisualWord*)0);
-				UASSERT(w);
-				UASSERT(w->getDescriptor().cols == _dataTree.cols);
-				UASSERT(w->getDescriptor().type() == _dataTree.type());
-				_dataTree.push_back(w->getDescriptor());
-				_mapIndexId.insert(_mapIndexId.end(), std::pair<int, int>(i, w->id()));
-				std::pair<std::map<int, int>::iterator, bool> inserted = _mapIdIndex.insert(std::pair<int, int>(w->id(), i));
-				UASSERT(inserted.second);
-				++i;
+				UTimer timer;
+				_vocTree->buildIndex(blocks, _vocTreeBranching, _vocTreeDepth);
+				ULOGGER_DEBUG("Time to create vocabulary tree = %f s (words=%d nodes=%d depth=%d)",
+						timer.ticks(), (int)_vocTree->indexedFeatures(), (int)_vocTree->nodesCount(), _vocTree->depth());
 			}
 		}
+		else if(backgroundRebuild && _visualWords.size())
+		{
+			this->startFlannRebuild();
+			return;
+		}
 		else
 		{
 			_mapIndexId.clear();
 			_mapIdIndex.clear();
 			_dataTree = cv::Mat();
 			_flannIndex->release();
+			_hnswIndex->release();
+			_vocTree->release();
+
+			// The old index doesn't use the arena anymore
+			this->compactArena();
 
 			if(_visualWords.size())
 			{
 				UTimer timer;
 				timer.start();
 
-				int type;
-				if(_visualWords.begin()->second->getDescriptor().type() == CV_8U)
+				if(this->isArenaIndexable())
 				{
-					useDistanceL1_ = true;
-					if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
-					{
-						type = CV_32F;
-					}
-					else
+					// The index is built directly on the blocks of the arena
+					std::vector<cv::Mat> blocks = this->createArenaData(_mapIndexId, _mapIdIndex);
+					ULOGGER_DEBUG("_mapIndexId.size() = %d, words.size()=%d, blocks=%d",_mapIndexId.size(), _visualWords.size(), (int)blocks.size());
+					if(blocks.size())
 					{
-						type = _visualWords.begin()->second->getDescriptor().type();
+						buildFlannIndex(_flannIndex, _strategy, blocks, useDistanceL1_, _rebalancingFactor);
 					}
 				}
 				else
 				{
-					type = _visualWords.begin()->second->getDescriptor().type();
+					// Create the data matrix (binary descriptors converted to float)
+					cv::Mat data = this->createFlannData(_mapIndexId, _mapIdIndex);
+
+					ULOGGER_DEBUG("_mapIndexId.size() = %d, words.size()=%d, _dim=%d",_mapIndexId.size(), _visualWords.size(), data.cols);
+					ULOGGER_DEBUG("copying data = %f s", timer.ticks());
+
+					buildFlannIndex(_flannIndex, _strategy, data, useDistanceL1_, _rebalancingFactor);
 				}
-				int dim = _visualWords.begin()->second->getDescriptor().cols;
+				_flannSizeAtBuild = (unsigned int)_mapIndexId.size();
+				_flannAddedSinceBuild = 0;
 
-				UASSERT(type == CV_32F || type == CV_8U);
-				UASSERT(dim > 0);
+				ULOGGER_DEBUG("Time to create kd tree = %f s", timer.ticks());
+			}
+		}
+		UDEBUG("Dictionary updated! (size=%d added=%d removed=%d)",
+				(int)_mapIndexId.size(), _notIndexedWords.size(), _removedIndexedWords.size());
+	}
+	else
+	{
+		UDEBUG("Dictionary has not changed, so no need to update it! (size=%d)", (int)_mapIndexId.size());
+	}
+	if(_flannRebuildThread == 0 && !_vocTree->isBuilt())
+	{
+		// The removed words are not indexed anymore, their rows in the arena can be reused
+		_arenaFreeSlots.insert(_arenaFreeSlots.end(), _arenaPendingFreeSlots.begin(), _arenaPendingFreeSlots.end());
+		_arenaPendingFreeSlots.clear();
+	}
+	_notIndexedWords.clear();
+	_removedIndexedWords.clear();
+	UDEBUG("");
+}
 
-				// Create the data matrix
-				_dataTree = cv::Mat(_visualWords.size(), dim, type); // SURF descriptors are CV_32F
-				std::map<int, VisualWord*>::const_iterator iter = _visualWords.begin();
-				for(unsigned int i=0; i < _visualWords.size(); ++i, ++iter)
-				{
-					cv::Mat descriptor;
-					if(iter->second->getDescriptor().type() == CV_8U)
-					{
-						if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
-						{
-							iter->second->getDescriptor().convertTo(descriptor, CV_32F);
-						}
-						else
-						{
-							descriptor = iter->second->getDescriptor();
-						}
-					}
-					else
-					{
-						descriptor = iter->second->getDescriptor();
-					}
+void VWDictionary::clear(bool printWarningsIfNotEmpty)
+{
+	ULOGGER_DEBUG("");
+	this->cancelFlannRebuild();
+	if(printWarningsIfNotEmpty)
+	{
+		if(_visualWords.size() && _incrementalDictionary)
+		{
+			UWARN("Visual dictionary would be already empty here (%d words still in dictionary).", (int)_visualWords.size());
+		}
+		if(_notIndexedWords.size())
+		{
+			UWARN("Not indexed words should be empty here (%d words still not indexed)", (int)_notIndexedWords.size());
+		}
+	}
+	for(std::map<int, VisualWord *>::iterator i=_visualWords.begin(); i!=_visualWords.end(); ++i)
+	{
+		delete (*i).second;
+	}
+	_visualWords.clear();
+	_notIndexedWords.clear();
+	_removedIndexedWords.clear();
+	_arenaBlocks.clear();
+	_arenaSlotIds.clear();
+	_arenaFreeSlots.clear();
+	_arenaPendingFreeSlots.clear();
+	_mapIdArenaSlot.clear();
+	_wordPostings.clear();
+	_signatureNodes.clear();
+	_nodeSignatureIds.clear();
+	_nodeReferences.clear();
+	_freeNodes.clear();
+	_totalActiveReferences = 0;
+	_lastWordId = 0;
+	_dataTree = cv::Mat();
+	_mapIndexId.clear();
+	_mapIdIndex.clear();
+	_unusedWords.clear();
+	_flannIndex->release();
+	_hnswIndex->release();
+	_vocTree->release();
+	// words using the mapped descriptors are deleted
+	delete _vocabularyFile;
+	_vocabularyFile = 0;
+	_flannSizeAtBuild = 0;
+	_flannAddedSinceBuild = 0;
+	useDistanceL1_ = false;
+}
 
-					UASSERT(descriptor.cols == dim);
-					UASSERT(descriptor.type() == type);
+int VWDictionary::getNextId()
+{
+	return ++_lastWordId;
+}
 
-					descriptor.copyTo(_dataTree.row(i));
-					_mapIndexId.insert(_mapIndexId.end(), std::pair<int, int>(i, iter->second->id()));
-					_mapIdIndex.insert(_mapIdIndex.end(), std::pair<int, int>(iter->second->id(), i));
-				}
+cv::Mat VWDictionary::createFlannData(std::map<int, int> & mapIndexId, std::map<int, int> & mapIdIndex)
+{
+	mapIndexId.clear();
+	mapIdIndex.clear();
+	if(_visualWords.empty())
+	{
+		return cv::Mat();
+	}
 
-				ULOGGER_DEBUG("_mapIndexId.size() = %d, words.size()=%d, _dim=%d",_mapIndexId.size(), _visualWords.size(), dim);
-				ULOGGER_DEBUG("copying data = %f s", timer.ticks());
+	int type;
+	if(_visualWords.begin()->second->getDescriptor().type() == CV_8U)
+	{
+		useDistanceL1_ = true;
+		if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
+		{
+			type = CV_32F;
+		}
+		else
+		{
+			type = _visualWords.begin()->second->getDescriptor().type();
+		}
+	}
+	else
+	{
+		type = _visualWords.begin()->second->getDescriptor().type();
+	}
+	int dim = _visualWords.begin()->second->getDescriptor().cols;
 
-				switch(_strategy)
-				{
-				case kNNFlannNaive:
-					_flannIndex->buildLinearIndex(_dataTree, useDistanceL1_, _rebalancingFactor);
-					break;
-				case kNNFlannKdTree:
-					UASSERT_MSG(type == CV_32F, "To use KdTree dictionary, float descriptors are required!");
-					_flannIndex->buildKDTreeIndex(_dataTree, KDTREE_SIZE, useDistanceL1_, _rebalancingFactor);
-					break;
-				case kNNFlannLSH:
-					UASSERT_MSG(type == CV_8U, "To use LSH dictionary, binary descriptors are required!");
-					_flannIndex->buildLSHIndex(_dataTree, 12, 20, 2, _rebalancingFactor);
-					break;
-				default:
-					break;
-				}
+	UASSERT(type == CV_32F || type == CV_8U);
+	UASSERT(dim > 0);
+
+	cv::Mat data(_visualWords.size(), dim, type); // SURF descriptors are CV_32F
+	std::map<int, VisualWord*>::const_iterator iter = _visualWords.begin();
+	for(unsigned int i=0; i < _visualWords.size(); ++i, ++iter)
+	{
+		cv::Mat descriptor;
+		if(iter->second->getDescriptor().type() == CV_8U)
+		{
+			if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
+			{
+				iter->second->getDescriptor().convertTo(descriptor, CV_32F);
+			}
+			else
+			{
+				descriptor = iter->second->getDescriptor();
+			}
+		}
+		else
+		{
+			descriptor = iter->second->getDescriptor();
+		}
+
+		UASSERT(descriptor.cols == dim);
+		UASSERT(descriptor.type() == type);
+
+		descriptor.copyTo(data.row(i));
+		mapIndexId.insert(mapIndexId.end(), std::pair<int, int>(i, iter->second->id()));
+		mapIdIndex.insert(mapIdIndex.end(), std::pair<int, int>(iter->second->id(), i));
+	}
+	return data;
+}
+
+bool VWDictionary::isArenaIndexable() const
+{
+	// binary descriptors are converted to float for FLANN kd-tree and linear indexes
+	return _arenaBlocks.size() &&
+		   (_arenaBlocks[0].type() != CV_8U || (_strategy != kNNFlannKdTree && _strategy != kNNFlannNaive));
+}
+
+std::vector<cv::Mat> VWDictionary::createArenaData(std::map<int, int> & mapIndexId, std::map<int, int> & mapIdIndex)
+{
+	mapIndexId.clear();
+	mapIdIndex.clear();
+	if(_arenaBlocks.empty())
+	{
+		return std::vector<cv::Mat>();
+	}
+	if(_arenaBlocks[0].type() == CV_8U)
+	{
+		useDistanceL1_ = true;
+	}
+	// the index of a word is its slot
+	for(unsigned int slot=0; slot<_arenaSlotIds.size(); ++slot)
+	{
+		if(_arenaSlotIds[slot])
+		{
+			mapIndexId.insert(mapIndexId.end(), std::pair<int, int>(slot, _arenaSlotIds[slot]));
+			mapIdIndex.insert(std::pair<int, int>(_arenaSlotIds[slot], slot));
+		}
+	}
+	return this->getArenaBlocks();
+}
+
+void VWDictionary::startFlannRebuild()
+{
+	UASSERT(_flannRebuildThread == 0);
+	UTimer timer;
+	_rebuildRemovedWords.clear();
+
+	// The current index is used until the new one is swapped, so the
+	// arena is not compacted: its free rows are removed from the new index.
+	std::vector<int> freeSlots = _arenaFreeSlots;
+	freeSlots.insert(freeSlots.end(), _arenaPendingFreeSlots.begin(), _arenaPendingFreeSlots.end());
+	std::vector<cv::Mat> blocks;
+	std::vector<int> removedIndexes;
+	if(this->isArenaIndexable())
+	{
+		blocks = this->createArenaData(_rebuildMapIndexId, _rebuildMapIdIndex);
+		removedIndexes = freeSlots;
+	}
+	else
+	{
+		cv::Mat data = this->createFlannData(_rebuildMapIndexId, _rebuildMapIdIndex);
+		if(!data.empty())
+		{
+			blocks.push_back(data);
+		}
+	}
+	if(blocks.size())
+	{
+		// Rows are not reused while the new index is built on them (see swapFlannRebuild())
+		_rebuildFreeSlots.swap(freeSlots);
+		_arenaFreeSlots.clear();
+		_arenaPendingFreeSlots.clear();
+
+		_flannRebuildThread = new FlannRebuildThread(blocks, removedIndexes, _strategy, useDistanceL1_);
+		_flannRebuildThread->start();
+		UDEBUG("Rebuilding FLANN index in background (words=%d not indexed=%d free rows=%d) = %fs",
+				(int)_rebuildMapIdIndex.size(), (int)_notIndexedWords.size(), (int)removedIndexes.size(), timer.ticks());
+	}
+}
+
+void VWDictionary::swapFlannRebuild()
+{
+	UASSERT(_flannRebuildThread != 0);
+	UTimer timer;
+	_flannRebuildThread->join();
+	delete _flannIndex;
+	_flannIndex = _flannRebuildThread->takeIndex();
+	delete _flannRebuildThread;
+	_flannRebuildThread = 0;
+
+	// The old index is released and the rows free before the rebuild
+	// are not in the new index, they can be reused
+	_arenaFreeSlots.insert(_arenaFreeSlots.end(), _rebuildFreeSlots.begin(), _rebuildFreeSlots.end());
+	_rebuildFreeSlots.clear();
+
+	_mapIndexId.swap(_rebuildMapIndexId);
+	_mapIdIndex.swap(_rebuildMapIdIndex);
+	_rebuildMapIndexId.clear();
+	_rebuildMapIdIndex.clear();
+
+	// Words added during the rebuild are still not indexed, words
+	// removed during the rebuild are still in the new index.
+	for(std::set<int>::iterator iter=_notIndexedWords.begin(); iter!=_notIndexedWords.end();)
+	{
+		if(_mapIdIndex.find(*iter) != _mapIdIndex.end())
+		{
+			_notIndexedWords.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+	_removedIndexedWords.swap(_rebuildRemovedWords);
+	_rebuildRemovedWords.clear();
+	_flannSizeAtBuild = (unsigned int)_mapIdIndex.size();
+	_flannAddedSinceBuild = 0;
+
+	UDEBUG("Swapped FLANN index (words=%d not indexed=%d removed=%d) = %fs",
+			(int)_mapIdIndex.size(), (int)_notIndexedWords.size(), (int)_removedIndexedWords.size(), timer.ticks());
+}
+
+void VWDictionary::cancelFlannRebuild()
+{
+	if(_flannRebuildThread)
+	{
+		UDEBUG("Waiting for the FLANN index rebuilding in background...");
+		delete _flannRebuildThread; // join
+		_flannRebuildThread = 0;
+		_rebuildMapIndexId.clear();
+		_rebuildMapIdIndex.clear();
+		_rebuildRemovedWords.clear();
+		// the current index may still use these rows
+		_arenaPendingFreeSlots.insert(_arenaPendingFreeSlots.end(), _rebuildFreeSlots.begin(), _rebuildFreeSlots.end());
+		_rebuildFreeSlots.clear();
+	}
+}
+
+void VWDictionary::addDescriptorToArena(VisualWord * vw)
+{
+	UASSERT(vw);
+	const cv::Mat & descriptor = vw->getDescriptor();
+	if(descriptor.rows != 1 || (descriptor.type() != CV_32FC1 && descriptor.type() != CV_8UC1))
+	{
+		UERROR("Word %d: descriptor is not a single row of CV_32FC1 or CV_8UC1 (rows=%d type=%d), it is not added to arena.",
+				vw->id(), descriptor.rows, descriptor.type());
+		return;
+	}
+	if(_arenaBlocks.size() &&
+	   (_arenaBlocks[0].cols != descriptor.cols || _arenaBlocks[0].type() != descriptor.type()))
+	{
+		UERROR("Word %d: descriptor (size=%d type=%d) is not the same as the other words in dictionary (size=%d type=%d), it is not added to arena.",
+				vw->id(), descriptor.cols, descriptor.type(), _arenaBlocks[0].cols, _arenaBlocks[0].type());
+		return;
+	}
+
+	int slot;
+	if(_arenaFreeSlots.size())
+	{
+		slot = _arenaFreeSlots.back();
+		_arenaFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (int)_arenaSlotIds.size();
+		_arenaSlotIds.push_back(0);
+		if(slot / ARENA_BLOCK_ROWS >= (int)_arenaBlocks.size())
+		{
+			_arenaBlocks.push_back(cv::Mat(ARENA_BLOCK_ROWS, descriptor.cols, descriptor.type()));
+		}
+	}
+
+	cv::Mat row = _arenaBlocks[slot / ARENA_BLOCK_ROWS].row(slot % ARENA_BLOCK_ROWS);
+	descriptor.copyTo(row);
+	vw->setDescriptor(row);
+	_arenaSlotIds[slot] = vw->id();
+	_mapIdArenaSlot.insert(std::make_pair(vw->id(), slot));
+}
+
+void VWDictionary::addDescriptorsToArena(const cv::Mat & descriptors, const std::vector<VisualWord *> & words)
+{
+	UASSERT(_arenaSlotIds.empty());
+	UASSERT(descriptors.rows == (int)words.size());
+	UASSERT(descriptors.type() == CV_32FC1 || descriptors.type() == CV_8UC1);
+
+	// Full blocks are used directly from the descriptors (no copy), the
+	// rows of the last block are copied so that new words can be added.
+	int fullBlocks = descriptors.rows / ARENA_BLOCK_ROWS;
+	for(int b=0; b<fullBlocks; ++b)
+	{
+		_arenaBlocks.push_back(descriptors.rowRange(b*ARENA_BLOCK_ROWS, (b+1)*ARENA_BLOCK_ROWS));
+	}
+	if(descriptors.rows % ARENA_BLOCK_ROWS)
+	{
+		cv::Mat block(ARENA_BLOCK_ROWS, descriptors.cols, descriptors.type());
+		descriptors.rowRange(fullBlocks*ARENA_BLOCK_ROWS, descriptors.rows).copyTo(block.rowRange(0, descriptors.rows % ARENA_BLOCK_ROWS));
+		_arenaBlocks.push_back(block);
+	}
+
+	_arenaSlotIds.resize(descriptors.rows, 0);
+	for(int slot=0; slot<descriptors.rows; ++slot)
+	{
+		UASSERT(words[slot] != 0);
+		words[slot]->setDescriptor(_arenaBlocks[slot / ARENA_BLOCK_ROWS].row(slot % ARENA_BLOCK_ROWS));
+		_arenaSlotIds[slot] = words[slot]->id();
+		_mapIdArenaSlot.insert(_mapIdArenaSlot.end(), std::make_pair(words[slot]->id(), slot));
+	}
+}
+
+void VWDictionary::removeDescriptorFromArena(VisualWord * vw, bool indexed)
+{
+	UASSERT(vw);
+	std::map<int, int>::iterator iter = _mapIdArenaSlot.find(vw->id());
+	if(iter != _mapIdArenaSlot.end())
+	{
+		// the word keeps its own copy, the row can be reused by another word
+		// when no index uses it anymore
+		vw->setDescriptor(vw->getDescriptor().clone());
+		_arenaSlotIds[iter->second] = 0;
+		if(indexed)
+		{
+			_arenaPendingFreeSlots.push_back(iter->second);
+		}
+		else
+		{
+			_arenaFreeSlots.push_back(iter->second);
+		}
+		_mapIdArenaSlot.erase(iter);
+	}
+}
 
-				ULOGGER_DEBUG("Time to create kd tree = %f s", timer.ticks());
-			}
+void VWDictionary::compactArena()
+{
+	// no index should use the arena here
+	_arenaFreeSlots.insert(_arenaFreeSlots.end(), _arenaPendingFreeSlots.begin(), _arenaPendingFreeSlots.end());
+	_arenaPendingFreeSlots.clear();
+	if(_arenaFreeSlots.empty())
+	{
+		return;
+	}
+	UDEBUG("Compacting arena: %d words, %d free rows", (int)_mapIdArenaSlot.size(), (int)_arenaFreeSlots.size());
+	std::sort(_arenaFreeSlots.begin(), _arenaFreeSlots.end());
+	int last = (int)_arenaSlotIds.size()-1;
+	for(unsigned int i=0; i<_arenaFreeSlots.size(); ++i)
+	{
+		int freeSlot = _arenaFreeSlots[i];
+		while(last >= 0 && _arenaSlotIds[last] == 0)
+		{
+			--last;
 		}
-		UDEBUG("Dictionary updated! (size=%d added=%d removed=%d)",
-				_dataTree.rows, _notIndexedWords.size(), _removedIndexedWords.size());
+		if(freeSlot >= last)
+		{
+			break;
+		}
+		// move the last word in the free row
+		VisualWord * vw = uValue(_visualWords, _arenaSlotIds[last], (VisualWord*)0);
+		UASSERT(vw);
+		cv::Mat row = _arenaBlocks[freeSlot / ARENA_BLOCK_ROWS].row(freeSlot % ARENA_BLOCK_ROWS);
+		vw->getDescriptor().copyTo(row);
+		vw->setDescriptor(row);
+		_arenaSlotIds[freeSlot] = vw->id();
+		_arenaSlotIds[last] = 0;
+		_mapIdArenaSlot.at(vw->id()) = freeSlot;
+		--last;
 	}
-	else
+	while(last >= 0 && _arenaSlotIds[last] == 0)
 	{
-		UDEBUG("Dictionary has not changed, so no need to update it! (size=%d)", _dataTree.rows);
+		--last;
 	}
-	_notIndexedWords.clear();
-	_removedIndexedWords.clear();
-	UDEBUG("");
+	_arenaSlotIds.resize(last+1);
+	_arenaFreeSlots.clear();
+	_arenaBlocks.resize((_arenaSlotIds.size() + ARENA_BLOCK_ROWS - 1) / ARENA_BLOCK_ROWS);
 }
 
-void VWDictionary::clear(bool printWarningsIfNotEmpty)
+std::vector<cv::Mat> VWDictionary::getArenaBlocks() const
 {
-	ULOGGER_DEBUG("");
-	if(printWarningsIfNotEmpty)
+	std::vector<cv::Mat> blocks(_arenaBlocks.size());
+	for(unsigned int i=0; i<_arenaBlocks.size(); ++i)
 	{
-		if(_visualWords.size() && _incrementalDictionary)
+		if(i == _arenaBlocks.size()-1 && _arenaSlotIds.size() % ARENA_BLOCK_ROWS)
 		{
-			UWARN("Visual dictionary would be already empty here (%d words still in dictionary).", (int)_visualWords.size());
+			// last block is partially used
+			blocks[i] = _arenaBlocks[i].rowRange(0, _arenaSlotIds.size() % ARENA_BLOCK_ROWS);
 		}
-		if(_notIndexedWords.size())
+		else
 		{
-			UWARN("Not indexed words should be empty here (%d words still not indexed)", (int)_notIndexedWords.size());
+			blocks[i] = _arenaBlocks[i];
 		}
 	}
-	for(std::map<int, VisualWord *>::iterator i=_visualWords.begin(); i!=_visualWords.end(); ++i)
-	{
-		delete (*i).second;
-	}
-	_visualWords.clear();
-	_notIndexedWords.clear();
-	_removedIndexedWords.clear();
-	_totalActiveReferences = 0;
-	_lastWordId = 0;
-	_dataTree = cv::Mat();
-	_mapIndexId.clear();
-	_mapIdIndex.clear();
-	_unusedWords.clear();
-	_flannIndex->release();
-	useDistanceL1_ = false;
+	return blocks;
 }
 
-int VWDictionary::getNextId()
+int VWDictionary::getArenaWordId(int block, int row) const
 {
-	return ++_lastWordId;
+	int slot = (block>0?block:0) * ARENA_BLOCK_ROWS + row;
+	if(slot >= 0 && slot < (int)_arenaSlotIds.size())
+	{
+		return _arenaSlotIds[slot];
+	}
+	return 0;
 }
 
 void VWDictionary::addWordRef(int wordId, int signatureId)
@@ -562,6 +1210,7 @@ void VWDictionary::addWordRef(int wordId, int signatureId)
 		if(vw)
 		{
 			vw->addRef(signatureId);
+			this->addPosting(wordId, signatureId, 1, vw->getReferences().at(signatureId) > 1);
 			_totalActiveReferences += 1;
 
 			_unusedWords.erase(vw->id());
@@ -579,7 +1228,12 @@ void VWDictionary::removeAllWordRef(int wordId, int signatureId)
 	vw = uValue(_visualWords, wordId, vw);
 	if(vw)
 	{
-		_totalActiveReferences -= vw->removeAllRef(signatureId);
+		int removed = vw->removeAllRef(signatureId);
+		if(removed)
+		{
+			this->removePosting(wordId, signatureId);
+		}
+		_totalActiveReferences -= removed;
 		if(vw->getReferences().size() == 0)
 		{
 			_unusedWords.insert(std::pair<int, VisualWord*>(vw->id(), vw));
@@ -587,6 +1241,100 @@ void VWDictionary::removeAllWordRef(int wordId, int signatureId)
 	}
 }
 
+const std::vector<std::pair<int, int> > & VWDictionary::getWordPostings(int wordId) const
+{
+	static const std::vector<std::pair<int, int> > empty;
+	std::map<int, std::vector<std::pair<int, int> > >::const_iterator iter = _wordPostings.find(wordId);
+	if(iter != _wordPostings.end())
+	{
+		return iter->second;
+	}
+	return empty;
+}
+
+int VWDictionary::getNodeIndex(int signatureId) const
+{
+	return uValue(_signatureNodes, signatureId, -1);
+}
+
+void VWDictionary::addPosting(int wordId, int signatureId, int count, bool exists)
+{
+	int node;
+	std::map<int, int>::iterator nodeIter = _signatureNodes.find(signatureId);
+	if(nodeIter == _signatureNodes.end())
+	{
+		if(_freeNodes.size())
+		{
+			node = _freeNodes.back();
+			_freeNodes.pop_back();
+		}
+		else
+		{
+			node = (int)_nodeSignatureIds.size();
+			_nodeSignatureIds.push_back(0);
+			_nodeReferences.push_back(0);
+		}
+		_nodeSignatureIds[node] = signatureId;
+		_signatureNodes.insert(std::make_pair(signatureId, node));
+		exists = false;
+	}
+	else
+	{
+		node = nodeIter->second;
+	}
+	_nodeReferences[node] += count;
+
+	std::vector<std::pair<int, int> > & postings = _wordPostings[wordId];
+	if(exists)
+	{
+		// most of the time the signature is the last added
+		for(int i=(int)postings.size()-1; i>=0; --i)
+		{
+			if(postings[i].first == node)
+			{
+				postings[i].second += count;
+				return;
+			}
+		}
+		UERROR("Signature %d not found in postings of word %d", signatureId, wordId);
+	}
+	postings.push_back(std::make_pair(node, count));
+}
+
+void VWDictionary::removePosting(int wordId, int signatureId)
+{
+	std::map<int, int>::iterator nodeIter = _signatureNodes.find(signatureId);
+	std::map<int, std::vector<std::pair<int, int> > >::iterator iter = _wordPostings.find(wordId);
+	if(nodeIter == _signatureNodes.end() || iter == _wordPostings.end())
+	{
+		return;
+	}
+	int node = nodeIter->second;
+	std::vector<std::pair<int, int> > & postings = iter->second;
+	for(unsigned int i=0; i<postings.size(); ++i)
+	{
+		if(postings[i].first == node)
+		{
+			_nodeReferences[node] -= postings[i].second;
+			postings[i] = postings.back();
+			postings.pop_back();
+			break;
+		}
+	}
+	if(postings.empty())
+	{
+		_wordPostings.erase(iter);
+	}
+	if(_nodeReferences[node] <= 0)
+	{
+		// the signature doesn't reference words anymore
+		_nodeSignatureIds[node] = 0;
+		_nodeReferences[node] = 0;
+		_freeNodes.push_back(node);
+		_signatureNodes.erase(nodeIter);
+	}
+}
+
 std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 							   int signatureId)
 {
@@ -647,12 +1395,24 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 	}
 	dim = 0;
 	type = -1;
-	if(_dataTree.rows || _flannIndex->isBuilt())
+	if(_hnswIndex->isBuilt())
+	{
+		dim = _hnswIndex->featuresDim();
+		type = _hnswIndex->featuresType();
+		UASSERT(type == CV_32F || type == CV_8U);
+	}
+	else if(_dataTree.rows || _flannIndex->isBuilt())
 	{
 		dim = _flannIndex->isBuilt()?_flannIndex->featuresDim():_dataTree.cols;
 		type = _flannIndex->isBuilt()?_flannIndex->featuresType():_dataTree.type();
 		UASSERT(type == CV_32F || type == CV_8U);
 	}
+	else if(_arenaBlocks.size())
+	{
+		dim = _arenaBlocks[0].cols;
+		type = _arenaBlocks[0].type();
+		UASSERT(type == CV_32F || type == CV_8U);
+	}
 
 	if(dim && dim != descriptors.cols)
 	{
@@ -671,8 +1431,9 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 
 	unsigned int k=2; // k nearest neighbors
 
-	cv::Mat newWords;
+	std::vector<int> newWordsRow;
 	std::vector<int> newWordsId;
+	int threads = nnThreads(_nnThreads);
 
 	cv::Mat results;
 	cv::Mat dists;
@@ -682,28 +1443,37 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 	UTimer timerLocal;
 	timerLocal.start();
 
-	if(_flannIndex->isBuilt() || (!_dataTree.empty() && _dataTree.rows >= (int)k))
+	if(_flannIndex->isBuilt() || _hnswIndex->isBuilt() || _vocTree->isBuilt() || ((_strategy == kNNBruteForce || _strategy == kNNBruteForceGPU) && _mapIdArenaSlot.size() >= k))
 	{
 		//Find nearest neighbors
 		UDEBUG("newPts.total()=%d ", descriptors.rows);
 
 		if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH)
 		{
-			_flannIndex->knnSearch(descriptors, results, dists, k, KNN_CHECKS);
+			_flannIndex->knnSearch(descriptors, results, dists, k, KNN_CHECKS, 0.0f, true, threads);
+		}
+		else if(_strategy == kNNHnsw)
+		{
+			_hnswIndex->knnSearch(descriptors, results, dists, k, threads);
+		}
+		else if(_strategy == kNNVocabularyTree)
+		{
+			_vocTree->knnSearch(descriptors, results, dists, k, threads);
 		}
 		else if(_strategy == kNNBruteForce)
 		{
 			bruteForce = true;
-			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-			matcher.knnMatch(descriptors, _dataTree, matches, k);
+			simd::knnMatch(descriptors, this->getArenaBlocks(), matches, k, threads);
 		}
 		else if(_strategy == kNNBruteForceGPU)
 		{
 			bruteForce = true;
+			cv::Mat arena;
+			cv::vconcat(this->getArenaBlocks(), arena);
 #if CV_MAJOR_VERSION < 3
 #ifdef HAVE_OPENCV_GPU
 			cv::gpu::GpuMat newDescriptorsGpu(descriptors);
-			cv::gpu::GpuMat lastDescriptorsGpu(_dataTree);
+			cv::gpu::GpuMat lastDescriptorsGpu(arena);
 			if(descriptors.type()==CV_8U)
 			{
 				cv::gpu::BruteForceMatcher_GPU<cv::Hamming> gpuMatcher;
@@ -720,7 +1490,7 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 #else
 #ifdef HAVE_OPENCV_CUDAFEATURES2D
 			cv::cuda::GpuMat newDescriptorsGpu(descriptors);
-			cv::cuda::GpuMat lastDescriptorsGpu(_dataTree);
+			cv::cuda::GpuMat lastDescriptorsGpu(arena);
 			cv::Ptr<cv::cuda::DescriptorMatcher> gpuMatcher;
 			if(descriptors.type()==CV_8U)
 			{
@@ -753,6 +1523,19 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 		UDEBUG("Time to find nn = %f s", timerLocal.ticks());
 	}
 
+	// Words of the previous updates not yet indexed (the index is rebuilding in background)
+	std::vector<int> notIndexedIds;
+	std::vector<std::vector<cv::DMatch> > matchesNotIndexed;
+	if(_notIndexedWords.size() && !bruteForce)
+	{
+		this->searchNotIndexedWords(descriptors, matchesNotIndexed, notIndexedIds);
+		UDEBUG("Time to search %d words not indexed = %f s", (int)notIndexedIds.size(), timerLocal.ticks());
+	}
+
+	// Distances to the new words added so far in this update, computed in
+	// parallel when there are enough of them.
+	std::vector<float> newDistances;
+
 	// Process results
 	for(int i = 0; i < descriptors.rows; ++i)
 	{
@@ -765,7 +1548,10 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 				int id = uValue(_mapIndexId, (int)results.at<size_t>(i,j));
 				if(d >= 0.0f && id > 0)
 				{
-					fullResults.insert(std::pair<float, int>(d, id));
+					if(_removedIndexedWords.find(id) == _removedIndexedWords.end())
+					{
+						fullResults.insert(std::pair<float, int>(d, id));
+					}
 				}
 				else
 				{
@@ -778,7 +1564,7 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 			for(unsigned int j=0; j<matches.at(i).size(); ++j)
 			{
 				float d = matches.at(i).at(j).distance;
-				int id = uValue(_mapIndexId, matches.at(i).at(j).trainIdx);
+				int id = this->getArenaWordId(matches.at(i).at(j).imgIdx, matches.at(i).at(j).trainIdx);
 				if(d >= 0.0f && id > 0)
 				{
 					fullResults.insert(std::pair<float, int>(d, id));
@@ -790,18 +1576,12 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 			}
 		}
 
-		// Check if this descriptor matches with a word from the last signature (a word not already added to the tree)
-		if(_newWordsComparedTogether && newWords.rows)
-		{
-			std::vector<std::vector<cv::DMatch> > matchesNewWords;
-			cv::BFMatcher matcher(descriptors.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
-			UASSERT(descriptors.cols == newWords.cols && descriptors.type() == newWords.type());
-			matcher.knnMatch(descriptors.row(i), newWords, matchesNewWords, newWords.rows>1?2:1);
-			UASSERT(matchesNewWords.size() == 1);
-			for(unsigned int j=0; j<matchesNewWords.at(0).size(); ++j)
+		if(matchesNotIndexed.size())
+		{
+			for(unsigned int j=0; j<matchesNotIndexed.at(i).size(); ++j)
 			{
-				float d = matchesNewWords.at(0).at(j).distance;
-				int id = newWordsId[matchesNewWords.at(0).at(j).trainIdx];
+				float d = matchesNotIndexed.at(i).at(j).distance;
+				int id = notIndexedIds.at(matchesNotIndexed.at(i).at(j).trainIdx);
 				if(d >= 0.0f && id > 0)
 				{
 					fullResults.insert(std::pair<float, int>(d, id));
@@ -813,6 +1593,48 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 			}
 		}
 
+		// Check if this descriptor matches with a word from the last signature (a word not already added to the tree)
+		if(_newWordsComparedTogether && newWordsRow.size())
+		{
+			int newWords = (int)newWordsRow.size();
+			bool parallel = threads > 1 && newWords >= NEW_WORDS_PARALLEL_MIN_WORDS;
+			if(parallel)
+			{
+				newDistances.resize(newWords);
+#ifdef _OPENMP
+				#pragma omp parallel for num_threads(threads)
+#endif
+				for(int m=0; m<newWords; ++m)
+				{
+					newDistances[m] = newWordsDistance(descriptors, i, newWordsRow[m], useDistanceL1_);
+				}
+			}
+
+			// two nearest new words (the first one on same distance)
+			int best[2] = {-1, -1};
+			float bestDist[2] = {0.0f, 0.0f};
+			for(int m=0; m<newWords; ++m)
+			{
+				float d = parallel?newDistances[m]:newWordsDistance(descriptors, i, newWordsRow[m], useDistanceL1_);
+				if(best[0] < 0 || d < bestDist[0])
+				{
+					best[1] = best[0];
+					bestDist[1] = bestDist[0];
+					best[0] = m;
+					bestDist[0] = d;
+				}
+				else if(best[1] < 0 || d < bestDist[1])
+				{
+					best[1] = m;
+					bestDist[1] = d;
+				}
+			}
+			for(int j=0; j<2 && best[j]>=0; ++j)
+			{
+				fullResults.insert(std::pair<float, int>(bestDist[j], newWordsId[best[j]]));
+			}
+		}
+
 		if(_incrementalDictionary)
 		{
 			bool badDist = false;
@@ -842,7 +1664,9 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 				VisualWord * vw = new VisualWord(getNextId(), descriptorsIn.row(i), signatureId);
 				_visualWords.insert(_visualWords.end(), std::pair<int, VisualWord *>(vw->id(), vw));
 				_notIndexedWords.insert(_notIndexedWords.end(), vw->id());
-				newWords.push_back(descriptors.row(i));
+				this->addDescriptorToArena(vw);
+				this->addPosting(vw->id(), signatureId, 1, false);
+				newWordsRow.push_back(i);
 				newWordsId.push_back(vw->id());
 				wordIds.push_back(vw->id());
 				UASSERT(vw->id()>0);
@@ -873,15 +1697,168 @@ std::list<int> VWDictionary::addNewWords(const cv::Mat & descriptorsIn,
 	}
 	ULOGGER_DEBUG("naive search and add ref/words time = %f s", timerLocal.ticks());
 
-	ULOGGER_DEBUG("%d new words added...", _notIndexedWords.size());
+	ULOGGER_DEBUG("%d new words added...", (int)newWordsId.size());
 	ULOGGER_DEBUG("%d duplicated words added (from current image = %d)...",
 			dupWordsCountFromDict+dupWordsCountFromLast, dupWordsCountFromLast);
 	UDEBUG("total time %fs", timer.ticks());
 
-	_totalActiveReferences += _notIndexedWords.size();
+	// Words not indexed yet may come from previous calls (the index is
+	// rebuilt in background), count only the words created here.
+	_totalActiveReferences += newWordsId.size();
 	return wordIds;
 }
 
+void VWDictionary::searchNotIndexedWords(
+		const cv::Mat & query,
+		std::vector<std::vector<cv::DMatch> > & matches,
+		std::vector<int> & wordIds) const
+{
+	cv::Mat dataNotIndexed = cv::Mat::zeros(_notIndexedWords.size(), query.cols, query.type());
+	wordIds.resize(_notIndexedWords.size());
+	unsigned int index = 0;
+	VisualWord * vw;
+	for(std::set<int>::const_iterator iter = _notIndexedWords.begin(); iter != _notIndexedWords.end(); ++iter, ++index)
+	{
+		vw = _visualWords.at(*iter);
+
+		cv::Mat descriptor;
+		if(vw->getDescriptor().type() == CV_8U)
+		{
+			if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
+			{
+				vw->getDescriptor().convertTo(descriptor, CV_32F);
+			}
+			else
+			{
+				descriptor = vw->getDescriptor();
+			}
+		}
+		else
+		{
+			descriptor = vw->getDescriptor();
+		}
+
+		UASSERT(vw != 0 && descriptor.cols == query.cols && descriptor.type() == query.type());
+		descriptor.copyTo(dataNotIndexed.row(index));
+		wordIds[index] = vw->id();
+	}
+
+	// Find nearest neighbor
+	cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
+	matcher.knnMatch(query, dataNotIndexed, matches, dataNotIndexed.rows>1?2:1);
+}
+
+bool VWDictionary::loadVocabulary(const std::string & path)
+{
+	MappedFile * file = new MappedFile();
+	if(!file->open(path))
+	{
+		delete file;
+		return false;
+	}
+	VocabularyHeader header;
+	memset(&header, 0, sizeof(header));
+	if(file->size() >= sizeof(header))
+	{
+		memcpy(&header, file->data(), sizeof(header));
+	}
+	if(memcmp(header.magic, VOCABULARY_MAGIC, sizeof(header.magic)) != 0 || header.version != VOCABULARY_VERSION)
+	{
+		UERROR("Invalid vocabulary file \"%s\" (version=%d, supported=%d), it should be exported again.", path.c_str(), header.version, VOCABULARY_VERSION);
+		delete file;
+		return false;
+	}
+	size_t rowSize = header.dim * (header.type == CV_32FC1?sizeof(float):1);
+	if((header.type != CV_8UC1 && header.type != CV_32FC1) || header.dim <= 0 || header.words <= 0 ||
+	   header.idsOffset + header.words*sizeof(int) > file->size() ||
+	   header.descriptorsOffset + header.words*rowSize > file->size() ||
+	   header.indexOffset + header.indexSize > file->size())
+	{
+		UERROR("Invalid vocabulary file \"%s\" (type=%d dim=%d words=%d size=%ld)", path.c_str(), header.type, header.dim, header.words, (long)file->size());
+		delete file;
+		return false;
+	}
+
+	// The old words, their index and the previous mapped file (if any) are
+	// released before mapping the new file, as they may use its memory.
+	if(!_visualWords.empty() || _vocabularyFile)
+	{
+		UDEBUG("Deleting old dictionary (%d words)", (int)_visualWords.size());
+		this->clear(false);
+	}
+
+	// The descriptors are used directly from the mapped file
+	const int * ids = (const int *)(file->data() + header.idsOffset);
+	cv::Mat data(header.words, header.dim, header.type, file->data() + header.descriptorsOffset);
+
+	// The index saved with the words is used directly
+	bool useTree = _strategy == kNNVocabularyTree && header.indexSize > 0;
+	if(useTree && !_vocTree->load(file->data() + header.indexOffset, header.indexSize, data))
+	{
+		UWARN("The vocabulary tree cannot be loaded from \"%s\", it will be rebuilt.", path.c_str());
+		useTree = false;
+	}
+	if(useTree)
+	{
+		_mapIndexId.clear();
+		_mapIdIndex.clear();
+		_flannIndex->release();
+		_dataTree = data;
+	}
+
+	bool mappedArena = true;
+	std::vector<VisualWord *> words(data.rows, (VisualWord*)0);
+	for(int i=0; i<data.rows; ++i)
+	{
+		VisualWord * vw = new VisualWord(ids[i], data.row(i), 0);
+		// ids are sorted, inserting at the end is constant time
+		std::map<int, VisualWord*>::iterator inserted = _visualWords.insert(_visualWords.end(), std::pair<int, VisualWord*>(ids[i], vw));
+		if(inserted->second != vw)
+		{
+			UERROR("Word %d is duplicated in \"%s\"", ids[i], path.c_str());
+			delete vw;
+			mappedArena = false;
+			continue;
+		}
+		words[i] = vw;
+		if(useTree)
+		{
+			_mapIndexId.insert(_mapIndexId.end(), std::pair<int, int>(i, ids[i]));
+			_mapIdIndex.insert(_mapIdIndex.end(), std::pair<int, int>(ids[i], i));
+		}
+		else
+		{
+			_notIndexedWords.insert(_notIndexedWords.end(), ids[i]);
+		}
+	}
+	if(mappedArena)
+	{
+		this->addDescriptorsToArena(data, words);
+	}
+	else
+	{
+		for(unsigned int i=0; i<words.size(); ++i)
+		{
+			if(words[i])
+			{
+				this->addDescriptorToArena(words[i]);
+			}
+		}
+	}
+	if(data.type() == CV_8UC1)
+	{
+		useDistanceL1_ = true;
+	}
+	// keep the file mapped while the words are used
+	UASSERT(_vocabularyFile == 0);
+	_vocabularyFile = file;
+	this->update();
+
+	UDEBUG("Mapped %d words from \"%s\" (index %s, nodes=%d depth=%d)",
+			data.rows, path.c_str(), useTree?"loaded":"not loaded", (int)_vocTree->nodesCount(), _vocTree->depth());
+	return true;
+}
+
 std::vector<int> VWDictionary::findNN(const std::list<VisualWord *> & vws) const
 {
 	UTimer timer;
@@ -968,12 +1945,24 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		}
 		dim = 0;
 		type = -1;
-		if(_dataTree.rows || _flannIndex->isBuilt())
+		if(_hnswIndex->isBuilt())
+		{
+			dim = _hnswIndex->featuresDim();
+			type = _hnswIndex->featuresType();
+			UASSERT(type == CV_32F || type == CV_8U);
+		}
+		else if(_dataTree.rows || _flannIndex->isBuilt())
 		{
 			dim = _flannIndex->isBuilt()?_flannIndex->featuresDim():_dataTree.cols;
 			type = _flannIndex->isBuilt()?_flannIndex->featuresType():_dataTree.type();
 			UASSERT(type == CV_32F || type == CV_8U);
 		}
+		else if(_arenaBlocks.size())
+		{
+			dim = _arenaBlocks[0].cols;
+			type = _arenaBlocks[0].type();
+			UASSERT(type == CV_32F || type == CV_8U);
+		}
 
 		if(dim && dim != query.cols)
 		{
@@ -992,28 +1981,37 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		cv::Mat results;
 		cv::Mat dists;
 
-		if(_flannIndex->isBuilt() || (!_dataTree.empty() && _dataTree.rows >= (int)k))
+		if(_flannIndex->isBuilt() || _hnswIndex->isBuilt() || _vocTree->isBuilt() || ((_strategy == kNNBruteForce || _strategy == kNNBruteForceGPU) && _mapIdArenaSlot.size() >= k))
 		{
 			//Find nearest neighbors
 			UDEBUG("query.rows=%d ", query.rows);
 
 			if(_strategy == kNNFlannNaive || _strategy == kNNFlannKdTree || _strategy == kNNFlannLSH)
 			{
-				_flannIndex->knnSearch(query, results, dists, k, KNN_CHECKS);
+				_flannIndex->knnSearch(query, results, dists, k, KNN_CHECKS, 0.0f, true, nnThreads(_nnThreads));
+			}
+			else if(_strategy == kNNHnsw)
+			{
+				_hnswIndex->knnSearch(query, results, dists, k, nnThreads(_nnThreads));
+			}
+			else if(_strategy == kNNVocabularyTree)
+			{
+				_vocTree->knnSearch(query, results, dists, k, nnThreads(_nnThreads));
 			}
 			else if(_strategy == kNNBruteForce)
 			{
 				bruteForce = true;
-				cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
-				matcher.knnMatch(query, _dataTree, matches, k);
+				simd::knnMatch(query, this->getArenaBlocks(), matches, k, nnThreads(_nnThreads));
 			}
 			else if(_strategy == kNNBruteForceGPU)
 			{
 				bruteForce = true;
+				cv::Mat arena;
+				cv::vconcat(this->getArenaBlocks(), arena);
 #if CV_MAJOR_VERSION < 3
 #ifdef HAVE_OPENCV_GPU
 				cv::gpu::GpuMat newDescriptorsGpu(query);
-				cv::gpu::GpuMat lastDescriptorsGpu(_dataTree);
+				cv::gpu::GpuMat lastDescriptorsGpu(arena);
 				if(query.type()==CV_8U)
 				{
 					cv::gpu::BruteForceMatcher_GPU<cv::Hamming> gpuMatcher;
@@ -1030,7 +2028,7 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 #else
 #ifdef HAVE_OPENCV_CUDAFEATURES2D
 				cv::cuda::GpuMat newDescriptorsGpu(query);
-				cv::cuda::GpuMat lastDescriptorsGpu(_dataTree);
+				cv::cuda::GpuMat lastDescriptorsGpu(arena);
 				cv::Ptr<cv::cuda::DescriptorMatcher> gpuMatcher;
 				if(query.type()==CV_8U)
 				{
@@ -1062,43 +2060,12 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 		}
 		ULOGGER_DEBUG("Search dictionary time = %fs", timer.ticks());
 
-		std::map<int, int> mapIndexIdNotIndexed;
+		std::vector<int> notIndexedIds;
 		std::vector<std::vector<cv::DMatch> > matchesNotIndexed;
-		if(_notIndexedWords.size())
+		if(_notIndexedWords.size() && !bruteForce)
 		{
-			cv::Mat dataNotIndexed = cv::Mat::zeros(_notIndexedWords.size(), query.cols, query.type());
-			unsigned int index = 0;
-			VisualWord * vw;
-			for(std::set<int>::iterator iter = _notIndexedWords.begin(); iter != _notIndexedWords.end(); ++iter, ++index)
-			{
-				vw = _visualWords.at(*iter);
-
-				cv::Mat descriptor;
-				if(vw->getDescriptor().type() == CV_8U)
-				{
-					if(_strategy == kNNFlannKdTree || _strategy == kNNFlannNaive)
-					{
-						vw->getDescriptor().convertTo(descriptor, CV_32F);
-					}
-					else
-					{
-						descriptor = vw->getDescriptor();
-					}
-				}
-				else
-				{
-					descriptor = vw->getDescriptor();
-				}
-
-				UASSERT(vw != 0 && descriptor.cols == query.cols && descriptor.type() == query.type());
-				vw->getDescriptor().copyTo(dataNotIndexed.row(index));
-				mapIndexIdNotIndexed.insert(mapIndexIdNotIndexed.end(), std::pair<int,int>(index, vw->id()));
-			}
-
-			// Find nearest neighbor
 			ULOGGER_DEBUG("Searching in words not indexed...");
-			cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:useDistanceL1_?cv::NORM_L1:cv::NORM_L2SQR);
-			matcher.knnMatch(query, dataNotIndexed, matchesNotIndexed, dataNotIndexed.rows>1?2:1);
+			this->searchNotIndexedWords(query, matchesNotIndexed, notIndexedIds);
 		}
 		ULOGGER_DEBUG("Search not yet indexed words time = %fs", timer.ticks());
 
@@ -1111,7 +2078,7 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 				{
 					float d = dists.at<float>(i,j);
 					int id = uValue(_mapIndexId, (int)results.at<size_t>(i,j));
-					if(d >= 0.0f && id > 0)
+					if(d >= 0.0f && id > 0 && _removedIndexedWords.find(id) == _removedIndexedWords.end())
 					{
 						fullResults.insert(std::pair<float, int>(d, id));
 					}
@@ -1122,7 +2089,7 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 				for(unsigned int j=0; j<matches.at(i).size(); ++j)
 				{
 					float d = matches.at(i).at(j).distance;
-					int id = uValue(_mapIndexId, matches.at(i).at(j).trainIdx);
+					int id = this->getArenaWordId(matches.at(i).at(j).imgIdx, matches.at(i).at(j).trainIdx);
 					if(d >= 0.0f && id > 0)
 					{
 						fullResults.insert(std::pair<float, int>(d, id));
@@ -1136,7 +2103,7 @@ std::vector<int> VWDictionary::findNN(const cv::Mat & queryIn) const
 				for(unsigned int j=0; j<matchesNotIndexed.at(i).size(); ++j)
 				{
 					float d = matchesNotIndexed.at(i).at(j).distance;
-					int id = uValue(mapIndexIdNotIndexed, matchesNotIndexed.at(i).at(j).trainIdx);
+					int id = notIndexedIds.at(matchesNotIndexed.at(i).at(j).trainIdx);
 					if(d >= 0.0f && id > 0)
 					{
 						fullResults.insert(std::pair<float, int>(d, id));
@@ -1193,9 +2160,14 @@ void VWDictionary::addWord(VisualWord * vw)
 	{
 		_visualWords.insert(std::pair<int, VisualWord *>(vw->id(), vw));
 		_notIndexedWords.insert(vw->id());
+		this->addDescriptorToArena(vw);
 		if(vw->getReferences().size())
 		{
 			_totalActiveReferences += uSum(uValues(vw->getReferences()));
+			for(std::map<int, int>::const_iterator iter=vw->getReferences().begin(); iter!=vw->getReferences().end(); ++iter)
+			{
+				this->addPosting(vw->id(), iter->first, iter->second, false);
+			}
 		}
 		else
 		{
@@ -1244,10 +2216,22 @@ void VWDictionary::removeWords(const std::vector<VisualWord*> & words)
 	{
 		_visualWords.erase(words[i]->id());
 		_unusedWords.erase(words[i]->id());
+		for(std::map<int, int>::const_iterator iter=words[i]->getReferences().begin(); iter!=words[i]->getReferences().end(); ++iter)
+		{
+			this->removePosting(words[i]->id(), iter->first);
+		}
+		bool indexed = false;
 		if(_notIndexedWords.erase(words[i]->id()) == 0)
 		{
 			_removedIndexedWords.insert(words[i]->id());
+			indexed = true;
+		}
+		if(_flannRebuildThread && _rebuildMapIdIndex.find(words[i]->id()) != _rebuildMapIdIndex.end())
+		{
+			_rebuildRemovedWords.insert(words[i]->id());
+			indexed = true;
 		}
+		this->removeDescriptorFromArena(words[i], indexed);
 	}
 }
 
@@ -1340,4 +2324,112 @@ void VWDictionary::exportDictionary(const char * fileNameReferences, const char
 		fclose(foutDesc);
 }
 
+bool VWDictionary::exportVocabulary(const std::string & path) const
+{
+	if(_visualWords.empty())
+	{
+		UWARN("Dictionary is empty, cannot export it!");
+		return false;
+	}
+	// The tree is saved only if it indexes all words
+	bool withTree = _strategy == kNNVocabularyTree && _vocTree->isBuilt() &&
+			_notIndexedWords.empty() && _removedIndexedWords.empty();
+	if(_strategy == kNNVocabularyTree && !withTree)
+	{
+		UWARN("The vocabulary tree is not up to date (not indexed=%d removed=%d), the vocabulary is exported without it.",
+				(int)_notIndexedWords.size(), (int)_removedIndexedWords.size());
+	}
+
+	// ids are in the same order than the descriptors
+	std::vector<int> ids;
+	cv::Mat descriptors;
+	if(withTree)
+	{
+		// in the order of the indexes of the tree
+		int rows = (int)_vocTree->indexedFeatures();
+		UASSERT((int)_mapIndexId.size() == rows);
+		descriptors = cv::Mat(rows, _vocTree->featuresDim(), _vocTree->featuresType());
+		ids.resize(rows);
+		for(std::map<int, int>::const_iterator iter=_mapIndexId.begin(); iter!=_mapIndexId.end(); ++iter)
+		{
+			UASSERT(iter->first >= 0 && iter->first < rows);
+			VisualWord * vw = uValue(_visualWords, iter->second, (VisualWord*)0);
+			UASSERT(vw);
+			vw->getDescriptor().copyTo(descriptors.row(iter->first));
+			ids[iter->first] = iter->second;
+		}
+	}
+	else
+	{
+		const cv::Mat & first = _visualWords.begin()->second->getDescriptor();
+		descriptors = cv::Mat((int)_visualWords.size(), first.cols, first.type());
+		ids.resize(_visualWords.size());
+		int i=0;
+		for(std::map<int, VisualWord *>::const_iterator iter=_visualWords.begin(); iter!=_visualWords.end(); ++iter, ++i)
+		{
+			const cv::Mat & descriptor = iter->second->getDescriptor();
+			UASSERT(descriptor.rows == 1 && descriptor.cols == first.cols && descriptor.type() == first.type());
+			descriptor.copyTo(descriptors.row(i));
+			ids[i] = iter->first;
+		}
+	}
+	if(descriptors.type() != CV_8UC1 && descriptors.type() != CV_32FC1)
+	{
+		UERROR("Descriptors type %d is not supported (only CV_8UC1 and CV_32FC1), cannot export the vocabulary!", descriptors.type());
+		return false;
+	}
+	if(!descriptors.isContinuous())
+	{
+		descriptors = descriptors.clone();
+	}
+
+	std::ofstream file(path.c_str(), std::ofstream::out | std::ofstream::binary);
+	if(!file.good())
+	{
+		UERROR("Cannot open \"%s\" for writing!", path.c_str());
+		return false;
+	}
+
+	VocabularyHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VOCABULARY_MAGIC, sizeof(header.magic));
+	header.version = VOCABULARY_VERSION;
+	header.type = descriptors.type();
+	header.dim = descriptors.cols;
+	header.words = descriptors.rows;
+	header.idsOffset = vocabularyAlign(sizeof(header));
+	header.descriptorsOffset = vocabularyAlign(header.idsOffset + ids.size()*sizeof(int));
+	header.indexOffset = vocabularyAlign(header.descriptorsOffset + descriptors.total()*descriptors.elemSize());
+	header.indexSize = 0;
+
+	file.write((const char *)&header, sizeof(header));
+	writeVocabularyPadding(file, header.idsOffset);
+	file.write((const char *)&ids[0], ids.size()*sizeof(int));
+	writeVocabularyPadding(file, header.descriptorsOffset);
+	file.write((const char *)descriptors.data, descriptors.total()*descriptors.elemSize());
+	if(withTree)
+	{
+		writeVocabularyPadding(file, header.indexOffset);
+		_vocTree->save(file);
+		header.indexSize = (unsigned long long)file.tellp() - header.indexOffset;
+		file.seekp(0);
+		file.write((const char *)&header, sizeof(header));
+	}
+	else
+	{
+		header.indexOffset = 0;
+		file.seekp(0);
+		file.write((const char *)&header, sizeof(header));
+	}
+	if(!file.good())
+	{
+		UERROR("Failed to write vocabulary to \"%s\"", path.c_str());
+		return false;
+	}
+	UINFO("Exported %d words%s to \"%s\"", descriptors.rows,
+			withTree?uFormat(" and the vocabulary tree (nodes=%d depth=%d)", (int)_vocTree->nodesCount(), _vocTree->depth()).c_str():"",
+			path.c_str());
+	return true;
+}
+
 } // namespace rtabmap
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "rtabmap/core/VisualWord.h"
+#include "rtabmap/core/ObjectPool.h"
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UStl.h"
 
@@ -48,6 +49,37 @@ VisualWord::~VisualWord()
 {
 }
 
+static ObjectPool & wordsPool()
+{
+	// never deleted, words may still be deleted during static destruction
+	static ObjectPool * pool = new ObjectPool(sizeof(VisualWord), 4096);
+	return *pool;
+}
+
+void * VisualWord::operator new(size_t size)
+{
+	if(size != sizeof(VisualWord))
+	{
+		return ::operator new(size);
+	}
+	return wordsPool().allocate();
+}
+
+void VisualWord::operator delete(void * p, size_t size)
+{
+	if(size != sizeof(VisualWord))
+	{
+		::operator delete(p);
+		return;
+	}
+	wordsPool().deallocate(p);
+}
+
+const ObjectPool & VisualWord::pool()
+{
+	return wordsPool();
+}
+
 void VisualWord::addRef(int signatureId)
 {
 	std::map<int, int>::iterator iter = _references.find(signatureId);
@@ -69,4 +101,11 @@ int VisualWord::removeAllRef(int signatureId)
 	return removed;
 }
 
+long VisualWord::getMemoryUsed() const // Return memory usage in Bytes
+{
+	return sizeof(VisualWord) +
+			_descriptor.total() * _descriptor.elemSize() +
+			(_references.size() + _oldReferences.size()) * sizeof(std::pair<const int, int>);
+}
+
 } // namespace rtabmap
@@ -0,0 +1,536 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/VocabularyTree.h>
+#include <rtabmap/core/SimdDistance.h>
+#include <rtabmap/utilite/ULogger.h>
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+namespace rtabmap {
+
+VocabularyTree::VocabularyTree():
+		featuresType_(0),
+		featuresDim_(0),
+		featuresCount_(0),
+		blockRows_(0),
+		rowSize_(0),
+		branching_(0),
+		depth_(0)
+{
+}
+VocabularyTree::~VocabularyTree()
+{
+	this->release();
+}
+
+void VocabularyTree::release()
+{
+	blocks_.clear();
+	featuresType_ = 0;
+	featuresDim_ = 0;
+	featuresCount_ = 0;
+	blockRows_ = 0;
+	rowSize_ = 0;
+	branching_ = 0;
+	depth_ = 0;
+	nodes_.clear();
+	centroids_.clear();
+	points_.clear();
+}
+
+unsigned int VocabularyTree::memoryUsed() const
+{
+	size_t bytes = nodes_.size()*sizeof(Node) + centroids_.size() + points_.size()*sizeof(int);
+	return bytes/1000;
+}
+
+void VocabularyTree::buildIndex(
+		const cv::Mat & features,
+		int branching,
+		int maxDepth,
+		int iterations)
+{
+	this->buildIndex(std::vector<cv::Mat>(1, features), branching, maxDepth, iterations);
+}
+
+void VocabularyTree::buildIndex(
+		const std::vector<cv::Mat> & blocks,
+		int branching,
+		int maxDepth,
+		int iterations)
+{
+	this->release();
+	UASSERT(!blocks.empty());
+	UASSERT(blocks[0].type() == CV_8UC1 || blocks[0].type() == CV_32FC1);
+	UASSERT(blocks[0].rows > 0 && blocks[0].cols > 0);
+	UASSERT(branching >= 2 && maxDepth >= 1 && iterations >= 1);
+	int count = 0;
+	for(unsigned int i=0; i<blocks.size(); ++i)
+	{
+		UASSERT(blocks[i].type() == blocks[0].type() && blocks[i].cols == blocks[0].cols);
+		UASSERT(i == blocks.size()-1 || blocks[i].rows == blocks[0].rows);
+		count += blocks[i].rows;
+	}
+
+	blocks_ = blocks;
+	featuresType_ = blocks[0].type();
+	featuresDim_ = blocks[0].cols;
+	featuresCount_ = count;
+	blockRows_ = blocks[0].rows;
+	rowSize_ = blocks[0].cols * blocks[0].elemSize();
+	branching_ = branching;
+
+	std::vector<int> indexes(count);
+	for(int i=0; i<count; ++i)
+	{
+		indexes[i] = i;
+	}
+	nodes_.resize(1);
+	centroids_.resize(rowSize_, 0); // the root doesn't have a centroid
+	cv::RNG rng(0xffffffff); // same features give the same tree
+	this->buildNode(0, indexes, 0, maxDepth, iterations, rng);
+	UDEBUG("Vocabulary tree built: points=%d blocks=%d nodes=%d depth=%d branching=%d",
+			count, (int)blocks.size(), (int)nodes_.size(), depth_, branching_);
+}
+
+void VocabularyTree::buildNode(int node, std::vector<int> & indexes, int level, int maxDepth, int iterations, cv::RNG & rng)
+{
+	nodes_[node].firstChild = 0;
+	nodes_[node].children = 0;
+	nodes_[node].firstPoint = (int)points_.size();
+	nodes_[node].points = (int)indexes.size();
+	if(level > depth_)
+	{
+		depth_ = level;
+	}
+
+	std::vector<std::vector<int> > clusters;
+	if(level < maxDepth && (int)indexes.size() > branching_)
+	{
+		std::vector<unsigned char> centers;
+		std::vector<int> labels;
+		this->kmeans(indexes, branching_, iterations, rng, centers, labels);
+
+		clusters.resize(branching_);
+		for(unsigned int i=0; i<indexes.size(); ++i)
+		{
+			clusters[labels[i]].push_back(indexes[i]);
+		}
+		// remove empty clusters
+		int c = 0;
+		for(int j=0; j<branching_; ++j)
+		{
+			if(clusters[j].size())
+			{
+				if(c != j)
+				{
+					clusters[c].swap(clusters[j]);
+					memcpy(&centers[c*rowSize_], &centers[j*rowSize_], rowSize_);
+				}
+				++c;
+			}
+		}
+		clusters.resize(c);
+
+		if(clusters.size() > 1)
+		{
+			int first = (int)nodes_.size();
+			nodes_[node].firstChild = first;
+			nodes_[node].children = (int)clusters.size();
+			nodes_.resize(first + clusters.size());
+			centroids_.resize(nodes_.size()*rowSize_);
+			memcpy(&centroids_[first*rowSize_], &centers[0], clusters.size()*rowSize_);
+		}
+	}
+
+	if(nodes_[node].children == 0)
+	{
+		points_.insert(points_.end(), indexes.begin(), indexes.end());
+	}
+	else
+	{
+		std::vector<int>().swap(indexes); // not used anymore
+		for(unsigned int j=0; j<clusters.size(); ++j)
+		{
+			this->buildNode(nodes_[node].firstChild+j, clusters[j], level+1, maxDepth, iterations, rng);
+		}
+	}
+}
+
+void VocabularyTree::kmeans(
+		const std::vector<int> & indexes,
+		int k,
+		int iterations,
+		cv::RNG & rng,
+		std::vector<unsigned char> & centers,
+		std::vector<int> & labels) const
+{
+	int n = (int)indexes.size();
+	UASSERT(n >= k);
+	centers.resize(k*rowSize_);
+	labels.resize(n);
+
+	// k-means++ seeding
+	std::vector<float> minDists(n, std::numeric_limits<float>::max());
+	memcpy(&centers[0], this->feature(indexes[rng.uniform(0, n)]), rowSize_);
+	for(int c=1; c<k; ++c)
+	{
+		double sum = 0.0;
+		for(int i=0; i<n; ++i)
+		{
+			float d = this->distance(this->feature(indexes[i]), &centers[(c-1)*rowSize_]);
+			if(d < minDists[i])
+			{
+				minDists[i] = d;
+			}
+			sum += minDists[i];
+		}
+		int chosen = n-1;
+		if(sum > 0.0)
+		{
+			double r = rng.uniform(0.0, sum);
+			for(int i=0; i<n; ++i)
+			{
+				r -= minDists[i];
+				if(r <= 0.0)
+				{
+					chosen = i;
+					break;
+				}
+			}
+		}
+		else
+		{
+			chosen = rng.uniform(0, n);
+		}
+		memcpy(&centers[c*rowSize_], this->feature(indexes[chosen]), rowSize_);
+	}
+
+	for(int it=0; it<iterations; ++it)
+	{
+		bool changed = false;
+		for(int i=0; i<n; ++i)
+		{
+			const unsigned char * p = this->feature(indexes[i]);
+			int best = 0;
+			float bestDist = this->distance(p, &centers[0]);
+			for(int c=1; c<k; ++c)
+			{
+				float d = this->distance(p, &centers[c*rowSize_]);
+				if(d < bestDist)
+				{
+					bestDist = d;
+					best = c;
+				}
+			}
+			if(it == 0 || labels[i] != best)
+			{
+				labels[i] = best;
+				changed = true;
+			}
+		}
+		if(!changed)
+		{
+			break;
+		}
+		this->updateCenters(indexes, labels, k, centers);
+	}
+}
+
+void VocabularyTree::updateCenters(
+		const std::vector<int> & indexes,
+		const std::vector<int> & labels,
+		int k,
+		std::vector<unsigned char> & centers) const
+{
+	int dim = featuresDim_;
+	std::vector<int> counts(k, 0);
+	if(featuresType_ == CV_8UC1)
+	{
+		// k-majority: each bit is set if it is set in the majority of the points
+		std::vector<int> bits(k*dim*8, 0);
+		for(unsigned int i=0; i<indexes.size(); ++i)
+		{
+			const unsigned char * p = this->feature(indexes[i]);
+			int * b = &bits[labels[i]*dim*8];
+			for(int j=0; j<dim; ++j)
+			{
+				for(int l=0; l<8; ++l)
+				{
+					b[j*8+l] += (p[j] >> (7-l)) & 1;
+				}
+			}
+			++counts[labels[i]];
+		}
+		for(int c=0; c<k; ++c)
+		{
+			if(counts[c])
+			{
+				unsigned char * center = &centers[c*rowSize_];
+				const int * b = &bits[c*dim*8];
+				for(int j=0; j<dim; ++j)
+				{
+					unsigned char v = 0;
+					for(int l=0; l<8; ++l)
+					{
+						if(b[j*8+l]*2 > counts[c])
+						{
+							v |= 1 << (7-l);
+						}
+					}
+					center[j] = v;
+				}
+			}
+		}
+	}
+	else
+	{
+		std::vector<double> sums(k*dim, 0.0);
+		for(unsigned int i=0; i<indexes.size(); ++i)
+		{
+			const float * p = (const float *)this->feature(indexes[i]);
+			double * s = &sums[labels[i]*dim];
+			for(int j=0; j<dim; ++j)
+			{
+				s[j] += p[j];
+			}
+			++counts[labels[i]];
+		}
+		for(int c=0; c<k; ++c)
+		{
+			if(counts[c])
+			{
+				float * center = (float*)&centers[c*rowSize_];
+				const double * s = &sums[c*dim];
+				for(int j=0; j<dim; ++j)
+				{
+					center[j] = float(s[j] / double(counts[c]));
+				}
+			}
+		}
+	}
+	// centers of empty clusters are not changed
+}
+
+void VocabularyTree::knnSearch(
+		const cv::Mat & query,
+		cv::Mat & indices,
+		cv::Mat & dists,
+		int knn,
+		int threads) const
+{
+	if(!this->isBuilt())
+	{
+		UERROR("Vocabulary tree not yet created!");
+		return;
+	}
+	UASSERT(query.type() == featuresType_);
+	UASSERT(query.cols == featuresDim_);
+	UASSERT(knn > 0);
+
+	indices.create(query.rows, knn, sizeof(size_t)==8?CV_64F:CV_32S);
+	dists.create(query.rows, knn, CV_32F);
+
+	// queries are independent, the tree is only read
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(threads>0?threads:1) schedule(dynamic, 16)
+#endif
+	for(int i=0; i<query.rows; ++i)
+	{
+		const unsigned char * q = query.ptr<unsigned char>(i);
+
+		// Descend to the nearest leaf. If the nearest child has less than knn
+		// points, the points of the current (small) subtree are all compared.
+		int node = 0;
+		while(nodes_[node].children)
+		{
+			const Node & n = nodes_[node];
+			int best = n.firstChild;
+			float bestDist = this->distance(q, this->centroid(best));
+			for(int c=n.firstChild+1; c<n.firstChild+n.children; ++c)
+			{
+				float d = this->distance(q, this->centroid(c));
+				if(d < bestDist)
+				{
+					bestDist = d;
+					best = c;
+				}
+			}
+			if(nodes_[best].points < knn && n.points <= branching_*branching_)
+			{
+				break;
+			}
+			node = best;
+		}
+
+		// sorted results <distance, index>
+		std::vector<std::pair<float, int> > results;
+		results.reserve(knn+1);
+		const Node & leaf = nodes_[node];
+		for(int j=leaf.firstPoint; j<leaf.firstPoint+leaf.points; ++j)
+		{
+			float d = this->distance(q, this->feature(points_[j]));
+			if((int)results.size() < knn || d < results.back().first)
+			{
+				std::pair<float, int> r(d, points_[j]);
+				results.insert(std::upper_bound(results.begin(), results.end(), r), r);
+				if((int)results.size() > knn)
+				{
+					results.pop_back();
+				}
+			}
+		}
+
+		size_t * indicesRow = indices.ptr<size_t>(i);
+		float * distsRow = dists.ptr<float>(i);
+		for(int j=0; j<knn; ++j)
+		{
+			if(j < (int)results.size())
+			{
+				indicesRow[j] = results[j].second;
+				distsRow[j] = results[j].first;
+			}
+			else
+			{
+				indicesRow[j] = 0;
+				distsRow[j] = -1.0f;
+			}
+		}
+	}
+}
+
+void VocabularyTree::save(std::ostream & stream) const
+{
+	int header[7] = {
+			1, // version
+			featuresType_,
+			featuresDim_,
+			branching_,
+			depth_,
+			(int)nodes_.size(),
+			(int)points_.size()};
+	stream.write((const char *)header, sizeof(header));
+	if(nodes_.size())
+	{
+		stream.write((const char *)&nodes_[0], nodes_.size()*sizeof(Node));
+		stream.write((const char *)&centroids_[0], centroids_.size());
+		stream.write((const char *)&points_[0], points_.size()*sizeof(int));
+	}
+}
+
+bool VocabularyTree::load(const unsigned char * data, size_t size, const cv::Mat & features)
+{
+	this->release();
+	int header[7] = {0};
+	if(data == 0 || size < sizeof(header))
+	{
+		UERROR("Cannot read the vocabulary tree, the buffer is too small (%d bytes)", (int)size);
+		return false;
+	}
+	memcpy(header, data, sizeof(header));
+	if(header[0] != 1)
+	{
+		UERROR("Cannot read the vocabulary tree (version=%d)", header[0]);
+		return false;
+	}
+	if(header[1] != features.type() || header[2] != features.cols || header[6] != features.rows || header[5] <= 0)
+	{
+		UERROR("The vocabulary tree (type=%d dim=%d points=%d) doesn't match the features (type=%d dim=%d points=%d)",
+				header[1], header[2], header[6], features.type(), features.cols, features.rows);
+		return false;
+	}
+	size_t rowSize = features.cols * features.elemSize();
+	size_t expected = sizeof(header) + header[5]*(sizeof(Node) + rowSize) + header[6]*sizeof(int);
+	if(size < expected)
+	{
+		UERROR("Cannot read the vocabulary tree, the buffer is truncated (%d bytes, expected %d).", (int)size, (int)expected);
+		return false;
+	}
+	blocks_.push_back(features);
+	featuresType_ = features.type();
+	featuresDim_ = features.cols;
+	featuresCount_ = features.rows;
+	blockRows_ = features.rows;
+	rowSize_ = (int)rowSize;
+	branching_ = header[3];
+	depth_ = header[4];
+	nodes_.resize(header[5]);
+	centroids_.resize(nodes_.size()*rowSize_);
+	points_.resize(header[6]);
+	data += sizeof(header);
+	memcpy(&nodes_[0], data, nodes_.size()*sizeof(Node));
+	data += nodes_.size()*sizeof(Node);
+	memcpy(&centroids_[0], data, centroids_.size());
+	data += centroids_.size();
+	memcpy(&points_[0], data, points_.size()*sizeof(int));
+
+	// The tree is read from a file, check that all indexes are valid
+	// before using them for search. Children are always after their
+	// parent, so a descent cannot loop.
+	bool valid = branching_ > 0 && depth_ >= 0;
+	int nodesCount = (int)nodes_.size();
+	int pointsCount = (int)points_.size();
+	for(int i=0; valid && i<nodesCount; ++i)
+	{
+		const Node & n = nodes_[i];
+		valid = n.children >= 0 && n.children <= branching_ &&
+				(n.children == 0 || (n.firstChild > i && n.firstChild <= nodesCount - n.children)) &&
+				n.points >= 0 && n.firstPoint >= 0 && n.firstPoint <= pointsCount - n.points;
+		if(!valid)
+		{
+			UERROR("Cannot read the vocabulary tree, node %d is not valid (children=%d first=%d points=%d first=%d)",
+					i, n.children, n.firstChild, n.points, n.firstPoint);
+		}
+	}
+	for(int i=0; valid && i<pointsCount; ++i)
+	{
+		valid = points_[i] >= 0 && points_[i] < features.rows;
+		if(!valid)
+		{
+			UERROR("Cannot read the vocabulary tree, point %d has an invalid index (%d, features=%d)", i, points_[i], features.rows);
+		}
+	}
+	if(!valid)
+	{
+		this->release();
+	}
+	return valid;
+}
+
+float VocabularyTree::distance(const unsigned char * a, const unsigned char * b) const
+{
+	if(featuresType_ == CV_8UC1)
+	{
+		return (float)simd::hamming(a, b, featuresDim_);
+	}
+	return simd::l2Sqr((const float*)a, (const float*)b, featuresDim_);
+}
+
+} /* namespace rtabmap */
@@ -42,6 +42,7 @@ typedef unsigned __int64 uint64_t;
 #endif
 
 #include "rtflann/defines.h"
+#include "rtabmap/core/SimdDistance.h"
 
 
 namespace rtflann
@@ -550,28 +551,11 @@ struct Hamming
     template <typename Iterator1, typename Iterator2>
     ResultType operator()(Iterator1 a, Iterator2 b, size_t size, ResultType /*worst_dist*/ = 0) const
     {
-#ifdef FLANN_PLATFORM_64_BIT
-        const uint64_t* pa = reinterpret_cast<const uint64_t*>(a);
-        const uint64_t* pb = reinterpret_cast<const uint64_t*>(b);
-        ResultType result = 0;
-        size /= (sizeof(uint64_t)/sizeof(unsigned char));
-        for(size_t i = 0; i < size; ++i ) {
-            result += popcnt64(*pa ^ *pb);
-            ++pa;
-            ++pb;
-        }
-#else
-        const uint32_t* pa = reinterpret_cast<const uint32_t*>(a);
-        const uint32_t* pb = reinterpret_cast<const uint32_t*>(b);
-        ResultType result = 0;
-        size /= (sizeof(uint32_t)/sizeof(unsigned char));
-        for(size_t i = 0; i < size; ++i ) {
-        	result += popcnt32(*pa ^ *pb);
-        	++pa;
-        	++pb;
-        }
-#endif
-        return result;
+        // POPCNT/AVX2 kernel selected at runtime, see rtabmap/core/SimdDistance.h
+        return rtabmap::simd::hamming(
+                reinterpret_cast<const unsigned char*>(a),
+                reinterpret_cast<const unsigned char*>(b),
+                (int)(size*sizeof(T)));
     }
 };
 
@@ -204,15 +204,12 @@ int main(int argc, char * argv[])
 	std::map<int, Signature> nodes;
 	std::map<int, Transform> optimizedPoses;
 	std::multimap<int, Link> links;
-	rtabmap->get3DMap(nodes, optimizedPoses, links, true, true);
+	rtabmap->get3DMap(nodes, optimizedPoses, links, true, true, true); // data is uncompressed
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
 	for(std::map<int, Transform>::iterator iter=optimizedPoses.begin(); iter!=optimizedPoses.end(); ++iter)
 	{
 		Signature node = nodes.find(iter->first)->second;
 
-		// uncompress data
-		node.sensorData().uncompressData();
-
 		pcl::PointCloud<pcl::PointXYZRGB>::Ptr tmp = util3d::cloudRGBFromSensorData(
 				node.sensorData(),
 				4,           // image decimation before creating the clouds
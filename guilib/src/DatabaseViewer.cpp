@@ -2552,13 +2552,24 @@ void DatabaseViewer::regenerateLocalMaps()
 	double decompressionTime = 0;
 	double gridCreationTime = 0;
 
+	// nodes are loaded and uncompressed by batch
+	const int batchSize = 16;
+	std::vector<SensorData> batch;
+
 	for(int i =0; i<ids_.size() && !progressDialog.isCanceled(); ++i)
 	{
 		UTimer timer;
-		SensorData data;
-		dbDriver_->getNodeData(ids_.at(i), data);
-		data.uncompressData();
-		decompressionTime = timer.ticks()*1000.0;
+		if(i % batchSize == 0)
+		{
+			std::vector<int> batchIds;
+			for(int j=i; j<ids_.size() && j<i+batchSize; ++j)
+			{
+				batchIds.push_back(ids_.at(j));
+			}
+			dbDriver_->getNodesData(batchIds, batch);
+			decompressionTime = timer.ticks()*1000.0/double(batchIds.size()); // average per node
+		}
+		SensorData data = batch[i % batchSize];
 
 		int mapId, weight;
 		Transform odomPose, groundTruth;
@@ -2674,14 +2685,15 @@ void DatabaseViewer::regenerateCurrentLocalMaps()
 	progressDialog.setMaximumSteps(ids.size());
 	progressDialog.show();
 
+	std::vector<SensorData> nodesData;
+	dbDriver_->getNodesData(ids.toVector().toStdVector(), nodesData);
+
 	for(int i =0; i<ids.size(); ++i)
 	{
 		generatedLocalMaps_.erase(ids.at(i));
 		generatedLocalMapsInfo_.erase(ids.at(i));
 
-		SensorData data;
-		dbDriver_->getNodeData(ids.at(i), data);
-		data.uncompressData();
+		SensorData & data = nodesData[i];
 
 		int mapId, weight;
 		Transform odomPose, groundTruth;
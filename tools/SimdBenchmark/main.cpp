@@ -0,0 +1,214 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/SimdDistance.h>
+#include <rtabmap/core/Quantization.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+using namespace rtabmap;
+
+void showUsage()
+{
+	printf("\nUsage:\n"
+			"rtabmap-simd_benchmark [options]\n"
+			"  Compare brute force descriptor matching speed of the\n"
+			"  SIMD distance kernels against the scalar fallback. For float\n"
+			"  descriptors, the recall after 8 bits quantized storage is also shown.\n"
+			"  Options:\n"
+			"     -train #      Number of train descriptors (default 10000).\n"
+			"     -query #      Number of query descriptors (default 500).\n"
+			"     -k #          Number of nearest neighbors (default 2).\n"
+			"     -repeat #     Number of times each matching is done (default 3).\n"
+			"\n");
+	exit(1);
+}
+
+// return the time (ms) of the fastest matching
+double benchmark(const cv::Mat & query, const cv::Mat & train, int k, int repeat, std::vector<std::vector<cv::DMatch> > & matches)
+{
+	double best = 0.0;
+	UTimer timer;
+	for(int i=0; i<repeat; ++i)
+	{
+		timer.restart();
+		simd::knnMatch(query, std::vector<cv::Mat>(1, train), matches, k);
+		double t = timer.elapsed()*1000.0;
+		if(i==0 || t < best)
+		{
+			best = t;
+		}
+	}
+	return best;
+}
+
+double benchmarkOpenCV(const cv::Mat & query, const cv::Mat & train, int k, int repeat)
+{
+	double best = 0.0;
+	UTimer timer;
+	std::vector<std::vector<cv::DMatch> > matches;
+	cv::BFMatcher matcher(query.type()==CV_8U?cv::NORM_HAMMING:cv::NORM_L2SQR);
+	for(int i=0; i<repeat; ++i)
+	{
+		timer.restart();
+		matcher.knnMatch(query, train, matches, k);
+		double t = timer.elapsed()*1000.0;
+		if(i==0 || t < best)
+		{
+			best = t;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	int trainSize = 10000;
+	int querySize = 500;
+	int k = 2;
+	int repeat = 3;
+	for(int i=1; i<argc; ++i)
+	{
+		if(strcmp(argv[i], "-train") == 0 && i+1<argc)
+		{
+			trainSize = uStr2Int(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-query") == 0 && i+1<argc)
+		{
+			querySize = uStr2Int(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-k") == 0 && i+1<argc)
+		{
+			k = uStr2Int(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-repeat") == 0 && i+1<argc)
+		{
+			repeat = uStr2Int(argv[++i]);
+		}
+		else
+		{
+			showUsage();
+		}
+	}
+	if(trainSize <= 0 || querySize <= 0 || k <= 0 || repeat <= 0)
+	{
+		showUsage();
+	}
+
+	simd::Instructions supported = simd::supportedInstructions();
+	printf("Supported instructions: %s\n", simd::instructionsName(supported));
+	printf("train=%d query=%d k=%d repeat=%d\n\n", trainSize, querySize, k, repeat);
+
+	// ORB/BRIEF (32 bytes), AKAZE/BRISK (64 bytes), SURF (64 floats), SIFT (128 floats)
+	int types[4] = {CV_8UC1, CV_8UC1, CV_32FC1, CV_32FC1};
+	int sizes[4] = {32, 64, 64, 128};
+	cv::RNG rng(42);
+	for(int t=0; t<4; ++t)
+	{
+		cv::Mat train(trainSize, sizes[t], types[t]);
+		cv::Mat query(querySize, sizes[t], types[t]);
+		if(types[t] == CV_8UC1)
+		{
+			rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+			rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+		}
+		else
+		{
+			rng.fill(train, cv::RNG::UNIFORM, 0.0f, 1.0f);
+			rng.fill(query, cv::RNG::UNIFORM, 0.0f, 1.0f);
+		}
+		printf("%s %d:\n", types[t]==CV_8UC1?"Binary":"Float", sizes[t]);
+
+		std::vector<std::vector<cv::DMatch> > reference;
+		simd::setInstructions(simd::kScalar);
+		double scalarTime = benchmark(query, train, k, repeat, reference);
+		printf("   %-8s %10.2f ms\n", simd::instructionsName(simd::kScalar), scalarTime);
+		for(int i=simd::kScalar+1; i<=supported; ++i)
+		{
+			std::vector<std::vector<cv::DMatch> > matches;
+			simd::setInstructions((simd::Instructions)i);
+			double time = benchmark(query, train, k, repeat, matches);
+			int errors = 0;
+			for(unsigned int j=0; j<matches.size(); ++j)
+			{
+				for(unsigned int m=0; m<matches[j].size(); ++m)
+				{
+					if(fabs(matches[j][m].distance - reference[j][m].distance) > 1e-3f * (1.0f+reference[j][m].distance))
+					{
+						++errors;
+					}
+				}
+			}
+			printf("   %-8s %10.2f ms (x%.1f)%s\n",
+					simd::instructionsName((simd::Instructions)i),
+					time,
+					time>0.0?scalarTime/time:0.0,
+					errors?uFormat(" %d distances differ from scalar!", errors).c_str():"");
+		}
+		double cvTime = benchmarkOpenCV(query, train, k, repeat);
+		printf("   %-8s %10.2f ms (x%.1f)\n", "OpenCV", cvTime, cvTime>0.0?scalarTime/cvTime:0.0);
+		if(types[t] == CV_32FC1)
+		{
+			// recall of the nearest neighbor on descriptors saved quantized in the
+			// database (DbSqlite3/WordsQuantized), then decoded when they are loaded
+			cv::Mat quantized = quantization::quantize(train);
+			UTimer timer;
+			cv::Mat decoded = quantization::dequantize(quantized);
+			double decodeTime = timer.elapsed()*1000.0;
+			std::vector<std::vector<cv::DMatch> > matches;
+			benchmark(query, decoded, k, 1, matches);
+			int found = 0;
+			for(unsigned int j=0; j<matches.size(); ++j)
+			{
+				if(matches[j].size() && reference[j].size() && matches[j][0].trainIdx == reference[j][0].trainIdx)
+				{
+					++found;
+				}
+			}
+			printf("   %-8s %10.2f ms (decoding) recall=%.1f%% database=%d KB (x%.1f smaller)\n",
+					"Int8 db",
+					decodeTime,
+					matches.size()?100.0f*float(found)/float(matches.size()):0.0f,
+					int(quantized.total()/1000),
+					float(train.total()*train.elemSize())/float(quantized.total()));
+		}
+		printf("\n");
+	}
+	simd::setInstructions(supported);
+
+	return 0;
+}
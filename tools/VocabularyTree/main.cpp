@@ -0,0 +1,182 @@
+/*
+Copyright (c) 2010-2016, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rtabmap/core/VWDictionary.h>
+#include <rtabmap/core/VisualWord.h>
+#include <rtabmap/core/DBDriver.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UFile.h>
+#include <rtabmap/utilite/UStl.h>
+#include <opencv2/core/core.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace rtabmap;
+
+void showUsage()
+{
+	printf("\nUsage:\n"
+			"rtabmap-vocabulary_tree [options] input output\n"
+			"  Build a vocabulary tree (hierarchical k-means) over the words of a\n"
+			"  dictionary and export it in binary format, to be used as fixed\n"
+			"  dictionary with Kp/DictionaryPath and Kp/NNStrategy=6.\n"
+			"  input          Database (*.db) or dictionary (*.txt, see VWDictionary::exportDictionary()).\n"
+			"  output         Binary vocabulary file.\n"
+			"  Options:\n"
+			"     -branching #  Number of children of each node (default %d).\n"
+			"     -depth #      Maximum depth of the tree (default %d).\n"
+			"     -query #      Number of words used as queries to measure quantization time (default 1000).\n"
+			"\n", Parameters::defaultKpVocTreeBranching(), Parameters::defaultKpVocTreeDepth());
+	exit(1);
+}
+
+int main(int argc, char * argv[])
+{
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	if(argc < 3)
+	{
+		showUsage();
+	}
+
+	int branching = Parameters::defaultKpVocTreeBranching();
+	int depth = Parameters::defaultKpVocTreeDepth();
+	int querySize = 1000;
+	for(int i=1; i<argc-2; ++i)
+	{
+		if(strcmp(argv[i], "-branching") == 0 && i+1<argc-2)
+		{
+			branching = uStr2Int(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-depth") == 0 && i+1<argc-2)
+		{
+			depth = uStr2Int(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-query") == 0 && i+1<argc-2)
+		{
+			querySize = uStr2Int(argv[++i]);
+		}
+		else
+		{
+			showUsage();
+		}
+	}
+	if(branching < 2 || depth < 1 || querySize < 0)
+	{
+		showUsage();
+	}
+	std::string input = argv[argc-2];
+	std::string output = argv[argc-1];
+
+	ParametersMap parameters;
+	parameters.insert(ParametersPair(Parameters::kKpNNStrategy(), uNumber2Str((int)VWDictionary::kNNVocabularyTree)));
+	parameters.insert(ParametersPair(Parameters::kKpVocTreeBranching(), uNumber2Str(branching)));
+	parameters.insert(ParametersPair(Parameters::kKpVocTreeDepth(), uNumber2Str(depth)));
+
+	UTimer timer;
+	VWDictionary dictionary(parameters);
+	if(UFile::getExtension(input).compare("db") == 0)
+	{
+		DBDriver * driver = DBDriver::create();
+		if(!driver->openConnection(input))
+		{
+			printf("Cannot open database \"%s\"\n", input.c_str());
+			delete driver;
+			return 1;
+		}
+		// all words of the database, not only those of the working memory
+		int lastWordId = 0;
+		driver->getLastWordId(lastWordId);
+		std::set<int> ids;
+		for(int i=1; i<=lastWordId; ++i)
+		{
+			ids.insert(ids.end(), i);
+		}
+		std::list<VisualWord *> words;
+		driver->loadWords(ids, words);
+		for(std::list<VisualWord *>::iterator iter=words.begin(); iter!=words.end(); ++iter)
+		{
+			dictionary.addWord(*iter);
+		}
+		driver->closeConnection(false);
+		delete driver;
+	}
+	else
+	{
+		parameters.insert(ParametersPair(Parameters::kKpIncrementalDictionary(), "false"));
+		parameters.insert(ParametersPair(Parameters::kKpDictionaryPath(), input));
+		dictionary.parseParameters(parameters);
+	}
+	printf("Loaded %d words from \"%s\" (%fs)\n", (int)dictionary.getVisualWords().size(), input.c_str(), timer.ticks());
+	if(dictionary.getVisualWords().empty())
+	{
+		return 1;
+	}
+
+	dictionary.update();
+	printf("Built vocabulary tree: words=%d memory=%d KB (%fs)\n",
+			(int)dictionary.getIndexedWordsCount(), (int)dictionary.getIndexMemoryUsed(), timer.ticks());
+
+	if(querySize)
+	{
+		// words of the dictionary are used as queries, they should be their own nearest word
+		cv::Mat queries;
+		std::vector<int> queryIds;
+		for(std::map<int, VisualWord *>::const_iterator iter=dictionary.getVisualWords().begin();
+			iter!=dictionary.getVisualWords().end() && (int)queryIds.size()<querySize;
+			++iter)
+		{
+			queries.push_back(iter->second->getDescriptor());
+			queryIds.push_back(iter->first);
+		}
+		timer.restart();
+		std::vector<int> results = dictionary.findNN(queries);
+		double t = timer.ticks();
+		int found = 0;
+		for(unsigned int i=0; i<results.size(); ++i)
+		{
+			if(results[i] == queryIds[i])
+			{
+				++found;
+			}
+		}
+		printf("Quantization: %d queries in %f ms (%f ms per 1000 descriptors), %d%% found their own word\n",
+				queries.rows, t*1000.0, t*1000.0*1000.0/double(queries.rows), found*100/queries.rows);
+	}
+
+	if(!dictionary.exportVocabulary(output))
+	{
+		return 1;
+	}
+	printf("Exported vocabulary to \"%s\"\n", output.c_str());
+	return 0;
+}